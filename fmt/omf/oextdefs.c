@@ -11,6 +11,7 @@ void omf_extdefs_context_init_extdef(struct omf_extdef_t * const ctx) {
 void omf_extdefs_context_init(struct omf_extdefs_context_t * const ctx) {
     ctx->omf_EXTDEFS = NULL;
     ctx->omf_EXTDEFS_count = 0;
+    omf_strpool_init(&ctx->names);
 #if defined(LINUX) || TARGET_MSDOS == 32
     ctx->omf_EXTDEFS_alloc = 32768;
 #elif defined(__COMPACT__) || defined(__LARGE__) || defined(__HUGE__)
@@ -23,20 +24,19 @@ void omf_extdefs_context_init(struct omf_extdefs_context_t * const ctx) {
 }
 
 void omf_extdefs_context_free_entries(struct omf_extdefs_context_t * const ctx) {
-    unsigned int i;
-
     if (ctx->omf_EXTDEFS) {
-        for (i=0;i < ctx->omf_EXTDEFS_count;i++)
-            cstr_free(&(ctx->omf_EXTDEFS[i].name_string));
-
         free(ctx->omf_EXTDEFS);
         ctx->omf_EXTDEFS = NULL;
     }
     ctx->omf_EXTDEFS_count = 0;
+
+    /* the names go all at once */
+    omf_strpool_clear(&ctx->names);
 }
 
 void omf_extdefs_context_free(struct omf_extdefs_context_t * const ctx) {
     omf_extdefs_context_free_entries(ctx);
+    omf_strpool_free(&ctx->names);
 }
 
 struct omf_extdefs_context_t *omf_extdefs_context_create(void) {
@@ -111,9 +111,8 @@ const struct omf_extdef_t *omf_extdefs_context_get_extdef(const struct omf_extde
 }
 
 int omf_extdefs_context_set_extdef_name(struct omf_extdefs_context_t * const ctx,struct omf_extdef_t * const extdef,const char * const name,const size_t namelen) {
-    (void)ctx;
-
-    if (cstr_set_n(&extdef->name_string,name,namelen) < 0)
+    extdef->name_string = omf_strpool_add(&ctx->names,name,namelen);
+    if (extdef->name_string == NULL)
         return -1;
 
     return 0;
@@ -5,6 +5,7 @@
 void omf_lnames_context_init(struct omf_lnames_context_t * const ctx) {
     ctx->omf_LNAMES = NULL;
     ctx->omf_LNAMES_count = 0;
+    omf_strpool_init(&ctx->names);
 #if defined(LINUX) || TARGET_MSDOS == 32
     ctx->omf_LNAMES_alloc = 32768;
 #elif defined(__COMPACT__) || defined(__LARGE__) || defined(__HUGE__)
@@ -47,11 +48,8 @@ int omf_lnames_context_clear_name(struct omf_lnames_context_t * const ctx,unsign
     if (ctx->omf_LNAMES == NULL)
         return 0; /* LNAMEs array not allocated */
 
-    if (ctx->omf_LNAMES[i] != NULL) {
-        free(ctx->omf_LNAMES[i]);
-        ctx->omf_LNAMES[i] = NULL;
-    }
-
+    /* the string stays in the pool until the names are cleared */
+    ctx->omf_LNAMES[i] = NULL;
     return 0;
 }
 
@@ -98,7 +96,8 @@ int omf_lnames_context_set_name(struct omf_lnames_context_t * const ctx,unsigned
     while (ctx->omf_LNAMES_count <= i)
         ctx->omf_LNAMES[ctx->omf_LNAMES_count++] = NULL;
 
-    if (cstr_set_n(&ctx->omf_LNAMES[i],name,namelen) < 0)
+    ctx->omf_LNAMES[i] = omf_strpool_add(&ctx->names,name,namelen);
+    if (ctx->omf_LNAMES[i] == NULL)
         return -1;
 
     return 0;
@@ -119,14 +118,8 @@ int omf_lnames_context_add_name(struct omf_lnames_context_t * const ctx,const ch
 }
 
 void omf_lnames_context_clear_names(struct omf_lnames_context_t * const ctx) {
-    char *p;
-
-    while (ctx->omf_LNAMES_count > 0) {
-        --ctx->omf_LNAMES_count;
-        p = ctx->omf_LNAMES[ctx->omf_LNAMES_count];
-        ctx->omf_LNAMES[ctx->omf_LNAMES_count] = NULL;
-        if (p != NULL) free(p);
-    }
+    ctx->omf_LNAMES_count = 0;
+    omf_strpool_clear(&ctx->names);
 }
 
 void omf_lnames_context_free_names(struct omf_lnames_context_t * const ctx) {
@@ -140,6 +133,7 @@ void omf_lnames_context_free_names(struct omf_lnames_context_t * const ctx) {
 
 void omf_lnames_context_free(struct omf_lnames_context_t * const ctx) {
     omf_lnames_context_free_names(ctx);
+    omf_strpool_free(&ctx->names);
 }
 
 struct omf_lnames_context_t *omf_lnames_context_create(void) {
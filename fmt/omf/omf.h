@@ -13,6 +13,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 
+#include <fmt/omf/omfcstr.h>
+
 enum {
     OMF_EXTDEF_TYPE_GLOBAL=0,
     OMF_EXTDEF_TYPE_LOCAL
@@ -106,7 +108,18 @@ enum {
 #define OMF_RECTYPE_LPUBDEF     (0xB6)
 #define OMF_RECTYPE_LPUBDEF32   (0xB7)
 
-extern char                             omf_temp_str[255+1/*NUL*/];
+#define OMF_RECTYPE_LIBHEAD     (0xF0)
+#define OMF_RECTYPE_LIBEND      (0xF1)
+
+// scratch buffer for names while parsing records. per-thread on Linux, so that
+// separate OMF contexts can parse on separate threads
+#if defined(LINUX)
+# define OMF_THREAD_LOCAL                __thread
+#else
+# define OMF_THREAD_LOCAL
+#endif
+
+extern OMF_THREAD_LOCAL char            omf_temp_str[255+1/*NUL*/];
 
 struct omf_record_t {
     unsigned char           rectype;
@@ -116,8 +129,48 @@ struct omf_record_t {
     size_t                  data_alloc;         // amount of data allocated if data != NULL or amount TO alloc if data == NULL
 
     unsigned long           rec_file_offset;    // file offset of record (~0UL if undefined)
+    unsigned char           data_external;      // data points into an omf_reader_t buffer, not ours to free or modify
 };
 
+// buffered (or memory-mapped) OMF file reader.
+// records read through this can point directly into the buffer (OMF_READER_ZERO_COPY), in which case
+// the record data is valid until the next record is read, same as the omf_ledata_info_t rule below.
+struct omf_reader_t {
+    int                     fd;
+    unsigned char*          buffer;             // read-ahead buffer, or the entire file if mapped
+    size_t                  buffer_alloc;       // size of buffer (or mapping)
+    size_t                  buffer_len;         // amount of valid data in buffer
+    size_t                  buffer_pos;         // read position in buffer
+    unsigned long           buffer_file_offset; // file offset of buffer[0]
+    unsigned char           mapped;             // buffer is mmap()'d file
+    unsigned char           zero_copy;          // records point into the buffer instead of copying
+};
+
+// .LIB dictionary, which follows LIBEND.
+// the dictionary is made of 512-byte blocks, each with 37 buckets
+#define OMF_LIB_DICT_BLOCK_SIZE         512u
+#define OMF_LIB_DICT_BUCKETS            37u
+
+#define OMF_LIB_FLAG_CASE_SENSITIVE     (1u << 0u)
+
+struct omf_lib_header_t {
+    unsigned short          block_size;         // module alignment ("page size"), from the LIBHEAD record length
+    unsigned long           dict_offset;        // file offset of dictionary
+    unsigned short          dict_blocks;        // number of 512-byte dictionary blocks
+    unsigned char           flags;              // OMF_LIB_FLAG_*
+};
+
+// where to look for a name in the dictionary, see omf_lib_dict_hash()
+struct omf_lib_dict_hash_t {
+    unsigned short          block_x;            // starting block
+    unsigned short          block_d;            // block step
+    unsigned short          bucket_x;           // starting bucket
+    unsigned short          bucket_d;           // bucket step
+};
+
+#define OMF_READER_ZERO_COPY            (1u << 0u)  // record data points into the reader buffer (read only!)
+#define OMF_READER_NO_MMAP              (1u << 1u)  // do not mmap() the file, use a read-ahead buffer
+
 // this is filled in by a utility function after reading the OMF record from the beginning.
 // the data pointer is valid UNTIL the OMF record is overwritten/rewritten, so take the
 // data right after parsing the header, before you read another OMF record.
@@ -174,6 +227,7 @@ struct omf_pubdefs_context_t {
     struct omf_pubdef_t*            omf_PUBDEFS;
     unsigned int                    omf_PUBDEFS_count;
     unsigned int                    omf_PUBDEFS_alloc;
+    struct omf_strpool_t            names;              // name_string storage
 };
 
 /* SEGDEFS collection */
@@ -218,6 +272,7 @@ struct omf_extdefs_context_t {
     struct omf_extdef_t*            omf_EXTDEFS;
     unsigned int                    omf_EXTDEFS_count;
     unsigned int                    omf_EXTDEFS_alloc;
+    struct omf_strpool_t            names;              // name_string storage
 };
 
 // grpdefs context:
@@ -257,6 +312,7 @@ struct omf_lnames_context_t {
     char**              omf_LNAMES;
     unsigned int        omf_LNAMES_count;
     unsigned int        omf_LNAMES_alloc;
+    struct omf_strpool_t names;                         // omf_LNAMES[] storage
 };
 
 struct omf_context_t {
@@ -395,6 +451,9 @@ static inline unsigned int omf_lnames_context_get_next_add_index(const struct om
 
 int omf_context_read_fd(struct omf_context_t * const ctx,int fd);
 int omf_context_next_lib_module_fd(struct omf_context_t * const ctx,int fd);
+int omf_context_read_reader(struct omf_context_t * const ctx,struct omf_reader_t * const rdr);
+int omf_context_next_lib_module_reader(struct omf_context_t * const ctx,struct omf_reader_t * const rdr);
+int omf_context_seek_lib_module_reader(struct omf_context_t * const ctx,struct omf_reader_t * const rdr,unsigned long ofs);
 
 const char *omf_context_get_grpdef_name(const struct omf_context_t * const ctx,unsigned int i);
 const char *omf_context_get_grpdef_name_safe(const struct omf_context_t * const ctx,unsigned int i);
@@ -494,6 +553,23 @@ int omf_context_parse_LEDATA(struct omf_context_t * const ctx,struct omf_ledata_
 int omf_context_parse_LIDATA(struct omf_context_t * const ctx,struct omf_ledata_info_t * const info,struct omf_record_t * const rec);
 int omf_context_parse_THEADR(struct omf_context_t * const ctx,struct omf_record_t * const rec);
 
+void omf_reader_init(struct omf_reader_t * const rdr);
+void omf_reader_free(struct omf_reader_t * const rdr);
+struct omf_reader_t *omf_reader_create(void);
+struct omf_reader_t *omf_reader_destroy(struct omf_reader_t * const rdr);
+int omf_reader_open_fd(struct omf_reader_t * const rdr,int fd,unsigned int flags);
+unsigned long omf_reader_tell(const struct omf_reader_t * const rdr);
+int omf_reader_seek(struct omf_reader_t * const rdr,unsigned long ofs);
+int omf_reader_fill(struct omf_reader_t * const rdr,size_t want);
+long omf_reader_read(struct omf_reader_t * const rdr,unsigned char *dst,unsigned int len);
+
+int omf_lib_parse_LIBHEAD(struct omf_lib_header_t * const hdr,struct omf_record_t * const rec);
+void omf_lib_dict_hash(struct omf_lib_dict_hash_t * const h,const char * const name,const size_t namelen,const unsigned int dict_blocks);
+int omf_lib_dict_lookup(const unsigned char * const dict,const unsigned int dict_blocks,const unsigned char flags,const char * const name,const size_t namelen,unsigned int * const page);
+unsigned int omf_lib_dict_blocks(const unsigned long names,const unsigned long name_bytes,const unsigned int min_blocks);
+void omf_lib_dict_init(unsigned char * const dict,const unsigned int dict_blocks);
+int omf_lib_dict_add(unsigned char * const dict,const unsigned int dict_blocks,const char * const name,const size_t namelen,const unsigned int page);
+
 void omf_context_init(struct omf_context_t * const ctx);
 void omf_context_free(struct omf_context_t * const ctx);
 struct omf_context_t *omf_context_create(void);
@@ -23,3 +23,168 @@ int cstr_set_n(char ** const p,const char * const str,const size_t strl) {
     return 0;
 }
 
+
+// first block size, doubling up to the max as the pool fills up. a pool per table per module
+// adds up fast when the tables are kept (lnkdos16 module cache), so start small.
+#define OMF_STRPOOL_BLOCK_MIN       256u
+#if defined(LINUX) || TARGET_MSDOS == 32
+# define OMF_STRPOOL_BLOCK_MAX      (64u * 1024u)
+# define OMF_STRPOOL_HASH_MAX       (64u * 1024u)
+#elif defined(__COMPACT__) || defined(__LARGE__) || defined(__HUGE__)
+# define OMF_STRPOOL_BLOCK_MAX      (8u * 1024u)
+# define OMF_STRPOOL_HASH_MAX       (2u * 1024u)
+#else
+# define OMF_STRPOOL_BLOCK_MAX      (2u * 1024u)
+# define OMF_STRPOOL_HASH_MAX       (256u)
+#endif
+#define OMF_STRPOOL_HASH_MIN        64u
+
+#define OMF_STRPOOL_ALIGN(x)        (((x) + sizeof(void*) - (size_t)1u) & (~(sizeof(void*) - (size_t)1u)))
+#define OMF_STRPOOL_ENT_SIZE(l)     OMF_STRPOOL_ALIGN(offsetof(struct omf_strpool_ent_t,str) + (size_t)(l) + (size_t)1u)
+
+void omf_strpool_init(struct omf_strpool_t * const pool) {
+    pool->block = NULL;
+    pool->hash = NULL;
+    pool->hash_size = 0;
+    pool->count = 0;
+}
+
+static void omf_strpool_free_blocks(struct omf_strpool_block_t *b) {
+    struct omf_strpool_block_t *p;
+
+    while (b != NULL) {
+        p = b->prev;
+        free(b);
+        b = p;
+    }
+}
+
+// forget every string. the current (largest) block and the hash buckets are kept for reuse.
+void omf_strpool_clear(struct omf_strpool_t * const pool) {
+    if (pool->block != NULL) {
+        omf_strpool_free_blocks(pool->block->prev);
+        pool->block->prev = NULL;
+        pool->block->used = 0;
+    }
+
+    if (pool->hash != NULL && pool->count != 0)
+        memset(pool->hash,0,sizeof(struct omf_strpool_ent_t*) * pool->hash_size);
+
+    pool->count = 0;
+}
+
+void omf_strpool_free(struct omf_strpool_t * const pool) {
+    omf_strpool_free_blocks(pool->block);
+    if (pool->hash != NULL) free(pool->hash);
+    omf_strpool_init(pool);
+}
+
+// done adding strings for now: drop the hash buckets. strings added after this
+// are only interned against each other, not against the ones already in the pool.
+void omf_strpool_trim(struct omf_strpool_t * const pool) {
+    if (pool->hash != NULL) {
+        free(pool->hash);
+        pool->hash = NULL;
+    }
+    pool->hash_size = 0;
+}
+
+static unsigned int omf_strpool_hash(const char *str,size_t strl) {
+    unsigned int h = 5381u;
+
+    // djb2
+    while (strl-- > 0)
+        h = ((h << 5u) + h) ^ (unsigned char)(*str++);
+
+    return h;
+}
+
+static int omf_strpool_rehash(struct omf_strpool_t * const pool,unsigned int sz) {
+    struct omf_strpool_ent_t **nh;
+    struct omf_strpool_ent_t *e,*n;
+    unsigned int i;
+
+    nh = (struct omf_strpool_ent_t**)calloc(sz,sizeof(struct omf_strpool_ent_t*));
+    if (nh == NULL)
+        return -1;
+
+    for (i=0;i < pool->hash_size;i++) {
+        for (e=pool->hash[i];e != NULL;e=n) {
+            n = e->next;
+            e->next = nh[e->hash & (sz - 1u)];
+            nh[e->hash & (sz - 1u)] = e;
+        }
+    }
+
+    if (pool->hash != NULL) free(pool->hash);
+    pool->hash = nh;
+    pool->hash_size = sz;
+    return 0;
+}
+
+static struct omf_strpool_ent_t *omf_strpool_alloc(struct omf_strpool_t * const pool,size_t sz) {
+    struct omf_strpool_block_t *b = pool->block;
+    struct omf_strpool_ent_t *e;
+
+    if (b == NULL || (b->size - b->used) < sz) {
+        size_t bsz = (b != NULL) ? (b->size * (size_t)2u) : (size_t)OMF_STRPOOL_BLOCK_MIN;
+
+        if (bsz > (size_t)OMF_STRPOOL_BLOCK_MAX) bsz = (size_t)OMF_STRPOOL_BLOCK_MAX;
+        if (bsz < sz) bsz = sz;
+
+        b = (struct omf_strpool_block_t*)malloc(OMF_STRPOOL_ALIGN(sizeof(*b)) + bsz);
+        if (b == NULL)
+            return NULL; // malloc sets errno
+
+        b->size = bsz;
+        b->used = 0;
+
+        // a block for one long string goes behind the current one, so the current one stays in use
+        if (pool->block != NULL && bsz == sz && (pool->block->size - pool->block->used) >= (size_t)OMF_STRPOOL_BLOCK_MIN) {
+            b->prev = pool->block->prev;
+            pool->block->prev = b;
+        }
+        else {
+            b->prev = pool->block;
+            pool->block = b;
+        }
+    }
+
+    e = (struct omf_strpool_ent_t*)((unsigned char*)b + OMF_STRPOOL_ALIGN(sizeof(*b)) + b->used);
+    b->used += sz;
+    return e;
+}
+
+// add a string (which need not be NUL terminated) to the pool. returns the pooled copy, or NULL if out of memory.
+char *omf_strpool_add(struct omf_strpool_t * const pool,const char * const str,const size_t strl) {
+    const unsigned int h = omf_strpool_hash(str,strl);
+    struct omf_strpool_ent_t *e;
+
+    if (pool->hash != NULL) {
+        for (e=pool->hash[h & (pool->hash_size - 1u)];e != NULL;e=e->next) {
+            if (e->hash == h && !memcmp(e->str,str,strl) && e->str[strl] == 0)
+                return e->str;
+        }
+    }
+
+    // keep the chains short. if there is no memory for the buckets, the string just isn't interned
+    if (pool->count >= (pool->hash_size * 2u) && pool->hash_size < OMF_STRPOOL_HASH_MAX)
+        omf_strpool_rehash(pool,pool->hash_size != 0u ? (pool->hash_size * 2u) : OMF_STRPOOL_HASH_MIN);
+
+    e = omf_strpool_alloc(pool,OMF_STRPOOL_ENT_SIZE(strl));
+    if (e == NULL)
+        return NULL;
+
+    e->hash = h;
+    memcpy(e->str,str,strl);
+    e->str[strl] = 0;
+
+    e->next = NULL;
+    if (pool->hash != NULL) {
+        e->next = pool->hash[h & (pool->hash_size - 1u)];
+        pool->hash[h & (pool->hash_size - 1u)] = e;
+    }
+
+    pool->count++;
+    return e->str;
+}
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -14,6 +15,40 @@
 
 void cstr_free(char ** const p);
 int cstr_set_n(char ** const p,const char * const str,const size_t strl);
+
+// string pool:
+//
+// strings are carved out of a chain of blocks instead of malloc()'d one at a time, and the
+// same string added twice comes back as the same pointer. the strings belong to the pool and
+// are never freed on their own. omf_strpool_clear() lets go of them all at once and keeps the
+// last block to reuse, which is what the parser wants at the start of each .LIB module.
+//
+// a pool can be moved by copying the struct and calling omf_strpool_init() on the original.
+
+struct omf_strpool_block_t {
+    struct omf_strpool_block_t*         prev;       // previous (smaller) block
+    size_t                              size;       // bytes following this header
+    size_t                              used;
+};
+
+struct omf_strpool_ent_t {
+    struct omf_strpool_ent_t*           next;       // hash chain
+    unsigned int                        hash;
+    char                                str[1];     // NUL terminated, variable length
+};
+
+struct omf_strpool_t {
+    struct omf_strpool_block_t*         block;      // current block, most recent first
+    struct omf_strpool_ent_t**          hash;       // hash buckets, or NULL
+    unsigned int                        hash_size;  // power of 2
+    unsigned int                        count;      // strings in the pool
+};
+
+void omf_strpool_init(struct omf_strpool_t * const pool);
+void omf_strpool_clear(struct omf_strpool_t * const pool);
+void omf_strpool_free(struct omf_strpool_t * const pool);
+void omf_strpool_trim(struct omf_strpool_t * const pool);
+char *omf_strpool_add(struct omf_strpool_t * const pool,const char * const str,const size_t strl);
  
 #endif //_DOSLIB_OMF_OMFCSTR_H
 
@@ -2,7 +2,7 @@
 #include <fmt/omf/omf.h>
 #include <fmt/omf/omfcstr.h>
 
-char                                    omf_temp_str[255+1/*NUL*/];
+OMF_THREAD_LOCAL char                   omf_temp_str[255+1/*NUL*/];
  
 void omf_context_init(struct omf_context_t * const ctx) {
     omf_fixupps_context_init(&ctx->FIXUPPs);
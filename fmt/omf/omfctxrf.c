@@ -19,6 +19,8 @@ int omf_context_read_fd(struct omf_context_t * const ctx,int fd) {
 
     ctx->last_error = NULL;
     omf_record_clear(&ctx->record);
+    if (ctx->record.data_external) // left over from omf_context_read_reader(), cannot read into that
+        omf_record_data_free(&ctx->record);
     if (ctx->record.data == NULL && omf_record_data_alloc(&ctx->record,0) < 0)
         return -1; // sets errno
     if (ctx->record.data_alloc < 16) {
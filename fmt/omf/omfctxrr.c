@@ -0,0 +1,154 @@
+#include <fmt/omf/omf.h>
+#include <fmt/omf/omfcstr.h>
+
+// omf_context_read_fd() through an omf_reader_t instead of read() per record
+int omf_context_read_reader(struct omf_context_t * const ctx,struct omf_reader_t * const rdr) {
+    unsigned char sum = 0;
+    unsigned char tmp[3];
+    unsigned int i;
+    long rd;
+    int ret;
+
+    // if the last record was a LIBEND, then stop reading.
+    // non-OMF junk usually follows.
+    if (ctx->record.rectype == 0xF1)
+        return 0;
+
+    // if the last record was a MODEND, then stop reading, make caller move to next module with another function
+    if ((ctx->record.rectype&0xFE) == 0x8A) // 0x8A or 0x8B
+        return 0;
+
+    ctx->last_error = NULL;
+    omf_record_clear(&ctx->record);
+    if (ctx->record.data_external) // previous record, which is no longer valid anyway
+        omf_record_data_free(&ctx->record);
+
+    ctx->record.rec_file_offset = omf_reader_tell(rdr);
+
+    if ((ret=omf_reader_fill(rdr,3)) <= 0) {
+        if (ret == 0) {
+            rdr->buffer_pos = rdr->buffer_len;
+            return 0; // EOF
+        }
+
+        ctx->last_error = "Reading OMF record header failed";
+        // read sets errno
+        return -1;
+    }
+    memcpy(tmp,rdr->buffer+rdr->buffer_pos,3);
+    rdr->buffer_pos += 3;
+
+    ctx->record.rectype = tmp[0];
+    ctx->record.reclen = *((uint16_t*)(tmp+1)); // length (including checksum)
+    if (ctx->record.rectype == 0 || ctx->record.reclen == 0)
+        return 0;
+
+    if (rdr->zero_copy && (ret=omf_reader_fill(rdr,ctx->record.reclen)) > 0) {
+        // point at the record in the buffer.
+        // NTS: not omf_record_data_free(), that would also clear rectype and reclen
+        if (ctx->record.data != NULL && !ctx->record.data_external)
+            free(ctx->record.data);
+
+        ctx->record.data = rdr->buffer + rdr->buffer_pos;
+        ctx->record.data_external = 1;
+        rdr->buffer_pos += ctx->record.reclen;
+    }
+    else if (ret < 0) {
+        ctx->last_error = "Reading OMF record contents failed";
+        return -1;
+    }
+    else {
+        // copy the record into our own buffer
+        if (ctx->record.data == NULL) {
+            const unsigned short reclen = ctx->record.reclen;
+
+            if (omf_record_data_alloc(&ctx->record,0) < 0)
+                return -1; // sets errno
+
+            ctx->record.reclen = reclen; // alloc zeroes it
+        }
+        if (ctx->record.reclen > ctx->record.data_alloc) {
+            ctx->last_error = "Reading OMF record failed because record too large for buffer";
+            errno = ERANGE;
+            return -1;
+        }
+        if ((rd=omf_reader_read(rdr,ctx->record.data,ctx->record.reclen)) != (long)ctx->record.reclen) {
+            ctx->last_error = "Reading OMF record contents failed";
+            if (rd >= 0L) errno = EIO;
+            return -1;
+        }
+    }
+
+    /* check checksum */
+    if (ctx->record.data[ctx->record.reclen-1] != 0/*optional*/) {
+        for (i=0;i < 3;i++)
+            sum += tmp[i];
+        for (i=0;i < ctx->record.reclen;i++)
+            sum += ctx->record.data[i];
+
+        if (sum != 0) {
+            ctx->last_error = "Reading OMF record checksum failed";
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    /* remember LIBHEAD block size */
+    if (ctx->record.rectype == 0xF0/*LIBHEAD*/) {
+        if (ctx->library_block_size == 0) {
+            // and the length of the record defines the block size that modules within are aligned by
+            ctx->library_block_size = ctx->record.reclen + 3;
+        }
+        else {
+            ctx->last_error = "LIBHEAD defined again";
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    ctx->record.reclen--; // omit checksum from reclen
+    return 1;
+}
+
+// omf_context_next_lib_module_fd() through an omf_reader_t
+int omf_context_next_lib_module_reader(struct omf_context_t * const ctx,struct omf_reader_t * const rdr) {
+    unsigned long ofs;
+
+    // if the last record was a LIBEND, then stop reading.
+    // non-OMF junk usually follows.
+    if (ctx->record.rectype == 0xF1)
+        return 0;
+
+    // if the last record was not a MODEND, then stop reading.
+    if ((ctx->record.rectype&0xFE) != 0x8A) { // Not 0x8A or 0x8B
+        errno = EIO;
+        return -1;
+    }
+
+    // if we don't have a block size, then we cannot advance
+    if (ctx->library_block_size == 0UL)
+        return 0;
+
+    // where does the next block size start?
+    ofs = ctx->record.rec_file_offset + 3 + ctx->record.reclen + 1/*checksum*/;
+    ofs += ctx->library_block_size - 1UL;
+    ofs -= ofs % ctx->library_block_size;
+    if (omf_reader_seek(rdr,ofs) < 0)
+        return 0;
+
+    ctx->record.rec_file_offset = ofs;
+    ctx->record.rectype = 0;
+    ctx->record.reclen = 0;
+    return 1;
+}
+
+// go to the library module at file offset 'ofs' (a dictionary lookup result) instead of the next one
+int omf_context_seek_lib_module_reader(struct omf_context_t * const ctx,struct omf_reader_t * const rdr,unsigned long ofs) {
+    if (omf_reader_seek(rdr,ofs) < 0)
+        return -1; // sets errno
+
+    ctx->record.rec_file_offset = ofs;
+    ctx->record.rectype = 0;
+    ctx->record.reclen = 0;
+    return 0;
+}
@@ -114,6 +114,7 @@ int main(int argc,char **argv) {
     unsigned char dumpstate = 0;
     unsigned char diddump = 0;
     unsigned char verbose = 0;
+    struct omf_reader_t *rdr;
     int i,fd,ret;
     char *a;
 
@@ -162,10 +163,16 @@ int main(int argc,char **argv) {
         return 1;
     }
 
+    // records are only read here, never modified, so they can point straight into the file
+    if ((rdr=omf_reader_create()) == NULL || omf_reader_open_fd(rdr,fd,OMF_READER_ZERO_COPY) < 0) {
+        fprintf(stderr,"Failed to init OMF reader %s\n",strerror(errno));
+        return 1;
+    }
+
     omf_context_begin_file(omf_state);
 
     do {
-        ret = omf_context_read_fd(omf_state,fd);
+        ret = omf_context_read_reader(omf_state,rdr);
         if (ret == 0) {
             if (omf_record_is_modend(&omf_state->record)) {
                 if (dumpstate && !diddump) {
@@ -175,7 +182,7 @@ int main(int argc,char **argv) {
 
                 printf("----- next module -----\n");
 
-                ret = omf_context_next_lib_module_fd(omf_state,fd);
+                ret = omf_context_next_lib_module_reader(omf_state,rdr);
                 if (ret < 0) {
                     printf("Unable to advance to next .LIB module, %s\n",strerror(errno));
                     if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
@@ -372,6 +379,7 @@ int main(int argc,char **argv) {
 
     omf_context_clear(omf_state);
     omf_state = omf_context_destroy(omf_state);
+    rdr = omf_reader_destroy(rdr);
     close(fd);
     return 0;
 }
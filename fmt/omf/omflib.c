@@ -0,0 +1,217 @@
+#include <fmt/omf/omf.h>
+
+#if defined(LINUX)
+# include <strings.h>
+#endif
+
+// parse the LIBHEAD record that starts a .LIB file
+int omf_lib_parse_LIBHEAD(struct omf_lib_header_t * const hdr,struct omf_record_t * const rec) {
+    if (rec->rectype != OMF_RECTYPE_LIBHEAD) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    omf_record_lseek(rec,0);
+    if (omf_record_data_available(rec) < 7) {
+        errno = EIO;
+        return -1;
+    }
+
+    hdr->block_size = rec->reclen + 1/*checksum*/ + 3/*header*/;
+    hdr->dict_offset = omf_record_get_dword(rec);
+    hdr->dict_blocks = omf_record_get_word(rec);
+    hdr->flags = omf_record_get_byte(rec);
+    return 0;
+}
+
+static inline unsigned short omf_lib_rol16(const unsigned short v,const unsigned int b) {
+    return (unsigned short)((v << b) | (v >> (16u - b)));
+}
+
+static inline unsigned short omf_lib_ror16(const unsigned short v,const unsigned int b) {
+    return (unsigned short)((v >> b) | (v << (16u - b)));
+}
+
+// the dictionary hash from the OMF specification, which works on the name as stored in the
+// dictionary (with its length byte in front) and ignores case (OR 0x20). it walks backwards
+// from the last character and forwards from the length byte at the same time.
+#define OMF_LIB_HASH_CHAR(i) ((unsigned char)(((i) == 0u) ? (unsigned char)namelen : (unsigned char)name[(i)-1u]) | 0x20u)
+
+void omf_lib_dict_hash(struct omf_lib_dict_hash_t * const h,const char * const name,const size_t namelen,const unsigned int dict_blocks) {
+    unsigned int len = (unsigned int)namelen;
+    unsigned int front = 0,back = (unsigned int)namelen;
+    unsigned short block_x,block_d,bucket_x,bucket_d;
+    unsigned char c;
+
+    block_x = bucket_d = (unsigned short)(len | 0x20u);
+    block_d = bucket_x = 0;
+
+    do {
+        c = OMF_LIB_HASH_CHAR(back); back--;
+        bucket_x = omf_lib_ror16(bucket_x,2) ^ c;
+        block_d = omf_lib_rol16(block_d,2) ^ c;
+        if (--len == 0) break;
+
+        c = OMF_LIB_HASH_CHAR(front); front++;
+        block_x = omf_lib_rol16(block_x,2) ^ c;
+        bucket_d = omf_lib_ror16(bucket_d,2) ^ c;
+    } while (1);
+
+    h->block_x = (unsigned short)(block_x % dict_blocks);
+    h->block_d = (unsigned short)(block_d % dict_blocks);
+    if (h->block_d == 0) h->block_d = 1;
+    h->bucket_x = (unsigned short)(bucket_x % OMF_LIB_DICT_BUCKETS);
+    h->bucket_d = (unsigned short)(bucket_d % OMF_LIB_DICT_BUCKETS);
+    if (h->bucket_d == 0) h->bucket_d = 1;
+}
+
+// look up a public name in a dictionary loaded into memory.
+// returns 1 and the module page number if found, 0 if not.
+int omf_lib_dict_lookup(const unsigned char * const dict,const unsigned int dict_blocks,const unsigned char flags,const char * const name,const size_t namelen,unsigned int * const page) {
+    struct omf_lib_dict_hash_t h;
+    unsigned int block,bucket;
+    unsigned int bi,ki;
+
+    if (dict == NULL || dict_blocks == 0 || namelen == 0 || namelen > 255)
+        return 0;
+
+    omf_lib_dict_hash(&h,name,namelen,dict_blocks);
+
+    block = h.block_x;
+    for (bi=0;bi < dict_blocks;bi++) {
+        const unsigned char *blk = dict + ((size_t)block * (size_t)OMF_LIB_DICT_BLOCK_SIZE);
+
+        bucket = h.bucket_x;
+        for (ki=0;ki < OMF_LIB_DICT_BUCKETS;ki++) {
+            const unsigned int ofs = (unsigned int)blk[bucket] * 2u;
+
+            if (ofs == 0) {
+                // empty bucket. if the block isn't full, the name would have gone here, so it's not in the dictionary
+                if (blk[OMF_LIB_DICT_BUCKETS] != 0xFFu)
+                    return 0;
+            }
+            else if ((ofs + 1u + (unsigned int)blk[ofs] + 2u) <= OMF_LIB_DICT_BLOCK_SIZE && (size_t)blk[ofs] == namelen) {
+                int cmp;
+
+                if (flags & OMF_LIB_FLAG_CASE_SENSITIVE)
+                    cmp = memcmp(blk+ofs+1,name,namelen);
+                else
+                    cmp = strncasecmp((const char*)blk+ofs+1,name,namelen);
+
+                if (cmp == 0) {
+                    *page = (unsigned int)blk[ofs+1+namelen] + ((unsigned int)blk[ofs+1+namelen+1] << 8u);
+                    return 1;
+                }
+            }
+
+            bucket = (bucket + h.bucket_d) % OMF_LIB_DICT_BUCKETS;
+        }
+
+        block = (block + h.block_d) % dict_blocks;
+    }
+
+    return 0;
+}
+
+// is n prime? dictionary block counts must be, so that the block step visits every block
+static unsigned int omf_lib_is_prime(const unsigned int n) {
+    unsigned int d;
+
+    if (n < 2u) return 0;
+    for (d=2u;(d * d) <= n;d++) {
+        if ((n % d) == 0u) return 0;
+    }
+
+    return 1;
+}
+
+// pick a (prime) number of dictionary blocks for a dictionary of 'names' names totalling
+// 'name_bytes' characters, leaving room for hash collisions. if a previous attempt at
+// building the dictionary failed, pass the block count it used as 'min_blocks' to get a
+// larger one. returns 0 if the dictionary cannot be made that large.
+unsigned int omf_lib_dict_blocks(const unsigned long names,const unsigned long name_bytes,const unsigned int min_blocks) {
+    unsigned long want;
+    unsigned long n;
+
+    // each entry is length byte + name + page word, word aligned. aim for about 2/3 full
+    // both by buckets and by space.
+    want = ((names * 3ul) / (2ul * OMF_LIB_DICT_BUCKETS)) + 1ul;
+    n = ((((name_bytes + (names * 4ul)) * 3ul) / 2ul) / (OMF_LIB_DICT_BLOCK_SIZE - (OMF_LIB_DICT_BUCKETS + 1u))) + 1ul;
+    if (want < n) want = n;
+    if (want < 2ul) want = 2ul;
+    if (want <= (unsigned long)min_blocks) want = (unsigned long)min_blocks + 1ul;
+
+    for (;want <= 0xFFFFul;want++) {
+        if (omf_lib_is_prime((unsigned int)want))
+            return (unsigned int)want;
+    }
+
+    return 0;
+}
+
+// clear a dictionary of dict_blocks blocks in memory before adding names to it
+void omf_lib_dict_init(unsigned char * const dict,const unsigned int dict_blocks) {
+    unsigned int b;
+
+    memset(dict,0,(size_t)dict_blocks * (size_t)OMF_LIB_DICT_BLOCK_SIZE);
+
+    // free space starts after the buckets and the free space byte, in words
+    for (b=0;b < dict_blocks;b++)
+        dict[((size_t)b * (size_t)OMF_LIB_DICT_BLOCK_SIZE) + OMF_LIB_DICT_BUCKETS] = (unsigned char)((OMF_LIB_DICT_BUCKETS + 1u) / 2u);
+}
+
+// add a public name and the page number of the module defining it to a dictionary in memory,
+// probing the same way omf_lib_dict_lookup() does. a block that cannot take the name (no
+// empty bucket on its probe sequence, or no room) is marked full, so that lookups move on to
+// the next block. returns 1 if added, 0 if the dictionary has no room (make a larger one).
+// the caller is expected to have checked for duplicates with omf_lib_dict_lookup().
+int omf_lib_dict_add(unsigned char * const dict,const unsigned int dict_blocks,const char * const name,const size_t namelen,const unsigned int page) {
+    struct omf_lib_dict_hash_t h;
+    unsigned int block,bucket;
+    unsigned int bi,ki;
+    unsigned int entlen;
+
+    if (dict == NULL || dict_blocks == 0 || namelen == 0 || namelen > 255) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    omf_lib_dict_hash(&h,name,namelen,dict_blocks);
+    entlen = (1u + (unsigned int)namelen + 2u + 1u) & (~1u); // entries start on a word boundary
+
+    block = h.block_x;
+    for (bi=0;bi < dict_blocks;bi++) {
+        unsigned char *blk = dict + ((size_t)block * (size_t)OMF_LIB_DICT_BLOCK_SIZE);
+
+        if (blk[OMF_LIB_DICT_BUCKETS] != 0xFFu) {
+            bucket = h.bucket_x;
+            for (ki=0;ki < OMF_LIB_DICT_BUCKETS;ki++) {
+                if (blk[bucket] == 0) {
+                    unsigned int ofs = (unsigned int)blk[OMF_LIB_DICT_BUCKETS] * 2u;
+
+                    if ((ofs + entlen) <= OMF_LIB_DICT_BLOCK_SIZE) {
+                        blk[bucket] = (unsigned char)(ofs / 2u);
+                        blk[ofs] = (unsigned char)namelen;
+                        memcpy(blk+ofs+1,name,namelen);
+                        blk[ofs+1+namelen] = (unsigned char)(page & 0xFFu);
+                        blk[ofs+1+namelen+1] = (unsigned char)((page >> 8u) & 0xFFu);
+
+                        ofs += entlen;
+                        blk[OMF_LIB_DICT_BUCKETS] = (ofs < OMF_LIB_DICT_BLOCK_SIZE) ? (unsigned char)(ofs / 2u) : 0xFFu;
+                        return 1;
+                    }
+
+                    break;
+                }
+
+                bucket = (bucket + h.bucket_d) % OMF_LIB_DICT_BUCKETS;
+            }
+
+            blk[OMF_LIB_DICT_BUCKETS] = 0xFFu;
+        }
+
+        block = (block + h.block_d) % dict_blocks;
+    }
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <fmt/omf/omf.h>
+
+#if defined(LINUX)
+# include <sys/mman.h>
+#endif
+
+// read-ahead buffer size, if not mapped
+#if defined(LINUX)
+# define OMF_READER_BUFFER_SIZE     (256u * 1024u)
+#elif TARGET_MSDOS == 32
+# define OMF_READER_BUFFER_SIZE     (64u * 1024u)
+#elif defined(__COMPACT__) || defined(__LARGE__) || defined(__HUGE__)
+# define OMF_READER_BUFFER_SIZE     (16u * 1024u)
+#else
+# define OMF_READER_BUFFER_SIZE     (4096u)
+#endif
+
+void omf_reader_init(struct omf_reader_t * const rdr) {
+    rdr->fd = -1;
+    rdr->buffer = NULL;
+    rdr->buffer_alloc = OMF_READER_BUFFER_SIZE;
+    rdr->buffer_len = 0;
+    rdr->buffer_pos = 0;
+    rdr->buffer_file_offset = 0;
+    rdr->mapped = 0;
+    rdr->zero_copy = 0;
+}
+
+void omf_reader_free(struct omf_reader_t * const rdr) {
+    if (rdr->buffer != NULL) {
+#if defined(LINUX)
+        if (rdr->mapped)
+            munmap(rdr->buffer,rdr->buffer_alloc);
+        else
+#endif
+            free(rdr->buffer);
+
+        rdr->buffer = NULL;
+    }
+
+    rdr->buffer_alloc = OMF_READER_BUFFER_SIZE;
+    rdr->buffer_len = 0;
+    rdr->buffer_pos = 0;
+    rdr->mapped = 0;
+    rdr->fd = -1;
+}
+
+struct omf_reader_t *omf_reader_create(void) {
+    struct omf_reader_t *rdr;
+
+    rdr = malloc(sizeof(*rdr));
+    if (rdr != NULL) omf_reader_init(rdr);
+    return rdr;
+}
+
+struct omf_reader_t *omf_reader_destroy(struct omf_reader_t * const rdr) {
+    if (rdr != NULL) {
+        omf_reader_free(rdr);
+        free(rdr);
+    }
+
+    return NULL;
+}
+
+// attach the reader to a file descriptor, starting from the current file pointer.
+// the reader owns the file pointer from here on, use omf_reader_seek() instead of lseek().
+// the caller still owns (and closes) the file descriptor.
+int omf_reader_open_fd(struct omf_reader_t * const rdr,int fd,unsigned int flags) {
+    off_t ofs;
+
+    omf_reader_free(rdr);
+
+    // not seekable (pipe)? then offsets are relative to where we started
+    ofs = lseek(fd,0,SEEK_CUR);
+    if (ofs < (off_t)0) ofs = 0;
+
+    rdr->fd = fd;
+    rdr->zero_copy = (flags & OMF_READER_ZERO_COPY) ? 1 : 0;
+
+#if defined(LINUX)
+    if (!(flags & OMF_READER_NO_MMAP)) {
+        struct stat st;
+
+        // map the whole file if we can. if it is not a regular file (pipe, etc) fall back to read()
+        if (fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+            (unsigned long long)st.st_size <= (unsigned long long)((size_t)(~0UL) >> 1UL)) {
+            void *p = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+
+            if (p != MAP_FAILED) {
+                rdr->buffer = (unsigned char*)p;
+                rdr->buffer_alloc = (size_t)st.st_size;
+                rdr->buffer_len = (size_t)st.st_size;
+                rdr->buffer_pos = ((unsigned long long)ofs < (unsigned long long)st.st_size) ? (size_t)ofs : (size_t)st.st_size;
+                rdr->buffer_file_offset = 0;
+                rdr->mapped = 1;
+                return 0;
+            }
+        }
+    }
+#endif
+
+    rdr->buffer = malloc(rdr->buffer_alloc);
+    if (rdr->buffer == NULL)
+        return -1; // malloc sets errno
+
+    rdr->buffer_len = 0;
+    rdr->buffer_pos = 0;
+    rdr->buffer_file_offset = (unsigned long)ofs;
+    return 0;
+}
+
+unsigned long omf_reader_tell(const struct omf_reader_t * const rdr) {
+    return rdr->buffer_file_offset + (unsigned long)rdr->buffer_pos;
+}
+
+int omf_reader_seek(struct omf_reader_t * const rdr,unsigned long ofs) {
+    if (rdr->buffer == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // within what we already have? (always true if mapped, unless past EOF)
+    if (ofs >= rdr->buffer_file_offset && (ofs - rdr->buffer_file_offset) <= (unsigned long)rdr->buffer_len) {
+        rdr->buffer_pos = (size_t)(ofs - rdr->buffer_file_offset);
+        return 0;
+    }
+
+    if (rdr->mapped) {
+        // past EOF. reads will return EOF, like read() would after lseek() past EOF
+        rdr->buffer_pos = rdr->buffer_len;
+        return 0;
+    }
+
+    if (lseek(rdr->fd,(off_t)ofs,SEEK_SET) != (off_t)ofs)
+        return -1; // lseek sets errno
+
+    rdr->buffer_file_offset = ofs;
+    rdr->buffer_len = 0;
+    rdr->buffer_pos = 0;
+    return 0;
+}
+
+// make sure at least 'want' bytes are in the buffer at the read position.
+// returns 1 if so, 0 if EOF comes first or 'want' is larger than the buffer, -1 on error.
+int omf_reader_fill(struct omf_reader_t * const rdr,size_t want) {
+    size_t avail = rdr->buffer_len - rdr->buffer_pos;
+    int rd;
+
+    if (avail >= want)
+        return 1;
+    if (rdr->mapped || want > rdr->buffer_alloc)
+        return 0;
+
+    // move the unread remainder down to the start of the buffer
+    if (rdr->buffer_pos != 0) {
+        if (avail != 0) memmove(rdr->buffer,rdr->buffer+rdr->buffer_pos,avail);
+        rdr->buffer_file_offset += (unsigned long)rdr->buffer_pos;
+        rdr->buffer_len = avail;
+        rdr->buffer_pos = 0;
+    }
+
+    while (rdr->buffer_len < want) {
+        size_t todo = rdr->buffer_alloc - rdr->buffer_len;
+
+        // NTS: 16-bit read() takes an unsigned int count
+        if (todo > (size_t)0x7FFFU) todo = (size_t)0x7FFFU;
+
+        rd = read(rdr->fd,rdr->buffer+rdr->buffer_len,(unsigned int)todo);
+        if (rd < 0)
+            return -1; // read sets errno
+        if (rd == 0)
+            return 0; // EOF
+
+        rdr->buffer_len += (size_t)rd;
+    }
+
+    return 1;
+}
+
+// copy 'len' bytes out of the reader, whatever the buffer size.
+// returns the number of bytes copied (less than len at EOF), or -1 on error.
+long omf_reader_read(struct omf_reader_t * const rdr,unsigned char *dst,unsigned int len) {
+    unsigned int count = 0;
+
+    while (count < len) {
+        size_t avail = rdr->buffer_len - rdr->buffer_pos;
+        int rd;
+
+        if (avail == 0) {
+            if ((rd=omf_reader_fill(rdr,1)) < 0)
+                return -1;
+            if (rd == 0)
+                break;
+
+            avail = rdr->buffer_len - rdr->buffer_pos;
+        }
+
+        if (avail > (size_t)(len - count))
+            avail = (size_t)(len - count);
+
+        memcpy(dst+count,rdr->buffer+rdr->buffer_pos,avail);
+        rdr->buffer_pos += avail;
+        count += (unsigned int)avail;
+    }
+
+    return (long)count;
+}
+
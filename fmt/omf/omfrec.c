@@ -11,11 +11,15 @@ void omf_record_init(struct omf_record_t * const rec) {
     rec->data = NULL;
     rec->data_alloc = 4096; // OMF spec says 1024
     rec->rec_file_offset = (~0UL);
+    rec->data_external = 0;
 }
 
 void omf_record_data_free(struct omf_record_t * const rec) {
     if (rec->data != NULL) {
-        free(rec->data);
+        if (!rec->data_external)
+            free(rec->data);
+
+        rec->data_external = 0;
         rec->data = NULL;
     }
     rec->reclen = 0;
@@ -66,7 +70,7 @@ unsigned short omf_record_lseek(struct omf_record_t * const rec,unsigned short p
 }
 
 size_t omf_record_can_write(const struct omf_record_t * const rec) {
-    if (rec->data == NULL)
+    if (rec->data == NULL || rec->data_external)
         return 0;
     if (rec->recpos >= rec->data_alloc)
         return 0;
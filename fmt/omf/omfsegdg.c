@@ -320,6 +320,7 @@ int main(int argc,char **argv) {
     unsigned char diddump = 0;
     unsigned char verbose = 0;
     unsigned char outself = 0;
+    struct omf_reader_t *rdr;
     int i,fd,ret,ofd;
     char *a;
 
@@ -397,11 +398,17 @@ int main(int argc,char **argv) {
         return 1;
     }
 
+    // NTS: no zero-copy, the second pass patches LEDATA and FIXUPP records in place
+    if ((rdr=omf_reader_create()) == NULL || omf_reader_open_fd(rdr,fd,0) < 0) {
+        fprintf(stderr,"Failed to init OMF reader %s\n",strerror(errno));
+        return 1;
+    }
+
     /* first pass: read OMF symbols, segdefs, and groupdefs */
     omf_context_begin_file(omf_state);
 
     do {
-        ret = omf_context_read_fd(omf_state,fd);
+        ret = omf_context_read_reader(omf_state,rdr);
         if (ret == 0) {
             break;
         }
@@ -504,7 +511,7 @@ int main(int argc,char **argv) {
     if (omf_state->flags.verbose)
         printf("Starting 2nd pass\n");
 
-    if (lseek(fd,0,SEEK_SET) != 0) {
+    if (omf_reader_seek(rdr,0) < 0) {
         fprintf(stderr,"lseek(0) failed\n");
         return 1;
     }
@@ -516,7 +523,7 @@ int main(int argc,char **argv) {
     memset(&last_ledata,0,sizeof(last_ledata));
 
     do {
-        ret = omf_context_read_fd(omf_state,fd);
+        ret = omf_context_read_reader(omf_state,rdr);
         if (ret == 0) {
             break;
         }
@@ -615,6 +622,7 @@ int main(int argc,char **argv) {
 
     omf_context_clear(omf_state);
     omf_state = omf_context_destroy(omf_state);
+    rdr = omf_reader_destroy(rdr);
     close(ofd);
     close(fd);
 
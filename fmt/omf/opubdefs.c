@@ -14,6 +14,7 @@ void omf_pubdefs_context_init_pubdef(struct omf_pubdef_t * const ctx) {
 void omf_pubdefs_context_init(struct omf_pubdefs_context_t * const ctx) {
     ctx->omf_PUBDEFS = NULL;
     ctx->omf_PUBDEFS_count = 0;
+    omf_strpool_init(&ctx->names);
 #if defined(LINUX) || TARGET_MSDOS == 32
     ctx->omf_PUBDEFS_alloc = 32768;
 #elif defined(__COMPACT__) || defined(__LARGE__) || defined(__HUGE__)
@@ -26,20 +27,19 @@ void omf_pubdefs_context_init(struct omf_pubdefs_context_t * const ctx) {
 }
 
 void omf_pubdefs_context_free_entries(struct omf_pubdefs_context_t * const ctx) {
-    unsigned int i;
-
     if (ctx->omf_PUBDEFS) {
-        for (i=0;i < ctx->omf_PUBDEFS_count;i++)
-            cstr_free(&(ctx->omf_PUBDEFS[i].name_string));
-
         free(ctx->omf_PUBDEFS);
         ctx->omf_PUBDEFS = NULL;
     }
     ctx->omf_PUBDEFS_count = 0;
+
+    /* the names go all at once */
+    omf_strpool_clear(&ctx->names);
 }
 
 void omf_pubdefs_context_free(struct omf_pubdefs_context_t * const ctx) {
     omf_pubdefs_context_free_entries(ctx);
+    omf_strpool_free(&ctx->names);
 }
 
 struct omf_pubdefs_context_t *omf_pubdefs_context_create(void) {
@@ -114,9 +114,8 @@ const struct omf_pubdef_t *omf_pubdefs_context_get_pubdef(const struct omf_pubde
 }
 
 int omf_pubdefs_context_set_pubdef_name(struct omf_pubdefs_context_t * const ctx,struct omf_pubdef_t * const pubdef,const char * const name,const size_t namelen) {
-    (void)ctx;
-
-    if (cstr_set_n(&pubdef->name_string,name,namelen) < 0)
+    pubdef->name_string = omf_strpool_add(&ctx->names,name,namelen);
+    if (pubdef->name_string == NULL)
         return -1;
 
     return 0;
@@ -0,0 +1,967 @@
+/* EXEDIFF: compare two builds of the same NE or LE/LX driver or DLL.
+ *
+ * Segments (NE) or objects (LE) are matched by number, exports by name or by ordinal if they have
+ * no name. Bytes patched by relocations (NE) or fixups (LE) are masked out of the comparison, in
+ * either file, so that a different load address or import does not show up as a changed byte.
+ * Non-additive NE relocations are followed down their chain through the segment data.
+ *
+ * The masked contents of each segment are hashed as a whole and in blocks, so identical segments
+ * and identical blocks within a changed segment are skipped without comparing bytes. A segment
+ * that changed places is found by looking up its hash among the segments of the other file. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+#include <hw/dos/exelehdr.h>
+#include <hw/dos/exelepar.h>
+
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
+/* segment contents are hashed in blocks of this many bytes */
+#define EXEDIFF_BLOCK                   256u
+
+/* bytes of each changed range shown with -v */
+#define EXEDIFF_SHOW_BYTES              16u
+
+static char*                    old_file = NULL;
+static char*                    new_file = NULL;
+
+static unsigned char            opt_summary = 0;    /* -s, no per-range listing */
+static unsigned char            opt_verbose = 0;    /* -v, show the bytes of each range */
+
+static void help(void) {
+    fprintf(stderr,"EXEDIFF -a <old exe file> -b <new exe file> [options]\n");
+    fprintf(stderr,"Compare two NE or LE/LX images by segment/object and export, ignoring\n");
+    fprintf(stderr,"bytes patched by relocations and fixups.\n");
+    fprintf(stderr," -s         Summary only, do not list changed ranges\n");
+    fprintf(stderr," -v         Show the old and new bytes of each changed range\n");
+    fprintf(stderr,"Exit status is 0 if the images match, 1 if they differ, 2 on error.\n");
+}
+
+/* one segment or object, as loaded */
+struct exediff_seg {
+    unsigned char*              data;               /* [size], zero past what the file provides */
+    unsigned char*              mask;               /* [size], nonzero where a relocation or fixup patches the byte */
+    uint32_t                    size;               /* bytes of data in the file (LE: whole pages) */
+    uint32_t                    alloc;              /* NE: minimum allocation, LE: virtual size */
+    uint32_t                    flags;
+    unsigned long               fixups;             /* relocation/fixup sites masked */
+    uint64_t*                   block_hash;         /* [(size + EXEDIFF_BLOCK - 1) / EXEDIFF_BLOCK] */
+    uint64_t                    hash;               /* of the block hashes and size */
+};
+
+struct exediff_export {
+    char*                       name;               /* NULL if exported by ordinal only */
+    unsigned int                ordinal;
+    unsigned int                segment;            /* segment or object, 0 if a constant or forwarder */
+    unsigned long               offset;
+};
+
+struct exediff_module {
+    const char*                 path;
+    const char*                 format;             /* "NE", "LE" or "LX" */
+    const char*                 seg_noun;           /* "Segment" or "Object" */
+    const char*                 seg_nouns;          /* "segments" or "objects" */
+    char                        name[255+1];        /* module name, first entry of the resident name table */
+    struct exediff_seg*         segs;
+    unsigned int                seg_count;
+    struct exediff_export*      exports;
+    unsigned int                export_count;
+    unsigned int                export_alloc;
+};
+
+static void exediff_module_init(struct exediff_module * const m) {
+    memset(m,0,sizeof(*m));
+}
+
+static void exediff_module_free(struct exediff_module * const m) {
+    unsigned int i;
+
+    for (i=0;i < m->seg_count;i++) {
+        if (m->segs[i].data) free(m->segs[i].data);
+        if (m->segs[i].mask) free(m->segs[i].mask);
+        if (m->segs[i].block_hash) free(m->segs[i].block_hash);
+    }
+    for (i=0;i < m->export_count;i++) {
+        if (m->exports[i].name) free(m->exports[i].name);
+    }
+    if (m->segs) free(m->segs);
+    if (m->exports) free(m->exports);
+    exediff_module_init(m);
+}
+
+#define EXEDIFF_HASH_INIT               0xCBF29CE484222325ULL
+
+/* FNV-1a, 64-bit. bytes with mask set hash as zero. mask can be NULL */
+static uint64_t exediff_hash(uint64_t h,const unsigned char *data,const unsigned char *mask,size_t len) {
+    while (len-- != 0) {
+        h ^= (mask != NULL && *mask++) ? 0u : (uint64_t)(*data);
+        h *= 0x100000001B3ULL;
+        data++;
+    }
+
+    return h;
+}
+
+/* hash the masked contents of a segment, per block and as a whole */
+static int exediff_seg_hash(struct exediff_seg * const s) {
+    const uint32_t blocks = (s->size + EXEDIFF_BLOCK - 1u) / EXEDIFF_BLOCK;
+    uint32_t b,ofs,len;
+
+    s->hash = exediff_hash(EXEDIFF_HASH_INIT,(const unsigned char*)(&s->size),NULL,sizeof(s->size));
+    if (blocks == 0)
+        return 0;
+
+    if ((s->block_hash=(uint64_t*)malloc(sizeof(uint64_t) * blocks)) == NULL)
+        return -1;
+
+    for (b=0;b < blocks;b++) {
+        ofs = b * EXEDIFF_BLOCK;
+        len = s->size - ofs;
+        if (len > EXEDIFF_BLOCK) len = EXEDIFF_BLOCK;
+
+        s->block_hash[b] = exediff_hash(EXEDIFF_HASH_INIT,s->data+ofs,s->mask+ofs,len);
+        s->hash = exediff_hash(s->hash,(const unsigned char*)(&s->block_hash[b]),NULL,sizeof(s->block_hash[b]));
+    }
+
+    return 0;
+}
+
+static int exediff_seg_alloc(struct exediff_seg * const s,const uint32_t size) {
+    s->size = size;
+    if (size == 0)
+        return 0;
+
+    s->data = (unsigned char*)calloc(size,1);
+    s->mask = (unsigned char*)calloc(size,1);
+    if (s->data == NULL || s->mask == NULL)
+        return -1;
+
+    return 0;
+}
+
+/* mark len bytes at ofs as patched. ofs can be out of range (LE fixups spanning pages) */
+static void exediff_seg_mask(struct exediff_seg * const s,const long ofs,unsigned int len) {
+    long i;
+
+    s->fixups++;
+    for (i=ofs;len != 0;i++,len--) {
+        if (i >= 0 && (unsigned long)i < (unsigned long)s->size)
+            s->mask[i] = 1;
+    }
+}
+
+static int exediff_add_export(struct exediff_module * const m,const char * const name,const unsigned int ordinal,const unsigned int segment,const unsigned long offset) {
+    struct exediff_export *e;
+
+    if (m->export_count >= m->export_alloc) {
+        unsigned int na = m->export_alloc + 256u;
+
+        if ((e=(struct exediff_export*)realloc(m->exports,sizeof(*e) * na)) == NULL)
+            return -1;
+
+        m->exports = e;
+        m->export_alloc = na;
+    }
+
+    e = m->exports + m->export_count;
+    e->name = NULL;
+    if (name != NULL && (e->name=strdup(name)) == NULL)
+        return -1;
+
+    e->ordinal = ordinal;
+    e->segment = segment;
+    e->offset = offset;
+    m->export_count++;
+    return 0;
+}
+
+static void exediff_module_name(struct exediff_module * const m,const struct exe_ne_header_name_entry_table * const t) {
+    if (t->table != NULL && t->length != 0 && ne_name_entry_get_ordinal(t,&t->table[0]) == 0)
+        ne_name_entry_get_name(m->name,sizeof(m->name),t,&t->table[0]);
+}
+
+/* look up the name of an export, or NULL */
+static const char *exediff_export_name(char * const tmp,const size_t tmpsz,const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie;
+
+    if (ordinal > 0xFFFFu || (ie=exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal)) == NULL)
+        return NULL;
+
+    ne_name_entry_get_name(tmp,tmpsz,ie->table,ie->entry);
+    return tmp;
+}
+
+static unsigned int exediff_ne_reloc_size(const unsigned char reloc_address_type) {
+    switch (reloc_address_type & EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_MASK) {
+        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET_LOBYTE:   return 1;
+        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:         return 2;
+        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR_POINTER:     return 4;
+        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:          return 2;
+        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_FAR48_POINTER:   return 6;
+        case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET32:        return 4;
+        default:                                                    break;
+    }
+
+    return 4;
+}
+
+/* mask the sites of one segment's relocations. non-additive relocations point at the first site of a
+ * linked list, with the WORD at each site giving the offset of the next, 0xFFFF at the end (see WNEDASM) */
+static void exediff_ne_mask_relocs(struct exediff_seg * const s,const struct exe_ne_header_segment_reloc_table * const relocs) {
+    const union exe_ne_header_segment_relocation_entry *relocent;
+    unsigned int i,sz,patience;
+    uint16_t site,nlink;
+
+    for (i=0;i < relocs->length;i++) {
+        relocent = relocs->table + i;
+        sz = exediff_ne_reloc_size(relocent->r.reloc_address_type);
+        site = relocent->r.seg_offset;
+        exediff_seg_mask(s,(long)site,sz);
+
+        if (relocent->r.reloc_type & EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)
+            continue;
+
+        patience = 32767; // to prevent runaway lists
+        while (((uint32_t)site + 2u) <= s->size && --patience != 0) {
+            nlink = *((uint16_t*)(s->data + site));
+            if (nlink == 0xFFFF || nlink == site) // end of the list
+                break;
+
+            site = nlink;
+            exediff_seg_mask(s,(long)site,sz);
+        }
+    }
+}
+
+static int exediff_load_ne(struct exediff_module * const m,struct exe_ne_image * const img) {
+    const struct exe_ne_header_entry_table_table *et;
+    struct exe_ne_header_segment_table *segs;
+    struct exe_ne_header_name_ordinal_index ordinals;
+    struct exe_ne_header_segment_reloc_table relocs;
+    const struct exe_ne_header_segment_entry *se;
+    const struct exe_ne_header_entry_table_entry *ent;
+    struct exediff_seg *s;
+    unsigned char *p,own;
+    unsigned long ofs,have;
+    unsigned int i;
+    char tmp[255+1];
+
+    m->format = "NE";
+    m->seg_noun = "Segment";
+    m->seg_nouns = "segments";
+    exediff_module_name(m,exe_ne_image_resident_names(img));
+
+    segs = exe_ne_image_segment_table(img);
+    if (segs->table != NULL && segs->length != 0) {
+        if ((m->segs=(struct exediff_seg*)calloc(segs->length,sizeof(*(m->segs)))) == NULL)
+            return -1;
+        m->seg_count = segs->length;
+    }
+
+    exe_ne_header_segment_reloc_table_init(&relocs);
+    for (i=0;i < m->seg_count;i++) {
+        se = segs->table + i;
+        s = m->segs + i;
+        s->flags = se->flags;
+        s->alloc = (se->minimum_allocation_size == 0) ? 0x10000ul : se->minimum_allocation_size;
+
+        if (se->offset_in_segments != 0) {
+            /* length == 0 is 64KB if there is data */
+            if (exediff_seg_alloc(s,(se->length == 0) ? 0x10000ul : se->length) < 0)
+                return -1;
+
+            ofs = (unsigned long)se->offset_in_segments << (unsigned long)segs->sector_shift;
+            have = 0;
+            if (ofs < (unsigned long)img->file_size) {
+                have = (unsigned long)img->file_size - ofs;
+                if (have > s->size) have = s->size;
+            }
+            if (have != 0 && (p=exe_ne_image_get(img,ofs,(size_t)have,&own)) != NULL) {
+                memcpy(s->data,p,(size_t)have);
+                exe_ne_image_put(p,own);
+            }
+
+            if ((se->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_RELOCATIONS) &&
+                exe_ne_image_segment_relocs(img,exe_ne_header_segment_table_get_relocation_table_offset(segs,se),&relocs) > 0 &&
+                relocs.table != NULL) {
+                exediff_ne_mask_relocs(s,&relocs);
+            }
+            exe_ne_header_segment_reloc_table_free(&relocs);
+        }
+
+        if (exediff_seg_hash(s) < 0)
+            return -1;
+    }
+
+    exe_ne_header_name_ordinal_index_init(&ordinals);
+    exe_ne_header_name_ordinal_index_build(&ordinals,exe_ne_image_resident_names(img),exe_ne_image_nonresident_names(img));
+
+    et = exe_ne_image_entry_table(img);
+    for (i=0;et->table != NULL && i < et->length;i++) { /* ordinal is i + 1 */
+        const char *name = exediff_export_name(tmp,sizeof(tmp),&ordinals,i + 1);
+        unsigned char *rawd;
+        int r;
+
+        ent = et->table + i;
+        if (ent->segment_id == 0x00) continue;
+        if ((rawd=exe_ne_header_entry_table_table_raw_entry(et,ent)) == NULL) continue;
+
+        if (ent->segment_id == 0xFF) {
+            const struct exe_ne_header_entry_table_movable_segment_entry *ment =
+                (const struct exe_ne_header_entry_table_movable_segment_entry*)rawd;
+
+            r = exediff_add_export(m,name,i + 1,ment->segid,ment->seg_offs);
+        }
+        else {
+            const struct exe_ne_header_entry_table_fixed_segment_entry *fent =
+                (const struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
+
+            if (ent->segment_id == 0xFE)
+                r = exediff_add_export(m,name,i + 1,0,fent->v.const_value);
+            else
+                r = exediff_add_export(m,name,i + 1,ent->segment_id,fent->v.seg_offs);
+        }
+
+        if (r < 0) {
+            exe_ne_header_name_ordinal_index_free(&ordinals);
+            return -1;
+        }
+    }
+
+    exe_ne_header_name_ordinal_index_free(&ordinals);
+    return 0;
+}
+
+static unsigned int exediff_le_fixup_size(const unsigned char src) {
+    switch (src & 0xF) {
+        case 0x0:   return 1;   /* byte */
+        case 0x2:   return 2;   /* 16-bit selector */
+        case 0x3:   return 4;   /* 16:16 pointer */
+        case 0x5:   return 2;   /* 16-bit offset */
+        case 0x6:   return 6;   /* 16:32 pointer */
+        case 0x7:   return 4;   /* 32-bit offset */
+        case 0x8:   return 4;   /* 32-bit self-relative offset */
+        default:    break;
+    }
+
+    return 4;
+}
+
+/* mask the sites of the fixups of one page, at pofs within the object */
+static void exediff_le_mask_fixups(struct exediff_seg * const s,struct le_header_fixup_record_table * const frtable,const long pofs) {
+    const unsigned char *raw;
+    unsigned int ti,sz,c;
+    size_t rawlen;
+    unsigned char src;
+
+    for (ti=0;ti < (unsigned int)frtable->length;ti++) {
+        raw = le_header_fixup_record_table_get_raw_entry(frtable,ti);
+        rawlen = le_header_fixup_record_table_get_raw_entry_length(frtable,ti);
+        if (raw == NULL || rawlen < 4) continue;
+
+        src = raw[0];
+        sz = exediff_le_fixup_size(src);
+        if (src & 0x20) {
+            /* count of source offsets, the list of which is at the end of the record */
+            c = raw[2];
+            if (((size_t)c * 2u) + 3u > rawlen) continue;
+
+            raw += rawlen - ((size_t)c * 2u);
+            while (c-- != 0) {
+                exediff_seg_mask(s,pofs + (long)(*((int16_t*)raw)),sz);
+                raw += 2;
+            }
+        }
+        else {
+            exediff_seg_mask(s,pofs + (long)(*((int16_t*)(raw+2))),sz);
+        }
+    }
+}
+
+static int exediff_load_le(struct exediff_module * const m,struct exe_ne_image * const img,const uint16_t signature) {
+    const struct exe_le_header_parseinfo_object_page_table_entry *pageent;
+    const struct exe_le_header_object_table_entry *o;
+    struct exe_ne_header_name_ordinal_index ordinals;
+    struct le_header_parseinfo le_parser;
+    struct exe_le_header *h;
+    struct exediff_seg *s;
+    unsigned long hofs;
+    uint32_t pg,pn,len;
+    unsigned int i;
+    char tmp[255+1];
+    int ret = -1;
+
+    m->format = (signature == EXE_LX_SIGNATURE) ? "LX" : "LE";
+    m->seg_noun = "Object";
+    m->seg_nouns = "objects";
+
+    le_header_parseinfo_init(&le_parser);
+    le_parser.file_image = img->map;
+    le_parser.file_image_size = img->file_size;
+    le_parser.le_header_offset = hofs = (unsigned long)img->ne_header_offset;
+    h = &le_parser.le_header;
+
+    if (le_parser_file_read(&le_parser,img->fd,hofs,h,sizeof(*h)) != (int)sizeof(*h))
+        goto done;
+    if (h->memory_page_size == 0 || h->memory_page_size > 0x10000ul)
+        goto done;
+
+    if (h->offset_of_object_table != 0 && h->object_table_entries != 0 && h->object_table_entries <= 0xFFFFu) {
+        unsigned char *base = le_header_parseinfo_alloc_object_table(&le_parser);
+        size_t readlen = le_header_parseinfo_get_object_table_buffer_size(&le_parser);
+
+        if (base != NULL && le_parser_file_read(&le_parser,img->fd,h->offset_of_object_table + hofs,base,readlen) != (int)readlen)
+            le_header_parseinfo_free_object_table(&le_parser);
+    }
+
+    if (h->object_page_map_offset != 0 && h->number_of_memory_pages != 0) {
+        unsigned char *base = le_header_parseinfo_alloc_object_page_map_table(&le_parser);
+        size_t readlen = le_header_parseinfo_get_object_page_map_table_read_buffer_size(&le_parser);
+
+        if (base != NULL && le_parser_file_read(&le_parser,img->fd,h->object_page_map_offset + hofs,base,readlen) != (int)readlen)
+            le_header_parseinfo_free_object_page_map_table(&le_parser);
+
+        /* "finish" reading by having the library convert the data in-place */
+        if (le_parser.le_object_page_map_table != NULL)
+            le_header_parseinfo_finish_read_get_object_page_map_table(&le_parser);
+    }
+
+    if (h->fixup_page_table_offset != 0 && h->number_of_memory_pages != 0) {
+        unsigned char *base = le_header_parseinfo_alloc_fixup_page_table(&le_parser);
+        size_t readlen = le_header_parseinfo_get_fixup_page_table_buffer_size(&le_parser);
+
+        if (base != NULL) {
+            if (le_parser_file_read(&le_parser,img->fd,h->fixup_page_table_offset + hofs,base,readlen) != (int)readlen)
+                le_header_parseinfo_free_fixup_page_table(&le_parser);
+
+            le_header_parseinfo_fixup_record_list_setup_prepare_from_page_table(&le_parser);
+        }
+    }
+
+    if (le_parser.le_fixup_records.table != NULL) {
+        struct le_header_fixup_record_table *frtable;
+        unsigned char *base;
+
+        for (i=0;i < le_parser.le_fixup_records.length;i++) {
+            frtable = le_parser.le_fixup_records.table + i;
+            if (frtable->file_length == 0) continue;
+
+            base = le_header_fixup_record_table_alloc_raw(frtable,frtable->file_length);
+            if (base == NULL) continue;
+
+            if (le_parser_file_read(&le_parser,img->fd,frtable->file_offset,base,frtable->file_length) != (int)frtable->file_length)
+                le_header_fixup_record_table_free_raw(frtable);
+
+            if (frtable->raw != NULL)
+                le_header_fixup_record_table_parse(frtable);
+        }
+    }
+
+    /* resident names run up to the entry table, the nonresident name table offset is from the start of the file */
+    if (h->resident_names_table_offset != 0 && h->entry_table_offset > h->resident_names_table_offset) {
+        uint32_t sz = h->entry_table_offset - h->resident_names_table_offset;
+        unsigned char *base = exe_ne_header_name_entry_table_alloc_raw(&le_parser.le_resident_names,sz);
+
+        if (base != NULL && le_parser_file_read(&le_parser,img->fd,h->resident_names_table_offset + hofs,base,sz) != (int)sz)
+            exe_ne_header_name_entry_table_free_raw(&le_parser.le_resident_names);
+
+        exe_ne_header_name_entry_table_parse_raw(&le_parser.le_resident_names);
+    }
+    if (h->nonresident_names_table_offset != 0 && h->nonresident_names_table_length != 0) {
+        uint32_t sz = h->nonresident_names_table_length;
+        unsigned char *base = exe_ne_header_name_entry_table_alloc_raw(&le_parser.le_nonresident_names,sz);
+
+        if (base != NULL && le_parser_file_read(&le_parser,img->fd,h->nonresident_names_table_offset,base,sz) != (int)sz)
+            exe_ne_header_name_entry_table_free_raw(&le_parser.le_nonresident_names);
+
+        exe_ne_header_name_entry_table_parse_raw(&le_parser.le_nonresident_names);
+    }
+    exediff_module_name(m,&le_parser.le_resident_names);
+
+    if (h->entry_table_offset != 0) {
+        uint32_t readlen = le_exe_header_entry_table_size(h);
+        unsigned char *base = le_header_entry_table_alloc(&le_parser.le_entry_table,readlen);
+
+        if (base != NULL && le_parser_file_read(&le_parser,img->fd,h->entry_table_offset + hofs,base,readlen) != (int)readlen)
+            le_header_entry_table_free(&le_parser.le_entry_table);
+
+        if (le_parser.le_entry_table.raw != NULL)
+            le_header_entry_table_parse(&le_parser.le_entry_table);
+    }
+
+    /* objects, from their pages */
+    if (le_parser.le_object_table != NULL && h->object_table_entries != 0) {
+        if ((m->segs=(struct exediff_seg*)calloc(h->object_table_entries,sizeof(*(m->segs)))) == NULL)
+            goto done;
+        m->seg_count = h->object_table_entries;
+    }
+
+    for (i=0;i < m->seg_count;i++) {
+        o = le_parser.le_object_table + i;
+        s = m->segs + i;
+        s->flags = o->object_flags;
+        s->alloc = o->virtual_segment_size;
+
+        if (le_parser.le_object_page_map_table != NULL && o->page_map_entries != 0 &&
+            o->page_map_index != 0 && o->page_map_index <= h->number_of_memory_pages &&
+            o->page_map_entries <= (h->number_of_memory_pages + 1u - o->page_map_index)) {
+            if (exediff_seg_alloc(s,o->page_map_entries * h->memory_page_size) < 0)
+                goto done;
+
+            for (pg=0;pg < o->page_map_entries;pg++) {
+                pn = o->page_map_index + pg; /* 1-based */
+                pageent = le_parser.le_object_page_map_table + pn - 1u;
+                len = pageent->data_size;
+                if (len > h->memory_page_size) len = h->memory_page_size;
+
+                if (len != 0)
+                    le_parser_file_read(&le_parser,img->fd,pageent->page_data_offset,s->data + (pg * h->memory_page_size),(size_t)len);
+                if (le_parser.le_fixup_records.table != NULL && (pn - 1u) < le_parser.le_fixup_records.length)
+                    exediff_le_mask_fixups(s,le_parser.le_fixup_records.table + pn - 1u,(long)(pg * h->memory_page_size));
+            }
+        }
+
+        if (exediff_seg_hash(s) < 0)
+            goto done;
+    }
+
+    exe_ne_header_name_ordinal_index_init(&ordinals);
+    exe_ne_header_name_ordinal_index_build(&ordinals,&le_parser.le_resident_names,&le_parser.le_nonresident_names);
+
+    for (i=0;le_parser.le_entry_table.table != NULL && i < le_parser.le_entry_table.length;i++) { /* ordinal is i + 1 */
+        const struct le_header_entry_table_entry * const ent = le_parser.le_entry_table.table + i;
+        const char *name = exediff_export_name(tmp,sizeof(tmp),&ordinals,i + 1);
+        const unsigned char *raw;
+        unsigned long offset = 0;
+
+        if (ent->type == 0) continue;
+        if ((raw=le_header_entry_table_get_raw_entry(&le_parser.le_entry_table,i)) == NULL) continue;
+
+        /* parser makes sure the flags byte and offset are there for these types */
+        if (ent->type == 1 || ent->type == 2)
+            offset = *((const uint16_t*)(raw+1));
+        else if (ent->type == 3)
+            offset = *((const uint32_t*)(raw+1));
+
+        if (exediff_add_export(m,name,i + 1,(ent->type >= 1 && ent->type <= 3) ? ent->object : 0,offset) < 0) {
+            exe_ne_header_name_ordinal_index_free(&ordinals);
+            goto done;
+        }
+    }
+
+    exe_ne_header_name_ordinal_index_free(&ordinals);
+    ret = 0;
+done:
+    le_header_parseinfo_free(&le_parser);
+    return ret;
+}
+
+static int exediff_load(struct exediff_module * const m,const char * const path) {
+    struct exe_ne_image img;
+    unsigned char *p,own;
+    uint16_t sig;
+    int fd,r;
+
+    m->path = path;
+    if ((fd=open(path,O_RDONLY|O_BINARY)) < 0) {
+        fprintf(stderr,"Unable to open '%s', %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    exe_ne_image_init(&img);
+    if ((r=exe_ne_image_open_fd(&img,fd)) < 0) {
+        fprintf(stderr,"%s: %s\n",path,exe_ne_image_error_str(r));
+        exe_ne_image_free(&img);
+        close(fd);
+        return -1;
+    }
+
+    r = exe_ne_image_read_ne_header(&img);
+
+    /* not NE, but there is an extension header. LE or LX? */
+    sig = 0;
+    if (r == EXE_NE_IMAGE_ERR_NOT_NE && (p=exe_ne_image_get(&img,img.ne_header_offset,2,&own)) != NULL) {
+        sig = *((uint16_t*)p);
+        exe_ne_image_put(p,own);
+    }
+
+    if (r == 0) {
+        r = exediff_load_ne(m,&img);
+    }
+    else if (sig == EXE_LE_SIGNATURE || sig == EXE_LX_SIGNATURE) {
+        r = exediff_load_le(m,&img,sig);
+    }
+    else {
+        fprintf(stderr,"%s: %s\n",path,r < 0 ? exe_ne_image_error_str(r) : "Not an NE or LE/LX image");
+        r = -1;
+    }
+
+    if (r < 0 && m->format != NULL)
+        fprintf(stderr,"%s: Unable to load %s image\n",path,m->format);
+
+    exe_ne_image_free(&img);
+    close(fd);
+    return r;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* segment hash to index, open addressing */
+struct exediff_seg_index {
+    unsigned int*               table;              /* [alloc] segment index + 1, 0 if empty */
+    unsigned int                alloc;              /* power of 2 */
+};
+
+static void exediff_seg_index_build(struct exediff_seg_index * const x,const struct exediff_module * const m) {
+    unsigned int i,h;
+
+    x->table = NULL;
+    x->alloc = 16;
+    while (x->alloc < (m->seg_count * 2u)) x->alloc *= 2u;
+    if ((x->table=(unsigned int*)calloc(x->alloc,sizeof(unsigned int))) == NULL)
+        return;
+
+    for (i=0;i < m->seg_count;i++) {
+        if (m->segs[i].size == 0) continue;
+
+        h = (unsigned int)m->segs[i].hash & (x->alloc - 1u);
+        while (x->table[h] != 0) h = (h + 1u) & (x->alloc - 1u);
+        x->table[h] = i + 1u;
+    }
+}
+
+/* another segment in m with the same contents as s, or -1 */
+static int exediff_seg_index_lookup(const struct exediff_seg_index * const x,const struct exediff_module * const m,const struct exediff_seg * const s) {
+    unsigned int h;
+
+    if (x->table == NULL || s->size == 0)
+        return -1;
+
+    h = (unsigned int)s->hash & (x->alloc - 1u);
+    while (x->table[h] != 0) {
+        const struct exediff_seg * const c = m->segs + x->table[h] - 1u;
+
+        if (c->hash == s->hash && c->size == s->size)
+            return (int)(x->table[h] - 1u);
+
+        h = (h + 1u) & (x->alloc - 1u);
+    }
+
+    return -1;
+}
+
+static void exediff_show_bytes(const char * const what,const struct exediff_seg * const s,const uint32_t ofs,const uint32_t len) {
+    uint32_t i;
+
+    printf("            %s:",what);
+    for (i=0;i < len && i < EXEDIFF_SHOW_BYTES;i++) {
+        if ((ofs + i) >= s->size)
+            printf(" --");
+        else if (s->mask[ofs + i])
+            printf(" ..");
+        else
+            printf(" %02X",s->data[ofs + i]);
+    }
+    if (len > EXEDIFF_SHOW_BYTES) printf(" ...");
+    printf("\n");
+}
+
+static void exediff_show_range(const struct exediff_seg * const a,const struct exediff_seg * const b,const uint32_t start,const uint32_t end) {
+    if (opt_summary) return;
+
+    printf("        0x%08lX-0x%08lX: %lu bytes\n",(unsigned long)start,(unsigned long)end - 1ul,(unsigned long)(end - start));
+    if (opt_verbose) {
+        exediff_show_bytes("old",a,start,end - start);
+        exediff_show_bytes("new",b,start,end - start);
+    }
+}
+
+/* compare segment contents, print changed ranges. returns number of changed bytes */
+static unsigned long exediff_compare_seg_data(const struct exediff_seg * const a,const struct exediff_seg * const b,unsigned long * const ranges,unsigned long * const skipped) {
+    const uint32_t common = (a->size < b->size) ? a->size : b->size;
+    unsigned long changed = 0;
+    uint32_t ofs,end,bl,x;
+    uint32_t rstart = 0;
+    int inrange = 0;
+    int diff;
+
+    for (ofs=0;ofs < common;ofs=end) {
+        bl = ofs / EXEDIFF_BLOCK;
+        end = ofs + EXEDIFF_BLOCK;
+        if (end > common) end = common;
+
+        /* whole block within both and the same masked contents: nothing to look at */
+        if ((end - ofs) == EXEDIFF_BLOCK && a->block_hash[bl] == b->block_hash[bl]) {
+            if (inrange) {
+                exediff_show_range(a,b,rstart,ofs);
+                inrange = 0;
+            }
+            (*skipped)++;
+            continue;
+        }
+
+        for (x=ofs;x < end;x++) {
+            /* a byte patched in either file is not compared */
+            diff = !a->mask[x] && !b->mask[x] && a->data[x] != b->data[x];
+            if (diff) {
+                changed++;
+                if (!inrange) {
+                    rstart = x;
+                    inrange = 1;
+                    (*ranges)++;
+                }
+            }
+            else if (inrange) {
+                exediff_show_range(a,b,rstart,x);
+                inrange = 0;
+            }
+        }
+    }
+
+    if (inrange)
+        exediff_show_range(a,b,rstart,common);
+
+    /* the rest of the longer one */
+    if (a->size != b->size) {
+        end = (a->size > b->size) ? a->size : b->size;
+        changed += (unsigned long)(end - common);
+        (*ranges)++;
+        exediff_show_range(a,b,common,end);
+    }
+
+    return changed;
+}
+
+/* returns nonzero if the segments differ */
+static int exediff_compare_segs(const struct exediff_module * const a,const struct exediff_module * const b) {
+    const unsigned int count = (a->seg_count > b->seg_count) ? a->seg_count : b->seg_count;
+    struct exediff_seg_index ai,bi;
+    unsigned long total_changed = 0,blocks_skipped = 0;
+    unsigned int i,changed_segs = 0,same_segs = 0;
+    int j;
+
+    exediff_seg_index_build(&ai,a);
+    exediff_seg_index_build(&bi,b);
+
+    for (i=0;i < count;i++) {
+        const struct exediff_seg * const sa = (i < a->seg_count) ? (a->segs + i) : NULL;
+        const struct exediff_seg * const sb = (i < b->seg_count) ? (b->segs + i) : NULL;
+        unsigned long changed,ranges = 0;
+
+        if (sa == NULL) {
+            printf("%s %u: added, %lu bytes",b->seg_noun,i + 1u,(unsigned long)sb->size);
+            if ((j=exediff_seg_index_lookup(&ai,a,sb)) >= 0)
+                printf(", same contents as old %s %d",a->seg_noun,j + 1);
+            printf("\n");
+            changed_segs++;
+            continue;
+        }
+        if (sb == NULL) {
+            printf("%s %u: removed, %lu bytes",a->seg_noun,i + 1u,(unsigned long)sa->size);
+            if ((j=exediff_seg_index_lookup(&bi,b,sa)) >= 0)
+                printf(", same contents as new %s %d",b->seg_noun,j + 1);
+            printf("\n");
+            changed_segs++;
+            continue;
+        }
+
+        /* same masked contents, same size */
+        if (sa->size == sb->size && sa->hash == sb->hash) {
+            printf("%s %u: identical, %lu bytes",a->seg_noun,i + 1u,(unsigned long)sa->size);
+            if (sa->fixups != sb->fixups)
+                printf(", fixups %lu -> %lu",sa->fixups,sb->fixups);
+            if (sa->flags != sb->flags || sa->alloc != sb->alloc)
+                printf(", flags 0x%lx -> 0x%lx, alloc 0x%lx -> 0x%lx",(unsigned long)sa->flags,(unsigned long)sb->flags,(unsigned long)sa->alloc,(unsigned long)sb->alloc);
+            printf("\n");
+            same_segs++;
+            continue;
+        }
+
+        printf("%s %u: size 0x%lx -> 0x%lx, alloc 0x%lx -> 0x%lx, flags 0x%lx -> 0x%lx, fixups %lu -> %lu",a->seg_noun,i + 1u,
+            (unsigned long)sa->size,(unsigned long)sb->size,(unsigned long)sa->alloc,(unsigned long)sb->alloc,
+            (unsigned long)sa->flags,(unsigned long)sb->flags,sa->fixups,sb->fixups);
+        if ((j=exediff_seg_index_lookup(&ai,a,sb)) >= 0)
+            printf(", same contents as old %s %d",a->seg_noun,j + 1);
+        printf("\n");
+
+        changed = exediff_compare_seg_data(sa,sb,&ranges,&blocks_skipped);
+        printf("    %lu bytes changed in %lu ranges\n",changed,ranges);
+        if (changed != 0) {
+            total_changed += changed;
+            changed_segs++;
+        }
+        else {
+            same_segs++;
+        }
+    }
+
+    printf("* %u %s unchanged, %u changed, %lu bytes changed, %lu identical blocks skipped\n",
+        same_segs,a->seg_nouns,changed_segs,total_changed,blocks_skipped);
+
+    if (ai.table) free(ai.table);
+    if (bi.table) free(bi.table);
+    return changed_segs != 0;
+}
+
+/* exports sort by name, exports without one after them by ordinal */
+static int exediff_export_cmp(const void *pa,const void *pb) {
+    const struct exediff_export *a = (const struct exediff_export*)pa;
+    const struct exediff_export *b = (const struct exediff_export*)pb;
+
+    if (a->name != NULL && b->name != NULL)
+        return strcmp(a->name,b->name);
+    if (a->name != NULL)
+        return -1;
+    if (b->name != NULL)
+        return 1;
+
+    if (a->ordinal < b->ordinal) return -1;
+    if (a->ordinal > b->ordinal) return 1;
+    return 0;
+}
+
+static void exediff_print_export(const char * const what,const struct exediff_export * const e) {
+    printf("    %s ",what);
+    if (e->name != NULL) printf("%s ",e->name);
+    printf("@%u",e->ordinal);
+    if (e->segment != 0) printf(" %u:0x%lX",e->segment,e->offset);
+    else printf(" =0x%lX",e->offset);
+}
+
+/* returns nonzero if the exports differ */
+static int exediff_compare_exports(struct exediff_module * const a,struct exediff_module * const b) {
+    unsigned int added = 0,removed = 0,changed = 0;
+    unsigned int ia = 0,ib = 0;
+    int c;
+
+    if (a->export_count > 1) qsort(a->exports,a->export_count,sizeof(*(a->exports)),exediff_export_cmp);
+    if (b->export_count > 1) qsort(b->exports,b->export_count,sizeof(*(b->exports)),exediff_export_cmp);
+
+    printf("Exports:\n");
+    while (ia < a->export_count || ib < b->export_count) {
+        const struct exediff_export * const ea = (ia < a->export_count) ? (a->exports + ia) : NULL;
+        const struct exediff_export * const eb = (ib < b->export_count) ? (b->exports + ib) : NULL;
+
+        if (ea == NULL) c = 1;
+        else if (eb == NULL) c = -1;
+        else c = exediff_export_cmp(ea,eb);
+
+        if (c < 0) {
+            exediff_print_export("-",ea);
+            printf("\n");
+            removed++;
+            ia++;
+        }
+        else if (c > 0) {
+            exediff_print_export("+",eb);
+            printf("\n");
+            added++;
+            ib++;
+        }
+        else {
+            if (ea->ordinal != eb->ordinal || ea->segment != eb->segment || ea->offset != eb->offset) {
+                exediff_print_export("~",ea);
+                printf(" ->");
+                if (ea->ordinal != eb->ordinal) printf(" @%u",eb->ordinal);
+                if (eb->segment != 0) printf(" %u:0x%lX",eb->segment,eb->offset);
+                else printf(" =0x%lX",eb->offset);
+                printf("\n");
+                changed++;
+            }
+            ia++;
+            ib++;
+        }
+    }
+
+    printf("* Exports: %u old, %u new, %u added, %u removed, %u changed\n",
+        a->export_count,b->export_count,added,removed,changed);
+    return (added + removed + changed) != 0;
+}
+
+int main(int argc,char **argv) {
+    struct exediff_module a,b;
+    int differ = 0;
+    char *s;
+    int i;
+
+    for (i=1;i < argc;) {
+        s = argv[i++];
+
+        if (*s == '-') {
+            do { s++; } while (*s == '-');
+
+            if (!strcmp(s,"h") || !strcmp(s,"help")) {
+                help();
+                return 2;
+            }
+            else if (!strcmp(s,"a")) {
+                old_file = argv[i++];
+                if (old_file == NULL) return 2;
+            }
+            else if (!strcmp(s,"b")) {
+                new_file = argv[i++];
+                if (new_file == NULL) return 2;
+            }
+            else if (!strcmp(s,"s")) {
+                opt_summary = 1;
+            }
+            else if (!strcmp(s,"v")) {
+                opt_verbose = 1;
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",s);
+                return 2;
+            }
+        }
+        else {
+            fprintf(stderr,"Unknown switch %s\n",s);
+            return 2;
+        }
+    }
+
+    if (old_file == NULL || new_file == NULL) {
+        fprintf(stderr,"Need both an old (-a) and a new (-b) file\n");
+        return 2;
+    }
+
+    exediff_module_init(&a);
+    exediff_module_init(&b);
+    if (exediff_load(&a,old_file) < 0 || exediff_load(&b,new_file) < 0) {
+        exediff_module_free(&a);
+        exediff_module_free(&b);
+        return 2;
+    }
+
+    printf("Old: %s, %s '%s', %u %s, %u exports\n",a.path,a.format,a.name,a.seg_count,a.seg_nouns,a.export_count);
+    printf("New: %s, %s '%s', %u %s, %u exports\n",b.path,b.format,b.name,b.seg_count,b.seg_nouns,b.export_count);
+    if (strcmp(a.format,b.format) != 0 && !(a.format[0] == 'L' && b.format[0] == 'L')) {
+        fprintf(stderr,"Cannot compare %s to %s\n",a.format,b.format);
+        exediff_module_free(&a);
+        exediff_module_free(&b);
+        return 2;
+    }
+    if (strcmp(a.name,b.name) != 0) {
+        printf("Module name: '%s' -> '%s'\n",a.name,b.name);
+        differ = 1;
+    }
+
+    if (exediff_compare_segs(&a,&b)) differ = 1;
+    if (exediff_compare_exports(&a,&b)) differ = 1;
+
+    exediff_module_free(&a);
+    exediff_module_free(&b);
+    return differ;
+}
+
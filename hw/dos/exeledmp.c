@@ -57,6 +57,7 @@
 #include <hw/dos/exenepar.h>
 #include <hw/dos/exelehdr.h>
 #include <hw/dos/exelepar.h>
+#include <hw/dos/exew3par.h>
 
 #ifndef O_BINARY
 #define O_BINARY (0)
@@ -66,10 +67,16 @@ static uint32_t                 load_base = 0x00400000;
 
 static unsigned char            opt_sort_ordinal = 0;
 static unsigned char            opt_sort_names = 0;
+static unsigned char            opt_verbose = 0;
 
 static char*                    src_file = NULL;
+static char*                    src_w3_name = NULL;
 static int                      src_fd = -1;
 
+static struct exe_w3_image      src_w3;
+static unsigned char*           src_w3_le = NULL;
+static uint32_t                 src_w3_le_size = 0;
+
 static struct exe_dos_header    exehdr;
 static struct exe_dos_layout    exelayout;
 
@@ -78,41 +85,24 @@ static void help(void) {
     fprintf(stderr," -sn        Sort names\n");
     fprintf(stderr," -so        Sort by ordinal\n");
     fprintf(stderr," -b <a>     Load base\n");
+    fprintf(stderr," -w3 <name> Dump VxD <name> from the W3/W4 container (WIN386.EXE, VMM32.VXD) given by -i\n");
+    fprintf(stderr," -v         Verbose (page cache statistics)\n");
 }
 
-void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
+void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie;
     char tmp[255+1];
-    unsigned int i;
-
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
-
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
-                printf(" RESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
-    }
 
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
+    if (ordinal > 0xFFFFu) return;
+    if ((ie=exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal)) == NULL) return;
 
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
-                printf(" NONRESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
-    }
+    ne_name_entry_get_name(tmp,sizeof(tmp),ie->table,ie->entry);
+    printf(" %s NAME '%s' ",ie->resident ? "RESIDENT" : "NONRESIDENT",tmp);
 }
 
 void name_entry_table_sort_by_user_options(struct exe_ne_header_name_entry_table * const t) {
     unsigned int first = 0;
 
-    ne_name_entry_sort_by_table = t;
     if (t->raw == NULL || t->length <= 1)
         return;
 
@@ -121,11 +111,11 @@ void name_entry_table_sort_by_user_options(struct exe_ne_header_name_entry_table
 
     if (opt_sort_ordinal) {
         /* NTS: Do not sort the module name in entry 0 IF first entry is zero */
-        qsort(t->table+first,t->length-first,sizeof(*(t->table)),ne_name_entry_sort_by_ordinal);
+        exe_ne_header_name_entry_table_sort(t,first,ne_name_entry_compare_by_ordinal);
     }
     else if (opt_sort_names) {
         /* NTS: Do not sort the module name in entry 0 IF first entry is zero */
-        qsort(t->table+first,t->length-first,sizeof(*(t->table)),ne_name_entry_sort_by_name);
+        exe_ne_header_name_entry_table_sort(t,first,ne_name_entry_compare_by_name);
     }
 }
 
@@ -182,11 +172,18 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"so")) {
                 opt_sort_ordinal = 1;
             }
+            else if (!strcmp(a,"v")) {
+                opt_verbose = 1;
+            }
             else if (!strcmp(a,"b")) {
                 a = argv[i++];
                 if (a == NULL) return 1;
                 load_base = (uint32_t)strtoul(a,NULL,0);
             }
+            else if (!strcmp(a,"w3")) {
+                src_w3_name = argv[i++];
+                if (src_w3_name == NULL) return 1;
+            }
             else if (!strcmp(a,"i")) {
                 src_file = argv[i++];
                 if (src_file == NULL) return 1;
@@ -218,7 +215,31 @@ int main(int argc,char **argv) {
     file_size = lseek(src_fd,0,SEEK_END);
     lseek(src_fd,0,SEEK_SET);
 
-    if (read(src_fd,&exehdr,sizeof(exehdr)) != (int)sizeof(exehdr)) {
+    /* dump a VxD within the W3 container, rebuilt in memory as a standalone file */
+    exe_w3_image_init(&src_w3);
+    if (src_w3_name != NULL) {
+        const struct exe_w3_image_dir_entry *ent;
+        int err;
+
+        if ((err=exe_w3_image_open_fd(&src_w3,src_fd)) < 0) {
+            fprintf(stderr,"W3 container: %s\n",exe_w3_image_error_str(err));
+            return 1;
+        }
+        if ((ent=exe_w3_image_lookup(&src_w3,src_w3_name)) == NULL) {
+            fprintf(stderr,"VxD '%s' not found in W3 container\n",src_w3_name);
+            return 1;
+        }
+        if ((src_w3_le=exe_w3_image_extract_le(&src_w3,ent,&src_w3_le_size)) == NULL) {
+            fprintf(stderr,"Unable to extract VxD '%s' from W3 container\n",ent->name);
+            return 1;
+        }
+
+        le_parser.file_image = src_w3_le;
+        le_parser.file_image_size = src_w3_le_size;
+        file_size = src_w3_le_size;
+    }
+
+    if (le_parser_file_read(&le_parser,src_fd,0,&exehdr,sizeof(exehdr)) != (int)sizeof(exehdr)) {
         fprintf(stderr,"EXE header read error\n");
         return 1;
     }
@@ -287,8 +308,7 @@ int main(int argc,char **argv) {
     }
 
     /* go read the extension */
-    if (lseek(src_fd,EXE_HEADER_EXTENSION_OFFSET,SEEK_SET) != EXE_HEADER_EXTENSION_OFFSET ||
-        read(src_fd,&le_header_offset,4) != 4) {
+    if (le_parser_file_read(&le_parser,src_fd,EXE_HEADER_EXTENSION_OFFSET,&le_header_offset,4) != 4) {
         fprintf(stderr,"Cannot read extension\n");
         return 1;
     }
@@ -299,8 +319,7 @@ int main(int argc,char **argv) {
     }
 
     /* go read the extended header */
-    if (lseek(src_fd,le_header_offset,SEEK_SET) != le_header_offset ||
-        read(src_fd,&le_header,sizeof(le_header)) != sizeof(le_header)) {
+    if (le_parser_file_read(&le_parser,src_fd,le_header_offset,&le_header,sizeof(le_header)) != (int)sizeof(le_header)) {
         fprintf(stderr,"Cannot read LE header\n");
         return 1;
     }
@@ -517,8 +536,7 @@ int main(int argc,char **argv) {
             printf("  * they should match the values in the DDB block.\n");
             printf("  * Windows will NOT load your driver without these fields.\n");
 
-            if ((uint32_t)lseek(src_fd,le_header_offset+EXE_HEADER_LE_HEADER_SIZE,SEEK_SET) == (uint32_t)(le_header_offset+EXE_HEADER_LE_HEADER_SIZE) &&
-                (int)read(src_fd,&vx,sizeof(vx)) == sizeof(vx)) {
+            if (le_parser_file_read(&le_parser,src_fd,le_header_offset+EXE_HEADER_LE_HEADER_SIZE,&vx,sizeof(vx)) == (int)sizeof(vx)) {
                 printf("    DDB_Req_Device_Number:          0x%04x\n",(unsigned int)vx.DDB_Req_Device_Number);
                 printf("    DDB_SDK_Version:                0x%04x\n",(unsigned int)vx.DDB_SDK_Version);
             }
@@ -530,7 +548,7 @@ int main(int argc,char **argv) {
         unsigned char *base = le_header_parseinfo_alloc_object_table(&le_parser);
         size_t readlen = le_header_parseinfo_get_object_table_buffer_size(&le_parser);
 
-        if ((unsigned long)lseek(src_fd,ofs,SEEK_SET) != ofs || (size_t)read(src_fd,base,readlen) != readlen)
+        if (le_parser_file_read(&le_parser,src_fd,ofs,base,readlen) != (int)readlen)
             le_header_parseinfo_free_object_table(&le_parser);
 
         le_header_object_table_loaded_linear_generate(&le_parser);
@@ -541,7 +559,7 @@ int main(int argc,char **argv) {
         unsigned char *base = le_header_parseinfo_alloc_object_page_map_table(&le_parser);
         size_t readlen = le_header_parseinfo_get_object_page_map_table_read_buffer_size(&le_parser);
 
-        if ((unsigned long)lseek(src_fd,ofs,SEEK_SET) != ofs || (size_t)read(src_fd,base,readlen) != readlen)
+        if (le_parser_file_read(&le_parser,src_fd,ofs,base,readlen) != (int)readlen)
             le_header_parseinfo_free_object_page_map_table(&le_parser);
 
         /* "finish" reading by having the library convert the data in-place */
@@ -558,7 +576,7 @@ int main(int argc,char **argv) {
             // NTS: This table has one extra entry, so that you can determine the size of each fixup record entry per segment
             //      by the difference between each entry. Entries in the fixup record table (and therefore the offsets in this
             //      table) numerically increase for this reason.
-            if ((unsigned long)lseek(src_fd,ofs,SEEK_SET) != ofs || (size_t)read(src_fd,base,readlen) != (size_t)readlen)
+            if (le_parser_file_read(&le_parser,src_fd,ofs,base,readlen) != (int)readlen)
                 le_header_parseinfo_free_fixup_page_table(&le_parser);
 
             le_header_parseinfo_fixup_record_list_setup_prepare_from_page_table(&le_parser);
@@ -578,8 +596,7 @@ int main(int argc,char **argv) {
             base = le_header_fixup_record_table_alloc_raw(frtable,frtable->file_length);
             if (base == NULL) continue;
 
-            if (!((unsigned long)lseek(src_fd,frtable->file_offset,SEEK_SET) == (unsigned long)frtable->file_offset &&
-                (unsigned long)read(src_fd,base,frtable->file_length) == (unsigned long)frtable->file_length))
+            if (le_parser_file_read(&le_parser,src_fd,frtable->file_offset,base,frtable->file_length) != (int)frtable->file_length)
                 le_header_fixup_record_table_free_raw(frtable);
 
             if (frtable->raw != NULL)
@@ -589,14 +606,13 @@ int main(int argc,char **argv) {
 
     /* load resident name table */
     if (le_header.resident_names_table_offset != (uint32_t)0 && le_header.entry_table_offset != (uint32_t)0 &&
-        le_header.resident_names_table_offset < le_header.entry_table_offset &&
-        (unsigned long)lseek(src_fd,le_header.resident_names_table_offset + le_header_offset,SEEK_SET) == (le_header.resident_names_table_offset + le_header_offset)) {
+        le_header.resident_names_table_offset < le_header.entry_table_offset) {
         uint32_t sz = le_header.entry_table_offset - le_header.resident_names_table_offset;
         unsigned char *base;
 
         base = exe_ne_header_name_entry_table_alloc_raw(&le_parser.le_resident_names,sz);
         if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,sz) != sz)
+            if (le_parser_file_read(&le_parser,src_fd,le_header.resident_names_table_offset + le_header_offset,base,sz) != (int)sz)
                 exe_ne_header_name_entry_table_free_raw(&le_parser.le_resident_names);
         }
 
@@ -606,13 +622,12 @@ int main(int argc,char **argv) {
 
     /* load nonresident name table */
     if (le_header.nonresident_names_table_offset != (uint32_t)0 &&
-        le_header.nonresident_names_table_length != (uint32_t)0 &&
-        (unsigned long)lseek(src_fd,le_header.nonresident_names_table_offset,SEEK_SET) == le_header.nonresident_names_table_offset) {
+        le_header.nonresident_names_table_length != (uint32_t)0) {
         unsigned char *base;
 
         base = exe_ne_header_name_entry_table_alloc_raw(&le_parser.le_nonresident_names,le_header.nonresident_names_table_length);
         if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,le_header.nonresident_names_table_length) != le_header.nonresident_names_table_length)
+            if (le_parser_file_read(&le_parser,src_fd,le_header.nonresident_names_table_offset,base,le_header.nonresident_names_table_length) != (int)le_header.nonresident_names_table_length)
                 exe_ne_header_name_entry_table_free_raw(&le_parser.le_nonresident_names);
         }
 
@@ -629,7 +644,7 @@ int main(int argc,char **argv) {
             // NTS: This table has one extra entry, so that you can determine the size of each fixup record entry per segment
             //      by the difference between each entry. Entries in the fixup record table (and therefore the offsets in this
             //      table) numerically increase for this reason.
-            if ((unsigned long)lseek(src_fd,ofs,SEEK_SET) != ofs || (size_t)read(src_fd,base,readlen) != (size_t)readlen)
+            if (le_parser_file_read(&le_parser,src_fd,ofs,base,readlen) != (int)readlen)
                 le_header_entry_table_free(&le_parser.le_entry_table);
         }
 
@@ -637,6 +652,10 @@ int main(int argc,char **argv) {
             le_header_entry_table_parse(&le_parser.le_entry_table);
     }
 
+    /* page data is read through the page cache from here on */
+    if (le_parser.le_object_page_map_table != NULL)
+        le_header_page_cache_init(&le_parser,LE_HEADER_PAGE_CACHE_DEFAULT,0);
+
     if (le_parser.le_object_table != NULL) {
         struct exe_le_header_object_table_entry *ent;
         unsigned int i;
@@ -893,10 +912,14 @@ int main(int argc,char **argv) {
     }
 
     if (le_parser.le_entry_table.table != NULL) {
+        struct exe_ne_header_name_ordinal_index ordinals;
         struct le_header_entry_table_entry *ent;
         unsigned char *raw;
         unsigned int i,mx;
 
+        exe_ne_header_name_ordinal_index_init(&ordinals);
+        exe_ne_header_name_ordinal_index_build(&ordinals,&le_parser.le_resident_names,&le_parser.le_nonresident_names);
+
         mx = le_parser.le_entry_table.length;
         printf("* Entry table, %lu entries\n",(unsigned long)mx);
 
@@ -906,7 +929,7 @@ int main(int argc,char **argv) {
             if (raw == NULL) continue;
 
             printf("    Ordinal #%u: ",i + 1);
-            print_entry_table_locate_name_by_ordinal(&le_parser.le_nonresident_names,&le_parser.le_resident_names,i + 1);
+            print_entry_table_locate_name_by_ordinal(&ordinals,i + 1);
             if (ent->type == 0)
                 printf("empty\n");
             else if (ent->type == 2) {
@@ -945,6 +968,8 @@ int main(int argc,char **argv) {
                 printf("unknown type %02x\n",ent->type);
             }
         }
+
+        exe_ne_header_name_ordinal_index_free(&ordinals);
     }
 
     {
@@ -1033,7 +1058,14 @@ int main(int argc,char **argv) {
         }
     }
 
+    if (opt_verbose && le_parser.le_page_cache.entries != NULL)
+        printf("* Page cache: %lu pages, %lu hits, %lu misses\n",
+                (unsigned long)le_parser.le_page_cache.count,
+                le_parser.le_page_cache.hits,le_parser.le_page_cache.misses);
+
     le_header_parseinfo_free(&le_parser);
+    if (src_w3_le != NULL) free(src_w3_le);
+    exe_w3_image_free(&src_w3);
     close(src_fd);
     return 0;
 }
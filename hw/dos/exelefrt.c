@@ -29,6 +29,9 @@ void le_header_fixup_record_table_free_raw(struct le_header_fixup_record_table *
 }
 
 void le_header_fixup_record_table_free_table(struct le_header_fixup_record_table *t) {
+    if (t->index) free(t->index);
+    t->index = NULL;
+    t->index_length = 0;
     if (t->table) free(t->table);
     t->table = NULL;
     t->length = 0;
@@ -110,6 +113,115 @@ int le_header_fixup_record_list_alloc(struct le_header_fixup_record_list *l,cons
     return 0;
 }
 
+/* decode the records found by the parser into one entry per source offset, sorted by source offset.
+ * the sort is stable so that fixups to the same source offset are still applied in file order. */
+static void le_header_fixup_record_table_build_index(struct le_header_fixup_record_table *t) {
+    struct le_header_fixup_record_index_entry *ent,tmp;
+    unsigned int srcoff_count,srcoff_i;
+    unsigned char src,flags;
+    unsigned char *raw;
+    uint16_t tobject;
+    uint32_t trgoff;
+    int16_t srcoff;
+    size_t count;
+    size_t i,j;
+
+    /* count first. records with a source list contribute one entry per source offset */
+    count = 0;
+    for (i=0;i < t->length;i++) {
+        raw = t->raw + t->table[i];
+        src = raw[0];
+        if ((raw[1]&3) != 0) continue; // not internal reference
+        count += (src & 0x20) ? (size_t)raw[2] : (size_t)1;
+    }
+
+    if (count == 0) return;
+    t->index = (struct le_header_fixup_record_index_entry*)malloc(sizeof(*(t->index)) * count);
+    if (t->index == NULL) return;
+
+    /* NTS: the parser already checked that each record lies entirely within the raw data */
+    ent = t->index;
+    for (i=0;i < t->length;i++) {
+        raw = t->raw + t->table[i];
+        src = *raw++;
+        flags = *raw++;
+
+        if ((flags&3) != 0) continue; // not internal reference
+
+        if (src & 0x20) {
+            srcoff_count = *raw++; //number of source offsets. object follows, then array of srcoff
+            srcoff = 0;
+        }
+        else {
+            srcoff_count = 1;
+            srcoff = *((int16_t*)raw); raw += 2;
+        }
+
+        if (flags&0x40) {
+            tobject = *((uint16_t*)raw); raw += 2;
+        }
+        else {
+            tobject = *raw++;
+        }
+
+        if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
+            if (flags&0x10) { // 32-bit target offset
+                trgoff = *((uint32_t*)raw); raw += 4;
+            }
+            else { // 16-bit target offset
+                trgoff = *((uint16_t*)raw); raw += 2;
+            }
+        }
+        else {
+            trgoff = 0;
+        }
+
+        for (srcoff_i=0;srcoff_i < srcoff_count;srcoff_i++) {
+            if (src & 0x20) {
+                srcoff = *((int16_t*)raw); raw += 2;
+            }
+
+            ent->srcoff = srcoff;
+            ent->src = src;
+            ent->flags = flags;
+            ent->object = tobject;
+            ent->trgoff = trgoff;
+            ent++;
+        }
+    }
+
+    t->index_length = (size_t)(ent - t->index);
+    assert(t->index_length == count);
+
+    /* insertion sort: stable, and linkers emit fixups mostly in order already */
+    for (i=1;i < t->index_length;i++) {
+        if (t->index[i-1].srcoff <= t->index[i].srcoff) continue;
+
+        tmp = t->index[i];
+        j = i;
+        do {
+            t->index[j] = t->index[j-1];
+            j--;
+        } while (j > 0 && t->index[j-1].srcoff > tmp.srcoff);
+        t->index[j] = tmp;
+    }
+}
+
+/* index of the first fixup in the sorted index with source offset >= srcoff, or index_length if none */
+size_t le_header_fixup_record_table_index_lookup(const struct le_header_fixup_record_table * const t,const int32_t srcoff) {
+    size_t lo = 0,hi = t->index_length,mid;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> (size_t)1);
+        if ((int32_t)t->index[mid].srcoff < srcoff)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
 void le_header_fixup_record_table_parse(struct le_header_fixup_record_table *t) {
     unsigned char *base,*scan,*fence,*entry;
     unsigned char src,flags;
@@ -198,6 +310,7 @@ void le_header_fixup_record_table_parse(struct le_header_fixup_record_table *t)
     }
 
     t->raw_length_parsed = (uint32_t)(scan - base);
+    le_header_fixup_record_table_build_index(t);
 }
 
 void le_header_parseinfo_fixup_record_list_setup_prepare_from_page_table(struct le_header_parseinfo * const p) {
@@ -15,18 +15,18 @@
 #include <hw/dos/exelehdr.h>
 #include <hw/dos/exelepar.h>
 
+/* apply the 32-bit offset fixups that land entirely within data[0...datlen-1], which holds the contents
+ * of the object starting at data_object_offset. the per-page fixup index is sorted by source offset,
+ * so each page costs one binary search followed by a linear walk of only the fixups in range. */
 int le_parser_apply_fixup(unsigned char * const data,const size_t datlen,const uint16_t object,const uint32_t data_object_offset,struct le_header_parseinfo *le_parser) {
+    const struct le_header_fixup_record_index_entry *ent,*fence;
     struct exe_le_header_object_table_entry *objent;
     struct le_header_fixup_record_table *frtable;
-    unsigned int srcoff_count,srcoff_i;
     uint32_t page_first,page_last;
     uint32_t data_linear_offset;
-    unsigned char flags,src;
-    uint32_t srclinoff;
-    unsigned char *raw;
-    uint32_t soffset;
-    uint16_t srcoff;
-    unsigned int ti;
+    uint32_t object_linear;
+    uint32_t trglinoff;
+    int32_t lo,hi;
     uint32_t page;
     int count = 0;
 
@@ -43,7 +43,8 @@ int le_parser_apply_fixup(unsigned char * const data,const size_t datlen,const u
     objent = le_parser->le_object_table + object - 1;
     page_first = (data_object_offset / le_parser->le_header.memory_page_size) + (uint32_t)objent->page_map_index;
     page_last = ((data_object_offset + datlen - 1) / le_parser->le_header.memory_page_size) + (uint32_t)objent->page_map_index;
-    data_linear_offset = data_object_offset + le_parser->le_object_table_loaded_linear[object - 1];
+    object_linear = le_parser->le_object_table_loaded_linear[object - 1];
+    data_linear_offset = data_object_offset + object_linear;
 
     for (page=page_first;page <= page_last;page++) { // <- in case the DDB struct spans two pages
         uint32_t pagelinoff =
@@ -55,92 +56,42 @@ int le_parser_apply_fixup(unsigned char * const data,const size_t datlen,const u
             continue;
 
         frtable = le_parser->le_fixup_records.table + page - 1; // <- page numbers are 1-based
-        for (ti=0;ti < (unsigned int)frtable->length;ti++) {
-            raw = le_header_fixup_record_table_get_raw_entry(frtable,ti);
-            if (raw == NULL) continue;
+        if (frtable->index == NULL || frtable->index_length == 0)
+            continue;
 
-            // caller ensures the record is long enough
-            src = *raw++;
-            flags = *raw++;
+        /* data[] relative to this page, [lo,hi). source offsets are signed 16-bit, clamp to that range.
+         * the end is always past the start of the page since page <= page_last */
+        if (pagelinoff > data_object_offset)
+            lo = ((pagelinoff - data_object_offset) > 0x8000UL) ? (int32_t)(-0x8000L) : -(int32_t)(pagelinoff - data_object_offset);
+        else
+            lo = (int32_t)(data_object_offset - pagelinoff);
 
-            if (src & 0xC0)
-                continue;
+        if (((uint32_t)data_object_offset + (uint32_t)datlen - pagelinoff) > 0x10000UL)
+            hi = (int32_t)0x10000L;
+        else
+            hi = (int32_t)((uint32_t)data_object_offset + (uint32_t)datlen - pagelinoff);
 
-            if (src & 0x20) {
-                srcoff_count = *raw++; //number of source offsets. object follows, then array of srcoff
-            }
-            else {
-                srcoff_count = 1;
-                srcoff = *((int16_t*)raw); raw += 2;
-            }
+        ent = frtable->index + le_header_fixup_record_table_index_lookup(frtable,lo);
+        fence = frtable->index + frtable->index_length;
+        for (;ent < fence && (int32_t)ent->srcoff + 4L <= hi;ent++) {
+            uint32_t soffset;
 
-            if ((flags&3) == 0) { // internal reference
-                uint32_t trglinoff;
-                uint16_t tobject;
-                uint32_t trgoff;
-
-                if (flags&0x40) {
-                    tobject = *((uint16_t*)raw); raw += 2;
-                }
-                else {
-                    tobject = *raw++;
-                }
-
-                if ((src&0xF) != 0x2) { /* not 16-bit selector fixup */
-                    if (flags&0x10) { // 32-bit target offset
-                        trgoff = *((uint32_t*)raw); raw += 4;
-                    }
-                    else { // 16-bit target offset
-                        trgoff = *((uint16_t*)raw); raw += 2;
-                    }
-                }
-                else {
-                    trgoff = 0;
-                }
-
-                // for this computation, we need to convert target object:offset to linear address
-                if (tobject != 0 && tobject <= le_parser->le_header.object_table_entries)
-                    trglinoff = le_parser->le_object_table_loaded_linear[tobject - 1] + trgoff;
-                else
-                    trglinoff = 0;
-
-                if (src & 0x20) {
-                    for (srcoff_i=0;srcoff_i < srcoff_count;srcoff_i++) {
-                        srcoff = *((int16_t*)raw); raw += 2;
-
-                        if ((src&0xF) == 0x7) { // must be 32-bit offset fixup
-                            // what is the relocation relative to the struct we just read?
-                            srclinoff =
-                                le_parser->le_object_table_loaded_linear[object - 1] + pagelinoff + (uint32_t)srcoff;
-                            soffset =
-                                (uint32_t)srclinoff - (uint32_t)data_linear_offset;
-
-                            // if it's within range, and in the same object, patch
-                            if ((soffset+4UL) <= datlen) {
-                                *((uint32_t*)(data+soffset)) = trglinoff;
-                                count++;
-                            }
-                        }
-                    }
-                }
-                else {
-                    if ((src&0xF) == 0x7) { // must be 32-bit offset fixup
-                        // what is the relocation relative to the struct we just read?
-                        srclinoff =
-                            le_parser->le_object_table_loaded_linear[object - 1] + pagelinoff + (uint32_t)srcoff;
-                        soffset =
-                            (uint32_t)srclinoff - (uint32_t)data_linear_offset;
-
-                        // if it's within range, and in the same object, patch
-                        if ((soffset+4UL) <= datlen) {
-                            *((uint32_t*)(data+soffset)) = trglinoff;
-                            count++;
-                        }
-                    }
-                }
-            }
-            else {
+            if ((ent->src&0xF) != 0x7) // must be 32-bit offset fixup
                 continue;
+
+            // for this computation, we need to convert target object:offset to linear address
+            if (ent->object != 0 && ent->object <= le_parser->le_header.object_table_entries)
+                trglinoff = le_parser->le_object_table_loaded_linear[ent->object - 1] + ent->trgoff;
+            else
+                trglinoff = 0;
+
+            // what is the relocation relative to the struct we just read?
+            soffset = (object_linear + pagelinoff + (uint32_t)((int32_t)ent->srcoff)) - data_linear_offset;
+
+            // if it's within range, and in the same object, patch
+            if (((size_t)soffset+(size_t)4) <= datlen) {
+                *((uint32_t*)(data+soffset)) = trglinoff;
+                count++;
             }
         }
     }
@@ -88,5 +88,6 @@ void le_header_parseinfo_free(struct le_header_parseinfo * const h) {
     le_header_parseinfo_free_fixup_page_table(h);
     le_header_object_table_loaded_linear_free(h);
     le_header_parseinfo_free_object_table(h);
+    le_header_page_cache_free(h);
 }
 
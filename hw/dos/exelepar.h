@@ -28,6 +28,27 @@ struct le_header_fixup_record_list {
     size_t                                                  length;
 };
 
+/* number of pages le_header_page_cache_init() holds by default */
+#define LE_HEADER_PAGE_CACHE_DEFAULT                        16
+
+struct le_header_page_cache_entry {
+    unsigned char*                                          data;           /* [memory_page_size], zero past length */
+    uint32_t                                                length;         /* bytes read from the file */
+    uint32_t                                                page_number;    /* 1-based, 0 if empty */
+    uint32_t                                                last_used;
+};
+
+/* LRU cache of whole pages, so that le_trackio_read() copies from memory instead of seeking and reading
+ * the file for every small read, and so that readers can use pointers into the page (le_trackio_map()) */
+struct le_header_page_cache {
+    struct le_header_page_cache_entry*                      entries;        /* [count], NULL if no cache */
+    unsigned int                                            count;
+    unsigned char                                           apply_fixups;   /* apply 32-bit offset fixups within the page as it is loaded */
+    uint32_t                                                clock;
+    unsigned long                                           hits;
+    unsigned long                                           misses;
+};
+
 struct le_header_parseinfo {
     struct le_header_fixup_record_list                      le_fixup_records;
     struct exe_ne_header_name_entry_table                   le_resident_names;
@@ -41,6 +62,9 @@ struct le_header_parseinfo {
     uint32_t*                                               le_object_table_loaded_linear;      /* [object_table_entries] entries */
     uint32_t                                                le_object_flat_32bit;               /* which segment is the chosen 32-bit segment, or 0 */
     uint32_t                                                load_base;
+    const unsigned char*                                    file_image;                         /* if set, read the file from here instead of fd (not owned) */
+    uint32_t                                                file_image_size;
+    struct le_header_page_cache                             le_page_cache;
 };
 
 struct le_vmap_trackio {
@@ -52,6 +76,15 @@ struct le_vmap_trackio {
     uint32_t                offset;         // offset within object
 };
 
+// parsed form of one internal reference fixup. records with a list of source offsets become one entry per offset.
+struct le_header_fixup_record_index_entry {
+    int16_t                                                 srcoff;         // page relative, can be negative (fixup spans from previous page)
+    uint8_t                                                 src;            // source type and flags byte of the record
+    uint8_t                                                 flags;          // target flags byte of the record
+    uint16_t                                                object;         // target object
+    uint32_t                                                trgoff;         // target offset (0 if 16-bit selector fixup)
+};
+
 struct le_header_fixup_record_table {
     uint32_t                                                file_offset;
     uint32_t                                                file_length;
@@ -61,10 +94,18 @@ struct le_header_fixup_record_table {
     size_t                                                  alloc;
     size_t                                                  length;
     size_t                                                  raw_length_parsed;
+    struct le_header_fixup_record_index_entry*              index;          // internal references, sorted by srcoff
+    size_t                                                  index_length;
 };
 
 int le_segofs_to_trackio(struct le_vmap_trackio * const io,const uint16_t object,const uint32_t offset,const struct le_header_parseinfo * const lep);
-int le_trackio_read(unsigned char *buf,int len,const int fd,struct le_vmap_trackio * const io,const struct le_header_parseinfo * const lep);
+int le_parser_file_read(const struct le_header_parseinfo * const lep,const int fd,const uint32_t ofs,void *buf,const size_t len);
+int le_trackio_read(unsigned char *buf,int len,const int fd,struct le_vmap_trackio * const io,struct le_header_parseinfo * const lep);
+const unsigned char *le_trackio_map(int * const len,const int fd,struct le_vmap_trackio * const io,struct le_header_parseinfo * const lep);
+
+int le_header_page_cache_init(struct le_header_parseinfo * const h,const unsigned int pages,const unsigned char apply_fixups);
+void le_header_page_cache_free(struct le_header_parseinfo * const h);
+const unsigned char *le_header_page_cache_get(struct le_header_parseinfo * const h,const int fd,const uint32_t page_number,uint32_t * const length);
 
 uint32_t le_exe_header_entry_table_size(struct exe_le_header * const h);
 void le_header_entry_table_free_table(struct le_header_entry_table *t);
@@ -103,6 +144,7 @@ void le_header_fixup_record_list_init(struct le_header_fixup_record_list *l);
 void le_header_fixup_record_list_free(struct le_header_fixup_record_list *l);
 int le_header_fixup_record_list_alloc(struct le_header_fixup_record_list *l,const size_t entries/*number_of_memory_pages*/);
 void le_header_fixup_record_table_parse(struct le_header_fixup_record_table *t);
+size_t le_header_fixup_record_table_index_lookup(const struct le_header_fixup_record_table * const t,const int32_t srcoff);
 
 void le_header_parseinfo_fixup_record_list_setup_prepare_from_page_table(struct le_header_parseinfo * const p);
 
@@ -0,0 +1,132 @@
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include <hw/dos/exehdr.h>
+
+/* re-use a little code from the NE parser. */
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+#include <hw/dos/exelehdr.h>
+#include <hw/dos/exelepar.h>
+
+/* set up a cache of "pages" pages. call after the object table and object page map have been read,
+ * and the fixup records too if apply_fixups is set. */
+int le_header_page_cache_init(struct le_header_parseinfo * const h,const unsigned int pages,const unsigned char apply_fixups) {
+    struct le_header_page_cache * const c = &h->le_page_cache;
+
+    le_header_page_cache_free(h);
+    if (pages < 2 || h->le_header.memory_page_size == 0 || h->le_header.memory_page_size > 0x10000UL)
+        return -1;
+
+    c->entries = (struct le_header_page_cache_entry*)calloc(pages,sizeof(*(c->entries)));
+    if (c->entries == NULL)
+        return -1;
+
+    c->count = pages;
+    c->apply_fixups = apply_fixups;
+    return 0;
+}
+
+void le_header_page_cache_free(struct le_header_parseinfo * const h) {
+    struct le_header_page_cache * const c = &h->le_page_cache;
+    unsigned int i;
+
+    if (c->entries != NULL) {
+        for (i=0;i < c->count;i++) {
+            if (c->entries[i].data != NULL)
+                free(c->entries[i].data);
+        }
+
+        free(c->entries);
+        c->entries = NULL;
+    }
+
+    c->count = 0;
+    c->clock = 0;
+    c->hits = 0;
+    c->misses = 0;
+}
+
+static void le_header_page_cache_apply_fixups(struct le_header_parseinfo * const h,unsigned char * const data,const uint32_t page_number) {
+    const struct exe_le_header_object_table_entry *objent;
+    unsigned int i;
+
+    if (h->le_object_table == NULL)
+        return;
+
+    for (i=0;i < h->le_header.object_table_entries;i++) {
+        objent = h->le_object_table + i;
+        if (page_number >= objent->page_map_index && (page_number - objent->page_map_index) < objent->page_map_entries) {
+            le_parser_apply_fixup(data,h->le_header.memory_page_size,(uint16_t)(i + 1u),
+                (page_number - objent->page_map_index) * h->le_header.memory_page_size,h);
+            break;
+        }
+    }
+}
+
+/* contents of page (1-based): memory_page_size bytes of the file from the page's data offset, the
+ * same bytes an uncached read returns, including any past the page's data size. *length is set to
+ * the number read, which is less only at the end of the file. the rest of the buffer is zero. the
+ * pointer stays valid until the page cache is accessed again (the page just returned is never the
+ * one evicted by the next access). */
+const unsigned char *le_header_page_cache_get(struct le_header_parseinfo * const h,const int fd,const uint32_t page_number,uint32_t * const length) {
+    struct le_header_page_cache * const c = &h->le_page_cache;
+    const struct exe_le_header_parseinfo_object_page_table_entry *pageent;
+    struct le_header_page_cache_entry *e,*victim = NULL;
+    unsigned int i;
+    int rd;
+
+    if (c->entries == NULL || h->le_object_page_map_table == NULL)
+        return NULL;
+    if (page_number == 0 || page_number > h->le_header.number_of_memory_pages)
+        return NULL;
+
+    c->clock++;
+    for (i=0;i < c->count;i++) {
+        e = c->entries + i;
+        if (e->page_number == page_number) {
+            e->last_used = c->clock;
+            c->hits++;
+            *length = e->length;
+            return e->data;
+        }
+
+        if (victim == NULL || (victim->page_number != 0 && (e->page_number == 0 || e->last_used < victim->last_used)))
+            victim = e;
+    }
+
+    assert(victim != NULL);
+    c->misses++;
+
+    if (victim->data == NULL) {
+        if ((victim->data=(unsigned char*)malloc(h->le_header.memory_page_size)) == NULL)
+            return NULL;
+    }
+
+    /* page numbers are 1-based, our array is zero based */
+    pageent = h->le_object_page_map_table + page_number - 1;
+
+    victim->page_number = 0;
+    rd = le_parser_file_read(h,fd,pageent->page_data_offset,victim->data,(size_t)h->le_header.memory_page_size);
+    if (rd < 0) rd = 0;
+    if ((uint32_t)rd < h->le_header.memory_page_size)
+        memset(victim->data + rd,0,(size_t)(h->le_header.memory_page_size - (uint32_t)rd));
+
+    if (c->apply_fixups)
+        le_header_page_cache_apply_fixups(h,victim->data,page_number);
+
+    victim->length = (uint32_t)rd;
+    victim->page_number = page_number;
+    victim->last_used = c->clock;
+    *length = victim->length;
+    return victim->data;
+}
+
@@ -67,13 +67,86 @@ int le_segofs_to_trackio(struct le_vmap_trackio * const io,const uint16_t object
     return 1;
 }
 
-int le_trackio_read(unsigned char *buf,int len,const int fd,struct le_vmap_trackio * const io,const struct le_header_parseinfo * const lep) {
+/* read from the LE file, or the in-memory copy of it if the caller provided one
+ * (i.e. a VxD extracted from a W3 container). returns bytes read, or -1 */
+int le_parser_file_read(const struct le_header_parseinfo * const lep,const int fd,const uint32_t ofs,void *buf,const size_t len) {
+    size_t canrd = len;
+
+    if (lep->file_image != NULL) {
+        if (ofs >= lep->file_image_size) return 0;
+        if ((unsigned long)canrd > (unsigned long)(lep->file_image_size - ofs)) canrd = (size_t)(lep->file_image_size - ofs);
+        memcpy(buf,lep->file_image + ofs,canrd);
+        return (int)canrd;
+    }
+
+    if ((unsigned long)lseek(fd,(off_t)ofs,SEEK_SET) != (unsigned long)ofs) return -1;
+    return (int)read(fd,buf,canrd);
+}
+
+/* move io to the start of the next page. returns 0 if already at or past the last page */
+static int le_trackio_next_page(struct le_vmap_trackio * const io,const struct le_header_parseinfo * const lep) {
     const struct exe_le_header_parseinfo_object_page_table_entry *pageent;
+
+    if (io->page_number >= lep->le_header.number_of_memory_pages) return 0; /* at or past last page */
+    io->page_number++;
+    io->page_ofs = 0;
+
+    /* page numbers are 1-based, our array is zero based */
+    pageent = (const struct exe_le_header_parseinfo_object_page_table_entry*)(lep->le_object_page_map_table + io->page_number - 1);
+    io->file_ofs = pageent->page_data_offset;
+    return 1;
+}
+
+/* pointer to up to *len bytes at io in the page cache, advancing io past them. *len is set to the
+ * number of bytes available, which stops at the end of the page, or of the file. the pointer stays
+ * valid until the page cache is accessed again. returns NULL at the end, or if the page cache is not
+ * set up. */
+const unsigned char *le_trackio_map(int * const len,const int fd,struct le_vmap_trackio * const io,struct le_header_parseinfo * const lep) {
+    const unsigned char *page;
+    uint32_t length;
+    int canrd;
+
+    if (*len <= 0 || io->object == 0 || io->page_number == 0) return NULL;
+
+    if (io->page_ofs >= io->page_size) {
+        if (!le_trackio_next_page(io,lep)) return NULL;
+    }
+
+    if ((page=le_header_page_cache_get(lep,fd,io->page_number,&length)) == NULL) return NULL;
+    if (io->page_ofs >= length) return NULL; /* the file ends here */
+
+    canrd = (int)(length - io->page_ofs);
+    if (canrd > *len) canrd = *len;
+    page += io->page_ofs;
+
+    io->page_ofs += canrd;
+    io->offset += canrd;
+    *len = canrd;
+    return page;
+}
+
+int le_trackio_read(unsigned char *buf,int len,const int fd,struct le_vmap_trackio * const io,struct le_header_parseinfo * const lep) {
+    const unsigned char *src;
     unsigned long ofs;
     int rd = 0;
     int canrd;
     int gotrd;
 
+    /* whole pages from the cache, if there is one */
+    if (lep->le_page_cache.entries != NULL) {
+        while (len > 0) {
+            canrd = len;
+            if ((src=le_trackio_map(&canrd,fd,io,lep)) == NULL) break;
+
+            memcpy(buf,src,(size_t)canrd);
+            buf += canrd;
+            len -= canrd;
+            rd += canrd;
+        }
+
+        return rd;
+    }
+
     while (len > 0) {
         if (io->object == 0 || io->page_number == 0) break;
 
@@ -82,9 +155,7 @@ int le_trackio_read(unsigned char *buf,int len,const int fd,struct le_vmap_track
             if (canrd > len) canrd = len;
 
             ofs = io->file_ofs + io->page_ofs;
-            if ((unsigned long)lseek(fd,ofs,SEEK_SET) != ofs) break;
-
-            gotrd = read(fd,buf,canrd);
+            gotrd = le_parser_file_read(lep,fd,ofs,buf,(size_t)canrd);
             if (gotrd <= 0) break;
 
             io->page_ofs += gotrd;
@@ -96,14 +167,7 @@ int le_trackio_read(unsigned char *buf,int len,const int fd,struct le_vmap_track
 
         assert(io->page_ofs <= io->page_size);
         if (io->page_ofs >= io->page_size) {
-            /* next page */
-            if (io->page_number >= lep->le_header.number_of_memory_pages) break; /* at or past last page */
-            io->page_number++;
-            io->page_ofs = 0;
-
-            /* page numbers are 1-based, our array is zero based */
-            pageent = (const struct exe_le_header_parseinfo_object_page_table_entry*)(lep->le_object_page_map_table + io->page_number - 1);
-            io->file_ofs = pageent->page_data_offset;
+            if (!le_trackio_next_page(io,lep)) break;
         }
     }
 
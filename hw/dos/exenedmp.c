@@ -247,36 +247,19 @@ void print_entry_table_flags(const uint16_t flags) {
     if (flags & 0xF8) printf("RING_TRANSITION_STACK_WORDS=%u ",flags >> 3);
 }
 
-void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
+void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie;
     char tmp[255+1];
-    unsigned int i;
 
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
+    if (ordinal > 0xFFFFu) return;
+    if ((ie=exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal)) == NULL) return;
 
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
-                printf(" RESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
-    }
-
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
-
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
-                printf(" NONRESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
-    }
+    ne_name_entry_get_name(tmp,sizeof(tmp),ie->table,ie->entry);
+    printf(" %s NAME '%s' ",ie->resident ? "RESIDENT" : "NONRESIDENT",tmp);
 }
 
 void print_entry_table(const struct exe_ne_header_entry_table_table * const t,const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames) {
+    struct exe_ne_header_name_ordinal_index ordinals;
     const struct exe_ne_header_entry_table_entry *ent;
     unsigned char *rawd;
     unsigned int i;
@@ -284,6 +267,10 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
     if (t->table == NULL || t->length == 0)
         return;
 
+    /* build the ordinal -> name index once, instead of scanning both name tables per entry */
+    exe_ne_header_name_ordinal_index_init(&ordinals);
+    exe_ne_header_name_ordinal_index_build(&ordinals,resnames,nonresnames);
+
     for (i=0;i < t->length;i++) { /* NTS: ordinal value is i + 1, ordinals are 1-based */
         ent = t->table + i;
         rawd = exe_ne_header_entry_table_table_raw_entry(t,ent);
@@ -301,7 +288,7 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
                 (struct exe_ne_header_entry_table_movable_segment_entry*)rawd;
 
             printf("movable segment #%d : 0x%04x",ment->segid,ment->seg_offs);
-            print_entry_table_locate_name_by_ordinal(nonresnames,resnames,i + 1);
+            print_entry_table_locate_name_by_ordinal(&ordinals,i + 1);
             printf("\n");
             if (ment->flags != 0) {
                 printf("            ");
@@ -315,7 +302,7 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
                 (struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
 
             printf("constant value : 0x%04x",fent->v.seg_offs);
-            print_entry_table_locate_name_by_ordinal(nonresnames,resnames,i + 1);
+            print_entry_table_locate_name_by_ordinal(&ordinals,i + 1);
             printf("\n");
             if (fent->flags != 0) {
                 printf("            ");
@@ -329,7 +316,7 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
                 (struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
 
             printf("fixed segment #%d : 0x%04x",ent->segment_id,fent->v.seg_offs);
-            print_entry_table_locate_name_by_ordinal(nonresnames,resnames,i + 1);
+            print_entry_table_locate_name_by_ordinal(&ordinals,i + 1);
             printf("\n");
             if (fent->flags != 0) {
                 printf("            ");
@@ -338,12 +325,13 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
             }
         }
     }
+
+    exe_ne_header_name_ordinal_index_free(&ordinals);
 }
 
 void name_entry_table_sort_by_user_options(struct exe_ne_header_name_entry_table * const t) {
     unsigned int first = 0;
 
-    ne_name_entry_sort_by_table = t;
     if (t->raw == NULL || t->length <= 1)
         return;
 
@@ -352,11 +340,11 @@ void name_entry_table_sort_by_user_options(struct exe_ne_header_name_entry_table
 
     if (opt_sort_ordinal) {
         /* NTS: Do not sort the module name in entry 0 IF first entry is zero */
-        qsort(t->table+first,t->length-first,sizeof(*(t->table)),ne_name_entry_sort_by_ordinal);
+        exe_ne_header_name_entry_table_sort(t,first,ne_name_entry_compare_by_ordinal);
     }
     else if (opt_sort_names) {
         /* NTS: Do not sort the module name in entry 0 IF first entry is zero */
-        qsort(t->table+first,t->length-first,sizeof(*(t->table)),ne_name_entry_sort_by_name);
+        exe_ne_header_name_entry_table_sort(t,first,ne_name_entry_compare_by_name);
     }
 }
 
@@ -1601,26 +1589,21 @@ void dump_ne_res_RT_VERSION(const unsigned char *data,const size_t len) {
 }
 
 int main(int argc,char **argv) {
-    struct exe_ne_header_imported_name_table ne_imported_name_table;
-    struct exe_ne_header_entry_table_table ne_entry_table;
-    struct exe_ne_header_name_entry_table ne_nonresname;
-    struct exe_ne_header_resource_table_t ne_resources;
-    struct exe_ne_header_name_entry_table ne_resname;
-    struct exe_ne_header_segment_table ne_segments;
+    struct exe_ne_header_imported_name_table *ne_imported_name_table;
+    struct exe_ne_header_entry_table_table *ne_entry_table;
+    struct exe_ne_header_name_entry_table *ne_nonresname;
+    struct exe_ne_header_resource_table_t *ne_resources;
+    struct exe_ne_header_name_entry_table *ne_resname;
+    struct exe_ne_header_segment_table *ne_segments;
+    struct exe_ne_image ne_image;
     struct exe_ne_header ne_header;
     uint32_t ne_header_offset;
-    uint32_t file_size;
     char *a;
     int i;
 
     assert(sizeof(ne_header) == 0x40);
     memset(&exehdr,0,sizeof(exehdr));
-    exe_ne_header_segment_table_init(&ne_segments);
-    exe_ne_header_resource_table_init(&ne_resources);
-    exe_ne_header_name_entry_table_init(&ne_resname);
-    exe_ne_header_name_entry_table_init(&ne_nonresname);
-    exe_ne_header_entry_table_table_init(&ne_entry_table);
-    exe_ne_header_imported_name_table_init(&ne_imported_name_table);
+    exe_ne_image_init(&ne_image);
 
     for (i=1;i < argc;) {
         a = argv[i++];
@@ -1666,21 +1649,14 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    file_size = lseek(src_fd,0,SEEK_END);
-    lseek(src_fd,0,SEEK_SET);
-
-    if (read(src_fd,&exehdr,sizeof(exehdr)) != (int)sizeof(exehdr)) {
-        fprintf(stderr,"EXE header read error\n");
-        return 1;
-    }
-
-    if (exehdr.magic != 0x5A4DU/*MZ*/) {
-        fprintf(stderr,"EXE header signature missing\n");
+    if ((i=exe_ne_image_open_fd(&ne_image,src_fd)) < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
+    exehdr = ne_image.exehdr;
 
     printf("File size:                        %lu bytes\n",
-        (unsigned long)file_size);
+        (unsigned long)ne_image.file_size);
     printf("MS-DOS EXE header:\n");
     printf("    last_block_bytes:             %u bytes\n",
         exehdr.last_block_bytes);
@@ -1732,33 +1708,23 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    if (!exe_header_can_contain_exe_extension(&exehdr)) {
-        fprintf(stderr,"EXE header cannot contain extension\n");
-        return 1;
-    }
-
-    /* go read the extension */
-    if (lseek(src_fd,EXE_HEADER_EXTENSION_OFFSET,SEEK_SET) != EXE_HEADER_EXTENSION_OFFSET ||
-        read(src_fd,&ne_header_offset,4) != 4) {
-        fprintf(stderr,"Cannot read extension\n");
+    /* go read the extension, and the extended header */
+    i = exe_ne_image_read_ne_header(&ne_image);
+    if (i == EXE_NE_IMAGE_ERR_NO_EXTENSION || i == EXE_NE_IMAGE_ERR_EXTENSION) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
-    printf("    EXE extension (if exists) at: %lu\n",(unsigned long)ne_header_offset);
-    if ((ne_header_offset+EXE_HEADER_NE_HEADER_SIZE) >= file_size) {
-        printf("! NE header not present (offset out of range)\n");
+    printf("    EXE extension (if exists) at: %lu\n",(unsigned long)ne_image.ne_header_offset);
+    if (i == EXE_NE_IMAGE_ERR_NO_NE_HEADER) {
+        printf("! %s\n",exe_ne_image_error_str(i));
         return 0;
     }
-
-    /* go read the extended header */
-    if (lseek(src_fd,ne_header_offset,SEEK_SET) != ne_header_offset ||
-        read(src_fd,&ne_header,sizeof(ne_header)) != sizeof(ne_header)) {
-        fprintf(stderr,"Cannot read NE header\n");
-        return 1;
-    }
-    if (ne_header.signature != EXE_NE_SIGNATURE) {
-        fprintf(stderr,"Not an NE executable\n");
+    else if (i < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
+    ne_header_offset = ne_image.ne_header_offset;
+    ne_header = ne_image.ne_header;
 
     printf("Windows or OS/2 NE header:\n");
     printf("    Linker version:               %u.%u\n",
@@ -2004,205 +1970,104 @@ int main(int argc,char **argv) {
         printf("! WARNING: imported name table offset > entry table offset");
 
     /* load segment table */
-    if (ne_header.segment_table_entries != 0 && ne_header.segment_table_offset != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.segment_table_offset + ne_header_offset,SEEK_SET) == ((unsigned long)ne_header.segment_table_offset + ne_header_offset)) {
-        unsigned char *base;
-        size_t rawlen;
-
-        base = exe_ne_header_segment_table_alloc_table(&ne_segments,ne_header.segment_table_entries,ne_header.sector_shift);
-        if (base != NULL) {
-            rawlen = exe_ne_header_segment_table_size(&ne_segments);
-            if (rawlen != 0) {
-                if ((size_t)read(src_fd,base,rawlen) != rawlen) {
-                    printf("    ! Unable to read segment table\n");
-                    exe_ne_header_segment_table_free_table(&ne_segments);
-                }
-            }
-        }
-    }
+    ne_segments = exe_ne_image_segment_table(&ne_image);
+    if (ne_header.segment_table_entries != 0 && ne_header.segment_table_offset != 0 && ne_segments->table == NULL)
+        printf("    ! Unable to read segment table\n");
 
     /* load nonresident name table */
-    if (ne_header.nonresident_name_table_offset != 0 && ne_header.nonresident_name_table_length != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.nonresident_name_table_offset,SEEK_SET) == ne_header.nonresident_name_table_offset) {
-        unsigned char *base;
-
+    if (ne_header.nonresident_name_table_offset != 0 && ne_header.nonresident_name_table_length != 0)
         printf("  * Nonresident name table length: %u\n",ne_header.nonresident_name_table_length);
-        base = exe_ne_header_name_entry_table_alloc_raw(&ne_nonresname,ne_header.nonresident_name_table_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_nonresname.raw_length) != ne_nonresname.raw_length)
-                exe_ne_header_name_entry_table_free_raw(&ne_nonresname);
-        }
-
-        exe_ne_header_name_entry_table_parse_raw(&ne_nonresname);
-        name_entry_table_sort_by_user_options(&ne_nonresname);
-    }
+    ne_nonresname = exe_ne_image_nonresident_names(&ne_image);
+    name_entry_table_sort_by_user_options(ne_nonresname);
 
     /* load resident name table */
-    if (ne_header.resident_name_table_offset != 0 && ne_header.module_reference_table_offset > ne_header.resident_name_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.resident_name_table_offset + ne_header_offset,SEEK_SET) == (ne_header.resident_name_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* RESIDENT_NAME_TABLE_SIZE = module_reference_table_offset - resident_name_table_offset */
-        raw_length = (unsigned short)(ne_header.module_reference_table_offset - ne_header.resident_name_table_offset);
-        printf("  * Resident name table length: %u\n",raw_length);
-
-        base = exe_ne_header_name_entry_table_alloc_raw(&ne_resname,raw_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_resname.raw_length) != ne_resname.raw_length)
-                exe_ne_header_name_entry_table_free_raw(&ne_resname);
-        }
-
-        exe_ne_header_name_entry_table_parse_raw(&ne_resname);
-        name_entry_table_sort_by_user_options(&ne_resname);
-    }
-
-    /* load imported name table */
-    if (ne_header.imported_name_table_offset != 0 && ne_header.entry_table_offset > ne_header.imported_name_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.imported_name_table_offset + ne_header_offset,SEEK_SET) == (ne_header.imported_name_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* IMPORTED_NAME_TABLE_SIZE = entry_table_offset - imported_name_table_offset       (header does not report size of imported name table) */
-        raw_length = (unsigned short)(ne_header.entry_table_offset - ne_header.imported_name_table_offset);
-        printf("  * Imported name table length: %u\n",raw_length);
-
-        base = exe_ne_header_imported_name_table_alloc_raw(&ne_imported_name_table,raw_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_imported_name_table.raw_length) != ne_imported_name_table.raw_length)
-                exe_ne_header_imported_name_table_free_raw(&ne_imported_name_table);
-        }
-
-        exe_ne_header_imported_name_table_parse_raw(&ne_imported_name_table);
-    }
-
-    /* load module reference table */
-    if (ne_header.module_reference_table_offset != 0 && ne_header.module_reftable_entries != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.module_reference_table_offset + ne_header_offset,SEEK_SET) == (ne_header.module_reference_table_offset + ne_header_offset)) {
-        uint16_t *base;
-
+    if (ne_header.resident_name_table_offset != 0 && ne_header.module_reference_table_offset > ne_header.resident_name_table_offset)
+        printf("  * Resident name table length: %u\n",
+            (unsigned short)(ne_header.module_reference_table_offset - ne_header.resident_name_table_offset));
+    ne_resname = exe_ne_image_resident_names(&ne_image);
+    name_entry_table_sort_by_user_options(ne_resname);
+
+    /* load imported name table, and module reference table */
+    if (ne_header.imported_name_table_offset != 0 && ne_header.entry_table_offset > ne_header.imported_name_table_offset)
+        printf("  * Imported name table length: %u\n",
+            (unsigned short)(ne_header.entry_table_offset - ne_header.imported_name_table_offset));
+    if (ne_header.module_reference_table_offset != 0 && ne_header.module_reftable_entries != 0)
         printf("  * Module reference table length: %u\n",ne_header.module_reftable_entries * 2);
-
-        base = exe_ne_header_imported_name_table_alloc_module_ref_table(&ne_imported_name_table,ne_header.module_reftable_entries);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_imported_name_table.module_ref_table_length*sizeof(uint16_t)) !=
-                (ne_imported_name_table.module_ref_table_length*sizeof(uint16_t)))
-                exe_ne_header_imported_name_table_free_module_ref_table(&ne_imported_name_table);
-        }
-    }
+    ne_imported_name_table = exe_ne_image_imported_names(&ne_image);
 
     /* entry table */
-    if (ne_header.entry_table_offset != 0 && ne_header.entry_table_length != 0 &&
-        lseek(src_fd,ne_header.entry_table_offset + ne_header_offset,SEEK_SET) == (ne_header.entry_table_offset + ne_header_offset)) {
-        unsigned char *base;
-
-        base = exe_ne_header_entry_table_table_alloc_raw(&ne_entry_table,ne_header.entry_table_length);
-        if (base != NULL) {
-            if (read(src_fd,base,ne_header.entry_table_length) != ne_header.entry_table_length)
-                exe_ne_header_entry_table_table_free_raw(&ne_entry_table);
-        }
-
-        exe_ne_header_entry_table_table_parse_raw(&ne_entry_table);
-    }
+    ne_entry_table = exe_ne_image_entry_table(&ne_image);
 
     /* resource table */
-    if (ne_header.resource_table_offset != 0 && ne_header.resident_name_table_offset > ne_header.resource_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.resource_table_offset + ne_header_offset,SEEK_SET) == (ne_header.resource_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* RESOURCE_TABLE_SIZE = resident_name_table_offset - resource_table_offset         (header does not report size, "number of segments" is worthless) */
-        raw_length = (unsigned short)(ne_header.resident_name_table_offset - ne_header.resource_table_offset);
-        printf("  * Resource table length: %u\n",raw_length);
-
-        base = exe_ne_header_resource_table_alloc_raw(&ne_resources,raw_length);
-        if (base != NULL) {
-            if ((unsigned int)read(src_fd,base,raw_length) != raw_length)
-                exe_ne_header_resource_table_free_raw(&ne_resources);
-        }
-
-        exe_ne_header_resource_table_parse(&ne_resources);
-    }
+    if (ne_header.resource_table_offset != 0 && ne_header.resident_name_table_offset > ne_header.resource_table_offset)
+        printf("  * Resource table length: %u\n",
+            (unsigned short)(ne_header.resident_name_table_offset - ne_header.resource_table_offset));
+    ne_resources = exe_ne_image_resource_table(&ne_image);
 
     /* imported name table */
     printf("    Imported name table, %u entries:\n",
-        (unsigned int)ne_imported_name_table.length);
-    print_imported_name_table(&ne_imported_name_table);
+        (unsigned int)ne_imported_name_table->length);
+    print_imported_name_table(ne_imported_name_table);
 
     /* module reference name table */
     printf("    Module reference name table, %u entries:\n",
-        (unsigned int)ne_imported_name_table.module_ref_table_length);
-    print_imported_name_table_module_ref_table(&ne_imported_name_table);
+        (unsigned int)ne_imported_name_table->module_ref_table_length);
+    print_imported_name_table_module_ref_table(ne_imported_name_table);
 
     /* non-resident name table */
     printf("    Non-resident name table, %u entries\n",
-        (unsigned int)ne_nonresname.length);
-    print_name_table(&ne_nonresname);
+        (unsigned int)ne_nonresname->length);
+    print_name_table(ne_nonresname);
 
     /* resident name table */
     printf("    Resident name table, %u entries\n",
-        (unsigned int)ne_resname.length);
-    print_name_table(&ne_resname);
+        (unsigned int)ne_resname->length);
+    print_name_table(ne_resname);
 
     /* segment table */
     printf("    Segment table, %u entries:\n",
-        (unsigned int)ne_segments.length);
-    print_segment_table(&ne_segments);
+        (unsigned int)ne_segments->length);
+    print_segment_table(ne_segments);
 
     /* segment relocation table */
     {
         struct exe_ne_header_segment_reloc_table ne_relocs;
         struct exe_ne_header_segment_entry *segent;
         unsigned long reloc_offset;
-        uint16_t reloc_entries;
-        unsigned char *base;
+        int reloc_entries;
         unsigned int i;
 
         printf("    Segment relocations:\n");
 
         exe_ne_header_segment_reloc_table_init(&ne_relocs);
-        for (i=0;i < ne_segments.length;i++) {
-            segent = ne_segments.table + i; /* C pointer math, becomes (char*)ne_segments + (i * sizeof(*ne_segments)) */
-            reloc_offset = exe_ne_header_segment_table_get_relocation_table_offset(&ne_segments,segent);
+        for (i=0;i < ne_segments->length;i++) {
+            segent = ne_segments->table + i; /* C pointer math, becomes (char*)ne_segments + (i * sizeof(*ne_segments)) */
+            reloc_offset = exe_ne_header_segment_table_get_relocation_table_offset(ne_segments,segent);
             if (reloc_offset == 0) continue;
 
             /* at the start of the relocation struct, is a 16-bit WORD that indicates how many entries are there,
              * followed by an array of relocation entries. */
-            if ((unsigned long)lseek(src_fd,reloc_offset,SEEK_SET) != reloc_offset || read(src_fd,&reloc_entries,2) != 2)
+            if ((reloc_entries=exe_ne_image_segment_relocs(&ne_image,reloc_offset,&ne_relocs)) < 0)
                 continue;
 
             printf("        Segment #%d:\n",i+1);
             printf("            Relocation table at: %lu, %u entries\n",reloc_offset,reloc_entries);
-            exe_ne_header_segment_reloc_table_free(&ne_relocs);
-            if (reloc_entries == 0) continue;
-
-            base = exe_ne_header_segment_reloc_table_alloc_table(&ne_relocs,reloc_entries);
-            if (base == NULL) continue;
-
-            {
-                size_t rd = exe_ne_header_segment_reloc_table_size(&ne_relocs);
-                if (rd == 0) continue;
-
-                if ((size_t)read(src_fd,ne_relocs.table,rd) != rd) {
-                    exe_ne_header_segment_reloc_table_free(&ne_relocs);
-                    continue;
-                }
-            }
+            if (ne_relocs.table == NULL) continue;
 
-            print_segment_reloc_table(&ne_relocs,&ne_imported_name_table);
+            print_segment_reloc_table(&ne_relocs,ne_imported_name_table);
             exe_ne_header_segment_reloc_table_free(&ne_relocs);
         }
     }
 
     /* entry table */
     printf("    Entry table, %u entries:\n",
-        (unsigned int)ne_entry_table.length);
-    print_entry_table(&ne_entry_table,&ne_nonresname,&ne_resname);
+        (unsigned int)ne_entry_table->length);
+    print_entry_table(ne_entry_table,ne_nonresname,ne_resname);
 
     printf("    Resource table, 1 << %u = %lu byte alignment:\n",
-        exe_ne_header_resource_table_get_shift(&ne_resources),
-        1UL << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
-    printf("        %u TYPEINFO entries\n",ne_resources.typeinfo_length);
+        exe_ne_header_resource_table_get_shift(ne_resources),
+        1UL << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources));
+    printf("        %u TYPEINFO entries\n",ne_resources->typeinfo_length);
     {
         const struct exe_ne_header_resource_table_nameinfo *ninfo;
         const struct exe_ne_header_resource_table_typeinfo *tinfo;
@@ -2211,10 +2076,10 @@ int main(int argc,char **argv) {
         unsigned int ti;
         unsigned int ni;
 
-        for (ti=0;ti < ne_resources.typeinfo_length;ti++) {
+        for (ti=0;ti < ne_resources->typeinfo_length;ti++) {
             printf("        Typeinfo entry #%d\n",ti+1);
 
-            tinfo = exe_ne_header_resource_table_get_typeinfo_entry(&ne_resources,ti);
+            tinfo = exe_ne_header_resource_table_get_typeinfo_entry(ne_resources,ti);
             if (tinfo == NULL) {
                 printf("            NULL\n");
                 continue;
@@ -2234,7 +2099,7 @@ int main(int argc,char **argv) {
                 printf("\n");
             }
             else {
-                exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),&ne_resources,tinfo->rtTypeID);
+                exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),ne_resources,tinfo->rtTypeID);
                 printf("            rtTypeID:   STRING OFFSET 0x%04x '%s'",tinfo->rtTypeID,tmp);
                 printf("\n");
             }
@@ -2250,12 +2115,12 @@ int main(int argc,char **argv) {
                 printf("            Entry #%d:\n",ni+1);
                 printf("                rnOffset:           %u sectors << %u = %lu bytes\n",
                     ninfo->rnOffset,
-                    exe_ne_header_resource_table_get_shift(&ne_resources),
-                    (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
+                    exe_ne_header_resource_table_get_shift(ne_resources),
+                    (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources));
                 printf("                rnLength:           %u sectors << %u = %lu bytes\n",
                     ninfo->rnLength,
-                    exe_ne_header_resource_table_get_shift(&ne_resources),
-                    (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
+                    exe_ne_header_resource_table_get_shift(ne_resources),
+                    (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources));
 
                 printf("                rnFlags:            0x%04x",
                     ninfo->rnFlags);
@@ -2281,7 +2146,7 @@ int main(int argc,char **argv) {
                         exe_ne_header_resource_table_typeinfo_RNID_AS_INTEGER(ninfo->rnID));
                 }
                 else {
-                    exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),&ne_resources,ninfo->rnID);
+                    exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),ne_resources,ninfo->rnID);
                     printf("                rnID:               STRING OFFSET 0x%04x '%s'\n",
                         ninfo->rnID,tmp);
                 }
@@ -2294,9 +2159,10 @@ int main(int argc,char **argv) {
                         ninfo->rnUsage);
 
                 if (ninfo->rnLength != 0) {
-                    unsigned long res_ofs = (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources);
-                    unsigned long res_len = (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources);
+                    unsigned long res_ofs = (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources);
+                    unsigned long res_len = (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources);
                     unsigned char *res_raw = NULL;
+                    unsigned char res_own;
 
                     // impose limits on resource data reading.
                     // for most formats we only care about the header anyway.
@@ -2308,59 +2174,50 @@ int main(int argc,char **argv) {
                     if (res_len > 0x400000UL) res_len = 0x400000UL;
 #endif
 
-                    res_raw = malloc(res_len);
+                    res_raw = exe_ne_image_get(&ne_image,res_ofs,(size_t)res_len,&res_own);
                     if (res_raw != NULL) {
-                        if ((unsigned long)lseek(src_fd,res_ofs,SEEK_SET) == res_ofs &&
-                            (unsigned long)read(src_fd,res_raw,res_len) == res_len) {
-
-                            /* FIXME: Running this code against Windows 2.x executables, it seems
-                             *        that the ICON, CURSOR, and BITMAP resources used an entirely
-                             *        different format inside the NE resource. */
-                            if (tinfo->rtTypeID == exe_ne_header_RT_ICON)
-                                dump_ne_res_RT_ICON(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_ICON)
-                                dump_ne_res_RT_GROUP_ICON(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_CURSOR)
-                                dump_ne_res_RT_CURSOR(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_CURSOR)
-                                dump_ne_res_RT_GROUP_CURSOR(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_STRING)
-                                dump_ne_res_RT_STRING(res_raw,(size_t)res_len,ninfo->rnID);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_NAME_TABLE)
-                                dump_ne_res_RT_NAME_TABLE(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_ACCELERATOR)
-                                dump_ne_res_RT_ACCELERATOR(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_BITMAP)
-                                dump_ne_res_RT_BITMAP(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_MENU)
-                                dump_ne_res_RT_MENU(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_DIALOG)
-                                dump_ne_res_RT_DIALOG(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_VERSION)
-                                dump_ne_res_RT_VERSION(res_raw,(size_t)res_len);
-                        }
-
-                        free(res_raw);
+                        /* FIXME: Running this code against Windows 2.x executables, it seems
+                         *        that the ICON, CURSOR, and BITMAP resources used an entirely
+                         *        different format inside the NE resource. */
+                        if (tinfo->rtTypeID == exe_ne_header_RT_ICON)
+                            dump_ne_res_RT_ICON(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_ICON)
+                            dump_ne_res_RT_GROUP_ICON(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_CURSOR)
+                            dump_ne_res_RT_CURSOR(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_CURSOR)
+                            dump_ne_res_RT_GROUP_CURSOR(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_STRING)
+                            dump_ne_res_RT_STRING(res_raw,(size_t)res_len,ninfo->rnID);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_NAME_TABLE)
+                            dump_ne_res_RT_NAME_TABLE(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_ACCELERATOR)
+                            dump_ne_res_RT_ACCELERATOR(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_BITMAP)
+                            dump_ne_res_RT_BITMAP(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_MENU)
+                            dump_ne_res_RT_MENU(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_DIALOG)
+                            dump_ne_res_RT_DIALOG(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_VERSION)
+                            dump_ne_res_RT_VERSION(res_raw,(size_t)res_len);
+
+                        exe_ne_image_put(res_raw,res_own);
                     }
                 }
             }
         }
 
         printf("        rscResourceNames, %u entries\n",
-            ne_resources.resnames_length);
-        for (ni=0;ni < ne_resources.resnames_length;ni++) {
-            exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),&ne_resources,
-                exe_ne_header_resource_table_get_resname(&ne_resources,ni));
+            ne_resources->resnames_length);
+        for (ni=0;ni < ne_resources->resnames_length;ni++) {
+            exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),ne_resources,
+                exe_ne_header_resource_table_get_resname(ne_resources,ni));
             printf("            '%s'\n",tmp);
         }
     }
 
-    exe_ne_header_imported_name_table_free(&ne_imported_name_table);
-    exe_ne_header_entry_table_table_free(&ne_entry_table);
-    exe_ne_header_name_entry_table_free(&ne_nonresname);
-    exe_ne_header_name_entry_table_free(&ne_resname);
-    exe_ne_header_resource_table_free(&ne_resources);
-    exe_ne_header_segment_table_free(&ne_segments);
+    exe_ne_image_free(&ne_image);
     close(src_fd);
     return 0;
 }
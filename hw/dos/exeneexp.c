@@ -52,40 +52,25 @@ void print_entry_table_flags(const uint16_t flags) {
     if (flags & 0xF8) printf("RING_TRANSITION_STACK_WORDS=%u ",flags >> 3);
 }
 
-void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
+void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie = NULL;
     char tmp[255+1];
-    unsigned int i;
-
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
-
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
-                printf("%s",tmp);
-                printf("\n    ORDINAL.%u.TYPE=resident",ordinal);
-                return;
-            }
-        }
-    }
 
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
+    if (ordinal <= 0xFFFFu)
+        ie = exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal);
 
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
-                printf("%s",tmp);
-                printf("\n    ORDINAL.%u.TYPE=nonresident",ordinal);
-                return;
-            }
-        }
+    if (ie != NULL) {
+        ne_name_entry_get_name(tmp,sizeof(tmp),ie->table,ie->entry);
+        printf("%s",tmp);
+        printf("\n    ORDINAL.%u.TYPE=%s",ordinal,ie->resident ? "resident" : "nonresident");
+        return;
     }
 
     printf("\n    ORDINAL.%u.TYPE=",ordinal);
 }
 
 void print_entry_table(const struct exe_ne_header_entry_table_table * const t,const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames) {
+    struct exe_ne_header_name_ordinal_index ordinals;
     const struct exe_ne_header_entry_table_entry *ent;
     unsigned char *rawd;
     unsigned int i;
@@ -93,6 +78,9 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
     if (t->table == NULL || t->length == 0)
         return;
 
+    exe_ne_header_name_ordinal_index_init(&ordinals);
+    exe_ne_header_name_ordinal_index_build(&ordinals,resnames,nonresnames);
+
     for (i=0;i < t->length;i++) { /* NTS: ordinal value is i + 1, ordinals are 1-based */
         ent = t->table + i;
         rawd = exe_ne_header_entry_table_table_raw_entry(t,ent);
@@ -104,7 +92,7 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
         }
         else {
             printf("    ORDINAL.%u.NAME=",i + 1);
-            print_entry_table_locate_name_by_ordinal(nonresnames,resnames,i + 1);
+            print_entry_table_locate_name_by_ordinal(&ordinals,i + 1);
             /* has generated .TYPE by now */
             if (ent->segment_id == 0xFE) {
                 struct exe_ne_header_entry_table_fixed_segment_entry *fent =
@@ -128,15 +116,16 @@ void print_entry_table(const struct exe_ne_header_entry_table_table * const t,co
             printf("\n");
         }
     }
+
+    exe_ne_header_name_ordinal_index_free(&ordinals);
 }
 
 void name_entry_table_sort_by_user_options(struct exe_ne_header_name_entry_table * const t) {
-    ne_name_entry_sort_by_table = t;
     if (t->raw == NULL || t->length <= 1)
         return;
 
     /* NTS: Do not sort the module name in entry 0 */
-    qsort(t->table+1,t->length-1,sizeof(*(t->table)),ne_name_entry_sort_by_ordinal);
+    exe_ne_header_name_entry_table_sort(t,1,ne_name_entry_compare_by_ordinal);
 }
 
 void dump_ne_res_BITMAPINFOHEADER(const struct exe_ne_header_BITMAPINFOHEADER *bmphdr) {
@@ -1380,20 +1369,16 @@ void dump_ne_res_RT_VERSION(const unsigned char *data,const size_t len) {
 }
 
 int main(int argc,char **argv) {
-    struct exe_ne_header_entry_table_table ne_entry_table;
-    struct exe_ne_header_name_entry_table ne_nonresname;
-    struct exe_ne_header_name_entry_table ne_resname;
-    struct exe_ne_header ne_header;
-    uint32_t ne_header_offset;
-    uint32_t file_size;
+    struct exe_ne_header_entry_table_table *ne_entry_table;
+    struct exe_ne_header_name_entry_table *ne_nonresname;
+    struct exe_ne_header_name_entry_table *ne_resname;
+    struct exe_ne_image ne_image;
     char *a;
     int i;
 
-    assert(sizeof(ne_header) == 0x40);
+    assert(sizeof(ne_image.ne_header) == 0x40);
     memset(&exehdr,0,sizeof(exehdr));
-    exe_ne_header_name_entry_table_init(&ne_resname);
-    exe_ne_header_name_entry_table_init(&ne_nonresname);
-    exe_ne_header_entry_table_table_init(&ne_entry_table);
+    exe_ne_image_init(&ne_image);
 
     for (i=1;i < argc;) {
         a = argv[i++];
@@ -1437,103 +1422,38 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    file_size = lseek(src_fd,0,SEEK_END);
-    lseek(src_fd,0,SEEK_SET);
-
-    if (read(src_fd,&exehdr,sizeof(exehdr)) != (int)sizeof(exehdr)) {
-        fprintf(stderr,"EXE header read error\n");
+    if ((i=exe_ne_image_open_fd(&ne_image,src_fd)) < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
+    exehdr = ne_image.exehdr;
 
-    if (exehdr.magic != 0x5A4DU/*MZ*/) {
-        fprintf(stderr,"EXE header signature missing\n");
-        return 1;
-    }
-
-    if (!exe_header_can_contain_exe_extension(&exehdr)) {
-        fprintf(stderr,"EXE header cannot contain extension\n");
-        return 1;
-    }
-
-    /* go read the extension */
-    if (lseek(src_fd,EXE_HEADER_EXTENSION_OFFSET,SEEK_SET) != EXE_HEADER_EXTENSION_OFFSET ||
-        read(src_fd,&ne_header_offset,4) != 4) {
-        fprintf(stderr,"Cannot read extension\n");
-        return 1;
-    }
-    if ((ne_header_offset+EXE_HEADER_NE_HEADER_SIZE) >= file_size) {
-        fprintf(stderr,"NE header not present (offset out of range)\n");
-        return 0;
-    }
-
-    /* go read the extended header */
-    if (lseek(src_fd,ne_header_offset,SEEK_SET) != ne_header_offset ||
-        read(src_fd,&ne_header,sizeof(ne_header)) != sizeof(ne_header)) {
-        fprintf(stderr,"Cannot read NE header\n");
-        return 1;
-    }
-    if (ne_header.signature != EXE_NE_SIGNATURE) {
-        fprintf(stderr,"Not an NE executable\n");
-        return 1;
+    /* go read the extension, and the extended header */
+    if ((i=exe_ne_image_read_ne_header(&ne_image)) < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
+        return (i == EXE_NE_IMAGE_ERR_NO_NE_HEADER) ? 0 : 1;
     }
 
     /* load nonresident name table */
-    if (ne_header.nonresident_name_table_offset != 0 && ne_header.nonresident_name_table_length != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.nonresident_name_table_offset,SEEK_SET) == ne_header.nonresident_name_table_offset) {
-        unsigned char *base;
-
-        base = exe_ne_header_name_entry_table_alloc_raw(&ne_nonresname,ne_header.nonresident_name_table_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_nonresname.raw_length) != ne_nonresname.raw_length)
-                exe_ne_header_name_entry_table_free_raw(&ne_nonresname);
-        }
-
-        exe_ne_header_name_entry_table_parse_raw(&ne_nonresname);
-        name_entry_table_sort_by_user_options(&ne_nonresname);
-    }
+    ne_nonresname = exe_ne_image_nonresident_names(&ne_image);
+    name_entry_table_sort_by_user_options(ne_nonresname);
 
     /* load resident name table */
-    if (ne_header.resident_name_table_offset != 0 && ne_header.module_reference_table_offset > ne_header.resident_name_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.resident_name_table_offset + ne_header_offset,SEEK_SET) == (ne_header.resident_name_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* RESIDENT_NAME_TABLE_SIZE = module_reference_table_offset - resident_name_table_offset */
-        raw_length = (unsigned short)(ne_header.module_reference_table_offset - ne_header.resident_name_table_offset);
-
-        base = exe_ne_header_name_entry_table_alloc_raw(&ne_resname,raw_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_resname.raw_length) != ne_resname.raw_length)
-                exe_ne_header_name_entry_table_free_raw(&ne_resname);
-        }
-
-        exe_ne_header_name_entry_table_parse_raw(&ne_resname);
-        name_entry_table_sort_by_user_options(&ne_resname);
-    }
+    ne_resname = exe_ne_image_resident_names(&ne_image);
+    name_entry_table_sort_by_user_options(ne_resname);
 
     /* entry table */
-    if (ne_header.entry_table_offset != 0 && ne_header.entry_table_length != 0 &&
-        lseek(src_fd,ne_header.entry_table_offset + ne_header_offset,SEEK_SET) == (ne_header.entry_table_offset + ne_header_offset)) {
-        unsigned char *base;
-
-        base = exe_ne_header_entry_table_table_alloc_raw(&ne_entry_table,ne_header.entry_table_length);
-        if (base != NULL) {
-            if (read(src_fd,base,ne_header.entry_table_length) != ne_header.entry_table_length)
-                exe_ne_header_entry_table_table_free_raw(&ne_entry_table);
-        }
-
-        exe_ne_header_entry_table_table_parse_raw(&ne_entry_table);
-    }
+    ne_entry_table = exe_ne_image_entry_table(&ne_image);
 
     /* show module name */
     {
-        if (ne_resname.table != NULL && ne_resname.length != 0) {
-            const struct exe_ne_header_name_entry *ent = ne_resname.table;
+        if (ne_resname->table != NULL && ne_resname->length != 0) {
+            const struct exe_ne_header_name_entry *ent = ne_resname->table;
             uint16_t ordinal;
             char tmp[255+1];
 
-            ordinal = ne_name_entry_get_ordinal(&ne_resname,ent);
-            ne_name_entry_get_name(tmp,sizeof(tmp),&ne_resname,ent);
+            ordinal = ne_name_entry_get_ordinal(ne_resname,ent);
+            ne_name_entry_get_name(tmp,sizeof(tmp),ne_resname,ent);
 
             if (ordinal == 0)
                 printf("MODULE %s\n",tmp);
@@ -1542,13 +1462,13 @@ int main(int argc,char **argv) {
 
     /* show module description */
     {
-        if (ne_nonresname.table != NULL && ne_nonresname.length != 0) {
-            const struct exe_ne_header_name_entry *ent = ne_nonresname.table;
+        if (ne_nonresname->table != NULL && ne_nonresname->length != 0) {
+            const struct exe_ne_header_name_entry *ent = ne_nonresname->table;
             uint16_t ordinal;
             char tmp[255+1];
 
-            ordinal = ne_name_entry_get_ordinal(&ne_nonresname,ent);
-            ne_name_entry_get_name(tmp,sizeof(tmp),&ne_nonresname,ent);
+            ordinal = ne_name_entry_get_ordinal(ne_nonresname,ent);
+            ne_name_entry_get_name(tmp,sizeof(tmp),ne_nonresname,ent);
 
             if (ordinal == 0)
                 printf("    DESCRIPTION=%s\n",tmp);
@@ -1573,18 +1493,12 @@ int main(int argc,char **argv) {
     }
 
     /* file size */
-    {
-        unsigned long sz = lseek(src_fd,0,SEEK_END);
-
-        printf("    FILE.SIZE=%lu\n",sz);
-    }
+    printf("    FILE.SIZE=%lu\n",(unsigned long)ne_image.file_size);
 
     /* exports */
-    print_entry_table(&ne_entry_table,&ne_nonresname,&ne_resname);
+    print_entry_table(ne_entry_table,ne_nonresname,ne_resname);
 
-    exe_ne_header_entry_table_table_free(&ne_entry_table);
-    exe_ne_header_name_entry_table_free(&ne_nonresname);
-    exe_ne_header_name_entry_table_free(&ne_resname);
+    exe_ne_image_free(&ne_image);
     close(src_fd);
     return 0;
 }
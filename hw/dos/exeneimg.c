@@ -0,0 +1,336 @@
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(LINUX)
+# include <sys/mman.h>
+#endif
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+
+void exe_ne_image_init(struct exe_ne_image * const img) {
+    memset(img,0,sizeof(*img));
+    img->fd = -1;
+    exe_ne_header_segment_table_init(&img->segments);
+    exe_ne_header_name_entry_table_init(&img->resident_names);
+    exe_ne_header_name_entry_table_init(&img->nonresident_names);
+    exe_ne_header_imported_name_table_init(&img->imported_names);
+    exe_ne_header_entry_table_table_init(&img->entry_table);
+    exe_ne_header_resource_table_init(&img->resources);
+}
+
+void exe_ne_image_free(struct exe_ne_image * const img) {
+    exe_ne_header_segment_table_free(&img->segments);
+    exe_ne_header_name_entry_table_free(&img->resident_names);
+    exe_ne_header_name_entry_table_free(&img->nonresident_names);
+    exe_ne_header_imported_name_table_free(&img->imported_names);
+    exe_ne_header_entry_table_table_free(&img->entry_table);
+    exe_ne_header_resource_table_free(&img->resources);
+    img->loaded = 0;
+
+#if defined(LINUX)
+    if (img->map != NULL) {
+        munmap(img->map,(size_t)img->file_size);
+        img->map = NULL;
+    }
+#endif
+
+    img->file_size = 0;
+    img->fd = -1;
+}
+
+/* return a pointer to len bytes at file offset ofs: into the mapping if mapped (*ownership = 0),
+ * else a malloc()'d copy read from the file (*ownership = 1). NULL if the range is not entirely
+ * within the file. give it back with exe_ne_image_put() */
+unsigned char *exe_ne_image_get(struct exe_ne_image * const img,const unsigned long ofs,const size_t len,unsigned char * const ownership) {
+    unsigned char *p;
+
+    *ownership = 0;
+    if (len == 0 || ofs >= (unsigned long)img->file_size || (unsigned long)len > ((unsigned long)img->file_size - ofs))
+        return NULL;
+
+    if (img->map != NULL)
+        return img->map + ofs;
+
+    if ((p=(unsigned char*)malloc(len)) == NULL)
+        return NULL;
+
+    if ((unsigned long)lseek(img->fd,(off_t)ofs,SEEK_SET) != ofs || (size_t)read(img->fd,p,len) != len) {
+        free(p);
+        return NULL;
+    }
+
+    *ownership = 1;
+    return p;
+}
+
+void exe_ne_image_put(unsigned char *p,const unsigned char ownership) {
+    if (p != NULL && ownership) free(p);
+}
+
+static int exe_ne_image_copy(struct exe_ne_image * const img,const unsigned long ofs,void * const dst,const size_t len) {
+    unsigned char own;
+    unsigned char *p;
+
+    if ((p=exe_ne_image_get(img,ofs,len,&own)) == NULL)
+        return -1;
+
+    memcpy(dst,p,len);
+    exe_ne_image_put(p,own);
+    return 0;
+}
+
+/* attach to a file, map it if possible, and read the MS-DOS EXE header */
+int exe_ne_image_open_fd(struct exe_ne_image * const img,const int fd) {
+    off_t sz;
+
+    exe_ne_image_free(img);
+
+    sz = lseek(fd,0,SEEK_END);
+    lseek(fd,0,SEEK_SET);
+    if (sz < (off_t)0) sz = 0;
+    if ((unsigned long long)sz > 0xFFFFFFFFull) sz = (off_t)0xFFFFFFFFul;
+
+    img->fd = fd;
+    img->file_size = (uint32_t)sz;
+
+#if defined(LINUX)
+    {
+        struct stat st;
+
+        if (img->file_size != 0 && fstat(fd,&st) == 0 && S_ISREG(st.st_mode)) {
+            void *p = mmap(NULL,(size_t)img->file_size,PROT_READ,MAP_PRIVATE,fd,0);
+            if (p != MAP_FAILED) img->map = (unsigned char*)p;
+        }
+    }
+#endif
+
+    if (exe_ne_image_copy(img,0,&img->exehdr,sizeof(img->exehdr)) < 0)
+        return EXE_NE_IMAGE_ERR_EXE_HEADER;
+    if (img->exehdr.magic != 0x5A4DU/*MZ*/)
+        return EXE_NE_IMAGE_ERR_NOT_MZ;
+
+    return 0;
+}
+
+/* follow the extension offset in the MS-DOS EXE header to the NE header */
+int exe_ne_image_read_ne_header(struct exe_ne_image * const img) {
+    if (!exe_header_can_contain_exe_extension(&img->exehdr))
+        return EXE_NE_IMAGE_ERR_NO_EXTENSION;
+    if (exe_ne_image_copy(img,EXE_HEADER_EXTENSION_OFFSET,&img->ne_header_offset,4) < 0)
+        return EXE_NE_IMAGE_ERR_EXTENSION;
+    if ((img->ne_header_offset+EXE_HEADER_NE_HEADER_SIZE) >= img->file_size)
+        return EXE_NE_IMAGE_ERR_NO_NE_HEADER;
+    if (exe_ne_image_copy(img,img->ne_header_offset,&img->ne_header,sizeof(img->ne_header)) < 0)
+        return EXE_NE_IMAGE_ERR_NE_HEADER;
+    if (img->ne_header.signature != EXE_NE_SIGNATURE)
+        return EXE_NE_IMAGE_ERR_NOT_NE;
+
+    return 0;
+}
+
+const char *exe_ne_image_error_str(const int err) {
+    switch (err) {
+        case 0:                                 return "No error";
+        case EXE_NE_IMAGE_ERR_EXE_HEADER:       return "EXE header read error";
+        case EXE_NE_IMAGE_ERR_NOT_MZ:           return "EXE header signature missing";
+        case EXE_NE_IMAGE_ERR_NO_EXTENSION:     return "EXE header cannot contain extension";
+        case EXE_NE_IMAGE_ERR_EXTENSION:        return "Cannot read extension";
+        case EXE_NE_IMAGE_ERR_NO_NE_HEADER:     return "NE header not present (offset out of range)";
+        case EXE_NE_IMAGE_ERR_NE_HEADER:        return "Cannot read NE header";
+        case EXE_NE_IMAGE_ERR_NOT_NE:           return "Not an NE executable";
+        default:                                break;
+    }
+
+    return "Unknown error";
+}
+
+struct exe_ne_header_segment_table *exe_ne_image_segment_table(struct exe_ne_image * const img) {
+    struct exe_ne_header_segment_table * const t = &img->segments;
+    const struct exe_ne_header * const h = &img->ne_header;
+    unsigned char own;
+    unsigned char *p;
+
+    if (img->loaded & EXE_NE_IMAGE_SEGMENT_TABLE) return t;
+    img->loaded |= EXE_NE_IMAGE_SEGMENT_TABLE;
+
+    assert(sizeof(*(t->table)) == 8);
+    if (h->segment_table_entries != 0 && h->segment_table_offset != 0) {
+        p = exe_ne_image_get(img,(unsigned long)h->segment_table_offset + img->ne_header_offset,
+            (size_t)h->segment_table_entries * sizeof(*(t->table)),&own);
+        if (p != NULL) {
+            t->table = (struct exe_ne_header_segment_entry*)p;
+            t->length = h->segment_table_entries;
+            t->sector_shift = h->sector_shift;
+            t->table_ownership = own;
+        }
+    }
+
+    return t;
+}
+
+static void exe_ne_image_load_name_table(struct exe_ne_image * const img,struct exe_ne_header_name_entry_table * const t,const unsigned long ofs,const size_t len) {
+    unsigned char own;
+    unsigned char *p;
+
+    if ((p=exe_ne_image_get(img,ofs,len,&own)) != NULL) {
+        t->raw = p;
+        t->raw_length = len;
+        t->raw_ownership = own;
+    }
+
+    exe_ne_header_name_entry_table_parse_raw(t);
+}
+
+struct exe_ne_header_name_entry_table *exe_ne_image_resident_names(struct exe_ne_image * const img) {
+    struct exe_ne_header_name_entry_table * const t = &img->resident_names;
+    const struct exe_ne_header * const h = &img->ne_header;
+
+    if (img->loaded & EXE_NE_IMAGE_RESIDENT_NAMES) return t;
+    img->loaded |= EXE_NE_IMAGE_RESIDENT_NAMES;
+
+    /* RESIDENT_NAME_TABLE_SIZE = module_reference_table_offset - resident_name_table_offset */
+    if (h->resident_name_table_offset != 0 && h->module_reference_table_offset > h->resident_name_table_offset)
+        exe_ne_image_load_name_table(img,t,(unsigned long)h->resident_name_table_offset + img->ne_header_offset,
+            (unsigned short)(h->module_reference_table_offset - h->resident_name_table_offset));
+
+    return t;
+}
+
+struct exe_ne_header_name_entry_table *exe_ne_image_nonresident_names(struct exe_ne_image * const img) {
+    struct exe_ne_header_name_entry_table * const t = &img->nonresident_names;
+    const struct exe_ne_header * const h = &img->ne_header;
+
+    if (img->loaded & EXE_NE_IMAGE_NONRESIDENT_NAMES) return t;
+    img->loaded |= EXE_NE_IMAGE_NONRESIDENT_NAMES;
+
+    /* NTS: the nonresident name table offset is relative to the start of the file */
+    if (h->nonresident_name_table_offset != 0 && h->nonresident_name_table_length != 0)
+        exe_ne_image_load_name_table(img,t,(unsigned long)h->nonresident_name_table_offset,h->nonresident_name_table_length);
+
+    return t;
+}
+
+struct exe_ne_header_imported_name_table *exe_ne_image_imported_names(struct exe_ne_image * const img) {
+    struct exe_ne_header_imported_name_table * const t = &img->imported_names;
+    const struct exe_ne_header * const h = &img->ne_header;
+    unsigned char own;
+    unsigned char *p;
+
+    if (img->loaded & EXE_NE_IMAGE_IMPORTED_NAMES) return t;
+    img->loaded |= EXE_NE_IMAGE_IMPORTED_NAMES;
+
+    /* IMPORTED_NAME_TABLE_SIZE = entry_table_offset - imported_name_table_offset       (header does not report size of imported name table) */
+    if (h->imported_name_table_offset != 0 && h->entry_table_offset > h->imported_name_table_offset) {
+        const size_t len = (unsigned short)(h->entry_table_offset - h->imported_name_table_offset);
+
+        if ((p=exe_ne_image_get(img,(unsigned long)h->imported_name_table_offset + img->ne_header_offset,len,&own)) != NULL) {
+            t->raw = p;
+            t->raw_length = len;
+            t->raw_ownership = own;
+        }
+
+        exe_ne_header_imported_name_table_parse_raw(t);
+    }
+
+    /* module reference table, offsets into the imported name table */
+    if (h->module_reference_table_offset != 0 && h->module_reftable_entries != 0) {
+        p = exe_ne_image_get(img,(unsigned long)h->module_reference_table_offset + img->ne_header_offset,
+            (size_t)h->module_reftable_entries * sizeof(uint16_t),&own);
+        if (p != NULL) {
+            t->module_ref_table = (uint16_t*)p;
+            t->module_ref_table_length = h->module_reftable_entries;
+            t->module_ref_table_ownership = own;
+        }
+    }
+
+    return t;
+}
+
+struct exe_ne_header_entry_table_table *exe_ne_image_entry_table(struct exe_ne_image * const img) {
+    struct exe_ne_header_entry_table_table * const t = &img->entry_table;
+    const struct exe_ne_header * const h = &img->ne_header;
+    unsigned char own;
+    unsigned char *p;
+
+    if (img->loaded & EXE_NE_IMAGE_ENTRY_TABLE) return t;
+    img->loaded |= EXE_NE_IMAGE_ENTRY_TABLE;
+
+    if (h->entry_table_offset != 0 && h->entry_table_length != 0) {
+        if ((p=exe_ne_image_get(img,(unsigned long)h->entry_table_offset + img->ne_header_offset,h->entry_table_length,&own)) != NULL) {
+            t->raw = p;
+            t->raw_length = h->entry_table_length;
+            t->raw_ownership = own;
+        }
+
+        exe_ne_header_entry_table_table_parse_raw(t);
+    }
+
+    return t;
+}
+
+struct exe_ne_header_resource_table_t *exe_ne_image_resource_table(struct exe_ne_image * const img) {
+    struct exe_ne_header_resource_table_t * const t = &img->resources;
+    const struct exe_ne_header * const h = &img->ne_header;
+    unsigned char own;
+    unsigned char *p;
+
+    if (img->loaded & EXE_NE_IMAGE_RESOURCE_TABLE) return t;
+    img->loaded |= EXE_NE_IMAGE_RESOURCE_TABLE;
+
+    /* RESOURCE_TABLE_SIZE = resident_name_table_offset - resource_table_offset         (header does not report size, "number of segments" is worthless) */
+    if (h->resource_table_offset != 0 && h->resident_name_table_offset > h->resource_table_offset) {
+        const size_t len = (unsigned short)(h->resident_name_table_offset - h->resource_table_offset);
+
+        if ((p=exe_ne_image_get(img,(unsigned long)h->resource_table_offset + img->ne_header_offset,len,&own)) != NULL) {
+            t->raw = p;
+            t->raw_length = len;
+            t->raw_ownership = own;
+        }
+
+        exe_ne_header_resource_table_parse(t);
+    }
+
+    return t;
+}
+
+/* relocation table of a segment, at the offset given by exe_ne_header_segment_table_get_relocation_table_offset().
+ * returns the number of relocations the table says it has (r->table is NULL if they could not all be read),
+ * or -1 if the count cannot be read. release r with exe_ne_header_segment_reloc_table_free() */
+int exe_ne_image_segment_relocs(struct exe_ne_image * const img,const unsigned long reloc_offset,struct exe_ne_header_segment_reloc_table * const r) {
+    uint16_t count;
+    unsigned char own;
+    unsigned char *p;
+
+    exe_ne_header_segment_reloc_table_free(r);
+    if (reloc_offset == 0)
+        return -1;
+
+    /* at the start of the relocation struct, is a 16-bit WORD that indicates how many entries are there,
+     * followed by an array of relocation entries. */
+    if (exe_ne_image_copy(img,reloc_offset,&count,2) < 0)
+        return -1;
+    if (count == 0)
+        return 0;
+
+    assert(sizeof(*(r->table)) == 8);
+    if ((p=exe_ne_image_get(img,reloc_offset + 2ul,(size_t)count * sizeof(*(r->table)),&own)) != NULL) {
+        r->table = (union exe_ne_header_segment_relocation_entry*)p;
+        r->length = count;
+        r->table_ownership = own;
+    }
+
+    return (int)count;
+}
+
@@ -44,7 +44,7 @@ void exe_ne_header_imported_name_table_init(struct exe_ne_header_imported_name_t
 }
 
 void exe_ne_header_imported_name_table_free_module_ref_table(struct exe_ne_header_imported_name_table * const t) {
-    if (t->module_ref_table) free(t->module_ref_table);
+    if (t->module_ref_table && t->module_ref_table_ownership) free(t->module_ref_table);
     t->module_ref_table = NULL;
     t->module_ref_table_length = 0;
 }
@@ -60,6 +60,7 @@ uint16_t *exe_ne_header_imported_name_table_alloc_module_ref_table(struct exe_ne
         return NULL;
 
     t->module_ref_table_length = entries;
+    t->module_ref_table_ownership = 1;
     return t->module_ref_table;
 }
 
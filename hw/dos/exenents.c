@@ -12,16 +12,12 @@
 #include <hw/dos/exenehdr.h>
 #include <hw/dos/exenepar.h>
 
-struct exe_ne_header_name_entry_table *ne_name_entry_sort_by_table = NULL;
-
-int ne_name_entry_sort_by_name(const void *a,const void *b) {
-    struct exe_ne_header_name_entry *ea = (struct exe_ne_header_name_entry *)a;
-    struct exe_ne_header_name_entry *eb = (struct exe_ne_header_name_entry *)b;
+int ne_name_entry_compare_by_name(const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ea,const struct exe_ne_header_name_entry * const eb) {
     unsigned char *pa,*pb;
     unsigned int i;
 
-    pa = ne_name_entry_get_name_base(ne_name_entry_sort_by_table,ea);
-    pb = ne_name_entry_get_name_base(ne_name_entry_sort_by_table,eb);
+    pa = ne_name_entry_get_name_base(t,ea);
+    pb = ne_name_entry_get_name_base(t,eb);
 
     for (i=0;i < ea->length && i < eb->length;i++) {
         int diff = (int)pa[i] - (int)pb[i];
@@ -36,10 +32,148 @@ int ne_name_entry_sort_by_name(const void *a,const void *b) {
         return 0 - (int)pb[i];
 }
 
-int ne_name_entry_sort_by_ordinal(const void *a,const void *b) {
-    struct exe_ne_header_name_entry *ea = (struct exe_ne_header_name_entry *)a;
-    struct exe_ne_header_name_entry *eb = (struct exe_ne_header_name_entry *)b;
-    return ne_name_entry_get_ordinal(ne_name_entry_sort_by_table,ea) -
-        ne_name_entry_get_ordinal(ne_name_entry_sort_by_table,eb);
+int ne_name_entry_compare_by_ordinal(const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ea,const struct exe_ne_header_name_entry * const eb) {
+    return (int)ne_name_entry_get_ordinal(t,ea) - (int)ne_name_entry_get_ordinal(t,eb);
+}
+
+/* stable sort of table[first...length-1]. the table is passed to the compare function, there is no global state,
+ * so different tables can be sorted at the same time from different threads. merge sort, or insertion sort if
+ * the temporary buffer cannot be allocated. */
+void exe_ne_header_name_entry_table_sort(struct exe_ne_header_name_entry_table * const t,const unsigned int first,const exe_ne_header_name_entry_compare_t cmp) {
+    struct exe_ne_header_name_entry *a,*tmp,*src,*dst,*sw;
+    unsigned int n,width,lo,mid,hi,i,j,k;
+
+    if (t->table == NULL || t->raw == NULL || first >= t->length || (t->length - first) <= 1)
+        return;
+
+    a = t->table + first;
+    n = t->length - first;
+
+    tmp = (struct exe_ne_header_name_entry*)malloc(sizeof(*tmp) * n);
+    if (tmp == NULL) {
+        struct exe_ne_header_name_entry e;
+
+        for (i=1;i < n;i++) {
+            e = a[i];
+            for (j=i;j > 0 && cmp(t,&a[j-1],&e) > 0;j--) a[j] = a[j-1];
+            a[j] = e;
+        }
+
+        return;
+    }
+
+    /* bottom-up merge sort, ping-ponging between the table and tmp */
+    src = a;
+    dst = tmp;
+    for (width=1;width < n;width *= 2u) {
+        for (lo=0;lo < n;lo += width * 2u) {
+            mid = lo + width;
+            if (mid > n) mid = n;
+            hi = mid + width;
+            if (hi > n) hi = n;
+
+            i = lo; j = mid; k = lo;
+            while (i < mid && j < hi) {
+                if (cmp(t,&src[j],&src[i]) < 0)
+                    dst[k++] = src[j++];
+                else
+                    dst[k++] = src[i++];
+            }
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+
+        sw = src; src = dst; dst = sw;
+    }
+
+    if (src != a) memcpy(a,src,sizeof(*a) * n);
+    free(tmp);
+}
+
+void exe_ne_header_name_ordinal_index_init(struct exe_ne_header_name_ordinal_index * const x) {
+    memset(x,0,sizeof(*x));
+}
+
+void exe_ne_header_name_ordinal_index_free(struct exe_ne_header_name_ordinal_index * const x) {
+    if (x->table) free(x->table);
+    x->table = NULL;
+    x->length = 0;
+    x->alloc = 0;
+}
+
+static unsigned int exe_ne_header_name_ordinal_index_hash(const uint16_t ordinal,const unsigned int alloc) {
+    /* ordinals are usually dense 1...N, multiplicative hash spreads them and any gaps well enough */
+    return (unsigned int)(((uint32_t)ordinal * 0x9E3779B1UL) >> 16UL) & (alloc - 1u);
+}
+
+static void exe_ne_header_name_ordinal_index_add_table(struct exe_ne_header_name_ordinal_index * const x,const struct exe_ne_header_name_entry_table * const t,const unsigned char resident) {
+    struct exe_ne_header_name_ordinal_index_entry *ie;
+    const struct exe_ne_header_name_entry *ent;
+    unsigned int i,h;
+    uint16_t ordinal;
+
+    if (t == NULL || t->table == NULL || t->raw == NULL)
+        return;
+
+    for (i=0;i < t->length;i++) {
+        ent = t->table + i;
+        ordinal = ne_name_entry_get_ordinal(t,ent);
+
+        /* first match wins, same as a linear search of the tables in the order they were added */
+        h = exe_ne_header_name_ordinal_index_hash(ordinal,x->alloc);
+        while ((ie=x->table+h)->entry != NULL && ie->ordinal != ordinal)
+            h = (h + 1u) & (x->alloc - 1u);
+
+        if (ie->entry == NULL) {
+            ie->ordinal = ordinal;
+            ie->resident = resident;
+            ie->table = t;
+            ie->entry = ent;
+            x->length++;
+        }
+    }
+}
+
+/* build an ordinal to name index over the resident and nonresident name tables. where an ordinal appears more
+ * than once the resident name table wins, then whichever comes first in the table. the index points into the
+ * tables, rebuild it if they are re-sorted or freed. either table may be NULL. */
+int exe_ne_header_name_ordinal_index_build(struct exe_ne_header_name_ordinal_index * const x,const struct exe_ne_header_name_entry_table * const resnames,const struct exe_ne_header_name_entry_table * const nonresnames) {
+    unsigned int count = 0;
+
+    exe_ne_header_name_ordinal_index_free(x);
+
+    if (resnames != NULL && resnames->table != NULL) count += resnames->length;
+    if (nonresnames != NULL && nonresnames->table != NULL) count += nonresnames->length;
+    if (count == 0) return 0;
+
+    /* power of 2, at most half full */
+    x->alloc = 16;
+    while (x->alloc < (count * 2u)) x->alloc *= 2u;
+
+    x->table = (struct exe_ne_header_name_ordinal_index_entry*)calloc(x->alloc,sizeof(*(x->table)));
+    if (x->table == NULL) {
+        x->alloc = 0;
+        return -1;
+    }
+
+    exe_ne_header_name_ordinal_index_add_table(x,resnames,1);
+    exe_ne_header_name_ordinal_index_add_table(x,nonresnames,0);
+    return 0;
+}
+
+const struct exe_ne_header_name_ordinal_index_entry *exe_ne_header_name_ordinal_index_lookup(const struct exe_ne_header_name_ordinal_index * const x,const uint16_t ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie;
+    unsigned int h;
+
+    if (x->table == NULL || x->length == 0)
+        return NULL;
+
+    h = exe_ne_header_name_ordinal_index_hash(ordinal,x->alloc);
+    while ((ie=x->table+h)->entry != NULL) {
+        if (ie->ordinal == ordinal) return ie;
+        h = (h + 1u) & (x->alloc - 1u);
+    }
+
+    return NULL;
 }
 
@@ -20,17 +20,20 @@ struct exe_ne_header_imported_name_table {
     /* module reference table (relies on this data) */
     uint16_t*                                       module_ref_table;
     unsigned int                                    module_ref_table_length; /* in entries of type uint16_t */
+    unsigned char                                   module_ref_table_ownership;
 };
 
 struct exe_ne_header_segment_reloc_table {
     union exe_ne_header_segment_relocation_entry*   table;
     unsigned int                                    length;
+    unsigned char                                   table_ownership;
 };
 
 struct exe_ne_header_segment_table {
     struct exe_ne_header_segment_entry*             table;
     unsigned int                                    length;
     unsigned int                                    sector_shift;
+    unsigned char                                   table_ownership;
 };
 
 struct exe_ne_header_name_entry_table {
@@ -48,6 +51,22 @@ struct exe_ne_header_name_entry {
 };
 #pragma pack(pop)
 
+typedef int (*exe_ne_header_name_entry_compare_t)(const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const a,const struct exe_ne_header_name_entry * const b);
+
+struct exe_ne_header_name_ordinal_index_entry {
+    const struct exe_ne_header_name_entry_table*    table;              /* table the name is in */
+    const struct exe_ne_header_name_entry*          entry;              /* NULL if slot is empty */
+    uint16_t                                        ordinal;
+    unsigned char                                   resident;           /* 1 = resident name table, 0 = nonresident */
+};
+
+/* ordinal to name hash index over the resident and nonresident name tables */
+struct exe_ne_header_name_ordinal_index {
+    struct exe_ne_header_name_ordinal_index_entry*  table;
+    unsigned int                                    alloc;              /* power of 2 */
+    unsigned int                                    length;
+};
+
 #pragma pack(push,1)
 struct exe_ne_header_entry_table_entry {
     uint8_t         segment_id;         // 0x00 = empty  0xFF = movable  0xFE = constant   anything else = segment index
@@ -151,8 +170,14 @@ unsigned char *ne_name_entry_get_name_base(const struct exe_ne_header_name_entry
 void ne_name_entry_get_name(char *dst,size_t dstmax,const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ent);
 int exe_ne_header_name_entry_table_parse_raw(struct exe_ne_header_name_entry_table * const t);
 
-int ne_name_entry_sort_by_name(const void *a,const void *b);
-int ne_name_entry_sort_by_ordinal(const void *a,const void *b);
+int ne_name_entry_compare_by_name(const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ea,const struct exe_ne_header_name_entry * const eb);
+int ne_name_entry_compare_by_ordinal(const struct exe_ne_header_name_entry_table * const t,const struct exe_ne_header_name_entry * const ea,const struct exe_ne_header_name_entry * const eb);
+void exe_ne_header_name_entry_table_sort(struct exe_ne_header_name_entry_table * const t,const unsigned int first,const exe_ne_header_name_entry_compare_t cmp);
+
+void exe_ne_header_name_ordinal_index_init(struct exe_ne_header_name_ordinal_index * const x);
+void exe_ne_header_name_ordinal_index_free(struct exe_ne_header_name_ordinal_index * const x);
+int exe_ne_header_name_ordinal_index_build(struct exe_ne_header_name_ordinal_index * const x,const struct exe_ne_header_name_entry_table * const resnames,const struct exe_ne_header_name_entry_table * const nonresnames);
+const struct exe_ne_header_name_ordinal_index_entry *exe_ne_header_name_ordinal_index_lookup(const struct exe_ne_header_name_ordinal_index * const x,const uint16_t ordinal);
 
 void exe_ne_header_entry_table_table_init(struct exe_ne_header_entry_table_table * const t);
 void exe_ne_header_entry_table_table_free_table(struct exe_ne_header_entry_table_table * const t);
@@ -163,8 +188,6 @@ void exe_ne_header_entry_table_table_parse_raw(struct exe_ne_header_entry_table_
 size_t exe_ne_header_entry_table_table_raw_entry_size(const struct exe_ne_header_entry_table_entry * const ent);
 unsigned char *exe_ne_header_entry_table_table_raw_entry(const struct exe_ne_header_entry_table_table * const t,const struct exe_ne_header_entry_table_entry * const ent);
 
-extern struct exe_ne_header_name_entry_table *ne_name_entry_sort_by_table;
-
 unsigned int exe_ne_header_is_WINOLDBITMAP(const unsigned char *data/*at least 4 bytes*/,const size_t len);
 unsigned int exe_ne_header_is_WINOLDICON(const unsigned char *data/*at least 4 bytes*/,const size_t len);
 unsigned int exe_ne_header_is_WINOLDCURSOR(const unsigned char *data/*at least 4 bytes*/,const size_t len);
@@ -173,3 +196,54 @@ unsigned int exe_ne_header_BITMAPINFOHEADER_get_palette_count(const struct exe_n
 
 const char *exe_ne_header_RT_DIALOG_ClassID_to_string(const uint8_t c);
 
+/* NE image: the whole file, mapped once (Linux) or read on demand from the file descriptor,
+ * with each table parsed the first time it is asked for. When mapped, the raw tables, segment
+ * table, module reference table and relocation tables point into the mapping (ownership == 0)
+ * instead of being copied. The caller still owns (and closes) the file descriptor. */
+#define EXE_NE_IMAGE_SEGMENT_TABLE                  (1U << 0U)
+#define EXE_NE_IMAGE_RESIDENT_NAMES                 (1U << 1U)
+#define EXE_NE_IMAGE_NONRESIDENT_NAMES              (1U << 2U)
+#define EXE_NE_IMAGE_IMPORTED_NAMES                 (1U << 3U)
+#define EXE_NE_IMAGE_ENTRY_TABLE                    (1U << 4U)
+#define EXE_NE_IMAGE_RESOURCE_TABLE                 (1U << 5U)
+
+/* exe_ne_image_open_fd() and exe_ne_image_read_ne_header() return values */
+#define EXE_NE_IMAGE_ERR_EXE_HEADER                 (-1)    /* cannot read MS-DOS EXE header */
+#define EXE_NE_IMAGE_ERR_NOT_MZ                     (-2)    /* MS-DOS EXE header signature missing */
+#define EXE_NE_IMAGE_ERR_NO_EXTENSION               (-3)    /* MS-DOS EXE header too small to point at an extension */
+#define EXE_NE_IMAGE_ERR_EXTENSION                  (-4)    /* cannot read extension offset */
+#define EXE_NE_IMAGE_ERR_NO_NE_HEADER               (-5)    /* extension offset out of range */
+#define EXE_NE_IMAGE_ERR_NE_HEADER                  (-6)    /* cannot read NE header */
+#define EXE_NE_IMAGE_ERR_NOT_NE                     (-7)    /* not an NE header */
+
+struct exe_ne_image {
+    int                                             fd;
+    unsigned char*                                  map;                /* entire file, or NULL if not mapped */
+    uint32_t                                        file_size;
+    struct exe_dos_header                           exehdr;
+    uint32_t                                        ne_header_offset;
+    struct exe_ne_header                            ne_header;
+    unsigned int                                    loaded;             /* EXE_NE_IMAGE_* tables parsed so far */
+    struct exe_ne_header_segment_table              segments;
+    struct exe_ne_header_name_entry_table           resident_names;
+    struct exe_ne_header_name_entry_table           nonresident_names;
+    struct exe_ne_header_imported_name_table        imported_names;     /* and module reference table */
+    struct exe_ne_header_entry_table_table          entry_table;
+    struct exe_ne_header_resource_table_t           resources;
+};
+
+void exe_ne_image_init(struct exe_ne_image * const img);
+void exe_ne_image_free(struct exe_ne_image * const img);
+int exe_ne_image_open_fd(struct exe_ne_image * const img,const int fd);
+int exe_ne_image_read_ne_header(struct exe_ne_image * const img);
+const char *exe_ne_image_error_str(const int err);
+unsigned char *exe_ne_image_get(struct exe_ne_image * const img,const unsigned long ofs,const size_t len,unsigned char * const ownership);
+void exe_ne_image_put(unsigned char *p,const unsigned char ownership);
+struct exe_ne_header_segment_table *exe_ne_image_segment_table(struct exe_ne_image * const img);
+struct exe_ne_header_name_entry_table *exe_ne_image_resident_names(struct exe_ne_image * const img);
+struct exe_ne_header_name_entry_table *exe_ne_image_nonresident_names(struct exe_ne_image * const img);
+struct exe_ne_header_imported_name_table *exe_ne_image_imported_names(struct exe_ne_image * const img);
+struct exe_ne_header_entry_table_table *exe_ne_image_entry_table(struct exe_ne_image * const img);
+struct exe_ne_header_resource_table_t *exe_ne_image_resource_table(struct exe_ne_image * const img);
+int exe_ne_image_segment_relocs(struct exe_ne_image * const img,const unsigned long reloc_offset,struct exe_ne_header_segment_reloc_table * const r);
+
@@ -8,6 +8,13 @@
 #include <stdio.h>
 #include <fcntl.h>
 
+#if defined(LINUX)
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <direct.h>
+#endif
+
 #include <hw/dos/exehdr.h>
 #include <hw/dos/exenehdr.h>
 #include <hw/dos/exenepar.h>
@@ -19,28 +26,770 @@
 static char*                    src_file = NULL;
 static int                      src_fd = -1;
 
+static char*                    bulk_dir = NULL;
+
 static unsigned char            opt_pric = 0;
 
 static struct exe_dos_header    exehdr;
 static struct exe_dos_layout    exelayout;
 
+/* bulk extraction reads neighboring resources together, up to this many bytes at a time */
+#if TARGET_MSDOS == 16
+# define BULK_RUN_MAX           0x8000UL
+#else
+# define BULK_RUN_MAX           0x100000UL
+#endif
+/* and reads across gaps between resources up to this size rather than start another read */
+#define BULK_RUN_GAP            4096UL
+
 static void help(void) {
     fprintf(stderr,"EXENERDM -i <exe file>\n");
     fprintf(stderr,"  -pric      Pre-pend a directory structure to ICON and CURSOR resources.\n");
     fprintf(stderr,"             .ico and .cur files are expected to contain this directory.\n");
+    fprintf(stderr,"  -x <dir>   Extract all resources into <dir> in one pass, converted to\n");
+    fprintf(stderr,"             .bmp, .ico, .cur and .txt where possible (implies -pric).\n");
+}
+
+/* converted resource, assembled in memory before it is written out */
+struct res_out {
+    unsigned char*              data;
+    size_t                      len;
+    size_t                      alloc;
+    unsigned char               err;                /* out of memory, contents incomplete */
+};
+
+static void res_out_init(struct res_out * const o) {
+    memset(o,0,sizeof(*o));
+}
+
+static void res_out_reset(struct res_out * const o) {
+    o->len = 0;
+    o->err = 0;
+}
+
+static void res_out_free(struct res_out * const o) {
+    if (o->data) free(o->data);
+    res_out_init(o);
+}
+
+/* append len zero bytes, return pointer to them */
+static unsigned char *res_out_alloc(struct res_out * const o,const size_t len) {
+    unsigned char *p;
+    size_t na;
+
+    if (o->err) return NULL;
+
+    if (len > (o->alloc - o->len)) {
+        na = o->alloc + (o->alloc / 2u) + len + 256u;
+        if (na < o->alloc || (p=(unsigned char*)realloc(o->data,na)) == NULL) {
+            o->err = 1;
+            return NULL;
+        }
+
+        o->data = p;
+        o->alloc = na;
+    }
+
+    p = o->data + o->len;
+    memset(p,0,len);
+    o->len += len;
+    return p;
+}
+
+static void res_out_write(struct res_out * const o,const void * const src,const size_t len) {
+    unsigned char *p;
+
+    if (len != 0 && (p=res_out_alloc(o,len)) != NULL)
+        memcpy(p,src,len);
+}
+
+/* append dst_len bytes from data[ofs] (src_len bytes at most), zero padded where the resource is too short */
+static void res_out_write_row(struct res_out * const o,const unsigned char * const data,const size_t len,const unsigned long ofs,size_t src_len,const size_t dst_len) {
+    unsigned char *p;
+
+    if ((p=res_out_alloc(o,dst_len)) == NULL)
+        return;
+
+    if (src_len > dst_len)
+        src_len = dst_len;
+    if (ofs >= (unsigned long)len)
+        src_len = 0;
+    else if ((unsigned long)src_len > ((unsigned long)len - ofs))
+        src_len = (size_t)((unsigned long)len - ofs);
+
+    if (src_len != 0) memcpy(p,data+ofs,src_len);
+}
+
+static int write_file(const char * const path,const unsigned char * const data,const size_t len) {
+    int fd;
+
+    fd = open(path,O_CREAT|O_TRUNC|O_WRONLY|O_BINARY,0644);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to write %s, %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    if (len != 0 && (size_t)write(fd,data,len) != len) {
+        fprintf(stderr,"Write error to %s\n",path);
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static void res_out_bmp_file_header(struct res_out * const o,const uint32_t size,const uint32_t bboff) {
+    unsigned char hd[14];
+
+    memcpy(hd+0,"BM",2);
+    *((uint32_t*)(hd+2)) = size;
+    *((uint16_t*)(hd+6)) = 0;
+    *((uint16_t*)(hd+8)) = 0;
+    *((uint32_t*)(hd+10)) = bboff;
+    res_out_write(o,hd,sizeof(hd));
+}
+
+static void res_out_bitmapinfoheader(struct res_out * const o,const int32_t width,const int32_t height,const uint16_t planes,const uint16_t bitcount,const uint32_t size_image) {
+    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
+
+    bmphdr3x.biSize = sizeof(bmphdr3x);
+    bmphdr3x.biWidth = width;
+    bmphdr3x.biHeight = height;
+    bmphdr3x.biPlanes = planes;
+    bmphdr3x.biBitCount = bitcount;
+    bmphdr3x.biCompression = 0;
+    bmphdr3x.biSizeImage = size_image;
+    bmphdr3x.biXPelsPerMeter = 0;
+    bmphdr3x.biYPelsPerMeter = 0;
+    bmphdr3x.biClrUsed = 0;
+    bmphdr3x.biClrImportant = 0;
+    res_out_write(o,&bmphdr3x,sizeof(bmphdr3x));
+}
+
+static void res_out_palette(struct res_out * const o,const unsigned int bitcount) {
+    struct exe_ne_header_RGBQUAD rgb;
+
+    if (bitcount == 1) {
+        rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
+        res_out_write(o,&rgb,sizeof(rgb));
+        rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
+        res_out_write(o,&rgb,sizeof(rgb));
+    }
+    else {
+        /* I'll add 4bpp generation when I see it in the wild */
+        printf("! Cannot guess palette\n");
+    }
+}
+
+static void res_out_icondir(struct res_out * const o,const uint16_t type,const uint16_t count) {
+    struct exe_ne_header_resource_ICONDIR pre; /* same layout as CURSORDIR */
+
+    pre.idReserved = 0;
+    pre.idType = type;
+    pre.idCount = count;
+    res_out_write(o,&pre,sizeof(pre));
+}
+
+/* Windows 1.x/2.x BITMAP to Windows 3.x .BMP.
+ * then it is necessary to convert, not just copy, because
+ * the alignment rules are different:
+ *
+ * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
+ * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
+static int res_convert_old_bitmap(struct res_out * const o,const unsigned char * const data,const size_t len) {
+    const struct exe_ne_header_RTBITMAP *bmphdr2x = (const struct exe_ne_header_RTBITMAP *)data;
+    unsigned long align3x,rd,h,y;
+    unsigned long bboff = 14;
+
+    if (!(bmphdr2x->bmPlanes == 1 && (bmphdr2x->bmBitsPixel == 1 || bmphdr2x->bmBitsPixel == 4)) ||
+        bmphdr2x->bmWidth <= 0 || bmphdr2x->bmWidthBytes <= 0)
+        return -1;
+
+    printf("* Converting BITMAP to BITMAPINFOHEADER\n");
+
+    align3x = ((((unsigned long)bmphdr2x->bmBitsPixel * (unsigned long)bmphdr2x->bmWidth) + 31UL) & (~31UL)) >> 3UL; // BITMAPINFOHEADER alignment
+    rd = (unsigned long)bmphdr2x->bmWidthBytes;
+    h = (unsigned long)abs(bmphdr2x->bmHeight);
+
+    /* generate BMP FILE header */
+    bboff += sizeof(struct exe_ne_header_BITMAPINFOHEADER);
+    bboff += (1UL << (unsigned long)bmphdr2x->bmBitsPixel) * 4UL;
+    res_out_bmp_file_header(o,(align3x * h) + bboff,bboff);
+    res_out_bitmapinfoheader(o,bmphdr2x->bmWidth,bmphdr2x->bmHeight,bmphdr2x->bmPlanes,bmphdr2x->bmBitsPixel,align3x * h);
+    res_out_palette(o,bmphdr2x->bmBitsPixel);
+
+    /* copy scanlines. bitmap bits immediately follow bmphdr2x.
+     * we have to flip the bitmap upside-down as we convert */
+    for (y=0;y < h;y++)
+        res_out_write_row(o,data,len,sizeof(*bmphdr2x) + ((h - 1UL - y) * rd),(size_t)rd,(size_t)align3x);
+
+    return 0;
+}
+
+/* Windows 1.x/2.x icon or cursor to a Windows 3.x .ICO or .CUR (type 1 or 2) with one image.
+ * the icon and cursor resources share the same layout. */
+static int res_convert_old_iconcur(struct res_out * const o,const unsigned char * const data,const size_t len,const uint16_t type) {
+    const struct exe_ne_header_RTICONBITMAP *bmphdr2x = (const struct exe_ne_header_RTICONBITMAP *)data;
+    struct exe_ne_header_resource_ICONDIRENTRY dent; /* same layout as CURSORDIRENTRY, hotspot in wPlanes/wBitCount */
+    unsigned long align3xmono,align3x;
+    unsigned long ird,mrd,h,y,mofs,iofs;
+    unsigned int planes,bpp;
+
+    /* Windows 1.x/2.x icons for whatever reason have bits/pixel == 0 and planes == 0,
+     * which apparently means monochromatic anyway */
+    planes = bmphdr2x->bmPlanes ? bmphdr2x->bmPlanes : 1;
+    bpp = bmphdr2x->bmBitsPixel ? bmphdr2x->bmBitsPixel : 1;
+
+    if (!(planes == 1 && bpp == 1) || bmphdr2x->bmWidth <= 0 || bmphdr2x->bmWidthBytes <= 0)
+        return -1;
+
+    printf("* Converting BITMAP to BITMAPINFOHEADER\n");
+
+    align3x = ((((unsigned long)bpp * (unsigned long)bmphdr2x->bmWidth) + 31UL) & (~31UL)) >> 3UL; // BITMAPINFOHEADER alignment
+    align3xmono = (((unsigned long)bmphdr2x->bmWidth + 31UL) & (~31UL)) >> 3UL; // BITMAPINFOHEADER alignment
+    h = (unsigned long)abs(bmphdr2x->bmHeight);
+
+    res_out_icondir(o,type,1);
+
+    dent.bWidth = (uint8_t)bmphdr2x->bmWidth;
+    dent.bHeight = (uint8_t)bmphdr2x->bmHeight;
+    dent.bColorCount = (type == 1) ? (uint8_t)(1u << bpp) : 0;
+    dent.bReserved = 0;
+    dent.wPlanes = (type == 1) ? planes : 0;        /* cursor: wXHotspot */
+    dent.wBitCount = (type == 1) ? bpp : 0;         /* cursor: wYHotspot */
+    dent.dwBytesInRes = sizeof(struct exe_ne_header_BITMAPINFOHEADER) + (4UL << (unsigned long)bpp) +
+        (align3x * h) + (align3xmono * h); // icon + mask
+    dent.dwImageOffset = sizeof(struct exe_ne_header_resource_ICONDIR) + sizeof(dent);
+    res_out_write(o,&dent,sizeof(dent));
+
+    res_out_bitmapinfoheader(o,bmphdr2x->bmWidth,bmphdr2x->bmHeight * 2,planes,bpp,
+        (align3x * h) + (align3xmono * h)); // icon + mask
+    res_out_palette(o,bpp);
+
+    /* NTS: Where Windows 3.x stores the image first, followed by the mask,
+     *      Windows 1.x/2.x store the mask first, then the image. Like bitmaps
+     *      in Windows 1.x/2.x the DIB is top-down, we convert here to bottom-up. */
+    ird = (unsigned long)bmphdr2x->bmWidthBytes;
+    mrd = (((unsigned long)bmphdr2x->bmWidth + 15UL) & (~15UL)) >> 3UL; /* WORD align requirement */
+    mofs = sizeof(*bmphdr2x);
+    iofs = mofs + (mrd * h);
+
+    for (y=0;y < h;y++)
+        res_out_write_row(o,data,len,iofs + ((h - 1UL - y) * ird),(size_t)ird,(size_t)align3x);
+    for (y=0;y < h;y++)
+        res_out_write_row(o,data,len,mofs + ((h - 1UL - y) * mrd),(size_t)mrd,(size_t)align3xmono);
+
+    return 0;
+}
+
+/* convert resource data (len bytes, of the fcpy bytes the resource table claims) to the file
+ * format Windows tools expect, or copy it as-is if there is nothing to convert */
+static void res_convert(struct res_out * const o,const uint16_t rtTypeID,const unsigned char *data,size_t len,const unsigned long fcpy) {
+    if (len == 0)
+        return;
+
+    if (rtTypeID == exe_ne_header_RT_BITMAP) {
+        if (exe_ne_header_is_WINOLDBITMAP(data,len)) {
+            if (res_convert_old_bitmap(o,data,len) == 0)
+                return;
+
+            printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
+        }
+        else if (len >= sizeof(struct exe_ne_header_BITMAPINFOHEADER)) {
+            /* need to add a BITMAPFILEHEADER to make it valid */
+            const struct exe_ne_header_BITMAPINFOHEADER *bmphdr =
+                (const struct exe_ne_header_BITMAPINFOHEADER *)data;
+            unsigned int pal_colors =
+                exe_ne_header_BITMAPINFOHEADER_get_palette_count(bmphdr);
+            unsigned long bboff = 14;
+
+            bboff += bmphdr->biSize;
+            bboff += pal_colors * 4;
+            res_out_bmp_file_header(o,fcpy + 14,bboff);
+        }
+    }
+    else if (rtTypeID == exe_ne_header_RT_ICON) {
+        if (exe_ne_header_is_WINOLDICON(data,len)) {
+            if (res_convert_old_iconcur(o,data,len,1) == 0)
+                return;
+
+            printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
+        }
+        else if (len >= sizeof(struct exe_ne_header_BITMAPINFOHEADER)) {
+            struct exe_ne_header_resource_ICONDIRENTRY dent;
+            const struct exe_ne_header_BITMAPINFOHEADER *bmp =
+                (const struct exe_ne_header_BITMAPINFOHEADER*)data;
+
+            res_out_icondir(o,1,1);
+
+            dent.bWidth = bmp->biWidth;
+            dent.bHeight = bmp->biHeight >> 1;      /* remember icons carry image + mask and dwHeight is double the actual height */
+            dent.bColorCount = 1 << bmp->biBitCount;
+            dent.bReserved = 0;
+            dent.wPlanes = bmp->biPlanes;
+            dent.wBitCount = bmp->biBitCount;
+            dent.dwBytesInRes = fcpy;
+            dent.dwImageOffset = sizeof(struct exe_ne_header_resource_ICONDIR) + sizeof(dent);
+            res_out_write(o,&dent,sizeof(dent));
+        }
+    }
+    else if (rtTypeID == exe_ne_header_RT_CURSOR) {
+        /* raw resource data for a cursor when in an NE executable:
+         *
+         * WORD                 hotspot_x
+         * WORD                 hotspot_y
+         * BITMAPINFOHEADER     cursor bitmapinfo
+         * RGBQUAD              cursor palette
+         * BYTE[]               cursor bitmap
+         *
+         */
+        if (exe_ne_header_is_WINOLDCURSOR(data,len)) {
+            if (res_convert_old_iconcur(o,data,len,2) == 0)
+                return;
+
+            printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
+        }
+        else if (len >= (4 + sizeof(struct exe_ne_header_BITMAPINFOHEADER))) {
+            struct exe_ne_header_resource_CURSORDIRENTRY dent;
+            const struct exe_ne_header_BITMAPINFOHEADER *bmp =
+                (const struct exe_ne_header_BITMAPINFOHEADER*)(data + 4);
+
+            res_out_icondir(o,2,1);
+
+            dent.bWidth = bmp->biWidth;
+            dent.bHeight = bmp->biHeight >> 1;      /* remember cursors carry image + mask and dwHeight is double the actual height */
+            dent.bColorCount = 1 << bmp->biBitCount;
+            dent.bReserved = 0;
+            dent.wXHotspot = *((uint16_t*)(data + 0));
+            dent.wYHotspot = *((uint16_t*)(data + 2));
+            dent.dwBytesInRes = fcpy - 4;
+            dent.dwImageOffset = sizeof(struct exe_ne_header_resource_CURSORDIR) + sizeof(dent);
+            res_out_write(o,&dent,sizeof(dent));
+
+            data += 4;
+            len -= 4;
+        }
+    }
+
+    res_out_write(o,data,len);
+}
+
+/* copy one resource to path, converted if -pric */
+static int res_extract(struct exe_ne_image * const img,const uint16_t rtTypeID,const unsigned long foff,const unsigned long fcpy,const char * const path) {
+    unsigned char *p = NULL,own = 0;
+    unsigned long have = 0;
+    struct res_out o;
+    int ret;
+
+    if (foff < (unsigned long)img->file_size) {
+        have = (unsigned long)img->file_size - foff;
+        if (have > fcpy) have = fcpy;
+    }
+    if (have != 0 && have <= (unsigned long)((size_t)(~0u)))
+        p = exe_ne_image_get(img,foff,(size_t)have,&own);
+    if (p == NULL)
+        have = 0;
+    if (have < fcpy)
+        fprintf(stderr,"Early EOF on resource\n");
+
+    if (opt_pric) {
+        res_out_init(&o);
+        res_convert(&o,rtTypeID,p,(size_t)have,fcpy);
+        if (o.err) {
+            fprintf(stderr,"Out of memory converting %s\n",path);
+            ret = -1;
+        }
+        else {
+            ret = write_file(path,o.data,o.len);
+        }
+        res_out_free(&o);
+    }
+    else {
+        ret = write_file(path,p,(size_t)have);
+    }
+
+    exe_ne_image_put(p,own);
+    return ret;
+}
+
+/* RT_STRING as text, one line per string: the string ID (numbered the same way EXENEDMP does),
+ * a tab, then the string with backslash, CR, LF and other control characters escaped */
+static void res_convert_strings(struct res_out * const o,const unsigned char *data,const size_t len,const uint16_t rnID) {
+    const unsigned char *fence = data + len;
+    unsigned int count = 0;
+    unsigned char length;
+    char tmp[32];
+    unsigned char c;
+
+    while (data < fence) {
+        length = *data++;
+        if ((data+length) > fence) break;
+
+        if (length != 0) {
+            sprintf(tmp,"0x%04x\t",((exe_ne_header_resource_table_typeinfo_RNID_AS_INTEGER(rnID) << 4U) + count) & 0xFFFFU);
+            res_out_write(o,tmp,strlen(tmp));
+
+            while (length-- != 0) {
+                c = *data++;
+                if (c == '\\')      res_out_write(o,"\\\\",2);
+                else if (c == '\r') res_out_write(o,"\\r",2);
+                else if (c == '\n') res_out_write(o,"\\n",2);
+                else if (c == '\t') res_out_write(o,"\\t",2);
+                else if (c < 0x20 || c == 0x7F) {
+                    sprintf(tmp,"\\x%02x",c);
+                    res_out_write(o,tmp,4);
+                }
+                else {
+                    res_out_write(o,&c,1);
+                }
+            }
+
+            res_out_write(o,"\n",1);
+        }
+
+        count++;
+    }
+}
+
+/* one resource in bulk extraction */
+struct bulk_res {
+    const struct exe_ne_header_resource_table_typeinfo*     tinfo;
+    const struct exe_ne_header_resource_table_nameinfo*     ninfo;
+    unsigned long                                           foff;
+    unsigned long                                           fcpy;
+    unsigned char*                                          data;   /* copy of RT_ICON, RT_CURSOR and groups, for after the pass */
+    size_t                                                  len;
+    unsigned char                                           grouped;/* RT_ICON or RT_CURSOR written as part of a group */
+};
+
+static int bulk_res_cmp_foff(const void *a,const void *b) {
+    const struct bulk_res *ra = (const struct bulk_res*)a;
+    const struct bulk_res *rb = (const struct bulk_res*)b;
+
+    if (ra->foff < rb->foff) return -1;
+    if (ra->foff > rb->foff) return 1;
+    return 0;
+}
+
+static const char *bulk_res_file_ext(const uint16_t rtTypeID) {
+    switch (rtTypeID) {
+        case exe_ne_header_RT_CURSOR:           return ".cur";
+        case exe_ne_header_RT_BITMAP:           return ".bmp";
+        case exe_ne_header_RT_ICON:             return ".ico";
+        case exe_ne_header_RT_MENU:             return ".men";
+        case exe_ne_header_RT_DIALOG:           return ".dlg";
+        case exe_ne_header_RT_STRING:           return ".txt";
+        case exe_ne_header_RT_FONTDIR:          return ".fdr";
+        case exe_ne_header_RT_FONT:             return ".fon";
+        case exe_ne_header_RT_ACCELERATOR:      return ".acc";
+        case exe_ne_header_RT_RCDATA:           return ".rcd";
+        case exe_ne_header_RT_MESSAGETABLE:     return ".msg";
+        case exe_ne_header_RT_GROUP_CURSOR:     return ".cur";
+        case exe_ne_header_RT_GROUP_ICON:       return ".ico";
+        case exe_ne_header_RT_NAME_TABLE:       return ".ntb";
+        case exe_ne_header_RT_VERSION:          return ".ver";
+        default:                                break;
+    };
+
+    return ".bin";
+}
+
+static void bulk_res_path(char * const path,const char * const dir,const struct bulk_res * const r,const char * const file_ext) {
+    sprintf(path,"%s/%04X%04X%s",dir,
+        (unsigned int)r->tinfo->rtTypeID,
+        (unsigned int)r->ninfo->rnID,
+        file_ext != NULL ? file_ext : bulk_res_file_ext(r->tinfo->rtTypeID));
+}
+
+static struct bulk_res *bulk_res_find_id(struct bulk_res * const res,const unsigned int count,const uint16_t rtTypeID,const uint16_t nID) {
+    unsigned int i;
+
+    for (i=0;i < count;i++) {
+        if (res[i].tinfo->rtTypeID == rtTypeID && res[i].ninfo->rnID == (nID | 0x8000u))
+            return res + i;
+    }
+
+    return NULL;
+}
+
+/* RT_GROUP_ICON or RT_GROUP_CURSOR and the RT_ICON or RT_CURSOR resources it lists, as one .ico or .cur */
+static int bulk_convert_group(struct res_out * const o,const struct bulk_res * const g,struct bulk_res * const res,const unsigned int count) {
+    const int is_cursor = (g->tinfo->rtTypeID == exe_ne_header_RT_GROUP_CURSOR);
+    const struct exe_ne_header_resource_GRICONDIRENTRY *gi;
+    const struct exe_ne_header_resource_GRCURSORDIRENTRY *gc;
+    struct exe_ne_header_resource_ICONDIRENTRY dent; /* same layout as CURSORDIRENTRY */
+    struct bulk_res **img;
+    unsigned long *imglen;
+    unsigned long imgofs;
+    unsigned int i,n;
+    uint16_t nID;
+    int ret = -1;
+
+    if (g->len < sizeof(struct exe_ne_header_resource_ICONDIR))
+        return -1;
+
+    n = ((const struct exe_ne_header_resource_ICONDIR*)g->data)->idCount;
+    if (n == 0 || (sizeof(struct exe_ne_header_resource_ICONDIR) + ((unsigned long)n * sizeof(*gi))) > (unsigned long)g->len)
+        return -1;
+
+    img = (struct bulk_res**)malloc(sizeof(*img) * n);
+    imglen = (unsigned long*)malloc(sizeof(*imglen) * n);
+    if (img == NULL || imglen == NULL)
+        goto done;
+
+    /* GRICONDIRENTRY and GRCURSORDIRENTRY are the same size, nID at the end */
+    gi = (const struct exe_ne_header_resource_GRICONDIRENTRY*)(g->data + sizeof(struct exe_ne_header_resource_ICONDIR));
+    gc = (const struct exe_ne_header_resource_GRCURSORDIRENTRY*)gi;
+
+    for (i=0;i < n;i++) {
+        nID = is_cursor ? gc[i].nID : gi[i].nID;
+        img[i] = bulk_res_find_id(res,count,is_cursor ? exe_ne_header_RT_CURSOR : exe_ne_header_RT_ICON,nID);
+        if (img[i] == NULL || img[i]->data == NULL || img[i]->len < (is_cursor ? 4u : 1u)) {
+            printf("! %s group entry %u refers to missing resource 0x%04x\n",is_cursor ? "Cursor" : "Icon",i,nID);
+            goto done;
+        }
+
+        /* the group knows the exact size, the resource table only knows it rounded up to alignment */
+        imglen[i] = is_cursor ? gc[i].lBytesInRes : gi[i].dwBytesInRes;
+        if (imglen[i] == 0 || imglen[i] > (unsigned long)img[i]->len)
+            imglen[i] = (unsigned long)img[i]->len;
+        if (is_cursor) {
+            if (imglen[i] < 4UL) imglen[i] = 4UL;
+            imglen[i] -= 4UL; /* hotspot */
+        }
+    }
+
+    res_out_icondir(o,is_cursor ? 2 : 1,n);
+    imgofs = sizeof(struct exe_ne_header_resource_ICONDIR) + ((unsigned long)n * sizeof(dent));
+    for (i=0;i < n;i++) {
+        if (is_cursor) {
+            dent.bWidth = (uint8_t)gc[i].wWidth;
+            dent.bHeight = (uint8_t)(gc[i].wHeight >> 1); /* image + mask */
+            dent.bColorCount = 0;
+            dent.bReserved = 0;
+            dent.wPlanes = *((uint16_t*)(img[i]->data + 0)); /* wXHotspot */
+            dent.wBitCount = *((uint16_t*)(img[i]->data + 2)); /* wYHotspot */
+        }
+        else {
+            dent.bWidth = gi[i].bWidth;
+            dent.bHeight = gi[i].bHeight;
+            dent.bColorCount = gi[i].bColorCount;
+            dent.bReserved = 0;
+            dent.wPlanes = gi[i].wPlanes;
+            dent.wBitCount = gi[i].wBitCount;
+        }
+        dent.dwBytesInRes = imglen[i];
+        dent.dwImageOffset = imgofs;
+        res_out_write(o,&dent,sizeof(dent));
+        imgofs += imglen[i];
+    }
+
+    for (i=0;i < n;i++) {
+        res_out_write(o,img[i]->data + (is_cursor ? 4 : 0),(size_t)imglen[i]);
+        img[i]->grouped = 1;
+    }
+
+    ret = 0;
+done:
+    if (imglen) free(imglen);
+    if (img) free(img);
+    return ret;
+}
+
+static int bulk_write(struct res_out * const o,const char * const dir,const struct bulk_res * const r,const char * const file_ext) {
+    char path[1024];
+
+    if (strlen(dir) > (sizeof(path) - 16))
+        return -1;
+
+    bulk_res_path(path,dir,r,file_ext);
+    if (o->err) {
+        fprintf(stderr,"Out of memory converting %s\n",path);
+        return -1;
+    }
+    if (write_file(path,o->data,o->len) < 0)
+        return -1;
+
+    printf("%s: %lu bytes\n",path,(unsigned long)o->len);
+    return 0;
+}
+
+/* extract every resource into dir. resources are visited in file offset order, and neighboring
+ * resources are fetched from the image with one read. icons and cursors are held back until the
+ * groups that list them are known, everything else is converted and written as it is read. */
+static int bulk_extract(struct exe_ne_image * const img,const char * const dir) {
+    const struct exe_ne_header_resource_table_typeinfo *tinfo;
+    struct exe_ne_header_resource_table_t *ne_resources;
+    unsigned int ti,ni,i,j,count = 0,reads = 0;
+    unsigned long rs,re,have;
+    struct bulk_res *res,*r;
+    unsigned char *p,own;
+    struct res_out o;
+    int ret = 0;
+
+    ne_resources = exe_ne_image_resource_table(img);
+    if (ne_resources == NULL || ne_resources->typeinfo_length == 0) {
+        printf("No resources\n");
+        return 0;
+    }
+
+    for (ti=0;ti < ne_resources->typeinfo_length;ti++) {
+        tinfo = exe_ne_header_resource_table_get_typeinfo_entry(ne_resources,ti);
+        if (tinfo != NULL) count += tinfo->rtResourceCount;
+    }
+    if (count == 0) {
+        printf("No resources\n");
+        return 0;
+    }
+
+#if defined(LINUX)
+    if (mkdir(dir,0755) < 0 && errno != EEXIST) {
+#else
+    if (mkdir(dir) < 0 && errno != EEXIST) {
+#endif
+        fprintf(stderr,"Unable to create %s, %s\n",dir,strerror(errno));
+        return 1;
+    }
+
+    if ((res=(struct bulk_res*)calloc(count,sizeof(*res))) == NULL)
+        return 1;
+
+    for (count=0,ti=0;ti < ne_resources->typeinfo_length;ti++) {
+        tinfo = exe_ne_header_resource_table_get_typeinfo_entry(ne_resources,ti);
+        if (tinfo == NULL) continue;
+
+        for (ni=0;ni < tinfo->rtResourceCount;ni++) {
+            r = res + count;
+            r->tinfo = tinfo;
+            r->ninfo = exe_ne_header_resource_table_get_typeinfo_nameinfo_entry(tinfo,ni);
+            if (r->ninfo == NULL) continue;
+
+            r->fcpy = (unsigned long)r->ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources);
+            r->foff = (unsigned long)r->ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources);
+            count++;
+        }
+    }
+
+    qsort(res,count,sizeof(*res),bulk_res_cmp_foff);
+
+    res_out_init(&o);
+    for (i=0;i < count;i=j) {
+        /* gather the run of resources starting here */
+        rs = res[i].foff;
+        re = rs + res[i].fcpy;
+        for (j=i+1;j < count;j++) {
+            unsigned long ne = res[j].foff + res[j].fcpy;
+
+            if (ne < re) ne = re;
+            if (res[j].foff > (re + BULK_RUN_GAP) || (ne - rs) > BULK_RUN_MAX)
+                break;
+
+            re = ne;
+        }
+
+        if (rs >= (unsigned long)img->file_size)
+            re = rs;
+        else if (re > (unsigned long)img->file_size)
+            re = (unsigned long)img->file_size;
+
+        p = NULL;
+        own = 0;
+        if (re > rs) {
+            if ((re - rs) <= (unsigned long)((size_t)(~0u)))
+                p = exe_ne_image_get(img,rs,(size_t)(re - rs),&own);
+            if (p != NULL)
+                reads++;
+            else
+                fprintf(stderr,"Unable to read %lu bytes at %lu\n",re - rs,rs);
+        }
+
+        for (;i < j;i++) {
+            const unsigned char *d = NULL;
+
+            r = res + i;
+            have = 0;
+            if (p != NULL && r->foff < re) {
+                have = re - r->foff;
+                if (have > r->fcpy) have = r->fcpy;
+                d = p + (r->foff - rs);
+            }
+            if (have < r->fcpy)
+                fprintf(stderr,"Early EOF on resource %04X%04X\n",r->tinfo->rtTypeID,r->ninfo->rnID);
+
+            switch (r->tinfo->rtTypeID) {
+                case exe_ne_header_RT_ICON:
+                case exe_ne_header_RT_CURSOR:
+                case exe_ne_header_RT_GROUP_ICON:
+                case exe_ne_header_RT_GROUP_CURSOR:
+                    if (have != 0 && (r->data=(unsigned char*)malloc((size_t)have)) != NULL) {
+                        memcpy(r->data,d,(size_t)have);
+                        r->len = (size_t)have;
+                    }
+                    continue;
+                case exe_ne_header_RT_STRING:
+                    if (have != 0) res_convert_strings(&o,d,(size_t)have,r->ninfo->rnID);
+                    break;
+                default:
+                    if (have != 0) res_convert(&o,r->tinfo->rtTypeID,d,(size_t)have,r->fcpy);
+                    break;
+            }
+
+            if (bulk_write(&o,dir,r,NULL) < 0) ret = 1;
+            res_out_reset(&o);
+        }
+
+        exe_ne_image_put(p,own);
+    }
+
+    /* groups first, then any icon or cursor no group claimed */
+    for (i=0;i < count;i++) {
+        r = res + i;
+        if (!(r->tinfo->rtTypeID == exe_ne_header_RT_GROUP_ICON || r->tinfo->rtTypeID == exe_ne_header_RT_GROUP_CURSOR))
+            continue;
+
+        if (bulk_convert_group(&o,r,res,count) == 0) {
+            if (bulk_write(&o,dir,r,NULL) < 0) ret = 1;
+        }
+        else {
+            /* leave it as the raw group directory */
+            res_out_reset(&o);
+            res_out_write(&o,r->data,r->len);
+            if (bulk_write(&o,dir,r,r->tinfo->rtTypeID == exe_ne_header_RT_GROUP_ICON ? ".gic" : ".gcr") < 0) ret = 1;
+        }
+        res_out_reset(&o);
+    }
+    for (i=0;i < count;i++) {
+        r = res + i;
+        if (!(r->tinfo->rtTypeID == exe_ne_header_RT_ICON || r->tinfo->rtTypeID == exe_ne_header_RT_CURSOR) || r->grouped)
+            continue;
+
+        if (r->data != NULL) res_convert(&o,r->tinfo->rtTypeID,r->data,r->len,r->fcpy);
+        if (bulk_write(&o,dir,r,NULL) < 0) ret = 1;
+        res_out_reset(&o);
+    }
+
+    printf("* %u resources, %u reads\n",count,reads);
+
+    res_out_free(&o);
+    for (i=0;i < count;i++) {
+        if (res[i].data) free(res[i].data);
+    }
+    free(res);
+    return ret;
 }
 
 int main(int argc,char **argv) {
-    struct exe_ne_header_resource_table_t ne_resources;
+    struct exe_ne_header_resource_table_t *ne_resources;
+    struct exe_ne_image ne_image;
     struct exe_ne_header ne_header;
     uint32_t ne_header_offset;
-    uint32_t file_size;
     char *a;
     int i;
 
     assert(sizeof(ne_header) == 0x40);
     memset(&exehdr,0,sizeof(exehdr));
-    exe_ne_header_resource_table_init(&ne_resources);
+    exe_ne_image_init(&ne_image);
 
     for (i=1;i < argc;) {
         a = argv[i++];
@@ -59,6 +808,10 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"pric")) {
                 opt_pric = 1;
             }
+            else if (!strcmp(a,"x")) {
+                bulk_dir = argv[i++];
+                if (bulk_dir == NULL) return 1;
+            }
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -83,21 +836,14 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    file_size = lseek(src_fd,0,SEEK_END);
-    lseek(src_fd,0,SEEK_SET);
-
-    if (read(src_fd,&exehdr,sizeof(exehdr)) != (int)sizeof(exehdr)) {
-        fprintf(stderr,"EXE header read error\n");
-        return 1;
-    }
-
-    if (exehdr.magic != 0x5A4DU/*MZ*/) {
-        fprintf(stderr,"EXE header signature missing\n");
+    if ((i=exe_ne_image_open_fd(&ne_image,src_fd)) < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
+    exehdr = ne_image.exehdr;
 
     printf("File size:                        %lu bytes\n",
-        (unsigned long)file_size);
+        (unsigned long)ne_image.file_size);
     printf("MS-DOS EXE header:\n");
     printf("    last_block_bytes:             %u bytes\n",
         exehdr.last_block_bytes);
@@ -149,32 +895,29 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    if (!exe_header_can_contain_exe_extension(&exehdr)) {
-        fprintf(stderr,"EXE header cannot contain extension\n");
+    /* go read the extension, and the extended header */
+    i = exe_ne_image_read_ne_header(&ne_image);
+    if (i == EXE_NE_IMAGE_ERR_NO_EXTENSION || i == EXE_NE_IMAGE_ERR_EXTENSION) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
-
-    /* go read the extension */
-    if (lseek(src_fd,EXE_HEADER_EXTENSION_OFFSET,SEEK_SET) != EXE_HEADER_EXTENSION_OFFSET ||
-        read(src_fd,&ne_header_offset,4) != 4) {
-        fprintf(stderr,"Cannot read extension\n");
-        return 1;
-    }
-    printf("    EXE extension (if exists) at: %lu\n",(unsigned long)ne_header_offset);
-    if ((ne_header_offset+EXE_HEADER_NE_HEADER_SIZE) >= file_size) {
-        printf("! NE header not present (offset out of range)\n");
+    printf("    EXE extension (if exists) at: %lu\n",(unsigned long)ne_image.ne_header_offset);
+    if (i == EXE_NE_IMAGE_ERR_NO_NE_HEADER) {
+        printf("! %s\n",exe_ne_image_error_str(i));
         return 0;
     }
-
-    /* go read the extended header */
-    if (lseek(src_fd,ne_header_offset,SEEK_SET) != ne_header_offset ||
-        read(src_fd,&ne_header,sizeof(ne_header)) != sizeof(ne_header)) {
-        fprintf(stderr,"Cannot read NE header\n");
+    else if (i < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(i));
         return 1;
     }
-    if (ne_header.signature != EXE_NE_SIGNATURE) {
-        fprintf(stderr,"Not an NE executable\n");
-        return 1;
+    ne_header_offset = ne_image.ne_header_offset;
+    ne_header = ne_image.ne_header;
+
+    if (bulk_dir != NULL) {
+        i = bulk_extract(&ne_image,bulk_dir);
+        exe_ne_image_free(&ne_image);
+        close(src_fd);
+        return i;
     }
 
     printf("Windows or OS/2 NE header:\n");
@@ -421,28 +1164,15 @@ int main(int argc,char **argv) {
         printf("! WARNING: imported name table offset > entry table offset");
 
     /* resource table */
-    if (ne_header.resource_table_offset != 0 && ne_header.resident_name_table_offset > ne_header.resource_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.resource_table_offset + ne_header_offset,SEEK_SET) == (ne_header.resource_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* RESOURCE_TABLE_SIZE = resident_name_table_offset - resource_table_offset         (header does not report size, "number of segments" is worthless) */
-        raw_length = (unsigned short)(ne_header.resident_name_table_offset - ne_header.resource_table_offset);
-        printf("  * Resource table length: %u\n",raw_length);
-
-        base = exe_ne_header_resource_table_alloc_raw(&ne_resources,raw_length);
-        if (base != NULL) {
-            if ((unsigned int)read(src_fd,base,raw_length) != raw_length)
-                exe_ne_header_resource_table_free_raw(&ne_resources);
-        }
-
-        exe_ne_header_resource_table_parse(&ne_resources);
-    }
+    if (ne_header.resource_table_offset != 0 && ne_header.resident_name_table_offset > ne_header.resource_table_offset)
+        printf("  * Resource table length: %u\n",
+            (unsigned short)(ne_header.resident_name_table_offset - ne_header.resource_table_offset));
+    ne_resources = exe_ne_image_resource_table(&ne_image);
 
     printf("    Resource table, 1 << %u = %lu byte alignment:\n",
-        exe_ne_header_resource_table_get_shift(&ne_resources),
-        1UL << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
-    printf("        %u TYPEINFO entries\n",ne_resources.typeinfo_length);
+        exe_ne_header_resource_table_get_shift(ne_resources),
+        1UL << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources));
+    printf("        %u TYPEINFO entries\n",ne_resources->typeinfo_length);
     {
         const struct exe_ne_header_resource_table_nameinfo *ninfo;
         const struct exe_ne_header_resource_table_typeinfo *tinfo;
@@ -450,16 +1180,14 @@ int main(int argc,char **argv) {
         const char *file_ext;
         unsigned long foff;
         unsigned long fcpy;
-        unsigned long fcnt;
         char tmp[255+1];
         unsigned int ti;
         unsigned int ni;
-        int fd;
 
-        for (ti=0;ti < ne_resources.typeinfo_length;ti++) {
+        for (ti=0;ti < ne_resources->typeinfo_length;ti++) {
             printf("        Typeinfo entry #%d\n",ti+1);
 
-            tinfo = exe_ne_header_resource_table_get_typeinfo_entry(&ne_resources,ti);
+            tinfo = exe_ne_header_resource_table_get_typeinfo_entry(ne_resources,ti);
             if (tinfo == NULL) {
                 printf("            NULL\n");
                 continue;
@@ -505,7 +1233,7 @@ int main(int argc,char **argv) {
                 printf("\n");
             }
             else {
-                exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),&ne_resources,tinfo->rtTypeID);
+                exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),ne_resources,tinfo->rtTypeID);
                 printf("            rtTypeID:   STRING OFFSET 0x%04x '%s'",tinfo->rtTypeID,tmp);
                 printf("\n");
             }
@@ -521,12 +1249,12 @@ int main(int argc,char **argv) {
                 printf("            Entry #%d:\n",ni+1);
                 printf("                rnOffset:           %u sectors << %u = %lu bytes\n",
                     ninfo->rnOffset,
-                    exe_ne_header_resource_table_get_shift(&ne_resources),
-                    (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
+                    exe_ne_header_resource_table_get_shift(ne_resources),
+                    (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources));
                 printf("                rnLength:           %u sectors << %u = %lu bytes\n",
                     ninfo->rnLength,
-                    exe_ne_header_resource_table_get_shift(&ne_resources),
-                    (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources));
+                    exe_ne_header_resource_table_get_shift(ne_resources),
+                    (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources));
 
                 printf("                rnFlags:            0x%04x",
                     ninfo->rnFlags);
@@ -552,7 +1280,7 @@ int main(int argc,char **argv) {
                         exe_ne_header_resource_table_typeinfo_RNID_AS_INTEGER(ninfo->rnID));
                 }
                 else {
-                    exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),&ne_resources,ninfo->rnID);
+                    exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),ne_resources,ninfo->rnID);
                     printf("                rnID:               STRING OFFSET 0x%04x '%s'\n",
                         ninfo->rnID,tmp);
                 }
@@ -565,447 +1293,15 @@ int main(int argc,char **argv) {
 
                 printf("                Writing to: %s\n",tmp);
 
-                fcpy = (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources);
-                foff = (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources);
-                if ((unsigned long)lseek(src_fd,foff,SEEK_SET) != foff) {
-                    printf("                ! Cannot seek to offset\n");
-                    continue;
-                }
-
-                fd = open(tmp,O_CREAT|O_TRUNC|O_WRONLY|O_BINARY,0644);
-                if (fd < 0) {
-                    fprintf(stderr,"Unable to write %s, %s\n",tmp,strerror(errno));
+                fcpy = (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources);
+                foff = (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(ne_resources);
+                if (res_extract(&ne_image,tinfo->rtTypeID,foff,fcpy,tmp) < 0)
                     return 1;
-                }
-
-                fcnt = 0;
-                while (fcpy > 0UL) {
-                    int docpy = (fcpy > sizeof(tmp) ? sizeof(tmp) : fcpy);
-                    int rd = read(src_fd,tmp,docpy);
-
-                    if (rd > 0) {
-                        /* WAIT: If this is an RT_ICON or RT_CURSOR, prepend a header to make it a valid file */
-                        if (opt_pric && fcnt == 0) {
-                            if (tinfo->rtTypeID == exe_ne_header_RT_BITMAP) {
-                                if (exe_ne_header_is_WINOLDBITMAP((const unsigned char*)tmp,docpy)) {
-                                    /* then it is necessary to convert, not just copy, because
-                                     * the alignment rules are different:
-                                     *
-                                     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
-                                     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
-                                    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
-                                    const struct exe_ne_header_RTBITMAP *bmphdr2x =
-                                        (const struct exe_ne_header_RTBITMAP *)tmp;
-                                    unsigned int pal_colors = 1 << bmphdr2x->bmBitsPixel;
-                                    unsigned int align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    struct exe_ne_header_RGBQUAD rgb;
-                                    unsigned long bboff = 14;
-                                    unsigned char hd[14];
-
-                                    if (bmphdr2x->bmPlanes == 1 && (bmphdr2x->bmBitsPixel == 1 || bmphdr2x->bmBitsPixel == 4)) {
-                                        printf("* Converting BITMAP to BITMAPINFOHEADER\n");
-
-                                        /* reseek file pointer, bitmap bits immediately follow bmphdr2x */
-                                        lseek(src_fd,foff+sizeof(*bmphdr2x),SEEK_SET);
-
-                                        /* generate BMP FILE header */
-                                        bboff += sizeof(bmphdr3x);
-                                        bboff += pal_colors * 4;
-
-                                        memcpy(hd+0,"BM",2);
-                                        *((uint32_t*)(hd+2)) = (align3x * abs(bmphdr2x->bmHeight)) + bboff;
-                                        *((uint16_t*)(hd+6)) = 0;
-                                        *((uint16_t*)(hd+8)) = 0;
-                                        *((uint32_t*)(hd+10)) = bboff;
-                                        write(fd,hd,sizeof(hd));
-
-                                        /* BITMAPINFOHEADER */
-                                        bmphdr3x.biSize = sizeof(bmphdr3x);
-                                        bmphdr3x.biWidth = bmphdr2x->bmWidth;
-                                        bmphdr3x.biHeight = bmphdr2x->bmHeight;
-                                        bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
-                                        bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
-                                        bmphdr3x.biCompression = 0;
-                                        bmphdr3x.biSizeImage = align3x * abs(bmphdr2x->bmHeight);
-                                        bmphdr3x.biXPelsPerMeter = 0;
-                                        bmphdr3x.biYPelsPerMeter = 0;
-                                        bmphdr3x.biClrUsed = 0;
-                                        bmphdr3x.biClrImportant = 0;
-                                        write(fd,&bmphdr3x,sizeof(bmphdr3x));
-
-                                        /* color palette */
-                                        if (bmphdr2x->bmBitsPixel == 1) {
-                                            {
-                                                rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                            {
-                                                rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                        }
-                                        else {
-                                            /* I'll add 4bpp generation when I see it in the wild */
-                                            printf("! Cannot guess palette\n");
-                                        }
-
-                                        /* copy scanlines */
-                                        {
-                                            size_t rd = bmphdr2x->bmWidthBytes;
-                                            size_t wd = align3x;
-                                            size_t bufl = (rd > wd) ? rd : wd;
-                                            unsigned char *buf = malloc(bufl);
-                                            unsigned int y;
-
-                                            if (buf) {
-                                                memset(buf,0,bufl);
-                                                for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++) {
-                                                    /* we have to flip the bitmap upside-down as we convert */
-                                                    lseek(src_fd,foff+sizeof(*bmphdr2x)+((abs(bmphdr2x->bmHeight) - 1 - y) * rd),SEEK_SET);
-                                                    read(src_fd,buf,rd);
-                                                    write(fd,buf,wd);
-                                                }
-                                                free(buf);
-                                            }
-                                        }
-
-                                        /* DONE */
-                                        break;
-                                    }
-                                    else {
-                                        printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
-                                    }
-                                }
-                                else {
-                                    /* need to add a BITMAPFILEHEADER to make it valid */
-                                    const struct exe_ne_header_BITMAPINFOHEADER *bmphdr =
-                                        (const struct exe_ne_header_BITMAPINFOHEADER *)tmp;
-                                    unsigned int pal_colors =
-                                        exe_ne_header_BITMAPINFOHEADER_get_palette_count(bmphdr);
-                                    unsigned long bboff = 14;
-                                    unsigned char hd[14];
-
-                                    bboff += bmphdr->biSize;
-                                    bboff += pal_colors * 4;
-
-                                    memcpy(hd+0,"BM",2);
-                                    *((uint32_t*)(hd+2)) = fcpy + 14;
-                                    *((uint16_t*)(hd+6)) = 0;
-                                    *((uint16_t*)(hd+8)) = 0;
-                                    *((uint32_t*)(hd+10)) = bboff;
-                                    write(fd,hd,sizeof(hd));
-                                }
-                            }
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_ICON) {
-                                if (exe_ne_header_is_WINOLDICON((const unsigned char*)tmp,docpy)) {
-                                    /* then it is necessary to convert, not just copy, because
-                                     * the alignment rules are different:
-                                     *
-                                     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
-                                     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
-                                    struct exe_ne_header_resource_ICONDIR pre;
-                                    struct exe_ne_header_resource_ICONDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
-                                    struct exe_ne_header_RTICONBITMAP *bmphdr2x =
-                                        (struct exe_ne_header_RTICONBITMAP *)tmp;
-                                    struct exe_ne_header_RGBQUAD rgb;
-                                    unsigned int align3xmono;
-                                    unsigned int align3x;
-
-                                    /* Windows 1.x/2.x icons for whatever reason have bits/pixel == 0 and planes == 0,
-                                     * which apparently means monochromatic anyway */
-                                    if (bmphdr2x->bmPlanes == 0)
-                                        bmphdr2x->bmPlanes = 1;
-                                    if (bmphdr2x->bmBitsPixel == 0)
-                                        bmphdr2x->bmBitsPixel = 1;
-
-                                    align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    align3xmono = ((bmphdr2x->bmWidth + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    if (bmphdr2x->bmPlanes == 1 && bmphdr2x->bmBitsPixel == 1) {
-                                        printf("* Converting BITMAP to BITMAPINFOHEADER\n");
-
-                                        /* reseek file pointer, bitmap bits immediately follow bmphdr2x */
-                                        lseek(src_fd,foff+sizeof(*bmphdr2x),SEEK_SET);
-
-                                        pre.idReserved = 0;
-                                        pre.idType = 1;
-                                        pre.idCount = 1;
-                                        write(fd,&pre,sizeof(pre));
-
-                                        dent.bWidth = bmphdr2x->bmWidth;
-                                        dent.bHeight = bmphdr2x->bmHeight;
-                                        dent.bColorCount = 1 << bmphdr2x->bmBitsPixel;
-                                        dent.bReserved = 0;
-                                        dent.wPlanes = bmphdr2x->bmPlanes;
-                                        dent.wBitCount = bmphdr2x->bmBitsPixel;
-                                        dent.dwBytesInRes = sizeof(bmphdr3x) + (4UL << (unsigned long)bmphdr2x->bmBitsPixel) +
-                                            (align3x * abs(bmphdr2x->bmHeight)) + (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                        write(fd,&dent,sizeof(dent));
-
-                                        /* BITMAPINFOHEADER */
-                                        bmphdr3x.biSize = sizeof(bmphdr3x);
-                                        bmphdr3x.biWidth = bmphdr2x->bmWidth;
-                                        bmphdr3x.biHeight = bmphdr2x->bmHeight * 2; // icon + mask
-                                        bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
-                                        bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
-                                        bmphdr3x.biCompression = 0;
-                                        bmphdr3x.biSizeImage = (align3x * abs(bmphdr2x->bmHeight)) +
-                                            (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        bmphdr3x.biXPelsPerMeter = 0;
-                                        bmphdr3x.biYPelsPerMeter = 0;
-                                        bmphdr3x.biClrUsed = 0;
-                                        bmphdr3x.biClrImportant = 0;
-                                        write(fd,&bmphdr3x,sizeof(bmphdr3x));
-
-                                        /* color palette */
-                                        if (bmphdr2x->bmBitsPixel == 1) {
-                                            {
-                                                rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                            {
-                                                rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                        }
-                                        else {
-                                            /* I'll add 4bpp generation when I see it in the wild */
-                                            printf("! Cannot guess palette\n");
-                                        }
-
-                                        /* NTS: Where Windows 3.x stores the image first, followed by the mask,
-                                         *      Windows 1.x/2.x store the mask first, then the image. Like bitmaps
-                                         *      in Windows 1.x/2.x the DIB is top-down, we convert here to bottom-up. */
-                                        {
-                                            size_t ird = bmphdr2x->bmWidthBytes;
-                                            size_t mrd = ((bmphdr2x->bmWidth + 15) & (~15)) >> 3; /* WORD align requirement */
-                                            size_t iwd = align3x;
-                                            size_t mwd = align3xmono;
-                                            size_t ibufl = (ird > iwd) ? ird : iwd;
-                                            size_t mbufl = (mrd > mwd) ? mrd : mwd;
-                                            unsigned char *img = malloc(ibufl * bmphdr2x->bmHeight);
-                                            unsigned char *msk = malloc(mbufl * bmphdr2x->bmHeight);
-                                            unsigned int y;
-
-                                            /* load */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,msk + ((abs(bmphdr2x->bmHeight) - 1 - y) * mbufl),mrd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,img + ((abs(bmphdr2x->bmHeight) - 1 - y) * ibufl),ird);
-
-                                            /* write */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,img + (y * ibufl),iwd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,msk + (y * mbufl),mwd);
-
-                                            free(img);
-                                            free(msk);
-                                        }
-
-                                        /* DONE */
-                                        break;
-                                    }
-                                    else {
-                                        printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
-                                    }
-                                }
-                                else {
-                                    struct exe_ne_header_resource_ICONDIR pre;
-                                    struct exe_ne_header_resource_ICONDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER *bmp =
-                                        (struct exe_ne_header_BITMAPINFOHEADER*)tmp;
-
-                                    pre.idReserved = 0;
-                                    pre.idType = 1;
-                                    pre.idCount = 1;
-                                    write(fd,&pre,sizeof(pre));
-
-                                    dent.bWidth = bmp->biWidth;
-                                    dent.bHeight = bmp->biHeight >> 1;      /* remember icons carry image + mask and dwHeight is double the actual height */
-                                    dent.bColorCount = 1 << bmp->biBitCount;
-                                    dent.bReserved = 0;
-                                    dent.wPlanes = bmp->biPlanes;
-                                    dent.wBitCount = bmp->biBitCount;
-                                    dent.dwBytesInRes = fcpy;
-                                    dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                    write(fd,&dent,sizeof(dent));
-                                }
-                            }
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_CURSOR) {
-                                /* raw resource data for a cursor when in an NE executable:
-                                 *
-                                 * WORD                 hotspot_x
-                                 * WORD                 hotspot_y
-                                 * BITMAPINFOHEADER     cursor bitmapinfo
-                                 * RGBQUAD              cursor palette
-                                 * BYTE[]               cursor bitmap
-                                 *
-                                 */
-                                if (exe_ne_header_is_WINOLDCURSOR((const unsigned char*)tmp,docpy)) {
-                                    /* then it is necessary to convert, not just copy, because
-                                     * the alignment rules are different:
-                                     *
-                                     * Windows 1.x/2.x BITMAP:          Requires WORD alignment, DIBs are top-down
-                                     * Windows 3.x BITMAPINFOHEADER:    Requires DWORD alignment, DIBs are bottom-up */
-                                    struct exe_ne_header_resource_CURSORDIR pre;
-                                    struct exe_ne_header_resource_CURSORDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER bmphdr3x;
-                                    struct exe_ne_header_RTCURSORBITMAP *bmphdr2x =
-                                        (struct exe_ne_header_RTCURSORBITMAP *)tmp;
-                                    struct exe_ne_header_RGBQUAD rgb;
-                                    unsigned int align3xmono;
-                                    unsigned int align3x;
-
-                                    /* Windows 1.x/2.x icons for whatever reason have bits/pixel == 0 and planes == 0,
-                                     * which apparently means monochromatic anyway */
-                                    if (bmphdr2x->bmPlanes == 0)
-                                        bmphdr2x->bmPlanes = 1;
-                                    if (bmphdr2x->bmBitsPixel == 0)
-                                        bmphdr2x->bmBitsPixel = 1;
-
-                                    align3x = (((bmphdr2x->bmBitsPixel * bmphdr2x->bmWidth) + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    align3xmono = ((bmphdr2x->bmWidth + 31) & (~31)) >> 3; // BITMAPINFOHEADER alignment
-                                    if (bmphdr2x->bmPlanes == 1 && bmphdr2x->bmBitsPixel == 1) {
-                                        printf("* Converting BITMAP to BITMAPINFOHEADER\n");
-
-                                        /* reseek file pointer, bitmap bits immediately follow bmphdr2x */
-                                        lseek(src_fd,foff+sizeof(*bmphdr2x),SEEK_SET);
-
-                                        pre.cdReserved = 0;
-                                        pre.cdType = 1;
-                                        pre.cdCount = 1;
-                                        write(fd,&pre,sizeof(pre));
-
-                                        dent.bWidth = bmphdr2x->bmWidth;
-                                        dent.bHeight = bmphdr2x->bmHeight;
-                                        dent.bColorCount = 1 << bmphdr2x->bmBitsPixel;
-                                        dent.bReserved = 0;
-                                        dent.wXHotspot = 0;
-                                        dent.wYHotspot = 0;
-                                        dent.bColorCount = 0;
-                                        dent.dwBytesInRes = sizeof(bmphdr3x) + (4UL << (unsigned long)bmphdr2x->bmBitsPixel) +
-                                            (align3x * abs(bmphdr2x->bmHeight)) + (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                        write(fd,&dent,sizeof(dent));
-
-                                        /* BITMAPINFOHEADER */
-                                        bmphdr3x.biSize = sizeof(bmphdr3x);
-                                        bmphdr3x.biWidth = bmphdr2x->bmWidth;
-                                        bmphdr3x.biHeight = bmphdr2x->bmHeight * 2; // icon + mask
-                                        bmphdr3x.biPlanes = bmphdr2x->bmPlanes;
-                                        bmphdr3x.biBitCount = bmphdr2x->bmBitsPixel;
-                                        bmphdr3x.biCompression = 0;
-                                        bmphdr3x.biSizeImage = (align3x * abs(bmphdr2x->bmHeight)) +
-                                            (align3xmono * abs(bmphdr2x->bmHeight)); // icon + mask
-                                        bmphdr3x.biXPelsPerMeter = 0;
-                                        bmphdr3x.biYPelsPerMeter = 0;
-                                        bmphdr3x.biClrUsed = 0;
-                                        bmphdr3x.biClrImportant = 0;
-                                        write(fd,&bmphdr3x,sizeof(bmphdr3x));
-
-                                        /* color palette */
-                                        if (bmphdr2x->bmBitsPixel == 1) {
-                                            {
-                                                rgb.rgbRed = 0x00; rgb.rgbGreen = 0x00; rgb.rgbBlue = 0x00; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                            {
-                                                rgb.rgbRed = 0xFF; rgb.rgbGreen = 0xFF; rgb.rgbBlue = 0xFF; rgb.rgbReserved = 0x00;
-                                                write(fd,&rgb,sizeof(rgb));
-                                            }
-                                        }
-                                        else {
-                                            /* I'll add 4bpp generation when I see it in the wild */
-                                            printf("! Cannot guess palette\n");
-                                        }
-
-                                        /* NTS: Where Windows 3.x stores the image first, followed by the mask,
-                                         *      Windows 1.x/2.x store the mask first, then the image. Like bitmaps
-                                         *      in Windows 1.x/2.x the DIB is top-down, we convert here to bottom-up. */
-                                        {
-                                            size_t ird = bmphdr2x->bmWidthBytes;
-                                            size_t mrd = ((bmphdr2x->bmWidth + 15) & (~15)) >> 3; /* WORD align requirement */
-                                            size_t iwd = align3x;
-                                            size_t mwd = align3xmono;
-                                            size_t ibufl = (ird > iwd) ? ird : iwd;
-                                            size_t mbufl = (mrd > mwd) ? mrd : mwd;
-                                            unsigned char *img = malloc(ibufl * bmphdr2x->bmHeight);
-                                            unsigned char *msk = malloc(mbufl * bmphdr2x->bmHeight);
-                                            unsigned int y;
-
-                                            /* load */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,msk + ((abs(bmphdr2x->bmHeight) - 1 - y) * mbufl),mrd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                read(src_fd,img + ((abs(bmphdr2x->bmHeight) - 1 - y) * ibufl),ird);
-
-                                            /* write */
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,img + (y * ibufl),iwd);
-                                            for (y=0;y < (unsigned int)abs(bmphdr2x->bmHeight);y++)
-                                                write(fd,msk + (y * mbufl),mwd);
-
-                                            free(img);
-                                            free(msk);
-                                        }
-
-                                        /* DONE */
-                                        break;
-                                    }
-                                    else {
-                                        printf("! Cannot convert BITMAP to BITMAPINFOHEADER, unknown format\n");
-                                    }
-                                }
-                                else {
-                                    struct exe_ne_header_resource_CURSORDIR pre;
-                                    struct exe_ne_header_resource_CURSORDIRENTRY dent;
-                                    struct exe_ne_header_BITMAPINFOHEADER *bmp =
-                                        (struct exe_ne_header_BITMAPINFOHEADER*)(tmp + 4);
-
-                                    pre.cdReserved = 0;
-                                    pre.cdType = 2;
-                                    pre.cdCount = 1;
-                                    write(fd,&pre,sizeof(pre));
-
-                                    dent.bWidth = bmp->biWidth;
-                                    dent.bHeight = bmp->biHeight >> 1;      /* remember cursors carry image + mask and dwHeight is double the actual height */
-                                    dent.bColorCount = 1 << bmp->biBitCount;
-                                    dent.bReserved = 0;
-                                    dent.wXHotspot = *((uint16_t*)(tmp + 0));
-                                    dent.wYHotspot = *((uint16_t*)(tmp + 2));
-                                    dent.dwBytesInRes = fcpy - 4;
-                                    dent.dwImageOffset = sizeof(pre) + sizeof(dent);
-                                    write(fd,&dent,sizeof(dent));
-
-                                    if (rd >= 4) {
-                                        rd -= 4;
-                                        fcpy -= 4;
-                                        docpy -= 4;
-                                        memmove(tmp,tmp+4,rd);
-                                    }
-                                }
-                            }
-                        }
-
-                        write(fd,tmp,rd);
-                        fcpy -= rd;
-                        fcnt += rd;
-                    }
-
-                    if (rd < docpy) {
-                        fprintf(stderr,"Early EOF on resource\n");
-                        break;
-                    }
-                }
-
-                close(fd);
             }
         }
     }
 
-    exe_ne_header_resource_table_free(&ne_resources);
+    exe_ne_image_free(&ne_image);
     close(src_fd);
     return 0;
 }
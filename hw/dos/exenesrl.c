@@ -17,7 +17,7 @@ void exe_ne_header_segment_reloc_table_init(struct exe_ne_header_segment_reloc_t
 }
 
 void exe_ne_header_segment_reloc_table_free_table(struct exe_ne_header_segment_reloc_table * const t) {
-    if (t->table) free(t->table);
+    if (t->table && t->table_ownership) free(t->table);
     t->table = NULL;
     t->length = 0;
 }
@@ -35,6 +35,7 @@ unsigned char *exe_ne_header_segment_reloc_table_alloc_table(struct exe_ne_heade
     t->table = malloc(entries * sizeof(*(t->table)));
     if (t->table == NULL) return NULL;
     t->length = entries;
+    t->table_ownership = 1;
     return (unsigned char*)(t->table); /* <- so that the caller can read the segment table into our array */
 }
 
@@ -17,7 +17,7 @@ void exe_ne_header_segment_table_init(struct exe_ne_header_segment_table * const
 }
 
 void exe_ne_header_segment_table_free_table(struct exe_ne_header_segment_table * const t) {
-    if (t->table) free(t->table);
+    if (t->table && t->table_ownership) free(t->table);
     t->table = NULL;
     t->length = 0;
 }
@@ -36,6 +36,7 @@ unsigned char *exe_ne_header_segment_table_alloc_table(struct exe_ne_header_segm
     if (t->table == NULL) return NULL;
     t->length = entries;
     t->sector_shift = shift;
+    t->table_ownership = 1;
     return (unsigned char*)(t->table); /* <- so that the caller can read the segment table into our array */
 }
 
@@ -0,0 +1,928 @@
+/* EXESCAN: walk a directory tree, sniff the MS-DOS EXE header of every file, and follow it to the
+ * NE or LE/LX header if there is one. One JSON record per executable is written per line (JSONL)
+ * with the header fields, imports, exports, segment/object sizes and a summary of the resources.
+ *
+ * This replaces shell loops of exenedmp/exeledmp over whole Windows 3.x/9x install trees, which
+ * spawn two processes per file and then have to scrape the text dump.
+ *
+ * Files are scanned on worker threads (Linux), one file per job, each job formatting its record
+ * into its own buffer. Records are written in the order the files were found (directory entries
+ * are visited in sorted order), so the output does not depend on the number of threads. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(LINUX)
+# include <pthread.h>
+#endif
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+#include <hw/dos/exelehdr.h>
+#include <hw/dos/exelepar.h>
+
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
+static unsigned char            opt_all = 0;        /* -a, emit a record for files that are not MZ too */
+static unsigned int             opt_threads = 0;    /* -j, 0 = one per CPU */
+static char*                    out_file = NULL;
+
+static void help(void) {
+    fprintf(stderr,"EXESCAN [options] <dir or file> [...]\n");
+    fprintf(stderr,"Scan a directory tree for MZ/NE/LE/LX executables, one JSON record per line\n");
+    fprintf(stderr," -o <file>  Write records to file (default stdout)\n");
+    fprintf(stderr," -j <n>     Worker threads (default one per CPU)\n");
+    fprintf(stderr," -a         Emit a record for every file, even if not an executable\n");
+}
+
+/* growable text buffer a record is formatted into */
+struct exescan_buf {
+    char*                       p;
+    size_t                      len;
+    size_t                      alloc;
+    unsigned char               err;                /* ran out of memory */
+};
+
+static void exescan_buf_free(struct exescan_buf * const b) {
+    if (b->p != NULL) {
+        free(b->p);
+        b->p = NULL;
+    }
+
+    b->len = b->alloc = 0;
+    b->err = 0;
+}
+
+static int exescan_buf_reserve(struct exescan_buf * const b,const size_t want) {
+    size_t na;
+    char *np;
+
+    if (b->err) return -1;
+    if ((b->len + want + 1) <= b->alloc) return 0;
+
+    na = (b->alloc != 0) ? b->alloc : 1024;
+    while (na < (b->len + want + 1)) na *= 2;
+
+    if ((np=(char*)realloc(b->p,na)) == NULL) {
+        b->err = 1;
+        return -1;
+    }
+
+    b->p = np;
+    b->alloc = na;
+    return 0;
+}
+
+static void exescan_printf(struct exescan_buf * const b,const char *fmt,...) {
+    va_list va;
+    int r;
+
+    if (exescan_buf_reserve(b,128) < 0) return;
+
+    va_start(va,fmt);
+    r = vsnprintf(b->p+b->len,b->alloc-b->len,fmt,va);
+    va_end(va);
+    if (r < 0) return;
+
+    if ((size_t)r >= (b->alloc-b->len)) {
+        if (exescan_buf_reserve(b,(size_t)r) < 0) return;
+
+        va_start(va,fmt);
+        r = vsnprintf(b->p+b->len,b->alloc-b->len,fmt,va);
+        va_end(va);
+        if (r < 0) return;
+    }
+
+    b->len += (size_t)r;
+}
+
+/* names in these files are whatever codepage the author used, not UTF-8.
+ * anything outside printable ASCII is escaped as if Latin-1 so the output is always valid JSON. */
+static void exescan_str(struct exescan_buf * const b,const char *s) {
+    const unsigned char *p = (const unsigned char*)s;
+
+    if (exescan_buf_reserve(b,2) < 0) return;
+    b->p[b->len++] = '"';
+
+    for (;*p != 0;p++) {
+        if (*p == '"' || *p == '\\') {
+            if (exescan_buf_reserve(b,2) < 0) return;
+            b->p[b->len++] = '\\';
+            b->p[b->len++] = (char)(*p);
+        }
+        else if (*p < 0x20 || *p >= 0x7F) {
+            exescan_printf(b,"\\u%04x",(unsigned int)(*p));
+        }
+        else {
+            if (exescan_buf_reserve(b,1) < 0) return;
+            b->p[b->len++] = (char)(*p);
+        }
+    }
+
+    if (exescan_buf_reserve(b,1) < 0) return;
+    b->p[b->len++] = '"';
+}
+
+static int exescan_copy(struct exe_ne_image * const img,const unsigned long ofs,void * const dst,const size_t len) {
+    unsigned char own;
+    unsigned char *p;
+
+    if ((p=exe_ne_image_get(img,ofs,len,&own)) == NULL)
+        return -1;
+
+    memcpy(dst,p,len);
+    exe_ne_image_put(p,own);
+    return 0;
+}
+
+static void exescan_mz(struct exescan_buf * const b,const struct exe_ne_image * const img) {
+    const struct exe_dos_header * const h = &img->exehdr;
+
+    exescan_printf(b,",\"mz\":{\"resident_size\":%lu,\"header_size\":%lu,\"relocations\":%u,",
+        (unsigned long)exe_dos_header_file_resident_size(h),
+        (unsigned long)exe_dos_header_file_header_size(h),
+        h->number_of_relocations);
+    exescan_printf(b,"\"min_alloc\":%lu,\"max_alloc\":%lu,\"cs_ip\":\"%04X:%04X\",\"ss_sp\":\"%04X:%04X\"}",
+        (unsigned long)exe_dos_header_bss_size(h),
+        (unsigned long)exe_dos_header_bss_max_size(h),
+        h->init_code_segment,h->init_instruction_pointer,
+        h->init_stack_segment,h->init_stack_pointer);
+}
+
+/* name of ordinal 0 of a name table, which is the module name (resident) or description (nonresident) */
+static void exescan_name_table_first(struct exescan_buf * const b,const char *key,const struct exe_ne_header_name_entry_table * const t) {
+    char tmp[255+1];
+
+    if (t->table == NULL || t->length == 0 || ne_name_entry_get_ordinal(t,&t->table[0]) != 0)
+        return;
+
+    ne_name_entry_get_name(tmp,sizeof(tmp),t,&t->table[0]);
+    exescan_printf(b,",\"%s\":",key);
+    exescan_str(b,tmp);
+}
+
+/* one export record, with the name looked up by ordinal */
+static void exescan_export(struct exescan_buf * const b,unsigned int * const count,const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie = NULL;
+    char tmp[255+1];
+
+    if ((*count)++ != 0) exescan_printf(b,",");
+    exescan_printf(b,"{\"ordinal\":%u",ordinal);
+
+    if (ordinal <= 0xFFFFu)
+        ie = exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal);
+    if (ie != NULL) {
+        ne_name_entry_get_name(tmp,sizeof(tmp),ie->table,ie->entry);
+        exescan_printf(b,",\"name\":");
+        exescan_str(b,tmp);
+        exescan_printf(b,",\"resident\":%s",ie->resident ? "true" : "false");
+    }
+}
+
+/* NE imports are collected from the segment relocations, then sorted and made unique per module */
+struct exescan_ne_import {
+    uint16_t                    module;             /* module reference index, 1-based */
+    uint16_t                    by_name;            /* 1 = value is an imported name table offset */
+    uint16_t                    value;              /* ordinal or imported name table offset */
+};
+
+static int exescan_ne_import_cmp(const void *a,const void *b) {
+    const struct exescan_ne_import *ia = (const struct exescan_ne_import*)a;
+    const struct exescan_ne_import *ib = (const struct exescan_ne_import*)b;
+
+    if (ia->module != ib->module) return (ia->module < ib->module) ? -1 : 1;
+    if (ia->by_name != ib->by_name) return (ia->by_name < ib->by_name) ? -1 : 1;
+    if (ia->value != ib->value) return (ia->value < ib->value) ? -1 : 1;
+    return 0;
+}
+
+static void exescan_ne_imports(struct exescan_buf * const b,struct exe_ne_image * const img) {
+    const struct exe_ne_header_imported_name_table * const names = exe_ne_image_imported_names(img);
+    const struct exe_ne_header_segment_table * const segs = exe_ne_image_segment_table(img);
+    struct exescan_ne_import *imp = NULL,*nimp;
+    struct exe_ne_header_segment_reloc_table relocs;
+    unsigned int imp_count = 0,imp_alloc = 0;
+    unsigned int i,j,m;
+    char tmp[255+1];
+
+    exescan_printf(b,",\"imports\":[");
+    if (names->module_ref_table == NULL || names->module_ref_table_length == 0) {
+        exescan_printf(b,"]");
+        return;
+    }
+
+    exe_ne_header_segment_reloc_table_init(&relocs);
+    if (segs->table != NULL) {
+        for (i=0;i < segs->length;i++) {
+            const unsigned long reloc_offset = exe_ne_header_segment_table_get_relocation_table_offset(segs,segs->table + i);
+
+            if (reloc_offset == 0) continue;
+            if (exe_ne_image_segment_relocs(img,reloc_offset,&relocs) < 0) continue;
+
+            for (j=0;relocs.table != NULL && j < relocs.length;j++) {
+                const union exe_ne_header_segment_relocation_entry * const r = relocs.table + j;
+                struct exescan_ne_import *ni;
+
+                switch (r->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
+                    case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
+                    case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
+                        break;
+                    default:
+                        continue;
+                }
+
+                if (imp_count >= imp_alloc) {
+                    imp_alloc = (imp_alloc != 0) ? (imp_alloc * 2u) : 64u;
+                    if ((nimp=(struct exescan_ne_import*)realloc(imp,imp_alloc * sizeof(*imp))) == NULL) {
+                        b->err = 1;
+                        break;
+                    }
+                    imp = nimp;
+                }
+
+                ni = imp + (imp_count++);
+                if ((r->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) == EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL) {
+                    ni->module = r->ordinal.module_reference_index;
+                    ni->by_name = 0;
+                    ni->value = r->ordinal.ordinal;
+                }
+                else {
+                    ni->module = r->name.module_reference_index;
+                    ni->by_name = 1;
+                    ni->value = r->name.imported_name_offset;
+                }
+            }
+
+            exe_ne_header_segment_reloc_table_free(&relocs);
+        }
+    }
+
+    if (imp_count != 0)
+        qsort(imp,imp_count,sizeof(*imp),exescan_ne_import_cmp);
+
+    /* every module in the module reference table, whether or not anything refers to it */
+    for (i=0,m=0;m < names->module_ref_table_length;m++) {
+        unsigned int ordinals = 0,byname = 0;
+
+        ne_imported_name_table_entry_get_name(tmp,sizeof(tmp),names,names->module_ref_table[m]);
+        if (m != 0) exescan_printf(b,",");
+        exescan_printf(b,"{\"module\":");
+        exescan_str(b,tmp);
+
+        /* skip references to modules that do not exist */
+        while (i < imp_count && imp[i].module < (m + 1u)) i++;
+
+        for (;i < imp_count && imp[i].module == (m + 1u);i++) {
+            if (i != 0 && exescan_ne_import_cmp(&imp[i-1],&imp[i]) == 0)
+                continue;
+
+            if (!imp[i].by_name) {
+                exescan_printf(b,"%s%u",(ordinals++ == 0) ? ",\"ordinals\":[" : ",",imp[i].value);
+            }
+            else {
+                if (ordinals != 0 && byname == 0) exescan_printf(b,"]");
+                ne_imported_name_table_entry_get_name(tmp,sizeof(tmp),names,imp[i].value);
+                exescan_printf(b,"%s",(byname++ == 0) ? ",\"names\":[" : ",");
+                exescan_str(b,tmp);
+            }
+        }
+
+        /* by ordinal sorts before by name, so only the last list is still open */
+        if (byname != 0 || ordinals != 0) exescan_printf(b,"]");
+        exescan_printf(b,"}");
+    }
+
+    exescan_printf(b,"]");
+    if (imp != NULL) free(imp);
+}
+
+static void exescan_ne_exports(struct exescan_buf * const b,struct exe_ne_image * const img) {
+    const struct exe_ne_header_entry_table_table * const t = exe_ne_image_entry_table(img);
+    struct exe_ne_header_name_ordinal_index ordinals;
+    const struct exe_ne_header_entry_table_entry *ent;
+    unsigned int i,count = 0;
+    unsigned char *rawd;
+
+    exe_ne_header_name_ordinal_index_init(&ordinals);
+    exe_ne_header_name_ordinal_index_build(&ordinals,exe_ne_image_resident_names(img),exe_ne_image_nonresident_names(img));
+
+    exescan_printf(b,",\"exports\":[");
+    for (i=0;t->table != NULL && i < t->length;i++) { /* ordinal is i + 1 */
+        ent = t->table + i;
+        if (ent->segment_id == 0x00) continue;
+        if ((rawd=exe_ne_header_entry_table_table_raw_entry(t,ent)) == NULL) continue;
+
+        exescan_export(b,&count,&ordinals,i + 1);
+        if (ent->segment_id == 0xFF) {
+            const struct exe_ne_header_entry_table_movable_segment_entry *ment =
+                (const struct exe_ne_header_entry_table_movable_segment_entry*)rawd;
+
+            exescan_printf(b,",\"segment\":%u,\"offset\":%u,\"movable\":true,\"flags\":%u}",ment->segid,ment->seg_offs,ment->flags);
+        }
+        else if (ent->segment_id == 0xFE) {
+            const struct exe_ne_header_entry_table_fixed_segment_entry *fent =
+                (const struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
+
+            exescan_printf(b,",\"constant\":%u,\"flags\":%u}",fent->v.const_value,fent->flags);
+        }
+        else {
+            const struct exe_ne_header_entry_table_fixed_segment_entry *fent =
+                (const struct exe_ne_header_entry_table_fixed_segment_entry*)rawd;
+
+            exescan_printf(b,",\"segment\":%u,\"offset\":%u,\"flags\":%u}",ent->segment_id,fent->v.seg_offs,fent->flags);
+        }
+    }
+    exescan_printf(b,"]");
+
+    exe_ne_header_name_ordinal_index_free(&ordinals);
+}
+
+static void exescan_ne_resources(struct exescan_buf * const b,struct exe_ne_image * const img) {
+    const struct exe_ne_header_resource_table_t * const t = exe_ne_image_resource_table(img);
+    const struct exe_ne_header_resource_table_typeinfo *tinfo;
+    const struct exe_ne_header_resource_table_nameinfo *ninfo;
+    unsigned long bytes,total = 0;
+    unsigned int ti,ni;
+    const char *str;
+    char tmp[255+1];
+
+    exescan_printf(b,",\"resources\":[");
+    for (ti=0;ti < t->typeinfo_length;ti++) {
+        if ((tinfo=exe_ne_header_resource_table_get_typeinfo_entry(t,ti)) == NULL)
+            continue;
+
+        if (ti != 0) exescan_printf(b,",");
+        exescan_printf(b,"{\"type\":");
+        if (exe_ne_header_resource_table_typeinfo_TYPEID_IS_INTEGER(tinfo->rtTypeID)) {
+            if ((str=exe_ne_header_resource_table_typeinfo_TYPEID_INTEGER_name_str(tinfo->rtTypeID)) != NULL)
+                exescan_str(b,str);
+            else
+                exescan_printf(b,"%u",exe_ne_header_resource_table_typeinfo_TYPEID_AS_INTEGER(tinfo->rtTypeID));
+        }
+        else {
+            exe_ne_header_resource_table_get_string(tmp,sizeof(tmp),t,tinfo->rtTypeID);
+            exescan_str(b,tmp);
+        }
+
+        /* rnLength is in units of (1 << rscAlignShift), not bytes */
+        for (bytes=0,ni=0;ni < tinfo->rtResourceCount;ni++) {
+            if ((ninfo=exe_ne_header_resource_table_get_typeinfo_nameinfo_entry(tinfo,ni)) == NULL)
+                continue;
+
+            bytes += (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(t);
+        }
+
+        exescan_printf(b,",\"count\":%u,\"bytes\":%lu}",tinfo->rtResourceCount,bytes);
+        total += tinfo->rtResourceCount;
+    }
+    exescan_printf(b,"],\"resource_count\":%lu",total);
+}
+
+static void exescan_ne(struct exescan_buf * const b,struct exe_ne_image * const img) {
+    const struct exe_ne_header * const h = &img->ne_header;
+    const struct exe_ne_header_segment_table *segs;
+    const struct exe_ne_header_segment_entry *s;
+    unsigned int i;
+
+    exescan_printf(b,",\"ne\":{\"offset\":%lu,\"linker\":\"%u.%u\",\"flags\":%u,\"target_os\":%u,\"other_flags\":%u,",
+        (unsigned long)img->ne_header_offset,h->linker_version,h->linker_revision,h->flags,h->target_os,h->other_flags);
+    exescan_printf(b,"\"windows_version\":\"%u.%02u\",\"auto_data_segment\":%u,\"heap\":%u,\"stack\":%u,",
+        h->minimum_windows_version >> 8u,h->minimum_windows_version & 0xFFu,h->auto_data_segment_number,h->init_local_heap,h->init_stack_size);
+    exescan_printf(b,"\"cs_ip\":\"%u:%04X\",\"ss_sp\":\"%u:%04X\"",h->entry_cs,h->entry_ip,h->entry_ss,h->entry_sp);
+    exescan_name_table_first(b,"module",exe_ne_image_resident_names(img));
+    exescan_name_table_first(b,"description",exe_ne_image_nonresident_names(img));
+    exescan_printf(b,"}");
+
+    /* length == 0 is 64KB if there is data, minimum allocation 0 is 64KB */
+    segs = exe_ne_image_segment_table(img);
+    exescan_printf(b,",\"segments\":[");
+    for (i=0;segs->table != NULL && i < segs->length;i++) {
+        s = segs->table + i;
+        exescan_printf(b,"%s{\"size\":%lu,\"alloc\":%lu,\"flags\":%u}",(i != 0) ? "," : "",
+            (s->length == 0 && s->offset_in_segments != 0) ? 0x10000ul : (unsigned long)s->length,
+            (s->minimum_allocation_size == 0) ? 0x10000ul : (unsigned long)s->minimum_allocation_size,
+            s->flags);
+    }
+    exescan_printf(b,"]");
+
+    exescan_ne_imports(b,img);
+    exescan_ne_exports(b,img);
+    exescan_ne_resources(b,img);
+}
+
+/* read a name table at file offset ofs into t, and parse it */
+static void exescan_le_name_table(struct exe_ne_image * const img,struct exe_ne_header_name_entry_table * const t,const unsigned long ofs,const size_t len) {
+    unsigned char *base;
+
+    if (ofs == 0 || len == 0 || len > 0xFFFFu) return;
+
+    if ((base=exe_ne_header_name_entry_table_alloc_raw(t,len)) != NULL) {
+        if (exescan_copy(img,ofs,base,len) < 0)
+            exe_ne_header_name_entry_table_free_raw(t);
+    }
+
+    exe_ne_header_name_entry_table_parse_raw(t);
+}
+
+static void exescan_le(struct exescan_buf * const b,struct exe_ne_image * const img,const uint16_t signature) {
+    struct le_header_parseinfo le_parser;
+    const struct exe_le_header *h;
+    struct exe_ne_header_name_ordinal_index ordinals;
+    unsigned long hofs;
+    unsigned int i,count;
+
+    le_header_parseinfo_init(&le_parser);
+    le_parser.le_header_offset = hofs = (unsigned long)img->ne_header_offset;
+    h = &le_parser.le_header;
+
+    if (exescan_copy(img,hofs,&le_parser.le_header,sizeof(le_parser.le_header)) < 0) {
+        exescan_printf(b,",\"format\":\"MZ\",\"error\":\"Cannot read LE header\"");
+        exescan_mz(b,img);
+        return;
+    }
+
+    exescan_printf(b,",\"format\":\"%s\"",signature == EXE_LX_SIGNATURE ? "LX" : "LE");
+    exescan_mz(b,img);
+
+    exescan_printf(b,",\"le\":{\"offset\":%lu,\"cpu_type\":",hofs);
+    exescan_str(b,le_cpu_type_to_str((uint8_t)h->cpu_type));
+    exescan_printf(b,",\"target_os\":");
+    exescan_str(b,le_target_operating_system_to_str((uint8_t)h->target_operating_system));
+    exescan_printf(b,",\"module_version\":%lu,\"module_flags\":%lu,\"pages\":%lu,\"page_size\":%lu,",
+        (unsigned long)h->module_version,(unsigned long)h->module_type_flags,
+        (unsigned long)h->number_of_memory_pages,(unsigned long)h->memory_page_size);
+    exescan_printf(b,"\"cs_eip\":\"%lu:%08lX\",\"ss_esp\":\"%lu:%08lX\",\"auto_data_object\":%lu",
+        (unsigned long)h->initial_object_cs_number,(unsigned long)h->initial_eip,
+        (unsigned long)h->initial_object_ss_number,(unsigned long)h->initial_esp,
+        (unsigned long)h->automatic_data_object);
+
+    /* resident names run up to the entry table, the nonresident name table offset is from the start of the file */
+    if (h->resident_names_table_offset != 0 && h->entry_table_offset > h->resident_names_table_offset)
+        exescan_le_name_table(img,&le_parser.le_resident_names,h->resident_names_table_offset + hofs,
+            (size_t)(h->entry_table_offset - h->resident_names_table_offset));
+    if (h->nonresident_names_table_offset != 0)
+        exescan_le_name_table(img,&le_parser.le_nonresident_names,h->nonresident_names_table_offset,
+            (size_t)h->nonresident_names_table_length);
+
+    exescan_name_table_first(b,"module",&le_parser.le_resident_names);
+    exescan_name_table_first(b,"description",&le_parser.le_nonresident_names);
+    exescan_printf(b,"}");
+
+    if (h->offset_of_object_table != 0 && h->object_table_entries != 0 && h->object_table_entries <= 0xFFFFu) {
+        unsigned char *base = le_header_parseinfo_alloc_object_table(&le_parser);
+
+        if (base != NULL && exescan_copy(img,h->offset_of_object_table + hofs,base,le_header_parseinfo_get_object_table_buffer_size(&le_parser)) < 0)
+            le_header_parseinfo_free_object_table(&le_parser);
+    }
+
+    exescan_printf(b,",\"objects\":[");
+    for (i=0;le_parser.le_object_table != NULL && i < h->object_table_entries;i++) {
+        const struct exe_le_header_object_table_entry * const o = le_parser.le_object_table + i;
+
+        exescan_printf(b,"%s{\"size\":%lu,\"base\":%lu,\"flags\":%lu,\"pages\":%lu}",(i != 0) ? "," : "",
+            (unsigned long)o->virtual_segment_size,(unsigned long)o->relocation_base_address,
+            (unsigned long)o->object_flags,(unsigned long)o->page_map_entries);
+    }
+    exescan_printf(b,"]");
+
+    /* imported modules are a list of length + string, like the resident name table without ordinals.
+     * imported procedures are only named by the fixup records, which this does not parse */
+    exescan_printf(b,",\"imports\":[");
+    if (h->imported_modules_name_table_offset != 0 && h->imported_modules_count != 0) {
+        unsigned long ofs = h->imported_modules_name_table_offset + hofs;
+        unsigned char len;
+        char tmp[255+1];
+
+        for (i=0;i < h->imported_modules_count;i++) {
+            if (exescan_copy(img,ofs,&len,1) < 0) break;
+            if (len != 0 && exescan_copy(img,ofs+1ul,tmp,len) < 0) break;
+            tmp[len] = 0;
+            ofs += 1ul + (unsigned long)len;
+
+            exescan_printf(b,"%s{\"module\":",(i != 0) ? "," : "");
+            exescan_str(b,tmp);
+            exescan_printf(b,"}");
+        }
+    }
+    exescan_printf(b,"]");
+
+    if (h->entry_table_offset != 0) {
+        uint32_t readlen = le_exe_header_entry_table_size(&le_parser.le_header);
+        unsigned char *base = le_header_entry_table_alloc(&le_parser.le_entry_table,readlen);
+
+        if (base != NULL) {
+            if (exescan_copy(img,h->entry_table_offset + hofs,base,readlen) < 0)
+                le_header_entry_table_free(&le_parser.le_entry_table);
+        }
+
+        if (le_parser.le_entry_table.raw != NULL)
+            le_header_entry_table_parse(&le_parser.le_entry_table);
+    }
+
+    exe_ne_header_name_ordinal_index_init(&ordinals);
+    exe_ne_header_name_ordinal_index_build(&ordinals,&le_parser.le_resident_names,&le_parser.le_nonresident_names);
+
+    exescan_printf(b,",\"exports\":[");
+    for (count=0,i=0;le_parser.le_entry_table.table != NULL && i < le_parser.le_entry_table.length;i++) {
+        const struct le_header_entry_table_entry * const ent = le_parser.le_entry_table.table + i;
+        const unsigned char *raw;
+
+        if (ent->type == 0) continue;
+        if ((raw=le_header_entry_table_get_raw_entry(&le_parser.le_entry_table,i)) == NULL) continue;
+
+        exescan_export(b,&count,&ordinals,i + 1);
+        exescan_printf(b,",\"object\":%u,\"type\":%u",ent->object,ent->type);
+        /* parser makes sure the flags byte and offset are there for these types */
+        if (ent->type == 1 || ent->type == 2)
+            exescan_printf(b,",\"offset\":%lu,\"flags\":%u",(unsigned long)(*((const uint16_t*)(raw+1))),raw[0]);
+        else if (ent->type == 3)
+            exescan_printf(b,",\"offset\":%lu,\"flags\":%u",(unsigned long)(*((const uint32_t*)(raw+1))),raw[0]);
+        exescan_printf(b,"}");
+    }
+    exescan_printf(b,"],\"resource_count\":%lu",(unsigned long)h->resource_table_entries);
+
+    exe_ne_header_name_ordinal_index_free(&ordinals);
+    le_header_parseinfo_free(&le_parser);
+}
+
+/* scan one file into b. returns 1 if there is a record to emit */
+static int exescan_file(struct exescan_buf * const b,const char * const path) {
+    struct exe_ne_image img;
+    uint16_t sig;
+    int fd,r;
+
+    b->len = 0;
+    exescan_printf(b,"{\"path\":");
+    exescan_str(b,path);
+
+    if ((fd=open(path,O_RDONLY|O_BINARY)) < 0) {
+        exescan_printf(b,",\"format\":\"error\",\"error\":");
+        exescan_str(b,strerror(errno));
+        exescan_printf(b,"}\n");
+        return 1;
+    }
+
+    exe_ne_image_init(&img);
+    r = exe_ne_image_open_fd(&img,fd);
+    exescan_printf(b,",\"size\":%lu",(unsigned long)img.file_size);
+    if (r < 0) {
+        exescan_printf(b,",\"format\":\"none\"}\n");
+        exe_ne_image_free(&img);
+        close(fd);
+        return opt_all;
+    }
+
+    r = exe_ne_image_read_ne_header(&img);
+    if (r == 0) {
+        exescan_printf(b,",\"format\":\"NE\"");
+        exescan_mz(b,&img);
+        exescan_ne(b,&img);
+    }
+    else if (r == EXE_NE_IMAGE_ERR_NOT_NE && exescan_copy(&img,img.ne_header_offset,&sig,2) == 0 &&
+        (sig == EXE_LE_SIGNATURE || sig == EXE_LX_SIGNATURE)) {
+        exescan_le(b,&img,sig);
+    }
+    else {
+        /* plain MS-DOS executable, or an extension this does not know (PE, W3, ...) */
+        exescan_printf(b,",\"format\":\"MZ\"");
+        if (r == EXE_NE_IMAGE_ERR_NOT_NE && exescan_copy(&img,img.ne_header_offset,&sig,2) == 0 &&
+            (sig & 0xFFu) >= 0x41u && (sig & 0xFFu) <= 0x5Au && (sig >> 8u) >= 0x30u && (sig >> 8u) <= 0x5Au) {
+            char tmp[3];
+
+            tmp[0] = (char)(sig & 0xFFu);
+            tmp[1] = (char)(sig >> 8u);
+            tmp[2] = 0;
+            exescan_printf(b,",\"extension\":");
+            exescan_str(b,tmp);
+        }
+        exescan_mz(b,&img);
+    }
+
+    exescan_printf(b,"}\n");
+    exe_ne_image_free(&img);
+    close(fd);
+    return 1;
+}
+
+/* the files to scan, in the order they are reported */
+struct exescan_job {
+    char*                       path;
+    struct exescan_buf          out;
+    unsigned char               emit;
+    volatile unsigned char      done;
+};
+
+static struct exescan_job*      jobs = NULL;
+static unsigned int             jobs_count = 0;
+static unsigned int             jobs_alloc = 0;
+
+static int exescan_add_file(const char * const path) {
+    struct exescan_job *nj;
+
+    if (jobs_count >= jobs_alloc) {
+        unsigned int na = (jobs_alloc != 0) ? (jobs_alloc * 2u) : 256u;
+
+        if ((nj=(struct exescan_job*)realloc(jobs,na * sizeof(*jobs))) == NULL)
+            return -1;
+
+        jobs = nj;
+        jobs_alloc = na;
+    }
+
+    nj = jobs + jobs_count;
+    memset(nj,0,sizeof(*nj));
+    if ((nj->path=strdup(path)) == NULL)
+        return -1;
+
+    jobs_count++;
+    return 0;
+}
+
+static int exescan_name_cmp(const void *a,const void *b) {
+    return strcmp(*((const char**)a),*((const char**)b));
+}
+
+/* add a file, or everything under a directory in sorted order */
+static int exescan_add_path(const char * const path) {
+    unsigned int count = 0,alloc = 0,i;
+    char **names = NULL,**nn;
+    struct dirent *d;
+    struct stat st;
+    char *sub;
+    DIR *dir;
+    int ret = 0;
+
+    if (stat(path,&st) < 0) {
+        fprintf(stderr,"Cannot stat %s, %s\n",path,strerror(errno));
+        return 0;
+    }
+
+    if (S_ISREG(st.st_mode))
+        return exescan_add_file(path);
+    if (!S_ISDIR(st.st_mode))
+        return 0;
+
+    if ((dir=opendir(path)) == NULL) {
+        fprintf(stderr,"Cannot open directory %s, %s\n",path,strerror(errno));
+        return 0;
+    }
+
+    while ((d=readdir(dir)) != NULL) {
+        if (!strcmp(d->d_name,".") || !strcmp(d->d_name,"..")) continue;
+
+        if (count >= alloc) {
+            alloc = (alloc != 0) ? (alloc * 2u) : 64u;
+            if ((nn=(char**)realloc(names,alloc * sizeof(char*))) == NULL) {
+                ret = -1;
+                break;
+            }
+            names = nn;
+        }
+
+        if ((names[count]=strdup(d->d_name)) == NULL) {
+            ret = -1;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    if (ret == 0 && count != 0)
+        qsort(names,count,sizeof(char*),exescan_name_cmp);
+
+    for (i=0;i < count;i++) {
+        if (ret == 0) {
+            const size_t pl = strlen(path);
+
+            if ((sub=(char*)malloc(pl + 1 + strlen(names[i]) + 1)) == NULL) {
+                ret = -1;
+            }
+            else {
+                memcpy(sub,path,pl);
+                if (pl != 0 && path[pl-1] == '/') sprintf(sub+pl,"%s",names[i]);
+                else sprintf(sub+pl,"/%s",names[i]);
+
+#if defined(LINUX)
+                /* do not follow symlinks to directories, they can loop */
+                if (lstat(sub,&st) == 0 && S_ISLNK(st.st_mode) && stat(sub,&st) == 0 && S_ISDIR(st.st_mode)) {
+                    free(sub);
+                    free(names[i]);
+                    continue;
+                }
+#endif
+
+                ret = exescan_add_path(sub);
+                free(sub);
+            }
+        }
+
+        free(names[i]);
+    }
+
+    if (names != NULL) free(names);
+    return ret;
+}
+
+static void exescan_free_jobs(void) {
+    unsigned int i;
+
+    if (jobs != NULL) {
+        for (i=0;i < jobs_count;i++) {
+            exescan_buf_free(&jobs[i].out);
+            free(jobs[i].path);
+        }
+
+        free(jobs);
+        jobs = NULL;
+    }
+
+    jobs_count = jobs_alloc = 0;
+}
+
+/* write out a finished job, and free what it used */
+static int exescan_emit(FILE *fp,struct exescan_job * const j) {
+    int ret = 0;
+
+    if (j->out.err) {
+        fprintf(stderr,"Out of memory scanning %s\n",j->path);
+        ret = -1;
+    }
+    else if (j->emit && j->out.len != 0) {
+        if (fwrite(j->out.p,j->out.len,1,fp) != 1)
+            ret = -1;
+    }
+
+    exescan_buf_free(&j->out);
+    return ret;
+}
+
+#if defined(LINUX)
+static unsigned int             jobs_next = 0;
+static pthread_mutex_t          jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static void *exescan_thread(void *arg) {
+    struct exescan_job *j;
+    unsigned int i;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&jobs_lock);
+        i = jobs_next++;
+        pthread_mutex_unlock(&jobs_lock);
+
+        if (i < jobs_count) {
+            j = jobs + i;
+            j->emit = (unsigned char)exescan_file(&j->out,j->path);
+
+            pthread_mutex_lock(&jobs_lock);
+            j->done = 1;
+            pthread_cond_broadcast(&jobs_cond);
+            pthread_mutex_unlock(&jobs_lock);
+        }
+    } while (i < jobs_count);
+
+    return NULL;
+}
+
+/* scan on worker threads, writing records in order as they finish. returns 0 if done, 1 on
+ * write error, or -1 if it could not be done this way and the caller should scan the files itself */
+static int exescan_files_parallel(FILE *fp) {
+    pthread_t threads[64];
+    unsigned int nthreads,i;
+    int ret = 0;
+
+    nthreads = opt_threads;
+    if (nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (n > 0) ? (unsigned int)n : 1u;
+    }
+    if (nthreads > (unsigned int)(sizeof(threads)/sizeof(threads[0])))
+        nthreads = (unsigned int)(sizeof(threads)/sizeof(threads[0]));
+    if (nthreads > jobs_count)
+        nthreads = jobs_count;
+    if (nthreads < 2u)
+        return -1;
+
+    jobs_next = 0;
+    for (i=0;i < nthreads;i++) {
+        if (pthread_create(&threads[i],NULL,exescan_thread,NULL) != 0)
+            break;
+    }
+    /* whatever threads did start will get through all of the files */
+    if (i == 0)
+        return -1;
+    nthreads = i;
+
+    for (i=0;i < jobs_count;i++) {
+        pthread_mutex_lock(&jobs_lock);
+        while (!jobs[i].done) pthread_cond_wait(&jobs_cond,&jobs_lock);
+        pthread_mutex_unlock(&jobs_lock);
+
+        if (exescan_emit(fp,&jobs[i]) < 0)
+            ret = 1;
+    }
+
+    while (nthreads > 0)
+        pthread_join(threads[--nthreads],NULL);
+
+    return ret;
+}
+#endif
+
+int main(int argc,char **argv) {
+    unsigned int i,paths = 0;
+    FILE *fp = stdout;
+    int ret = 0;
+    char *a;
+    int c;
+
+    for (c=1;c < argc;) {
+        a = argv[c++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                return 1;
+            }
+            else if (!strcmp(a,"a")) {
+                opt_all = 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[c++];
+                if (a == NULL) return 1;
+                opt_threads = (unsigned int)strtoul(a,NULL,0);
+            }
+            else if (!strcmp(a,"o")) {
+                out_file = argv[c++];
+                if (out_file == NULL) return 1;
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                return 1;
+            }
+        }
+        else {
+            if (exescan_add_path(a) < 0) {
+                fprintf(stderr,"Out of memory\n");
+                exescan_free_jobs();
+                return 1;
+            }
+            paths++;
+        }
+    }
+
+    if (paths == 0) {
+        fprintf(stderr,"No directory or file specified\n");
+        return 1;
+    }
+
+    if (out_file != NULL && (fp=fopen(out_file,"w")) == NULL) {
+        fprintf(stderr,"Unable to write %s, %s\n",out_file,strerror(errno));
+        exescan_free_jobs();
+        return 1;
+    }
+
+#if defined(LINUX)
+    if ((ret=exescan_files_parallel(fp)) < 0)
+#endif
+    {
+        ret = 0;
+        for (i=0;i < jobs_count;i++) {
+            jobs[i].emit = (unsigned char)exescan_file(&jobs[i].out,jobs[i].path);
+            if (exescan_emit(fp,&jobs[i]) < 0)
+                ret = 1;
+        }
+    }
+
+    if (fp != stdout) {
+        if (fclose(fp) != 0) ret = 1;
+    }
+    else {
+        fflush(fp);
+    }
+
+    if (ret != 0)
+        fprintf(stderr,"Error writing records\n");
+
+    exescan_free_jobs();
+    return ret;
+}
+
@@ -0,0 +1,271 @@
+/* EXEW3DMP: list and extract the VxDs in the W3 container of WIN386.EXE (Windows 3.x) or the
+ * compressed W4 container of VMM32.VXD (Windows 95).
+ *
+ * The container is opened once, W4 chunks are decompressed on demand (and cached), and each
+ * VxD is rebuilt as a standalone LE file in memory the same way tool/w3extract.pl does it,
+ * without first writing the whole decompressed container to disk. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exelehdr.h>
+#include <hw/dos/exew3par.h>
+
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
+static char*                    src_file = NULL;
+static char*                    out_file = NULL;
+static char*                    w3_file = NULL;
+static char*                    extract_name = NULL;
+
+static void help(void) {
+    fprintf(stderr,"EXEW3DMP -i <WIN386.EXE or VMM32.VXD> [options]\n");
+    fprintf(stderr,"List the VxDs in a W3/W4 container, or extract them\n");
+    fprintf(stderr," -x <name>  Extract VxD <name> as <name>.386, or * for all of them\n");
+    fprintf(stderr," -o <file>  Extract to <file> instead (one VxD only)\n");
+    fprintf(stderr," -w3 <file> Write the container decompressed (W4 to W3)\n");
+}
+
+/* same rule as w3extract.pl: names are alphanumeric, or the entry is not a VxD to extract */
+static int name_is_vxd(const char *s) {
+    if (*s == 0) return 0;
+    while (*s != 0) {
+        if (!isalnum((unsigned char)(*s))) return 0;
+        s++;
+    }
+
+    return 1;
+}
+
+static int write_file(const char * const path,const unsigned char *buf,const uint32_t len) {
+    int fd;
+
+    fd = open(path,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,0644);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to write %s, %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    if ((uint32_t)write(fd,buf,len) != len) {
+        fprintf(stderr,"Write error to %s\n",path);
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+static int extract_entry(struct exe_w3_image * const img,const struct exe_w3_image_dir_entry * const ent,const char *path) {
+    char tmp[8+1+3+1];
+    unsigned char *buf;
+    uint32_t len;
+    int ret;
+
+    if ((buf=exe_w3_image_extract_le(img,ent,&len)) == NULL) {
+        fprintf(stderr,"Unable to extract '%s'\n",ent->name);
+        return -1;
+    }
+
+    if (path == NULL) {
+        sprintf(tmp,"%s.386",ent->name);
+        path = tmp;
+    }
+
+    ret = write_file(path,buf,len);
+    if (ret == 0) printf("%s: %lu bytes\n",path,(unsigned long)len);
+    free(buf);
+    return ret;
+}
+
+static int write_w3(struct exe_w3_image * const img,const char * const path) {
+    unsigned char *buf;
+    uint32_t ofs = 0;
+    int fd,rd;
+
+    if ((buf=(unsigned char*)malloc(0x10000)) == NULL)
+        return -1;
+
+    fd = open(path,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,0644);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to write %s, %s\n",path,strerror(errno));
+        free(buf);
+        return -1;
+    }
+
+    while (ofs < img->size) {
+        rd = exe_w3_image_read(img,ofs,buf,0x10000);
+        if (rd <= 0) break;
+
+        if (write(fd,buf,(size_t)rd) != rd) {
+            fprintf(stderr,"Write error to %s\n",path);
+            break;
+        }
+
+        ofs += (uint32_t)rd;
+    }
+
+    close(fd);
+    free(buf);
+
+    if (ofs != img->size) {
+        fprintf(stderr,"W3 container only partially written (%lu of %lu bytes)\n",(unsigned long)ofs,(unsigned long)img->size);
+        return -1;
+    }
+
+    printf("%s: %lu bytes\n",path,(unsigned long)ofs);
+    return 0;
+}
+
+static void list_entries(struct exe_w3_image * const img) {
+    const struct exe_w3_image_dir_entry *ent;
+    struct exe_le_header le;
+    unsigned int i;
+
+    printf("File size:                        %lu bytes\n",(unsigned long)img->file_size);
+    printf("W3 container at:                  %lu\n",(unsigned long)img->w3_offset);
+    if (img->is_w4) {
+        printf("W4 compressed container:\n");
+        printf("    Version:                      0x%04x\n",img->w4_header.version);
+        printf("    Chunk size:                   %u bytes\n",img->w4_header.chunk_size);
+        printf("    Chunks:                       %u\n",img->w4_header.chunk_count);
+        printf("  * Decompressed size:            %lu bytes\n",(unsigned long)img->size);
+    }
+    printf("W3 container:\n");
+    printf("    Windows version:              %u.%02u\n",img->w3_header.windows_version >> 8u,img->w3_header.windows_version & 0xFFu);
+    printf("    Directory entries:            %u\n",img->w3_header.directory_entries);
+
+    for (i=0;i < img->w3_header.directory_entries;i++) {
+        ent = img->dir + i;
+
+        printf("    VxD #%-3u '%-8s' LE header at 0x%08lx, %lu bytes",
+            i+1u,ent->name,(unsigned long)ent->le_header_offset,(unsigned long)ent->le_header_length);
+
+        if (exe_w3_image_read(img,ent->le_header_offset,(unsigned char*)(&le),sizeof(le)) == (int)sizeof(le) &&
+            le.signature == EXE_LE_SIGNATURE) {
+            printf(", %lu objects, %lu pages of %lu, data at 0x%08lx",
+                (unsigned long)le.object_table_entries,
+                (unsigned long)le.number_of_memory_pages,
+                (unsigned long)le.memory_page_size,
+                (unsigned long)le.data_pages_offset);
+        }
+        else {
+            printf(", not LE");
+        }
+
+        printf("\n");
+    }
+}
+
+int main(int argc,char **argv) {
+    const struct exe_w3_image_dir_entry *ent;
+    struct exe_w3_image img;
+    unsigned int i;
+    int ret = 0;
+    int fd,err;
+    char *a;
+
+    for (i=1;i < (unsigned int)argc;) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                return 1;
+            }
+            else if (!strcmp(a,"i")) {
+                src_file = argv[i++];
+                if (src_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"x")) {
+                extract_name = argv[i++];
+                if (extract_name == NULL) return 1;
+            }
+            else if (!strcmp(a,"o")) {
+                out_file = argv[i++];
+                if (out_file == NULL) return 1;
+            }
+            else if (!strcmp(a,"w3")) {
+                w3_file = argv[i++];
+                if (w3_file == NULL) return 1;
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr,"Unknown switch %s\n",a);
+            return 1;
+        }
+    }
+
+    if (src_file == NULL) {
+        fprintf(stderr,"No source file specified\n");
+        return 1;
+    }
+    if (out_file != NULL && (extract_name == NULL || !strcmp(extract_name,"*"))) {
+        fprintf(stderr,"-o requires -x with one VxD name\n");
+        return 1;
+    }
+
+    fd = open(src_file,O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to open '%s', %s\n",src_file,strerror(errno));
+        return 1;
+    }
+
+    exe_w3_image_init(&img);
+    if ((err=exe_w3_image_open_fd(&img,fd)) < 0) {
+        fprintf(stderr,"%s: %s\n",src_file,exe_w3_image_error_str(err));
+        exe_w3_image_free(&img);
+        close(fd);
+        return 1;
+    }
+
+    if (w3_file != NULL) {
+        if (write_w3(&img,w3_file) < 0)
+            ret = 1;
+    }
+    else if (extract_name != NULL && !strcmp(extract_name,"*")) {
+        for (i=0;i < img.w3_header.directory_entries;i++) {
+            ent = img.dir + i;
+            if (ent->le_header_offset < img.w3_offset || !name_is_vxd(ent->name))
+                continue;
+            if (extract_entry(&img,ent,NULL) < 0)
+                ret = 1;
+        }
+    }
+    else if (extract_name != NULL) {
+        if ((ent=exe_w3_image_lookup(&img,extract_name)) == NULL) {
+            fprintf(stderr,"VxD '%s' not found\n",extract_name);
+            ret = 1;
+        }
+        else if (extract_entry(&img,ent,out_file) < 0) {
+            ret = 1;
+        }
+    }
+    else {
+        list_entries(&img);
+    }
+
+    if (img.is_w4)
+        printf("* W4 chunk cache: %lu hits, %lu misses\n",img.cache_hits,img.cache_misses);
+
+    exe_w3_image_free(&img);
+    close(fd);
+    return ret;
+}
+
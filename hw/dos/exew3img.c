@@ -0,0 +1,540 @@
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exelehdr.h>
+#include <hw/dos/exew3par.h>
+
+/* W4 decompression, based on "W4DECOMP.C" from the book "Windows Undocumented File Formats"
+ * by way of tool/w4tow3, with the pointers range checked. */
+static void exe_w4_load_minibuffer(uint32_t *pMiniBuffer,const unsigned char **psrc,const unsigned char *srcfence,uint16_t *pBitsUsed,uint16_t *pBitCount) {
+    while ((*pBitsUsed) != 0) {
+        (*pBitsUsed)--;
+        *pMiniBuffer >>= 1;
+        if (--(*pBitCount) == 0) {
+            if (*psrc < srcfence) {
+                *pMiniBuffer += (uint32_t)(**psrc) << (uint32_t)24U;
+                (*psrc) += 1U;
+            }
+            *pBitCount += 8U;
+        }
+    }
+}
+
+/* decompress one chunk. returns the number of bytes written to dst, which falls short of
+ * the chunk size if the compressed data is damaged or runs out early */
+uint32_t exe_w4_decompress(unsigned char *dst,const size_t dstmax,const unsigned char *src,const size_t srclen) {
+    const unsigned char *srcfence = src + srclen;
+    unsigned char *dstfence = dst + dstmax;
+    unsigned char *dstbase = dst;
+    uint32_t minibuffer = 0;
+    uint16_t nCount, nDepth;
+    uint16_t nBitsUsed = 0;
+    uint16_t nBitCount;
+    size_t nIndex = 0;
+
+    if (srclen < 4)
+        return 0;
+
+    nDepth = 1;
+    nBitCount = 8;
+    for (nIndex=0;nIndex <= 3;nIndex++)
+        minibuffer = (minibuffer >> (uint32_t)8) + (((uint32_t)(*src++)) << (uint32_t)24);
+
+    while (nDepth != 0) {
+        exe_w4_load_minibuffer(&minibuffer,&src,srcfence,&nBitsUsed,&nBitCount);
+
+        if ((minibuffer & 3) == 1 ||
+            (minibuffer & 3) == 2) {
+            if (dst >= dstfence) break;
+            *dst++ = (unsigned char)(((minibuffer & 0x1FCU) >> 2U) + ((minibuffer & 1U) << 7U));
+            nBitsUsed = 9;
+        }
+        else {
+            // 0-63
+            if ((minibuffer & 3U) == 0U) {
+                nDepth = (minibuffer & 0xFCU) >> 2U;
+                nBitsUsed = 8;
+            }
+            // 64-319
+            else if ((minibuffer & 7U) == 3U) {
+                nDepth = ((minibuffer & 0x7F8U) >> 3U) + 0x40U;
+                nBitsUsed = 11;
+            }
+            // 320-4414
+            else if ((minibuffer & 7U) == 7U) {
+                nDepth = ((minibuffer & 0x7FF8U) >> 3U) + 0x140U;
+                nBitsUsed = 15;
+            }
+            else {
+                break; /* invalid depth data */
+            }
+
+            // if not zero and not CheckBuffer
+            if (nDepth != 0 && nDepth != 0x113FU) { // 0x113FU == (4415 - 320)
+                exe_w4_load_minibuffer(&minibuffer,&src,srcfence,&nBitsUsed,&nBitCount);
+
+                if ((minibuffer & 1) == 1) { // 2
+                    nCount = 2;
+                    nBitsUsed = 1;
+                }
+                else if ((minibuffer & 3) == 2) { // 3-4
+                    nCount = ((minibuffer & 4U) >> 2U) + 3U;
+                    nBitsUsed = 3;
+                }
+                else if ((minibuffer & 7) == 4) { // 5-8
+                    nCount = ((minibuffer & 0x18U) >> 3U) + 5U;
+                    nBitsUsed = 5;
+                }
+                else if ((minibuffer & 0x0FU) == 8) { // 9-16
+                    nCount = ((minibuffer & 0x70U) >> 4U) + 9U;
+                    nBitsUsed = 7;
+                }
+                else if ((minibuffer & 0x1FU) == 16) { // 17-32
+                    nCount = ((minibuffer & 0x1E0U) >> 5U) + 17U;
+                    nBitsUsed = 9;
+                }
+                else if ((minibuffer & 0x3FU) == 32) { // 33-64
+                    nCount = ((minibuffer & 0x7C0U) >> 6U) + 33U;
+                    nBitsUsed = 11;
+                }
+                else if ((minibuffer & 0x7FU) == 64) { // 65-128
+                    nCount = ((minibuffer & 0x1F80U) >> 7U) + 65U;
+                    nBitsUsed = 13;
+                }
+                else if ((minibuffer & 0xFFU) == 128) { // 129-256
+                    nCount = ((minibuffer & 0x7F00U) >> 8U) + 129U;
+                    nBitsUsed = 15;
+                }
+                else if ((minibuffer & 0x1FFU) == 256) { // 257-512
+                    nCount = ((minibuffer & 0x1FE00U) >> 9U) + 257U;
+                    nBitsUsed = 17;
+                }
+                else {
+                    break; /* unexpected compressed code */
+                }
+
+                {
+                    unsigned char *sp = dst - nDepth;
+
+                    if ((size_t)(dst - dstbase) < (size_t)nDepth)
+                        break; /* reaches back too far */
+                    if ((size_t)(dstfence - dst) < (size_t)nCount)
+                        break; /* reaches too far forward into dest */
+
+                    assert(nCount != 0);
+
+                    do {  *dst++ = *sp++;
+                    } while (--nCount != 0);
+
+                    assert(dst <= dstfence);
+                }
+            }
+            else if (nDepth == 0x113FU && src == srcfence) {
+                break;
+            }
+        }
+    }
+
+    return (uint32_t)(dst - dstbase);
+}
+
+void exe_w3_image_init(struct exe_w3_image * const img) {
+    unsigned int i;
+
+    memset(img,0,sizeof(*img));
+    img->fd = -1;
+    for (i=0;i < EXE_W3_IMAGE_CHUNK_CACHE;i++)
+        img->cache[i].chunk = -1;
+}
+
+void exe_w3_image_free(struct exe_w3_image * const img) {
+    unsigned int i;
+
+    for (i=0;i < EXE_W3_IMAGE_CHUNK_CACHE;i++) {
+        if (img->cache[i].data != NULL) free(img->cache[i].data);
+        img->cache[i].data = NULL;
+        img->cache[i].length = 0;
+        img->cache[i].chunk = -1;
+    }
+
+    if (img->chunk_src != NULL) free(img->chunk_src);
+    img->chunk_src = NULL;
+    if (img->chunk_table != NULL) free(img->chunk_table);
+    img->chunk_table = NULL;
+    if (img->dir != NULL) free(img->dir);
+    img->dir = NULL;
+
+    img->is_w4 = 0;
+    img->size = 0;
+    img->file_size = 0;
+    img->w3_offset = 0;
+    img->cache_clock = 0;
+    img->cache_hits = 0;
+    img->cache_misses = 0;
+    img->fd = -1;
+}
+
+static int exe_w3_image_file_read(struct exe_w3_image * const img,const uint32_t ofs,void * const buf,const size_t len) {
+    if (len == 0)
+        return 0;
+    if ((unsigned long)lseek(img->fd,(off_t)ofs,SEEK_SET) != (unsigned long)ofs || (size_t)read(img->fd,buf,len) != len)
+        return -1;
+
+    return 0;
+}
+
+/* decompressed chunk, from the cache if possible, else decompressed into the least recently used slot */
+static const struct exe_w3_image_chunk *exe_w3_image_get_chunk(struct exe_w3_image * const img,const unsigned int chunk) {
+    struct exe_w3_image_chunk *c,*victim = NULL;
+    uint32_t start,end;
+    unsigned int i;
+
+    if (chunk >= img->w4_header.chunk_count)
+        return NULL;
+
+    img->cache_clock++;
+    for (i=0;i < EXE_W3_IMAGE_CHUNK_CACHE;i++) {
+        c = img->cache + i;
+        if (c->chunk == (int)chunk) {
+            c->last_used = img->cache_clock;
+            img->cache_hits++;
+            return c;
+        }
+
+        if (victim == NULL || (victim->chunk >= 0 && (c->chunk < 0 || c->last_used < victim->last_used)))
+            victim = c;
+    }
+
+    assert(victim != NULL);
+    img->cache_misses++;
+
+    if (victim->data == NULL) {
+        if ((victim->data=(unsigned char*)malloc(img->w4_header.chunk_size)) == NULL)
+            return NULL;
+    }
+
+    /* open_fd() already checked that every chunk fits within the file and chunk size */
+    start = img->chunk_table[chunk];
+    end = ((chunk + 1u) < img->w4_header.chunk_count) ? img->chunk_table[chunk + 1u] : img->file_size;
+
+    victim->chunk = -1;
+    victim->length = 0;
+    if (exe_w3_image_file_read(img,start,img->chunk_src,(size_t)(end - start)) < 0)
+        return NULL;
+
+    if ((end - start) == (uint32_t)img->w4_header.chunk_size) {
+        /* stored without compression */
+        memcpy(victim->data,img->chunk_src,img->w4_header.chunk_size);
+        victim->length = img->w4_header.chunk_size;
+    }
+    else {
+        victim->length = exe_w4_decompress(victim->data,img->w4_header.chunk_size,img->chunk_src,(size_t)(end - start));
+    }
+
+    victim->chunk = (int)chunk;
+    victim->last_used = img->cache_clock;
+    return victim;
+}
+
+static int exe_w3_image_open_w4(struct exe_w3_image * const img) {
+    const struct exe_w3_image_chunk *last;
+    uint32_t start,end,table_end;
+    unsigned int i;
+
+    if (exe_w3_image_file_read(img,img->w3_offset,&img->w4_header,sizeof(img->w4_header)) < 0)
+        return EXE_W3_IMAGE_ERR_W4_HEADER;
+    if (!(img->w4_header.version == 0 || (img->w4_header.version >> 8u) == 0x04))
+        return EXE_W3_IMAGE_ERR_W4_HEADER;
+    if (memcmp(img->w4_header.compression,"DS",2) != 0 || img->w4_header.chunk_size == 0)
+        return EXE_W3_IMAGE_ERR_W4_HEADER;
+    if (img->w4_header.chunk_count == 0)
+        return EXE_W3_IMAGE_ERR_W4_CHUNKS;
+
+    if ((img->chunk_table=(uint32_t*)malloc(sizeof(uint32_t) * img->w4_header.chunk_count)) == NULL)
+        return EXE_W3_IMAGE_ERR_MEMORY;
+    if ((img->chunk_src=(unsigned char*)malloc(img->w4_header.chunk_size)) == NULL)
+        return EXE_W3_IMAGE_ERR_MEMORY;
+    if (exe_w3_image_file_read(img,img->w3_offset + (uint32_t)sizeof(img->w4_header),img->chunk_table,sizeof(uint32_t) * img->w4_header.chunk_count) < 0)
+        return EXE_W3_IMAGE_ERR_W4_CHUNKS;
+
+    /* chunks follow the table in order, each no larger than the chunk size, the last one ends at EOF */
+    table_end = img->w3_offset + (uint32_t)sizeof(img->w4_header) + ((uint32_t)sizeof(uint32_t) * (uint32_t)img->w4_header.chunk_count);
+    for (i=0;i < img->w4_header.chunk_count;i++) {
+        start = img->chunk_table[i];
+        end = ((i + 1u) < img->w4_header.chunk_count) ? img->chunk_table[i + 1u] : img->file_size;
+
+        if (start < table_end || start >= end || end > img->file_size || (end - start) > (uint32_t)img->w4_header.chunk_size)
+            return EXE_W3_IMAGE_ERR_W4_CHUNKS;
+    }
+
+    img->is_w4 = 1;
+
+    /* the last chunk is the only one allowed to decompress short, so that is where the container ends */
+    if ((last=exe_w3_image_get_chunk(img,img->w4_header.chunk_count - 1u)) == NULL)
+        return EXE_W3_IMAGE_ERR_W4_CHUNKS;
+
+    img->size = img->w3_offset +
+        ((uint32_t)(img->w4_header.chunk_count - 1u) * (uint32_t)img->w4_header.chunk_size) + last->length;
+
+    return 0;
+}
+
+/* attach to WIN386.EXE or VMM32.VXD, and read the W3 directory, decompressing as needed */
+int exe_w3_image_open_fd(struct exe_w3_image * const img,const int fd) {
+    struct exe_w3_directory_entry de;
+    struct exe_dos_header exehdr;
+    char sig[2];
+    unsigned int i,j;
+    off_t sz;
+    int err;
+
+    exe_w3_image_free(img);
+
+    sz = lseek(fd,0,SEEK_END);
+    lseek(fd,0,SEEK_SET);
+    if (sz < (off_t)0) sz = 0;
+    if ((unsigned long long)sz > 0xFFFFFFFFull) sz = (off_t)0xFFFFFFFFul;
+
+    img->fd = fd;
+    img->file_size = (uint32_t)sz;
+
+    if (exe_w3_image_file_read(img,0,&exehdr,sizeof(exehdr)) < 0)
+        return EXE_W3_IMAGE_ERR_EXE_HEADER;
+    if (exehdr.magic != 0x5A4DU/*MZ*/)
+        return EXE_W3_IMAGE_ERR_NOT_MZ;
+    if (exe_w3_image_file_read(img,EXE_HEADER_EXTENSION_OFFSET,&img->w3_offset,4) < 0)
+        return EXE_W3_IMAGE_ERR_EXTENSION;
+    if (exe_w3_image_file_read(img,img->w3_offset,sig,2) < 0)
+        return EXE_W3_IMAGE_ERR_NOT_W3;
+
+    if (!memcmp(sig,"W4",2)) {
+        if ((err=exe_w3_image_open_w4(img)) < 0)
+            return err;
+    }
+    else if (!memcmp(sig,"W3",2)) {
+        img->size = img->file_size;
+    }
+    else {
+        return EXE_W3_IMAGE_ERR_NOT_W3;
+    }
+
+    if (exe_w3_image_read(img,img->w3_offset,(unsigned char*)(&img->w3_header),sizeof(img->w3_header)) != (int)sizeof(img->w3_header))
+        return EXE_W3_IMAGE_ERR_W3_HEADER;
+    if (memcmp(img->w3_header.signature,"W3",2) != 0)
+        return EXE_W3_IMAGE_ERR_W3_HEADER;
+    if (!((img->w3_header.windows_version >> 8u) == 3 || (img->w3_header.windows_version >> 8u) == 4))
+        return EXE_W3_IMAGE_ERR_W3_HEADER;
+    /* Windows 3.0 and 3.1 have somewhere between 20 and 30, Windows 95 somewhat more */
+    if (img->w3_header.directory_entries == 0 || img->w3_header.directory_entries >= 256)
+        return EXE_W3_IMAGE_ERR_W3_HEADER;
+
+    if ((img->dir=(struct exe_w3_image_dir_entry*)malloc(sizeof(*(img->dir)) * img->w3_header.directory_entries)) == NULL)
+        return EXE_W3_IMAGE_ERR_MEMORY;
+
+    for (i=0;i < img->w3_header.directory_entries;i++) {
+        const uint32_t o = img->w3_offset + (uint32_t)sizeof(img->w3_header) + ((uint32_t)i * (uint32_t)sizeof(de));
+
+        if (exe_w3_image_read(img,o,(unsigned char*)(&de),sizeof(de)) != (int)sizeof(de))
+            return EXE_W3_IMAGE_ERR_W3_HEADER;
+
+        memcpy(img->dir[i].name,de.name,8);
+        j = 8;
+        while (j > 0 && (de.name[j-1] == ' ' || de.name[j-1] == 0)) j--;
+        img->dir[i].name[j] = 0;
+        img->dir[i].le_header_offset = de.le_header_offset;
+        img->dir[i].le_header_length = de.le_header_length;
+    }
+
+    return 0;
+}
+
+const char *exe_w3_image_error_str(const int err) {
+    switch (err) {
+        case 0:                                 return "No error";
+        case EXE_W3_IMAGE_ERR_EXE_HEADER:       return "EXE header read error";
+        case EXE_W3_IMAGE_ERR_NOT_MZ:           return "EXE header signature missing";
+        case EXE_W3_IMAGE_ERR_EXTENSION:        return "Cannot read extension";
+        case EXE_W3_IMAGE_ERR_NOT_W3:           return "Not a W3 or W4 container";
+        case EXE_W3_IMAGE_ERR_W4_HEADER:        return "Unsupported W4 header";
+        case EXE_W3_IMAGE_ERR_W4_CHUNKS:        return "Bad W4 chunk table";
+        case EXE_W3_IMAGE_ERR_W3_HEADER:        return "Bad W3 header";
+        case EXE_W3_IMAGE_ERR_MEMORY:           return "Out of memory";
+        default:                                break;
+    }
+
+    return "Unknown error";
+}
+
+/* read from the file as if the W3 container were not compressed. returns the number of bytes read,
+ * which is short at the end of the container, or -1 on error */
+int exe_w3_image_read(struct exe_w3_image * const img,uint32_t ofs,unsigned char *buf,size_t len) {
+    const struct exe_w3_image_chunk *c;
+    size_t done = 0,n;
+    uint32_t rel;
+
+    if (ofs >= img->size)
+        return 0;
+    if ((unsigned long)len > (unsigned long)(img->size - ofs))
+        len = (size_t)(img->size - ofs);
+
+    if (!img->is_w4) {
+        if (exe_w3_image_file_read(img,ofs,buf,len) < 0)
+            return -1;
+
+        return (int)len;
+    }
+
+    /* the MS-DOS stub ahead of the W4 header is not compressed */
+    if (ofs < img->w3_offset) {
+        n = len;
+        if ((unsigned long)n > (unsigned long)(img->w3_offset - ofs))
+            n = (size_t)(img->w3_offset - ofs);
+        if (exe_w3_image_file_read(img,ofs,buf,n) < 0)
+            return -1;
+
+        done += n;
+    }
+
+    while (done < len) {
+        rel = ofs + (uint32_t)done - img->w3_offset;
+        if ((c=exe_w3_image_get_chunk(img,(unsigned int)(rel / img->w4_header.chunk_size))) == NULL)
+            return -1;
+
+        rel %= img->w4_header.chunk_size;
+        if (rel >= c->length)
+            break; /* damaged chunk that decompressed short */
+
+        n = len - done;
+        if ((unsigned long)n > (unsigned long)(c->length - rel))
+            n = (size_t)(c->length - rel);
+
+        memcpy(buf + done,c->data + rel,n);
+        done += n;
+    }
+
+    return (int)done;
+}
+
+/* directory entry by name, case insensitive */
+const struct exe_w3_image_dir_entry *exe_w3_image_lookup(const struct exe_w3_image * const img,const char * const name) {
+    const char *a,*b;
+    unsigned int i;
+
+    if (img->dir == NULL)
+        return NULL;
+
+    for (i=0;i < img->w3_header.directory_entries;i++) {
+        a = img->dir[i].name;
+        b = name;
+        while (*a != 0 && toupper((unsigned char)(*a)) == toupper((unsigned char)(*b))) { a++; b++; }
+        if (*a == 0 && *b == 0)
+            return img->dir + i;
+    }
+
+    return NULL;
+}
+
+/* rebuild an embedded VxD as a standalone LE file in memory. returns a malloc()'d buffer, or NULL.
+ *
+ * The images stored in the container are just raw LE images, but:
+ *
+ * - The directory points directly at the "LE" header, there is no stub
+ * - The length is only the length of the LE header and loader section
+ * - The Data Pages Offset field in the LE header is an absolute offset in the container
+ * - The Non-resident name table offset does not point at anything useful
+ *
+ * So the container's own MS-DOS stub is copied in front (its extension field already
+ * points just past it), the LE header, loader section and whatever lies between it and
+ * the pages are copied, then the pages, and the data pages offset is adjusted to match.
+ * A non-resident name table naming the module and its NAME_DDB entry point is made up
+ * and appended to the end. */
+unsigned char *exe_w3_image_extract_le(struct exe_w3_image * const img,const struct exe_w3_image_dir_entry * const ent,uint32_t * const length) {
+    uint32_t hdr_end,extra,data,nonres_len,total,new_dpo;
+    struct exe_le_header le,*nle;
+    char modname[64],ddbname[16];
+    unsigned char *buf,*p;
+    size_t ml,dl;
+    unsigned int i;
+    int rd;
+
+    *length = 0;
+    if (ent->le_header_length < (uint32_t)sizeof(le) || ent->le_header_offset < img->w3_offset)
+        return NULL;
+    if (exe_w3_image_read(img,ent->le_header_offset,(unsigned char*)(&le),sizeof(le)) != (int)sizeof(le))
+        return NULL;
+    if (le.signature != EXE_LE_SIGNATURE)
+        return NULL;
+
+    hdr_end = ent->le_header_offset + ent->le_header_length;
+    if (hdr_end < ent->le_header_offset || le.data_pages_offset < hdr_end)
+        return NULL;
+    extra = le.data_pages_offset - hdr_end;
+    if (extra >= 0x10000ul)
+        return NULL;
+
+    if (le.number_of_memory_pages == 0 || le.number_of_memory_pages > 0x10000ul ||
+        le.memory_page_size == 0 || le.memory_page_size > 0x10000ul || le.bytes_on_last_page > le.memory_page_size)
+        return NULL;
+    data = ((le.number_of_memory_pages - 1ul) * le.memory_page_size) +
+        (le.bytes_on_last_page != 0 ? le.bytes_on_last_page : le.memory_page_size);
+
+    sprintf(modname,"W3 extracted %s module",ent->name);
+    sprintf(ddbname,"%s_DDB",ent->name);
+    for (i=0;ddbname[i] != 0;i++) ddbname[i] = (char)toupper((unsigned char)ddbname[i]);
+    ml = strlen(modname);
+    dl = strlen(ddbname);
+    nonres_len = (uint32_t)(1u + ml + 2u + 1u + dl + 2u + 1u);
+
+    total = img->w3_offset + ent->le_header_length + extra + data + nonres_len;
+    if (total < ent->le_header_length + extra + data || (unsigned long)((size_t)total) != (unsigned long)total)
+        return NULL;
+    if ((buf=(unsigned char*)malloc((size_t)total)) == NULL)
+        return NULL;
+
+    p = buf;
+    if (exe_w3_image_read(img,0,p,img->w3_offset) != (int)img->w3_offset)
+        goto fail;
+    p += img->w3_offset;
+
+    if (exe_w3_image_read(img,ent->le_header_offset,p,(size_t)(ent->le_header_length + extra)) != (int)(ent->le_header_length + extra))
+        goto fail;
+    nle = (struct exe_le_header*)p;
+    p += ent->le_header_length + extra;
+
+    /* pages missing from the end of the container are left zero */
+    if ((rd=exe_w3_image_read(img,le.data_pages_offset,p,(size_t)data)) < 0)
+        goto fail;
+    if ((uint32_t)rd < data)
+        memset(p + rd,0,(size_t)(data - (uint32_t)rd));
+    p += data;
+
+    new_dpo = img->w3_offset + ent->le_header_length + extra;
+    nle->data_pages_offset = new_dpo;
+    nle->nonresident_names_table_offset = new_dpo + data;
+    nle->nonresident_names_table_length = nonres_len;
+
+    *p++ = (unsigned char)ml;
+    memcpy(p,modname,ml); p += ml;
+    *p++ = 0; *p++ = 0;             /* ordinal 0 */
+    *p++ = (unsigned char)dl;
+    memcpy(p,ddbname,dl); p += dl;
+    *p++ = 1; *p++ = 0;             /* ordinal 1 */
+    *p++ = 0;
+    assert(p == (buf + total));
+
+    *length = total;
+    return buf;
+fail:
+    free(buf);
+    return NULL;
+}
+
@@ -0,0 +1,103 @@
+
+/* WIN386.EXE (Windows 3.x) and VMM32.VXD (Windows 95) carry the VMM and the built-in VxDs
+ * in a "W3" container following the MS-DOS stub, at the offset given by the EXE extension
+ * field. Windows 95 compresses the container ("W4") in independently compressed chunks.
+ *
+ * W3 header:
+ *   +0x00 char[2]   "W3"
+ *   +0x02 uint16_t  Windows version (0x0300 = 3.0, 0x030A = 3.1, 0x0400 = 95)
+ *   +0x04 uint16_t  number of directory entries
+ *   +0x06 ...       (unknown, 10 bytes)
+ *   +0x10           directory, 16 bytes per entry
+ *
+ * W4 header:
+ *   +0x00 char[2]   "W4"
+ *   +0x02 uint16_t  version (0 or 0x04xx)
+ *   +0x04 uint16_t  chunk size (decompressed)
+ *   +0x06 uint16_t  number of chunks
+ *   +0x08 char[2]   "DS" (DoubleSpace compression)
+ *   +0x0A ...       (unknown, 6 bytes)
+ *   +0x10 uint32_t  file offset of each chunk, [number of chunks]
+ *
+ * Decompressing the chunks in order, from the same file offset, yields the W3 container. */
+#pragma pack(push,1)
+struct exe_w3_header {
+    char            signature[2];                   // +0x00 "W3"
+    uint16_t        windows_version;                // +0x02
+    uint16_t        directory_entries;              // +0x04
+    uint8_t         _unknown_06[10];                // +0x06
+};                                                  // =0x10
+#pragma pack(pop)
+
+#pragma pack(push,1)
+struct exe_w3_directory_entry {
+    char            name[8];                        // +0x00 name of the VxD, space padded
+    uint32_t        le_header_offset;               // +0x08 offset of the LE header, not the MS-DOS stub
+    uint32_t        le_header_length;               // +0x0C length of the LE header and loader section only
+};                                                  // =0x10
+#pragma pack(pop)
+
+#pragma pack(push,1)
+struct exe_w4_header {
+    char            signature[2];                   // +0x00 "W4"
+    uint16_t        version;                        // +0x02
+    uint16_t        chunk_size;                     // +0x04
+    uint16_t        chunk_count;                    // +0x06
+    char            compression[2];                 // +0x08 "DS"
+    uint8_t         _unknown_0A[6];                 // +0x0A
+};                                                  // =0x10
+#pragma pack(pop)
+
+/* number of decompressed W4 chunks kept around */
+#define EXE_W3_IMAGE_CHUNK_CACHE                    8
+
+/* exe_w3_image_open_fd() return values */
+#define EXE_W3_IMAGE_ERR_EXE_HEADER                 (-1)    /* cannot read MS-DOS EXE header */
+#define EXE_W3_IMAGE_ERR_NOT_MZ                     (-2)    /* MS-DOS EXE header signature missing */
+#define EXE_W3_IMAGE_ERR_EXTENSION                  (-3)    /* cannot read extension offset */
+#define EXE_W3_IMAGE_ERR_NOT_W3                     (-4)    /* extension is neither W3 nor W4 */
+#define EXE_W3_IMAGE_ERR_W4_HEADER                  (-5)    /* unsupported W4 header or compression */
+#define EXE_W3_IMAGE_ERR_W4_CHUNKS                  (-6)    /* cannot read W4 chunk table, or it makes no sense */
+#define EXE_W3_IMAGE_ERR_W3_HEADER                  (-7)    /* cannot read W3 header, or it makes no sense */
+#define EXE_W3_IMAGE_ERR_MEMORY                     (-8)    /* out of memory */
+
+struct exe_w3_image_dir_entry {
+    char                                            name[8+1];          /* spaces removed */
+    uint32_t                                        le_header_offset;   /* in the (decompressed) W3 container */
+    uint32_t                                        le_header_length;
+};
+
+struct exe_w3_image_chunk {
+    unsigned char*                                  data;               /* [chunk_size] */
+    uint32_t                                        length;             /* decompressed length */
+    uint32_t                                        last_used;
+    int                                             chunk;              /* -1 if empty */
+};
+
+struct exe_w3_image {
+    int                                             fd;
+    uint32_t                                        file_size;
+    uint32_t                                        w3_offset;          /* W3 (or W4) header, also the length of the MS-DOS stub */
+    uint32_t                                        size;               /* of the file with the W3 container decompressed */
+    struct exe_w3_header                            w3_header;
+    struct exe_w3_image_dir_entry*                  dir;                /* [w3_header.directory_entries] */
+    unsigned char                                   is_w4;
+    struct exe_w4_header                            w4_header;
+    uint32_t*                                       chunk_table;        /* [w4_header.chunk_count] */
+    unsigned char*                                  chunk_src;          /* compressed chunk buffer */
+    struct exe_w3_image_chunk                       cache[EXE_W3_IMAGE_CHUNK_CACHE];
+    uint32_t                                        cache_clock;
+    unsigned long                                   cache_hits;
+    unsigned long                                   cache_misses;
+};
+
+uint32_t exe_w4_decompress(unsigned char *dst,const size_t dstmax,const unsigned char *src,const size_t srclen);
+
+void exe_w3_image_init(struct exe_w3_image * const img);
+void exe_w3_image_free(struct exe_w3_image * const img);
+int exe_w3_image_open_fd(struct exe_w3_image * const img,const int fd);
+const char *exe_w3_image_error_str(const int err);
+int exe_w3_image_read(struct exe_w3_image * const img,uint32_t ofs,unsigned char *buf,size_t len);
+const struct exe_w3_image_dir_entry *exe_w3_image_lookup(const struct exe_w3_image * const img,const char * const name);
+unsigned char *exe_w3_image_extract_le(struct exe_w3_image * const img,const struct exe_w3_image_dir_entry * const ent,uint32_t * const length);
+
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "decflow.h"
+
+void dec_flow_init(struct dec_flow * const f) {
+    memset(f,0,sizeof(*f));
+}
+
+static void dec_flow_object_free(struct dec_flow_object * const o) {
+    if (o->image != NULL) free(o->image);
+    if (o->insn != NULL) free(o->insn);
+    if (o->code != NULL) free(o->code);
+    if (o->leader != NULL) free(o->leader);
+    memset(o,0,sizeof(*o));
+}
+
+void dec_flow_free(struct dec_flow * const f) {
+    unsigned int i;
+
+    if (f->object != NULL) {
+        for (i=0;i < f->object_count;i++)
+            dec_flow_object_free(f->object + i);
+
+        free(f->object);
+        f->object = NULL;
+    }
+
+    if (f->block != NULL) {
+        free(f->block);
+        f->block = NULL;
+    }
+
+    f->object_count = 0;
+    f->object_alloc = 0;
+    f->block_count = 0;
+    f->block_alloc = 0;
+}
+
+/* add a segment/object covering seg:[base,base+size). returns the (zeroed) image for the caller to fill in */
+unsigned char *dec_flow_add_object(struct dec_flow * const f,const uint16_t seg,const uint32_t base,const uint32_t size) {
+    const size_t bmsz = ((size_t)size + (size_t)7u) >> (size_t)3u;
+    struct dec_flow_object *o;
+
+    if (f->object_count >= f->object_alloc) {
+        const unsigned int na = (f->object_alloc != 0) ? (f->object_alloc * 2u) : 16u;
+        struct dec_flow_object *n = (struct dec_flow_object*)realloc((void*)f->object,sizeof(*n) * na);
+        if (n == NULL) return NULL;
+        f->object = n;
+        f->object_alloc = na;
+    }
+
+    o = f->object + f->object_count;
+    memset(o,0,sizeof(*o));
+    o->image = (unsigned char*)calloc((size_t)size + (size_t)DEC_FLOW_IMAGE_PADDING,1);
+    o->insn = (unsigned char*)calloc(bmsz + (size_t)1u,1);
+    o->code = (unsigned char*)calloc(bmsz + (size_t)1u,1);
+    o->leader = (unsigned char*)calloc(bmsz + (size_t)1u,1);
+    if (o->image == NULL || o->insn == NULL || o->code == NULL || o->leader == NULL) {
+        dec_flow_object_free(o);
+        return NULL;
+    }
+
+    o->seg = seg;
+    o->base = base;
+    o->size = size;
+    f->object_count++;
+    return o->image;
+}
+
+struct dec_flow_object *dec_flow_find_object(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs) {
+    struct dec_flow_object *o;
+    unsigned int i;
+
+    for (i=0;i < f->object_count;i++) {
+        o = f->object + i;
+        if (o->seg == seg && ofs >= o->base && (ofs - o->base) < o->size)
+            return o;
+    }
+
+    return NULL;
+}
+
+static int dec_flow_bit(const unsigned char * const bm,const struct dec_flow_object * const o,const uint32_t ofs) {
+    uint32_t b;
+
+    if (ofs < o->base || (ofs - o->base) >= o->size)
+        return 0;
+
+    b = ofs - o->base;
+    return (bm[b >> 3u] >> (b & 7u)) & 1u;
+}
+
+int dec_flow_is_code(const struct dec_flow_object * const o,const uint32_t ofs) {
+    return dec_flow_bit(o->code,o,ofs);
+}
+
+int dec_flow_is_insn(const struct dec_flow_object * const o,const uint32_t ofs) {
+    return dec_flow_bit(o->insn,o,ofs);
+}
+
+/* instruction at ofs, len bytes long. the part past the end of the object, if any, is ignored */
+void dec_flow_mark_insn(struct dec_flow_object * const o,const uint32_t ofs,const uint32_t len) {
+    uint32_t b,e;
+
+    if (ofs < o->base || (ofs - o->base) >= o->size)
+        return;
+
+    b = ofs - o->base;
+    e = (len < (o->size - b)) ? (b + len) : o->size;
+
+    o->insn[b >> 3u] |= (unsigned char)(1u << (b & 7u));
+    for (;b < e;b++)
+        o->code[b >> 3u] |= (unsigned char)(1u << (b & 7u));
+}
+
+void dec_flow_mark_leader(struct dec_flow_object * const o,const uint32_t ofs) {
+    uint32_t b;
+
+    if (ofs < o->base || (ofs - o->base) >= o->size)
+        return;
+
+    b = ofs - o->base;
+    o->leader[b >> 3u] |= (unsigned char)(1u << (b & 7u));
+}
+
+static int dec_flow_block_qsortcb(const void *a,const void *b) {
+    const struct dec_flow_block *as = (const struct dec_flow_block*)a;
+    const struct dec_flow_block *bs = (const struct dec_flow_block*)b;
+
+    if (as->seg < bs->seg)
+        return -1;
+    else if (as->seg > bs->seg)
+        return 1;
+
+    if (as->start < bs->start)
+        return -1;
+    else if (as->start > bs->start)
+        return 1;
+
+    return 0;
+}
+
+static int dec_flow_emit_block(struct dec_flow * const f,const uint16_t seg,const uint32_t start,const uint32_t end) {
+    struct dec_flow_block *b;
+
+    if (f->block_count >= f->block_alloc) {
+        const size_t na = (f->block_alloc != 0) ? (f->block_alloc * (size_t)2u) : (size_t)1024u;
+        struct dec_flow_block *n = (struct dec_flow_block*)realloc((void*)f->block,sizeof(*n) * na);
+        if (n == NULL) return -1;
+        f->block = n;
+        f->block_alloc = na;
+    }
+
+    b = f->block + (f->block_count++);
+    b->seg = seg;
+    b->start = start;
+    b->end = end;
+    return 0;
+}
+
+/* turn the marks left by the first pass into the sorted basic block list.
+ * a block is a run of decoded bytes that starts at a leader (or wherever decoded code begins)
+ * and ends at the next leader or the first byte that was not decoded. */
+int dec_flow_build_blocks(struct dec_flow * const f) {
+    struct dec_flow_object *o;
+    unsigned char open;
+    uint32_t p,start;
+    unsigned int i;
+
+    f->block_count = 0;
+    for (i=0;i < f->object_count;i++) {
+        o = f->object + i;
+        start = 0;
+        open = 0;
+
+        for (p=0;p < o->size;p++) {
+            if (!((o->code[p >> 3u] >> (p & 7u)) & 1u)) {
+                if (open) {
+                    if (dec_flow_emit_block(f,o->seg,o->base + start,o->base + p) < 0)
+                        return -1;
+                    open = 0;
+                }
+                continue;
+            }
+
+            if ((o->insn[p >> 3u] >> (p & 7u)) & 1u) {
+                if (open && ((o->leader[p >> 3u] >> (p & 7u)) & 1u)) {
+                    if (dec_flow_emit_block(f,o->seg,o->base + start,o->base + p) < 0)
+                        return -1;
+                    open = 0;
+                }
+                if (!open) {
+                    start = p;
+                    open = 1;
+                }
+            }
+        }
+
+        if (open) {
+            if (dec_flow_emit_block(f,o->seg,o->base + start,o->base + p) < 0)
+                return -1;
+        }
+    }
+
+    if (f->block_count > 1)
+        qsort(f->block,f->block_count,sizeof(*(f->block)),dec_flow_block_qsortcb);
+
+    return 0;
+}
+
+/* index of the first block that starts after seg:ofs */
+static size_t dec_flow_upper_bound(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs) {
+    size_t lo = 0,hi = f->block_count,mid;
+    const struct dec_flow_block *b;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> (size_t)1u);
+        b = f->block + mid;
+        if (b->seg < seg || (b->seg == seg && b->start <= ofs))
+            lo = mid + (size_t)1u;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* block containing seg:ofs, or NULL if that byte is not code */
+const struct dec_flow_block *dec_flow_find_block(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs) {
+    const struct dec_flow_block *b;
+    size_t i;
+
+    i = dec_flow_upper_bound(f,seg,ofs);
+    if (i == 0) return NULL;
+
+    b = f->block + i - (size_t)1u;
+    if (b->seg == seg && ofs >= b->start && ofs < b->end)
+        return b;
+
+    return NULL;
+}
+
+/* first block in seg that starts after ofs, or NULL */
+const struct dec_flow_block *dec_flow_next_block(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs) {
+    const struct dec_flow_block *b;
+    size_t i;
+
+    i = dec_flow_upper_bound(f,seg,ofs);
+    if (i >= f->block_count) return NULL;
+
+    b = f->block + i;
+    if (b->seg == seg)
+        return b;
+
+    return NULL;
+}
+
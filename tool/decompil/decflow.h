@@ -0,0 +1,50 @@
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* code discovery map for the decompilers.
+ *
+ * each code segment/object is read into memory once and decoded from there. the first pass
+ * marks every byte it decodes, so that a trace stops as soon as it runs into code that has
+ * already been seen, and marks the start of every basic block (trace starts, branch targets,
+ * the instruction after a conditional branch). once the first pass is done the marks are
+ * turned into a sorted list of basic blocks, and anything in the segment that is not in a
+ * block is data as far as the second pass is concerned. */
+#define DEC_FLOW_IMAGE_PADDING              32          /* zero bytes past the end of the image, for the decoder */
+
+struct dec_flow_block {
+    uint32_t                    start,end;          /* [start,end) */
+    uint16_t                    seg;
+};
+
+struct dec_flow_object {
+    unsigned char*              image;              /* size + DEC_FLOW_IMAGE_PADDING bytes */
+    unsigned char*              insn;               /* bitmap: an instruction starts at this byte */
+    unsigned char*              code;               /* bitmap: this byte belongs to a decoded instruction */
+    unsigned char*              leader;             /* bitmap: a basic block starts at this byte */
+    uint32_t                    base;               /* offset of image[0] within seg */
+    uint32_t                    size;
+    uint16_t                    seg;
+};
+
+struct dec_flow {
+    struct dec_flow_object*     object;
+    unsigned int                object_count;
+    unsigned int                object_alloc;
+    struct dec_flow_block*      block;
+    size_t                      block_count;
+    size_t                      block_alloc;
+};
+
+void dec_flow_init(struct dec_flow * const f);
+void dec_flow_free(struct dec_flow * const f);
+unsigned char *dec_flow_add_object(struct dec_flow * const f,const uint16_t seg,const uint32_t base,const uint32_t size);
+struct dec_flow_object *dec_flow_find_object(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs);
+int dec_flow_is_code(const struct dec_flow_object * const o,const uint32_t ofs);
+int dec_flow_is_insn(const struct dec_flow_object * const o,const uint32_t ofs);
+void dec_flow_mark_insn(struct dec_flow_object * const o,const uint32_t ofs,const uint32_t len);
+void dec_flow_mark_leader(struct dec_flow_object * const o,const uint32_t ofs);
+int dec_flow_build_blocks(struct dec_flow * const f);
+const struct dec_flow_block *dec_flow_find_block(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs);
+const struct dec_flow_block *dec_flow_next_block(const struct dec_flow * const f,const uint16_t seg,const uint32_t ofs);
+
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "declabel.h"
+
+void dec_label_index_init(struct dec_label_index * const x) {
+    memset(x,0,sizeof(*x));
+}
+
+void dec_label_index_free(struct dec_label_index * const x) {
+    if (x->table != NULL) {
+        free(x->table);
+        x->table = NULL;
+    }
+
+    x->alloc = 0;
+    x->count = 0;
+    x->indexed = 0;
+    x->failed = 0;
+}
+
+/* forget everything, i.e. after the label array has been sorted. labels are added again as they are looked up */
+void dec_label_index_reset(struct dec_label_index * const x) {
+    if (x->table != NULL)
+        memset(x->table,0,sizeof(*(x->table)) * x->alloc);
+
+    x->count = 0;
+    x->indexed = 0;
+    x->failed = 0;
+}
+
+static size_t dec_label_index_hash(const uint16_t seg,const uint32_t ofs,const size_t alloc) {
+    uint32_t h = (ofs ^ ((uint32_t)seg << 20u) ^ ((uint32_t)seg >> 12u)) * 0x9E3779B1UL;
+
+    return (size_t)(h ^ (h >> 15u)) & (alloc - (size_t)1u);
+}
+
+static struct dec_label_index_ent *dec_label_index_slot(const struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs) {
+    struct dec_label_index_ent *e;
+    size_t h;
+
+    h = dec_label_index_hash(seg,ofs,x->alloc);
+    while ((e=x->table+h)->label != 0 && !(e->seg == seg && e->ofs == ofs))
+        h = (h + (size_t)1u) & (x->alloc - (size_t)1u);
+
+    return e;
+}
+
+/* double the table, keeping it at most half full */
+static int dec_label_index_grow(struct dec_label_index * const x) {
+    struct dec_label_index_ent *ot = x->table,*e;
+    const size_t oa = x->alloc;
+    size_t i;
+
+    x->alloc = (oa != 0) ? (oa * (size_t)2u) : (size_t)4096u;
+    x->table = (struct dec_label_index_ent*)calloc(x->alloc,sizeof(*(x->table)));
+    if (x->table == NULL) {
+        x->table = ot;
+        x->alloc = oa;
+        return -1;
+    }
+
+    for (i=0;i < oa;i++) {
+        if (ot[i].label == 0) continue;
+        e = dec_label_index_slot(x,ot[i].seg,ot[i].ofs);
+        *e = ot[i];
+    }
+
+    if (ot != NULL) free(ot);
+    return 0;
+}
+
+/* add label (array index) under seg:ofs. if the key is already there, the earlier label is kept */
+int dec_label_index_add(struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs,const size_t label) {
+    struct dec_label_index_ent *e;
+
+    if (x->failed)
+        return -1;
+
+    if ((x->count + (size_t)1u) * (size_t)2u > x->alloc) {
+        if (dec_label_index_grow(x) < 0) {
+            x->failed = 1;
+            return -1;
+        }
+    }
+
+    e = dec_label_index_slot(x,seg,ofs);
+    if (e->label == 0) {
+        e->seg = seg;
+        e->ofs = ofs;
+        e->label = label + (size_t)1u;
+        x->count++;
+    }
+
+    return 0;
+}
+
+/* array index of the first label added under seg:ofs, or DEC_LABEL_INDEX_NONE */
+size_t dec_label_index_find(const struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs) {
+    const struct dec_label_index_ent *e;
+
+    if (x->table == NULL || x->count == 0)
+        return DEC_LABEL_INDEX_NONE;
+
+    e = dec_label_index_slot(x,seg,ofs);
+    if (e->label == 0)
+        return DEC_LABEL_INDEX_NONE;
+
+    return e->label - (size_t)1u;
+}
+
@@ -0,0 +1,31 @@
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* hash index over the decompiler label array, keyed by (segment/object, offset).
+ *
+ * the index refers to labels by their position in the array, so it survives the array being
+ * realloc()'d but not sorted. labels are added to the index in array order and the first one
+ * added with a given key wins, which gives the same answer as a linear search of the array. */
+#define DEC_LABEL_INDEX_NONE                ((size_t)(~((size_t)0u)))
+
+struct dec_label_index_ent {
+    uint32_t                    ofs;
+    uint16_t                    seg;
+    size_t                      label;              /* array index + 1, 0 if slot is empty */
+};
+
+struct dec_label_index {
+    struct dec_label_index_ent* table;
+    size_t                      alloc;              /* power of 2 */
+    size_t                      count;
+    size_t                      indexed;            /* labels [0,indexed) of the array have been added */
+    unsigned char               failed;             /* ran out of memory, caller should search the array */
+};
+
+void dec_label_index_init(struct dec_label_index * const x);
+void dec_label_index_free(struct dec_label_index * const x);
+void dec_label_index_reset(struct dec_label_index * const x);
+int dec_label_index_add(struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs,const size_t label);
+size_t dec_label_index_find(const struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs);
+
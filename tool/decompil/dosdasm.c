@@ -14,6 +14,8 @@
 
 #include <hw/dos/exehdr.h>
 
+#include "declabel.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -49,6 +51,7 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dec_label_index          dec_label_idx;
 unsigned long                   dec_ofs;
 uint16_t                        dec_cs;
 
@@ -193,16 +196,39 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_count = 0;
+    dec_label_alloc = 0;
+    dec_label_index_free(&dec_label_idx);
 }
 
 struct dec_label *dec_find_label(const uint32_t ofs) {
     unsigned int i=0;
+    struct dec_label *l;
+    size_t li;
 
     if (dec_label == NULL)
         return NULL;
 
+    /* index the labels added since the last lookup. callers fill in (and translate) the
+     * address right after dec_label_malloc(), so they are final by now */
+    while (!dec_label_idx.failed && dec_label_idx.indexed < dec_label_count) {
+        l = dec_label + dec_label_idx.indexed;
+        if (dec_label_index_add(&dec_label_idx,0,l->offset,dec_label_idx.indexed) < 0)
+            break;
+
+        dec_label_idx.indexed++;
+    }
+
+    if (!dec_label_idx.failed) {
+        if ((li=dec_label_index_find(&dec_label_idx,0,ofs)) == DEC_LABEL_INDEX_NONE)
+            return NULL;
+
+        return dec_label + li;
+    }
+
+    /* out of memory for the index, fall back to searching the array */
     while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+        l = dec_label + i;
 
         if (l->offset == ofs)
             return l;
@@ -214,13 +240,25 @@ struct dec_label *dec_find_label(const uint32_t ofs) {
 }
 
 struct dec_label *dec_label_malloc() {
+    struct dec_label *l;
+
     if (dec_label == NULL)
         return NULL;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        /* grow. nobody holds a label pointer across dec_label_malloc(), and the index refers to labels by position */
+        const size_t na = dec_label_alloc * 2u;
+
+        if (na <= dec_label_alloc || (l=(struct dec_label*)realloc(dec_label,sizeof(*dec_label) * na)) == NULL)
+            return NULL;
 
-    return dec_label + (dec_label_count++);
+        dec_label = l;
+        dec_label_alloc = na;
+    }
+
+    l = dec_label + (dec_label_count++);
+    memset(l,0,sizeof(*l));
+    return l;
 }
 
 int exe_relocation_qsort_cb(const void *a,const void *b) {
@@ -252,6 +290,9 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+
+    /* labels have moved, index them again on the next lookup */
+    dec_label_index_reset(&dec_label_idx);
 }
 
 int main(int argc,char **argv) {
@@ -271,6 +312,7 @@ int main(int argc,char **argv) {
         return 1;
     }
     memset(dec_label,0,sizeof(*dec_label) * dec_label_alloc);
+    dec_label_index_init(&dec_label_idx);
 
     src_fd = open(src_file,O_RDONLY|O_BINARY);
     if (src_fd < 0) {
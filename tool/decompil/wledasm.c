@@ -883,6 +883,9 @@ const char *vxd_service_to_name(const uint16_t vid,const uint16_t sid) {
 #include <hw/dos/exelehdr.h>
 #include <hw/dos/exelepar.h>
 
+#include "declabel.h"
+#include "decflow.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -954,6 +957,9 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dec_label_index          dec_label_idx;
+struct dec_flow                 dec_flow;
+unsigned char                   dec_flow_ready = 0;
 unsigned long                   dec_ofs;
 uint16_t                        dec_cs;
 
@@ -996,6 +1002,9 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_count = 0;
+    dec_label_alloc = 0;
+    dec_label_index_free(&dec_label_idx);
 }
 
 uint32_t current_offset_minus_buffer() {
@@ -1012,6 +1021,13 @@ static void minx86dec_set_buffer(struct minx86dec_state *st,uint8_t *buf,int sz)
 	st->read_ip = buf;
 }
 
+/* decode straight from an in-memory object image instead of dec_buffer */
+static void minx86dec_set_image(struct minx86dec_state *st,const struct dec_flow_object *o,uint32_t ofs) {
+	st->fence = o->image + o->size;
+	st->prefetch_fence = o->image + o->size + DEC_FLOW_IMAGE_PADDING - 16;
+	st->read_ip = o->image + ofs;
+}
+
 void help() {
     fprintf(stderr,"dosdasm [options]\n");
     fprintf(stderr,"MS-DOS COM/EXE/SYS decompiler\n");
@@ -1021,33 +1037,15 @@ void help() {
     fprintf(stderr,"    -b <a>           Load base\n");
 }
 
-void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
+void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie;
     char tmp[255+1];
-    unsigned int i;
 
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
+    if (ordinal > 0xFFFFu) return;
+    if ((ie=exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal)) == NULL) return;
 
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),resnames,ent);
-                printf(" RESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
-    }
-
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
-
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,sizeof(tmp),nonresnames,ent);
-                printf(" NONRESIDENT NAME '%s' ",tmp);
-                return;
-            }
-        }
-    }
+    ne_name_entry_get_name(tmp,sizeof(tmp),ie->table,ie->entry);
+    printf(" %s NAME '%s' ",ie->resident ? "RESIDENT" : "NONRESIDENT",tmp);
 }
 
 int parse_argv(int argc,char **argv) {
@@ -1182,12 +1180,32 @@ void dec_label_xlate_32flat_always(struct dec_label *l,struct le_header_parseinf
 
 struct dec_label *dec_find_label(const uint16_t so,const uint32_t oo) {
     unsigned int i=0;
+    struct dec_label *l;
+    size_t li;
 
     if (dec_label == NULL)
         return NULL;
 
+    /* index the labels added since the last lookup. callers fill in (and translate) the
+     * address right after dec_label_malloc(), so they are final by now */
+    while (!dec_label_idx.failed && dec_label_idx.indexed < dec_label_count) {
+        l = dec_label + dec_label_idx.indexed;
+        if (dec_label_index_add(&dec_label_idx,l->seg_v,l->ofs_v,dec_label_idx.indexed) < 0)
+            break;
+
+        dec_label_idx.indexed++;
+    }
+
+    if (!dec_label_idx.failed) {
+        if ((li=dec_label_index_find(&dec_label_idx,so,oo)) == DEC_LABEL_INDEX_NONE)
+            return NULL;
+
+        return dec_label + li;
+    }
+
+    /* out of memory for the index, fall back to searching the array */
     while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+        l = dec_label + i;
 
         if (l->seg_v == so && l->ofs_v == oo)
             return l;
@@ -1199,13 +1217,25 @@ struct dec_label *dec_find_label(const uint16_t so,const uint32_t oo) {
 }
 
 struct dec_label *dec_label_malloc() {
+    struct dec_label *l;
+
     if (dec_label == NULL)
         return NULL;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        /* grow. nobody holds a label pointer across dec_label_malloc(), and the index refers to labels by position */
+        const size_t na = dec_label_alloc * 2u;
 
-    return dec_label + (dec_label_count++);
+        if (na <= dec_label_alloc || (l=(struct dec_label*)realloc(dec_label,sizeof(*dec_label) * na)) == NULL)
+            return NULL;
+
+        dec_label = l;
+        dec_label_alloc = na;
+    }
+
+    l = dec_label + (dec_label_count++);
+    memset(l,0,sizeof(*l));
+    return l;
 }
 
 int dec_label_qsortcb(const void *a,const void *b) {
@@ -1244,6 +1274,9 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+
+    /* labels have moved, index them again on the next lookup */
+    dec_label_index_reset(&dec_label_idx);
 }
 
 struct fixup_tracking_window_ent {
@@ -1367,6 +1400,8 @@ int main(int argc,char **argv) {
         return 1;
     }
     memset(dec_label,0,sizeof(*dec_label) * dec_label_alloc);
+    dec_label_index_init(&dec_label_idx);
+    dec_flow_init(&dec_flow);
 
     if (src_file == NULL) {
         fprintf(stderr,"No source file specified\n");
@@ -1536,6 +1571,10 @@ int main(int argc,char **argv) {
             le_header_entry_table_parse(&le_parser.le_entry_table);
     }
 
+    /* page data is read through the page cache from here on */
+    if (le_parser.le_object_page_map_table != NULL)
+        le_header_page_cache_init(&le_parser,LE_HEADER_PAGE_CACHE_DEFAULT,0);
+
     if (le_header.initial_object_cs_number != 0) {
         if ((label=dec_label_malloc()) != NULL) {
             dec_label_set_name(label,"LE entry point");
@@ -1626,6 +1665,9 @@ int main(int argc,char **argv) {
                 label->seg_v = ~0;
                 label->ofs_v = ~0;
                 dec_label_set_name(label,"VXD DDB entry point");
+
+                /* the label moved, the index still has it under the old address */
+                dec_label_index_reset(&dec_label_idx);
             }
 
             if (le_segofs_to_trackio(&io,object,offset,&le_parser)) {
@@ -1760,11 +1802,55 @@ int main(int argc,char **argv) {
         }
     }
  
-    /* first pass: decompilation */
+    /* load the executable objects into memory, once. the first pass decodes from there */
+    if (le_parser.le_object_table != NULL) {
+        struct exe_le_header_object_table_entry *ent;
+        unsigned char *image;
+        unsigned int i;
+        uint32_t base,o;
+        uint16_t seg;
+        int rd;
+
+        for (i=0;i < le_parser.le_header.object_table_entries;i++) {
+            ent = le_parser.le_object_table + i;
+            if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE))
+                continue;
+
+            if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) {
+                seg = le_parser.le_object_flat_32bit;
+                base = le_parser.le_object_table_loaded_linear[i];
+                if (!le_segofs_to_trackio(&io,0/*flat*/,base,&le_parser))
+                    continue;
+            }
+            else {
+                seg = i + 1;
+                base = 0;
+                if (!le_segofs_to_trackio(&io,i + 1,0,&le_parser))
+                    continue;
+            }
+
+            if ((image=dec_flow_add_object(&dec_flow,seg,base,ent->virtual_segment_size)) == NULL) {
+                printf("! unable to alloc image of LE object #%u\n",i + 1);
+                continue;
+            }
+
+            /* pages not present in the file stay zero */
+            for (o=0;o < ent->virtual_segment_size;o += (uint32_t)rd) {
+                rd = (int)((ent->virtual_segment_size - o) < 0x10000UL ? (ent->virtual_segment_size - o) : 0x10000UL);
+                if ((rd=le_trackio_read(image + o,rd,src_fd,&io,&le_parser)) <= 0)
+                    break;
+            }
+        }
+    }
+
+    /* first pass: decompilation.
+     * the label array is the work queue: every trace adds the branch targets it finds to the end of it.
+     * a trace stops at a JMP/RET or as soon as it runs into code an earlier trace already decoded. */
     {
         struct exe_le_header_object_table_entry *ent;
-        unsigned int inscount;
+        struct dec_flow_object *fo;
         unsigned int los = 0;
+        uint32_t ip;
 
         while (los < dec_label_count) {
             label = dec_label + los;
@@ -1779,32 +1865,27 @@ int main(int argc,char **argv) {
                 continue;
             }
 
-            if (label->seg_v == le_parser.le_object_flat_32bit) {
-                if (!le_segofs_to_trackio(&io,0/*flat*/,label->ofs_v,&le_parser)) {
-                    los++;
-                    continue;
-                }
+            if ((fo=dec_flow_find_object(&dec_flow,label->seg_v,label->ofs_v)) == NULL) {
+                los++;
+                continue;
             }
-            else {
-                if (!le_segofs_to_trackio(&io,label->seg_v,label->ofs_v,&le_parser)) {
-                    los++;
-                    continue;
-                }
+
+            /* an earlier trace already decoded this. a basic block starts here if it is on an instruction boundary */
+            if (dec_flow_is_code(fo,label->ofs_v)) {
+                if (dec_flow_is_insn(fo,label->ofs_v))
+                    dec_flow_mark_leader(fo,label->ofs_v);
+
+                los++;
+                continue;
             }
 
-            inscount = 0;
-            reset_buffer();
             dec_ofs = 0;
             entry_ip = 0;
             dec_cs = label->seg_v;
             start_decom = 0;
             entry_cs = dec_cs;
-            current_offset = label->ofs_v;
-            dec_read = dec_end = dec_buffer;
-            end_decom = ent->virtual_segment_size;
-            if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
-                end_decom += le_parser.le_object_table_loaded_linear[label->seg_v - 1];
-            refill(&io,&le_parser);
+            ip = label->ofs_v;
+            dec_flow_mark_leader(fo,ip);
             minx86dec_init_state(&dec_st);
             dec_st.data32 = dec_st.addr32 =
                 (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) ? 1 : 0;
@@ -1813,18 +1894,20 @@ int main(int argc,char **argv) {
                 (unsigned int)dec_cs,(unsigned long)label->ofs_v,label->name);
 
             do {
-                uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer();
-                uint32_t ip = ofs + entry_ip - dec_ofs;
+                const uint32_t ofs = ip - fo->base;
                 unsigned int c;
 
-                if (!refill(&io,&le_parser)) break;
+                /* end of the object, or ran into code another trace already decoded */
+                if (ofs >= fo->size) break;
+                if (dec_flow_is_code(fo,ip)) break;
 
-                minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
+                dec_read = fo->image + ofs;
+                minx86dec_set_image(&dec_st,fo,ofs);
                 minx86dec_init_instruction(&dec_i);
                 dec_st.ip_value = ip;
                 minx86dec_decodeall(&dec_st,&dec_i);
                 assert(dec_i.end >= dec_read);
-                assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
+                assert(dec_i.end <= (fo->image+fo->size+DEC_FLOW_IMAGE_PADDING-4));
 
                 if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
                     printf("%04lX:%08lX  ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value);
@@ -1902,7 +1985,8 @@ int main(int argc,char **argv) {
                 if (dec_i.lock) printf("  ; LOCK#");
                 printf("\n");
 
-                dec_read = dec_i.end;
+                dec_flow_mark_insn(fo,ip,(uint32_t)(dec_i.end - dec_i.start));
+                ip += (uint32_t)(dec_i.end - dec_i.start);
 
                 if ((dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_CALL || dec_i.opcode == MXOP_JCXZ ||
                     (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG)) && dec_i.argc == 1 &&
@@ -1933,6 +2017,10 @@ int main(int argc,char **argv) {
 
                     if (dec_i.opcode == MXOP_JMP)
                         break;
+
+                    /* conditional branch, the fall through starts another basic block */
+                    if (dec_i.opcode != MXOP_CALL)
+                        dec_flow_mark_leader(fo,ip);
                 }
                 else if (dec_i.opcode == MXOP_JMP)
                     break;
@@ -1942,13 +2030,18 @@ int main(int argc,char **argv) {
                     if (dec_i.opcode == MXOP_JMP_FAR)
                         break;
                 }
-
-                if (++inscount >= 1024)
-                    break;
             } while(1);
 
             los++;
         }
+
+        if (dec_flow_build_blocks(&dec_flow) < 0) {
+            printf("! unable to alloc basic block list, decoding objects linearly\n");
+        }
+        else {
+            printf("* %lu basic blocks\n",(unsigned long)dec_flow.block_count);
+            dec_flow_ready = 1;
+        }
     }
 
     /* sort labels */
@@ -2206,6 +2299,33 @@ int main(int argc,char **argv) {
                     }
                 }
 
+                /* not reached by the first pass: data, up to the next basic block or label */
+                if (dec_flow_ready && dec_flow_find_block(&dec_flow,dec_cs,ip) == NULL) {
+                    const struct dec_flow_block *nb = dec_flow_next_block(&dec_flow,dec_cs,ip);
+                    uint32_t n = (uint32_t)(dec_end - dec_read);
+
+                    if (n > 8) n = 8;
+                    if (nb != NULL && n > (nb->start - ip))
+                        n = nb->start - ip;
+                    if (labeli < dec_label_count && dec_label[labeli].seg_v == dec_cs &&
+                        dec_label[labeli].ofs_v > ip && n > (dec_label[labeli].ofs_v - ip))
+                        n = dec_label[labeli].ofs_v - ip;
+
+                    if (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT)
+                        printf("%04lX:%08lX  ",(unsigned long)dec_cs,(unsigned long)ip);
+                    else
+                        printf("%04lX:%04lX      ",(unsigned long)dec_cs,(unsigned long)ip);
+
+                    for (c=0;c < n;c++)
+                        printf("%02X ",dec_read[c]);
+                    for (;c < 8;c++)
+                        printf("   ");
+
+                    printf("%-8s \n","DB");
+                    dec_read += n;
+                    continue;
+                }
+
                 minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
                 minx86dec_init_instruction(&dec_i);
                 dec_st.ip_value = ip;
@@ -2409,6 +2529,7 @@ int main(int argc,char **argv) {
 
     fixup_tracking_window_free(&fixup_window);
     le_header_parseinfo_free(&le_parser);
+    dec_flow_free(&dec_flow);
     dec_free_labels();
     close(src_fd);
     return 0;
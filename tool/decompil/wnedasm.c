@@ -41,6 +41,9 @@
 #include <hw/dos/exenehdr.h>
 #include <hw/dos/exenepar.h>
 
+#include "declabel.h"
+#include "decflow.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -111,6 +114,9 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dec_label_index          dec_label_idx;
+struct dec_flow                 dec_flow;
+unsigned char                   dec_flow_ready = 0;
 unsigned long                   dec_ofs;
 uint16_t                        dec_cs;
 
@@ -150,6 +156,9 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_count = 0;
+    dec_label_alloc = 0;
+    dec_label_index_free(&dec_label_idx);
 }
 
 uint32_t current_offset_minus_buffer() {
@@ -166,6 +175,13 @@ static void minx86dec_set_buffer(struct minx86dec_state *st,uint8_t *buf,int sz)
 	st->read_ip = buf;
 }
 
+/* decode straight from an in-memory segment image instead of dec_buffer */
+static void minx86dec_set_image(struct minx86dec_state *st,const struct dec_flow_object *o,uint32_t ofs) {
+	st->fence = o->image + o->size;
+	st->prefetch_fence = o->image + o->size + DEC_FLOW_IMAGE_PADDING - 16;
+	st->read_ip = o->image + ofs;
+}
+
 void help() {
     fprintf(stderr,"dosdasm [options]\n");
     fprintf(stderr,"MS-DOS COM/EXE/SYS decompiler\n");
@@ -264,12 +280,32 @@ int refill() {
 
 struct dec_label *dec_find_label(const uint16_t so,const uint16_t oo) {
     unsigned int i=0;
+    struct dec_label *l;
+    size_t li;
 
     if (dec_label == NULL)
         return NULL;
 
+    /* index the labels added since the last lookup. callers fill in (and translate) the
+     * address right after dec_label_malloc(), so they are final by now */
+    while (!dec_label_idx.failed && dec_label_idx.indexed < dec_label_count) {
+        l = dec_label + dec_label_idx.indexed;
+        if (dec_label_index_add(&dec_label_idx,l->seg_v,l->ofs_v,dec_label_idx.indexed) < 0)
+            break;
+
+        dec_label_idx.indexed++;
+    }
+
+    if (!dec_label_idx.failed) {
+        if ((li=dec_label_index_find(&dec_label_idx,so,oo)) == DEC_LABEL_INDEX_NONE)
+            return NULL;
+
+        return dec_label + li;
+    }
+
+    /* out of memory for the index, fall back to searching the array */
     while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+        l = dec_label + i;
 
         if (l->seg_v == so && l->ofs_v == oo)
             return l;
@@ -281,13 +317,25 @@ struct dec_label *dec_find_label(const uint16_t so,const uint16_t oo) {
 }
 
 struct dec_label *dec_label_malloc() {
+    struct dec_label *l;
+
     if (dec_label == NULL)
         return NULL;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        /* grow. nobody holds a label pointer across dec_label_malloc(), and the index refers to labels by position */
+        const size_t na = dec_label_alloc * 2u;
+
+        if (na <= dec_label_alloc || (l=(struct dec_label*)realloc(dec_label,sizeof(*dec_label) * na)) == NULL)
+            return NULL;
+
+        dec_label = l;
+        dec_label_alloc = na;
+    }
 
-    return dec_label + (dec_label_count++);
+    l = dec_label + (dec_label_count++);
+    memset(l,0,sizeof(*l));
+    return l;
 }
 
 int dec_label_qsortcb(const void *a,const void *b) {
@@ -326,6 +374,9 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+
+    /* labels have moved, index them again on the next lookup */
+    dec_label_index_reset(&dec_label_idx);
 }
 
 const char *mod_symbols_list_lookup(
@@ -448,47 +499,28 @@ void print_segment_reloc_table(const struct exe_ne_header_segment_reloc_table *
     }
 }
 
-void get_entry_name_by_ordinal(char *tmp,size_t tmplen,const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
-    unsigned int i;
+void get_entry_name_by_ordinal(char *tmp,size_t tmplen,const struct exe_ne_header_name_ordinal_index * const ordinals,const unsigned int ordinal) {
+    const struct exe_ne_header_name_ordinal_index_entry *ie;
 
     tmp[0] = 0;
     if (tmplen <= 1) return;
+    if (ordinal > 0xFFFFu) return;
 
-    if (resnames->table != NULL) {
-        for (i=0;i < resnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = resnames->table + i;
-
-            if (ne_name_entry_get_ordinal(resnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,tmplen,resnames,ent);
-                return;
-            }
-        }
-    }
-
-    if (nonresnames->table != NULL) {
-        for (i=0;i < nonresnames->length;i++) {
-            struct exe_ne_header_name_entry *ent = nonresnames->table + i;
-
-            if (ne_name_entry_get_ordinal(nonresnames,ent) == ordinal) {
-                ne_name_entry_get_name(tmp,tmplen,nonresnames,ent);
-                return;
-            }
-        }
-    }
+    if ((ie=exe_ne_header_name_ordinal_index_lookup(ordinals,(uint16_t)ordinal)) != NULL)
+        ne_name_entry_get_name(tmp,tmplen,ie->table,ie->entry);
 }
 
 void print_relocation_farptr(
     const struct exe_ne_header_imported_name_table *ne_imported_name_table,
     const struct exe_ne_header_entry_table_table *ne_entry_table,
-    const struct exe_ne_header_name_entry_table *ne_nonresname,
-    const struct exe_ne_header_name_entry_table *ne_resname,
+    const struct exe_ne_header_name_ordinal_index *ne_ordinals,
     const union exe_ne_header_segment_relocation_entry *relocent,
     const struct mod_symbols_list * const mod_syms) {
     // caller has established relocation is 2-byte SEGMENT value.
     switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
             if (relocent->intref.segment_index == 0xFF) {
-                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
+                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_ordinals,relocent->movintref.entry_ordinal);
 
                 if (name_tmp[0] != 0)
                     printf("entry %s ordinal #%d",
@@ -563,15 +595,14 @@ void print_relocation_farptr(
 void print_relocation_segment(
     const struct exe_ne_header_imported_name_table *ne_imported_name_table,
     const struct exe_ne_header_entry_table_table *ne_entry_table,
-    const struct exe_ne_header_name_entry_table *ne_nonresname,
-    const struct exe_ne_header_name_entry_table *ne_resname,
+    const struct exe_ne_header_name_ordinal_index *ne_ordinals,
     const union exe_ne_header_segment_relocation_entry *relocent,
     const struct mod_symbols_list * const mod_syms) {
     // caller has established relocation is 2-byte SEGMENT value.
     switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
             if (relocent->intref.segment_index == 0xFF) {
-                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
+                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_ordinals,relocent->movintref.entry_ordinal);
 
                 if (name_tmp[0] != 0)
                     printf("segment of entry %s ordinal #%d",
@@ -638,15 +669,14 @@ void print_relocation_segment(
 void print_relocation_offset(
     const struct exe_ne_header_imported_name_table *ne_imported_name_table,
     const struct exe_ne_header_entry_table_table *ne_entry_table,
-    const struct exe_ne_header_name_entry_table *ne_nonresname,
-    const struct exe_ne_header_name_entry_table *ne_resname,
+    const struct exe_ne_header_name_ordinal_index *ne_ordinals,
     const union exe_ne_header_segment_relocation_entry *relocent,
     const struct mod_symbols_list * const mod_syms) {
     // caller has established relocation is 2-byte SEGMENT value.
     switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
         case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
             if (relocent->intref.segment_index == 0xFF) {
-                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_nonresname,ne_resname,relocent->movintref.entry_ordinal);
+                get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),ne_ordinals,relocent->movintref.entry_ordinal);
 
                 if (name_tmp[0] != 0)
                     printf("offset of entry %s ordinal #%d",
@@ -711,31 +741,27 @@ void print_relocation_offset(
 
 int main(int argc,char **argv) {
     struct exe_ne_header_segment_reloc_table *ne_segment_relocs = NULL;
-    struct exe_ne_header_imported_name_table ne_imported_name_table;
-    struct exe_ne_header_entry_table_table ne_entry_table;
-    struct exe_ne_header_name_entry_table ne_nonresname;
-    struct exe_ne_header_resource_table_t ne_resources;
-    struct exe_ne_header_name_entry_table ne_resname;
-    struct exe_ne_header_segment_table ne_segments;
+    struct exe_ne_header_imported_name_table *ne_imported_name_table;
+    struct exe_ne_header_entry_table_table *ne_entry_table;
+    struct exe_ne_header_name_entry_table *ne_nonresname;
+    struct exe_ne_header_name_entry_table *ne_resname;
+    struct exe_ne_header_name_ordinal_index ne_ordinals;
+    struct exe_ne_header_segment_table *ne_segments;
     struct mod_symbols_list mod_syms;
+    struct exe_ne_image ne_image;
     struct exe_ne_header ne_header;
     uint32_t ne_header_offset;
     struct dec_label *label;
     unsigned int segmenti;
     unsigned int reloci;
     unsigned int labeli;
-    uint32_t file_size;
     int c;
 
     assert(sizeof(ne_header) == 0x40);
     memset(&exehdr,0,sizeof(exehdr));
     memset(&mod_syms,0,sizeof(mod_syms));
-    exe_ne_header_segment_table_init(&ne_segments);
-    exe_ne_header_resource_table_init(&ne_resources);
-    exe_ne_header_name_entry_table_init(&ne_resname);
-    exe_ne_header_name_entry_table_init(&ne_nonresname);
-    exe_ne_header_entry_table_table_init(&ne_entry_table);
-    exe_ne_header_imported_name_table_init(&ne_imported_name_table);
+    exe_ne_image_init(&ne_image);
+    exe_ne_header_name_ordinal_index_init(&ne_ordinals);
 
     if (parse_argv(argc,argv))
         return 1;
@@ -748,6 +774,8 @@ int main(int argc,char **argv) {
         return 1;
     }
     memset(dec_label,0,sizeof(*dec_label) * dec_label_alloc);
+    dec_label_index_init(&dec_label_idx);
+    dec_flow_init(&dec_flow);
 
     src_fd = open(src_file,O_RDONLY|O_BINARY);
     if (src_fd < 0) {
@@ -755,46 +783,29 @@ int main(int argc,char **argv) {
         return 1;
     }
 
-    file_size = lseek(src_fd,0,SEEK_END);
-    lseek(src_fd,0,SEEK_SET);
-
-    if (read(src_fd,&exehdr,sizeof(exehdr)) != (int)sizeof(exehdr)) {
-        fprintf(stderr,"EXE header read error\n");
+    if ((c=exe_ne_image_open_fd(&ne_image,src_fd)) < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(c));
         return 1;
     }
+    exehdr = ne_image.exehdr;
 
-    if (exehdr.magic != 0x5A4DU/*MZ*/) {
-        fprintf(stderr,"EXE header signature missing\n");
+    /* go read the extension, and the extended header */
+    c = exe_ne_image_read_ne_header(&ne_image);
+    if (c == EXE_NE_IMAGE_ERR_NO_EXTENSION || c == EXE_NE_IMAGE_ERR_EXTENSION) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(c));
         return 1;
     }
-
-    if (!exe_header_can_contain_exe_extension(&exehdr)) {
-        fprintf(stderr,"EXE header cannot contain extension\n");
-        return 1;
-    }
-
-    /* go read the extension */
-    if (lseek(src_fd,EXE_HEADER_EXTENSION_OFFSET,SEEK_SET) != EXE_HEADER_EXTENSION_OFFSET ||
-        read(src_fd,&ne_header_offset,4) != 4) {
-        fprintf(stderr,"Cannot read extension\n");
-        return 1;
-    }
-    printf("    EXE extension (if exists) at: %lu\n",(unsigned long)ne_header_offset);
-    if ((ne_header_offset+EXE_HEADER_NE_HEADER_SIZE) >= file_size) {
-        printf("! NE header not present (offset out of range)\n");
+    printf("    EXE extension (if exists) at: %lu\n",(unsigned long)ne_image.ne_header_offset);
+    if (c == EXE_NE_IMAGE_ERR_NO_NE_HEADER) {
+        printf("! %s\n",exe_ne_image_error_str(c));
         return 0;
     }
-
-    /* go read the extended header */
-    if (lseek(src_fd,ne_header_offset,SEEK_SET) != ne_header_offset ||
-        read(src_fd,&ne_header,sizeof(ne_header)) != sizeof(ne_header)) {
-        fprintf(stderr,"Cannot read NE header\n");
-        return 1;
-    }
-    if (ne_header.signature != EXE_NE_SIGNATURE) {
-        fprintf(stderr,"Not an NE executable\n");
+    else if (c < 0) {
+        fprintf(stderr,"%s\n",exe_ne_image_error_str(c));
         return 1;
     }
+    ne_header_offset = ne_image.ne_header_offset;
+    ne_header = ne_image.ne_header;
 
     if (ne_header.nonresident_name_table_offset < (ne_header_offset + 0x40UL))
         printf("! WARNING: Non-resident name table offset too small (would overlap NE header)\n");
@@ -830,112 +841,42 @@ int main(int argc,char **argv) {
         printf("! WARNING: imported name table offset > entry table offset");
 
     /* load segment table */
-    if (ne_header.segment_table_entries != 0 && ne_header.segment_table_offset != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.segment_table_offset + ne_header_offset,SEEK_SET) == ((unsigned long)ne_header.segment_table_offset + ne_header_offset)) {
-        unsigned char *base;
-        size_t rawlen;
-
-        base = exe_ne_header_segment_table_alloc_table(&ne_segments,ne_header.segment_table_entries,ne_header.sector_shift);
-        if (base != NULL) {
-            rawlen = exe_ne_header_segment_table_size(&ne_segments);
-            if (rawlen != 0) {
-                if ((size_t)read(src_fd,base,rawlen) != rawlen) {
-                    printf("    ! Unable to read segment table\n");
-                    exe_ne_header_segment_table_free_table(&ne_segments);
-                }
-            }
-        }
-    }
+    ne_segments = exe_ne_image_segment_table(&ne_image);
+    if (ne_header.segment_table_entries != 0 && ne_header.segment_table_offset != 0 && ne_segments->table == NULL)
+        printf("    ! Unable to read segment table\n");
 
     /* load nonresident name table */
-    if (ne_header.nonresident_name_table_offset != 0 && ne_header.nonresident_name_table_length != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.nonresident_name_table_offset,SEEK_SET) == ne_header.nonresident_name_table_offset) {
-        unsigned char *base;
-
+    if (ne_header.nonresident_name_table_offset != 0 && ne_header.nonresident_name_table_length != 0)
         printf("  * Nonresident name table length: %u\n",ne_header.nonresident_name_table_length);
-        base = exe_ne_header_name_entry_table_alloc_raw(&ne_nonresname,ne_header.nonresident_name_table_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_nonresname.raw_length) != ne_nonresname.raw_length)
-                exe_ne_header_name_entry_table_free_raw(&ne_nonresname);
-        }
-
-        exe_ne_header_name_entry_table_parse_raw(&ne_nonresname);
-    }
+    ne_nonresname = exe_ne_image_nonresident_names(&ne_image);
 
     /* load resident name table */
-    if (ne_header.resident_name_table_offset != 0 && ne_header.module_reference_table_offset > ne_header.resident_name_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.resident_name_table_offset + ne_header_offset,SEEK_SET) == (ne_header.resident_name_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* RESIDENT_NAME_TABLE_SIZE = module_reference_table_offset - resident_name_table_offset */
-        raw_length = (unsigned short)(ne_header.module_reference_table_offset - ne_header.resident_name_table_offset);
-        printf("  * Resident name table length: %u\n",raw_length);
-
-        base = exe_ne_header_name_entry_table_alloc_raw(&ne_resname,raw_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_resname.raw_length) != ne_resname.raw_length)
-                exe_ne_header_name_entry_table_free_raw(&ne_resname);
-        }
-
-        exe_ne_header_name_entry_table_parse_raw(&ne_resname);
-    }
-
-    /* load imported name table */
-    if (ne_header.imported_name_table_offset != 0 && ne_header.entry_table_offset > ne_header.imported_name_table_offset &&
-        (unsigned long)lseek(src_fd,ne_header.imported_name_table_offset + ne_header_offset,SEEK_SET) == (ne_header.imported_name_table_offset + ne_header_offset)) {
-        unsigned int raw_length;
-        unsigned char *base;
-
-        /* IMPORTED_NAME_TABLE_SIZE = entry_table_offset - imported_name_table_offset       (header does not report size of imported name table) */
-        raw_length = (unsigned short)(ne_header.entry_table_offset - ne_header.imported_name_table_offset);
-        printf("  * Imported name table length: %u\n",raw_length);
-
-        base = exe_ne_header_imported_name_table_alloc_raw(&ne_imported_name_table,raw_length);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_imported_name_table.raw_length) != ne_imported_name_table.raw_length)
-                exe_ne_header_imported_name_table_free_raw(&ne_imported_name_table);
-        }
-
-        exe_ne_header_imported_name_table_parse_raw(&ne_imported_name_table);
-    }
-
-    /* load module reference table */
-    if (ne_header.module_reference_table_offset != 0 && ne_header.module_reftable_entries != 0 &&
-        (unsigned long)lseek(src_fd,ne_header.module_reference_table_offset + ne_header_offset,SEEK_SET) == (ne_header.module_reference_table_offset + ne_header_offset)) {
-        uint16_t *base;
-
+    if (ne_header.resident_name_table_offset != 0 && ne_header.module_reference_table_offset > ne_header.resident_name_table_offset)
+        printf("  * Resident name table length: %u\n",
+            (unsigned short)(ne_header.module_reference_table_offset - ne_header.resident_name_table_offset));
+    ne_resname = exe_ne_image_resident_names(&ne_image);
+
+    /* ordinal -> name lookup for entry points and internal references */
+    exe_ne_header_name_ordinal_index_build(&ne_ordinals,ne_resname,ne_nonresname);
+
+    /* load imported name table, and module reference table */
+    if (ne_header.imported_name_table_offset != 0 && ne_header.entry_table_offset > ne_header.imported_name_table_offset)
+        printf("  * Imported name table length: %u\n",
+            (unsigned short)(ne_header.entry_table_offset - ne_header.imported_name_table_offset));
+    if (ne_header.module_reference_table_offset != 0 && ne_header.module_reftable_entries != 0)
         printf("  * Module reference table length: %u\n",ne_header.module_reftable_entries * 2);
-
-        base = exe_ne_header_imported_name_table_alloc_module_ref_table(&ne_imported_name_table,ne_header.module_reftable_entries);
-        if (base != NULL) {
-            if ((unsigned long)read(src_fd,base,ne_imported_name_table.module_ref_table_length*sizeof(uint16_t)) !=
-                (ne_imported_name_table.module_ref_table_length*sizeof(uint16_t)))
-                exe_ne_header_imported_name_table_free_module_ref_table(&ne_imported_name_table);
-        }
-    }
+    ne_imported_name_table = exe_ne_image_imported_names(&ne_image);
 
     /* entry table */
-    if (ne_header.entry_table_offset != 0 && ne_header.entry_table_length != 0 &&
-        lseek(src_fd,ne_header.entry_table_offset + ne_header_offset,SEEK_SET) == (ne_header.entry_table_offset + ne_header_offset)) {
-        unsigned char *base;
-
-        base = exe_ne_header_entry_table_table_alloc_raw(&ne_entry_table,ne_header.entry_table_length);
-        if (base != NULL) {
-            if (read(src_fd,base,ne_header.entry_table_length) != ne_header.entry_table_length)
-                exe_ne_header_entry_table_table_free_raw(&ne_entry_table);
-        }
-
-        exe_ne_header_entry_table_table_parse_raw(&ne_entry_table);
-    }
+    ne_entry_table = exe_ne_image_entry_table(&ne_image);
 
-    if (sym_file != NULL && ne_imported_name_table.length != 0 && ne_imported_name_table.module_ref_table_length != 0) {
+    if (sym_file != NULL && ne_imported_name_table->length != 0 && ne_imported_name_table->module_ref_table_length != 0) {
         int current_module_index = -1;
         char *current_module = NULL;
         unsigned int i;
 
         assert(mod_syms.table == NULL && mod_syms.length == 0);
-        mod_syms.length = ne_imported_name_table.module_ref_table_length;
+        mod_syms.length = ne_imported_name_table->module_ref_table_length;
         mod_syms.table = malloc(sizeof(*mod_syms.table) * mod_syms.length);
         if (mod_syms.table == NULL) return 1;
         memset(mod_syms.table,0,sizeof(*mod_syms.table) * mod_syms.length);
@@ -968,9 +909,9 @@ int main(int argc,char **argv) {
                 i = 0;
                 current_module_index = -1;
                 cstr_copy(&current_module,s);
-                while (i < ne_imported_name_table.module_ref_table_length) {
+                while (i < ne_imported_name_table->module_ref_table_length) {
                     ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),
-                        &ne_imported_name_table,i + 1);
+                        ne_imported_name_table,i + 1);
 
                     if (name_tmp[0] != 0 && strcasecmp(name_tmp,current_module) == 0) {
                         current_module_index = i;
@@ -1089,12 +1030,12 @@ int main(int argc,char **argv) {
         ne_header.entry_ip);
 
     // load and alloc relocations
-    if (ne_segments.length != 0) {
+    if (ne_segments->length != 0) {
         unsigned int i;
 
-        ne_segment_relocs = malloc(sizeof(*ne_segment_relocs) * ne_segments.length);
+        ne_segment_relocs = malloc(sizeof(*ne_segment_relocs) * ne_segments->length);
         if (ne_segment_relocs != NULL) {
-            for (i=0;i < ne_segments.length;i++)
+            for (i=0;i < ne_segments->length;i++)
                 exe_ne_header_segment_reloc_table_init(&ne_segment_relocs[i]);
         }
     }
@@ -1102,33 +1043,29 @@ int main(int argc,char **argv) {
     if (ne_segment_relocs) {
         struct exe_ne_header_segment_entry *segent;
         unsigned long reloc_offset;
-        uint16_t reloc_entries;
-        unsigned char *base;
         unsigned int i,j;
 
-        for (i=0;i < ne_segments.length;i++) {
-            segent = ne_segments.table + i; /* C pointer math, becomes (char*)ne_segments + (i * sizeof(*ne_segments)) */
-            reloc_offset = exe_ne_header_segment_table_get_relocation_table_offset(&ne_segments,segent);
+        for (i=0;i < ne_segments->length;i++) {
+            segent = ne_segments->table + i; /* C pointer math, becomes (char*)ne_segments + (i * sizeof(*ne_segments)) */
+            reloc_offset = exe_ne_header_segment_table_get_relocation_table_offset(ne_segments,segent);
             if (reloc_offset == 0) continue;
 
             /* at the start of the relocation struct, is a 16-bit WORD that indicates how many entries are there,
              * followed by an array of relocation entries. */
-            if ((unsigned long)lseek(src_fd,reloc_offset,SEEK_SET) != reloc_offset || read(src_fd,&reloc_entries,2) != 2)
+            if (exe_ne_image_segment_relocs(&ne_image,reloc_offset,&ne_segment_relocs[i]) <= 0)
+                continue;
+            if (ne_segment_relocs[i].table == NULL)
                 continue;
 
-            if (reloc_entries == 0) continue;
-
-            base = exe_ne_header_segment_reloc_table_alloc_table(&ne_segment_relocs[i],reloc_entries);
-            if (base == NULL) continue;
-
-            {
-                size_t rd = exe_ne_header_segment_reloc_table_size(&ne_segment_relocs[i]);
-                if (rd == 0) continue;
+            /* the table is sorted and extended below. if it points into the read-only file mapping, make a copy */
+            if (!ne_segment_relocs[i].table_ownership) {
+                const union exe_ne_header_segment_relocation_entry *mapped = ne_segment_relocs[i].table;
+                const unsigned int count = ne_segment_relocs[i].length;
 
-                if ((size_t)read(src_fd,ne_segment_relocs[i].table,rd) != rd) {
-                    exe_ne_header_segment_reloc_table_free(&ne_segment_relocs[i]);
+                if (exe_ne_header_segment_reloc_table_alloc_table(&ne_segment_relocs[i],count) == NULL)
                     continue;
-                }
+
+                memcpy(ne_segment_relocs[i].table,mapped,count * sizeof(*mapped));
             }
 
             printf("* Segment #%u, %u relocations\n",i+1,ne_segment_relocs[i].length);
@@ -1177,7 +1114,7 @@ int main(int argc,char **argv) {
              * list instead? Still, would have been nice to document! */
             {
                 struct exe_ne_header_segment_reloc_table *reloc = &ne_segment_relocs[i];
-                uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments.sector_shift;
+                uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments->sector_shift;
                 union exe_ne_header_segment_relocation_entry *newlist = NULL;
                 size_t newlist_count = 0,newlist_alloc = 0;
 
@@ -1254,11 +1191,11 @@ int main(int argc,char **argv) {
                     sizeof(const union exe_ne_header_segment_relocation_entry *),
                     ne_segment_relocs_table_qsort);
 
-            print_segment_reloc_table(&ne_segment_relocs[i],&ne_imported_name_table,&mod_syms);
+            print_segment_reloc_table(&ne_segment_relocs[i],ne_imported_name_table,&mod_syms);
         }
     }
 
-    if (ne_header.entry_cs >= 1 && ne_header.entry_cs <= ne_segments.length) {
+    if (ne_header.entry_cs >= 1 && ne_header.entry_cs <= ne_segments->length) {
         if ((label=dec_label_malloc()) != NULL) {
             dec_label_set_name(label,"Entry point NE .EXE");
             label->seg_v =
@@ -1268,18 +1205,18 @@ int main(int argc,char **argv) {
         }
     }
 
-    if (ne_entry_table.table != NULL && ne_entry_table.length != 0) {
+    if (ne_entry_table->table != NULL && ne_entry_table->length != 0) {
         const struct exe_ne_header_entry_table_entry *ent;
         unsigned char *rawd;
         unsigned int i;
 
-        for (i=0;i < ne_entry_table.length;i++) { /* NTS: ordinal value is i + 1, ordinals are 1-based */
-            ent = ne_entry_table.table + i;
-            rawd = exe_ne_header_entry_table_table_raw_entry(&ne_entry_table,ent);
+        for (i=0;i < ne_entry_table->length;i++) { /* NTS: ordinal value is i + 1, ordinals are 1-based */
+            ent = ne_entry_table->table + i;
+            rawd = exe_ne_header_entry_table_table_raw_entry(ne_entry_table,ent);
             if (rawd == NULL) continue;
             if (ent->segment_id == 0x00) continue;
 
-            get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_nonresname,&ne_resname,i + 1);
+            get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_ordinals,i + 1);
 
             if (name_tmp[0] != 0)
                 snprintf((char*)dec_buffer,sizeof(dec_buffer),"Entry %s ordinal #%u",name_tmp,i + 1);
@@ -1317,10 +1254,39 @@ int main(int argc,char **argv) {
         }
     }
 
-    /* first pass: decompilation */
+    /* load the code segments into memory, once. the first pass decodes from there */
+    for (segmenti=0;segmenti < ne_segments->length;segmenti++) {
+        const struct exe_ne_header_segment_entry *segent = ne_segments->table + segmenti;
+        uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments->sector_shift;
+        unsigned char *image;
+        uint32_t segment_sz;
+        int rd;
+
+        if (segent->offset_in_segments == 0 || (segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA))
+            continue;
+
+        segment_sz =
+            (segent->length == 0 ? 0x10000UL : segent->length);
+
+        if ((image=dec_flow_add_object(&dec_flow,segmenti + 1,0,segment_sz)) == NULL) {
+            printf("! unable to alloc image of NE segment #%d\n",segmenti + 1);
+            continue;
+        }
+
+        /* whatever is past the end of the file stays zero */
+        if ((uint32_t)lseek(src_fd,segment_ofs,SEEK_SET) == segment_ofs) {
+            rd = read(src_fd,image,segment_sz);
+            (void)rd;
+        }
+    }
+
+    /* first pass: decompilation.
+     * the label array is the work queue: every trace adds the branch targets it finds to the end of it.
+     * a trace stops at a JMP/RET or as soon as it runs into code an earlier trace already decoded. */
     {
+        struct dec_flow_object *fo;
         unsigned int los = 0;
-        unsigned int inscount;
+        uint32_t ip;
 
         while (los < dec_label_count) {
             label = dec_label + los;
@@ -1329,10 +1295,24 @@ int main(int argc,char **argv) {
                 continue;
             }
 
+            if ((fo=dec_flow_find_object(&dec_flow,label->seg_v,label->ofs_v)) == NULL) {
+                los++;
+                continue;
+            }
+
+            /* an earlier trace already decoded this. a basic block starts here if it is on an instruction boundary */
+            if (dec_flow_is_code(fo,label->ofs_v)) {
+                if (dec_flow_is_insn(fo,label->ofs_v))
+                    dec_flow_mark_leader(fo,label->ofs_v);
+
+                los++;
+                continue;
+            }
+
             segmenti = label->seg_v - 1;
             {
-                const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
-                uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments.sector_shift;
+                const struct exe_ne_header_segment_entry *segent = ne_segments->table + segmenti;
+                uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments->sector_shift;
                 struct exe_ne_header_segment_reloc_table *reloc;
                 uint32_t segment_sz;
 
@@ -1346,21 +1326,15 @@ int main(int argc,char **argv) {
                 dec_cs = segmenti + 1;
                 dec_ofs = 0;
 
-                if ((uint32_t)lseek(src_fd,segment_ofs + label->ofs_v,SEEK_SET) != (segment_ofs + label->ofs_v))
-                    return 1;
-
                 printf("* NE segment #%d (0x%lx bytes @0x%lx) 1st pass\n",
                         segmenti + 1,(unsigned long)segment_sz,(unsigned long)segment_ofs);
 
                 reloci = 0;
-                inscount = 0;
                 entry_ip = 0;
-                reset_buffer();
                 entry_cs = dec_cs;
-                current_offset = segment_ofs + label->ofs_v;
-                end_decom = segment_ofs + segment_sz;
+                ip = label->ofs_v;
+                dec_flow_mark_leader(fo,ip);
                 minx86dec_init_state(&dec_st);
-                dec_read = dec_end = dec_buffer;
                 dec_st.data32 = dec_st.addr32 = 0;
 
                 if (ne_segment_relocs)
@@ -1372,18 +1346,19 @@ int main(int argc,char **argv) {
                 }
                 else {
                     do {
-                        uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - segment_ofs;
-                        uint32_t ip = ofs + entry_ip - dec_ofs;
                         size_t inslen;
 
-                        if (!refill()) break;
+                        /* end of the segment, or ran into code another trace already decoded */
+                        if (ip >= fo->size) break;
+                        if (dec_flow_is_code(fo,ip)) break;
 
-                        minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
+                        dec_read = fo->image + ip;
+                        minx86dec_set_image(&dec_st,fo,ip);
                         minx86dec_init_instruction(&dec_i);
                         dec_st.ip_value = ip;
                         minx86dec_decodeall(&dec_st,&dec_i);
                         assert(dec_i.end >= dec_read);
-                        assert(dec_i.end <= (dec_buffer+sizeof(dec_buffer)));
+                        assert(dec_i.end <= (fo->image+fo->size+DEC_FLOW_IMAGE_PADDING));
                         inslen = (size_t)(dec_i.end - dec_i.start);
 
                         if (reloc) {
@@ -1391,7 +1366,7 @@ int main(int argc,char **argv) {
                                 reloci++;
                         }
 
-                        printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value,(unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
+                        printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)dec_st.ip_value,(unsigned long)(segment_ofs + ip));
                         for (c=0,iptr=dec_i.start;iptr != dec_i.end;c++)
                             printf("%02X ",*iptr++);
 
@@ -1424,7 +1399,7 @@ int main(int argc,char **argv) {
                         if (dec_i.lock) printf("  ; LOCK#");
                         printf("\n");
 
-                        dec_read = dec_i.end;
+                        dec_flow_mark_insn(fo,ip,(uint32_t)inslen);
 
                         if ((dec_i.opcode == MXOP_JMP || dec_i.opcode == MXOP_CALL || dec_i.opcode == MXOP_JCXZ ||
                                 (dec_i.opcode >= MXOP_JO && dec_i.opcode <= MXOP_JG)) && dec_i.argc == 1 &&
@@ -1454,6 +1429,10 @@ int main(int argc,char **argv) {
 
                             if (dec_i.opcode == MXOP_JMP)
                                 break;
+
+                            /* conditional branch, the fall through starts another basic block */
+                            if (dec_i.opcode != MXOP_CALL)
+                                dec_flow_mark_leader(fo,ip + (uint32_t)inslen);
                         }
                         else if (dec_i.opcode == MXOP_JMP)
                             break;
@@ -1506,23 +1485,30 @@ int main(int argc,char **argv) {
                                 break;
                         }
 
-                        if (++inscount >= 1024)
-                            break;
+                        ip += (uint32_t)inslen;
                     } while(1);
                 }
             }
 
             los++;
         }
+
+        if (dec_flow_build_blocks(&dec_flow) < 0) {
+            printf("! unable to alloc basic block list, decoding segments linearly\n");
+        }
+        else {
+            printf("* %lu basic blocks\n",(unsigned long)dec_flow.block_count);
+            dec_flow_ready = 1;
+        }
     }
 
     /* sort labels */
     dec_label_sort();
 
     /* second pass: decompilation */
-    for (segmenti=0;segmenti < ne_segments.length;segmenti++) {
-        const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
-        uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments.sector_shift;
+    for (segmenti=0;segmenti < ne_segments->length;segmenti++) {
+        const struct exe_ne_header_segment_entry *segent = ne_segments->table + segmenti;
+        uint32_t segment_ofs = (uint32_t)segent->offset_in_segments << (uint32_t)ne_segments->sector_shift;
         struct exe_ne_header_segment_reloc_table *reloc;
         uint32_t segment_sz;
 
@@ -1661,7 +1647,7 @@ int main(int argc,char **argv) {
                         switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
                             case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
                                 if (relocent->intref.segment_index == 0xFF) {
-                                    get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_nonresname,&ne_resname,relocent->movintref.entry_ordinal);
+                                    get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_ordinals,relocent->movintref.entry_ordinal);
 
                                     printf("                    Refers to movable segment, entry ordinal #%d",
                                             relocent->movintref.entry_ordinal);
@@ -1676,7 +1662,7 @@ int main(int argc,char **argv) {
                                 }
                                 break;
                             case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
                                 printf("                    Refers to module reference #%d '%s', ordinal %d",
                                         relocent->ordinal.module_reference_index,name_tmp,
                                         relocent->ordinal.ordinal);
@@ -1690,12 +1676,12 @@ int main(int argc,char **argv) {
                                 printf("\n");
                                 break;
                             case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
                                 printf("                    Refers to module reference #%d '%s', imp name offset %d",
                                         relocent->name.module_reference_index,name_tmp,
                                         relocent->name.imported_name_offset);
 
-                                ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->name.imported_name_offset);
+                                ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->name.imported_name_offset);
                                 printf(" '%s'\n",
                                         name_tmp);
                                 break;
@@ -1781,6 +1767,29 @@ int main(int argc,char **argv) {
 
                 if (!refill()) break;
 
+                /* not reached by the first pass: data, up to the next basic block or label */
+                if (dec_flow_ready && dec_flow_find_block(&dec_flow,dec_cs,ip) == NULL) {
+                    const struct dec_flow_block *nb = dec_flow_next_block(&dec_flow,dec_cs,ip);
+                    uint32_t n = (uint32_t)(dec_end - dec_read);
+
+                    if (n > 8) n = 8;
+                    if (nb != NULL && n > (nb->start - ip))
+                        n = nb->start - ip;
+                    if (labeli < dec_label_count && dec_label[labeli].seg_v == dec_cs &&
+                        dec_label[labeli].ofs_v > ip && n > (dec_label[labeli].ofs_v - ip))
+                        n = dec_label[labeli].ofs_v - ip;
+
+                    printf("%04lX:%04lX @0x%08lX ",(unsigned long)dec_cs,(unsigned long)ip,(unsigned long)(dec_read - dec_buffer) + current_offset_minus_buffer());
+                    for (c=0;c < (int)n;c++)
+                        printf("%02X ",dec_read[c]);
+                    for (;c < 8;c++)
+                        printf("   ");
+
+                    printf("%-8s \n","DB");
+                    dec_read += n;
+                    continue;
+                }
+
                 minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
                 minx86dec_init_instruction(&dec_i);
                 dec_st.ip_value = ip;
@@ -1831,7 +1840,7 @@ int main(int argc,char **argv) {
                                 case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
                                     if (o == (ip + 1 + 2)) { // CALL/JMP FAR segment relocation affecting segment portion
                                         printf("<");
-                                        print_relocation_segment(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                        print_relocation_segment(ne_imported_name_table,ne_entry_table,&ne_ordinals,relocent,&mod_syms);
                                         if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
                                             printf(" + 0x%04x>:0x%04x",
                                                 (unsigned int)dec_i.argv[0].segval,
@@ -1849,7 +1858,7 @@ int main(int argc,char **argv) {
                                     if (o == (ip + 1)) {
                                         if (!(relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE)) {
                                             printf("<");
-                                            print_relocation_farptr(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                            print_relocation_farptr(ne_imported_name_table,ne_entry_table,&ne_ordinals,relocent,&mod_syms);
                                             printf(">");
                                         }
 
@@ -1865,7 +1874,7 @@ int main(int argc,char **argv) {
                                 case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
                                     {
                                         printf("<");
-                                        print_relocation_segment(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                        print_relocation_segment(ne_imported_name_table,ne_entry_table,&ne_ordinals,relocent,&mod_syms);
                                         if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
                                             printf(" + 0x%04x>",
                                                 (unsigned int)dec_i.argv[0].value);
@@ -1878,7 +1887,7 @@ int main(int argc,char **argv) {
                                 case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
                                     {
                                         printf("<");
-                                        print_relocation_offset(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                        print_relocation_offset(ne_imported_name_table,ne_entry_table,&ne_ordinals,relocent,&mod_syms);
                                         if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
                                             printf(" + 0x%04x>",
                                                 (unsigned int)dec_i.argv[0].value);
@@ -1906,7 +1915,7 @@ int main(int argc,char **argv) {
                                 case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_SEGMENT:
                                     {
                                         printf("<");
-                                        print_relocation_segment(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                        print_relocation_segment(ne_imported_name_table,ne_entry_table,&ne_ordinals,relocent,&mod_syms);
                                         if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
                                             printf(" + 0x%04x>",
                                                 (unsigned int)dec_i.argv[0].value);
@@ -1919,7 +1928,7 @@ int main(int argc,char **argv) {
                                 case EXE_NE_HEADER_SEGMENT_RELOC_ADDR_TYPE_OFFSET:
                                     {
                                         printf("<");
-                                        print_relocation_offset(&ne_imported_name_table,&ne_entry_table,&ne_nonresname,&ne_resname,relocent,&mod_syms);
+                                        print_relocation_offset(ne_imported_name_table,ne_entry_table,&ne_ordinals,relocent,&mod_syms);
                                         if (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_ADDITIVE) {
                                             printf(" + 0x%04x>",
                                                 (unsigned int)dec_i.argv[0].value);
@@ -2000,7 +2009,7 @@ int main(int argc,char **argv) {
                         switch (relocent->r.reloc_type&EXE_NE_HEADER_SEGMENT_RELOC_TYPE_MASK) {
                             case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_INTERNAL_REFERENCE:
                                 if (relocent->intref.segment_index == 0xFF) {
-                                    get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_nonresname,&ne_resname,relocent->movintref.entry_ordinal);
+                                    get_entry_name_by_ordinal(name_tmp,sizeof(name_tmp),&ne_ordinals,relocent->movintref.entry_ordinal);
 
                                     printf("                    Refers to movable segment, entry ordinal #%d",
                                             relocent->movintref.entry_ordinal);
@@ -2015,7 +2024,7 @@ int main(int argc,char **argv) {
                                 }
                                 break;
                             case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_ORDINAL:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
                                 printf("                    Refers to module reference #%d '%s', ordinal %d",
                                         relocent->ordinal.module_reference_index,name_tmp,
                                         relocent->ordinal.ordinal);
@@ -2029,12 +2038,12 @@ int main(int argc,char **argv) {
                                 printf("\n");
                                 break;
                             case EXE_NE_HEADER_SEGMENT_RELOC_TYPE_IMPORTED_NAME:
-                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->ordinal.module_reference_index);
+                                ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->ordinal.module_reference_index);
                                 printf("                    Refers to module reference #%d '%s', imp name offset %d",
                                         relocent->name.module_reference_index,name_tmp,
                                         relocent->name.imported_name_offset);
 
-                                ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),&ne_imported_name_table,relocent->name.imported_name_offset);
+                                ne_imported_name_table_entry_get_name(name_tmp,sizeof(name_tmp),ne_imported_name_table,relocent->name.imported_name_offset);
                                 printf(" '%s'\n",
                                         name_tmp);
                                 break;
@@ -2059,19 +2068,16 @@ int main(int argc,char **argv) {
     if (ne_segment_relocs) {
         unsigned int i;
 
-        for (i=0;i < ne_segments.length;i++)
+        for (i=0;i < ne_segments->length;i++)
             exe_ne_header_segment_reloc_table_free(&ne_segment_relocs[i]);
 
         free(ne_segment_relocs);
     }
 
     mod_symbols_list_free(&mod_syms);
-    exe_ne_header_imported_name_table_free(&ne_imported_name_table);
-    exe_ne_header_entry_table_table_free(&ne_entry_table);
-    exe_ne_header_name_entry_table_free(&ne_nonresname);
-    exe_ne_header_name_entry_table_free(&ne_resname);
-    exe_ne_header_resource_table_free(&ne_resources);
-    exe_ne_header_segment_table_free(&ne_segments);
+    exe_ne_header_name_ordinal_index_free(&ne_ordinals);
+    exe_ne_image_free(&ne_image);
+    dec_flow_free(&dec_flow);
     dec_free_labels();
     close(src_fd);
 	return 0;
@@ -11,6 +11,7 @@ NOW_BUILDING = TOOL_LINKER
 
 !ifeq TARGET_MSDOS 32
 LNKDOS16_EXE = $(SUBDIR)$(HPS)lnkdos16.$(EXEEXT)
+LNKLIB_EXE = $(SUBDIR)$(HPS)lnklib.$(EXEEXT)
 !endif
 
 # NTS we have to construct the command line into tmp.cmd because for MS-DOS
@@ -21,7 +22,7 @@ LNKDOS16_EXE = $(SUBDIR)$(HPS)lnkdos16.$(EXEEXT)
 
 all: lib exe
 
-exe: $(LNKDOS16_EXE) .symbolic
+exe: $(LNKDOS16_EXE) $(LNKLIB_EXE) .symbolic
 
 lib: $(FMT_OMF_LIB) .symbolic
 
@@ -47,6 +48,28 @@ $(LNKDOS16_EXE): $(FMT_OMF_LIB) $(FMT_OMF_LIB_DEPENDENCIES) $(SUBDIR)$(HPS)lnkdo
 ! endif
 !endif
 
+!ifdef LNKLIB_EXE
+$(LNKLIB_EXE): $(FMT_OMF_LIB) $(FMT_OMF_LIB_DEPENDENCIES) $(SUBDIR)$(HPS)lnklib.obj
+	%write tmp.cmd option quiet system $(WLINK_CON_SYSTEM) $(WLINK_FLAGS) file $(SUBDIR)$(HPS)lnklib.obj $(FMT_OMF_LIB_WLINK_LIBRARIES)
+	%write tmp.cmd option map=$(LNKLIB_EXE).map
+! ifdef TARGET_WINDOWS
+!  ifeq TARGET_MSDOS 16
+	%write tmp.cmd segment TYPE CODE PRELOAD FIXED DISCARDABLE SHARED
+	%write tmp.cmd segment TYPE DATA PRELOAD MOVEABLE
+!  endif
+! endif
+	%write tmp.cmd name $(LNKLIB_EXE)
+	@wlink @tmp.cmd
+	@$(COPY) ..$(HPS)..$(HPS)dos32a.dat $(SUBDIR)$(HPS)dos4gw.exe
+! ifdef WIN386
+	@$(WIN386_EXE_TO_REX_IF_REX) $(LNKLIB_EXE)
+	@wbind $(LNKLIB_EXE) -q -n
+! endif
+! ifdef WIN_NE_SETVER_BUILD
+	$(WIN_NE_SETVER_BUILD) $(LNKLIB_EXE)
+! endif
+!endif
+
 clean: .SYMBOLIC
           del $(SUBDIR)$(HPS)*.obj
           del $(FMT_OMF_LIB)
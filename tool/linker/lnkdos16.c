@@ -13,10 +13,16 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <fmt/omf/omf.h>
 #include <fmt/omf/omfcstr.h>
 
+#if defined(LINUX)
+# include <sys/resource.h>
+# include <pthread.h>
+#endif
+
 #if defined(_MSC_VER)
 # define strcasecmp strcmpi
 #endif
@@ -70,9 +76,76 @@ const char *get_in_file(unsigned int idx) {
     return "";
 }
 
+/* Link statistics (-stats, -stats-json).
+ *
+ * Wall time is charged to one phase at a time: link_stats_phase() ends the current phase and
+ * starts another, so the phases add up to the whole link. Records are counted by type as they
+ * are read in PASS_GATHER. */
+enum {
+    LINK_PHASE_SETUP=0,
+    LINK_PHASE_LIBRARIES,                   /* .LIB dictionary module selection */
+    LINK_PHASE_PARSE,                       /* reading and decoding OMF records */
+    LINK_PHASE_GATHER,                      /* SEGDEF/PUBDEF/GRPDEF/MODEND into the linker tables */
+    LINK_PHASE_ARRANGE,                     /* segment sort order and layout */
+    LINK_PHASE_BUILD,                       /* LEDATA into the segment images */
+    LINK_PHASE_FIXUP,                       /* fixups and relocations */
+    LINK_PHASE_EMIT,                        /* output, hex dump and map file */
+
+    LINK_PHASE_MAX
+};
+
+static const char*                      link_phase_names[LINK_PHASE_MAX] = {
+    "setup",
+    "libraries",
+    "parse",
+    "gather",
+    "arrange",
+    "build",
+    "fixup",
+    "emit"
+};
+
+static unsigned char                    link_stats = 0;
+static char*                            link_stats_json = NULL;
+static unsigned int                     link_stats_cur_phase = LINK_PHASE_SETUP;
+static double                           link_stats_phase_time[LINK_PHASE_MAX];
+static double                           link_stats_last_time = 0;
+static unsigned long                    link_stats_records[256];
+static unsigned long                    link_stats_symbol_lookups = 0;
+static unsigned long                    link_stats_segment_lookups = 0;
+
+/* seconds, from an arbitrary starting point */
+double link_stats_clock(void) {
+#if defined(LINUX)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+#else
+    return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+/* charge the time since the last call to the current phase, and switch to 'phase'. returns the previous phase */
+unsigned int link_stats_phase(unsigned int phase) {
+    unsigned int prev = link_stats_cur_phase;
+
+    if (link_stats) {
+        double now = link_stats_clock();
+
+        assert(prev < LINK_PHASE_MAX);
+        link_stats_phase_time[prev] += now - link_stats_last_time;
+        link_stats_last_time = now;
+    }
+
+    link_stats_cur_phase = phase;
+    return prev;
+}
+
 static unsigned char                    do_dosseg = 1;
 
 struct omf_context_t*                   omf_state = NULL;
+struct omf_reader_t*                    omf_reader = NULL;
 
 static unsigned char                    verbose = 0;
 
@@ -197,14 +270,29 @@ void free_exe_relocations(void) {
 static unsigned int                     output_format = OFMT_COM;
 static unsigned int                     output_format_variant = OFMTVAR_NONE;
 
+/* NTS: 32-bit and Linux builds have no fixed segment limit, and fragments are limited only by
+ *      the 16-bit fragment index in struct link_symbol and struct seg_fragment */
+#if TARGET_MSDOS == 32 || defined(LINUX)
+#define MAX_SEG_FRAGMENTS               0xFFFFu
+#else
+#define MAX_SEGMENTS                    256
 #define MAX_SEG_FRAGMENTS               1024
+#endif
+
+/* NTS: 32-bit and Linux builds have no fixed symbol limit, the table grows as needed */
+#if !(TARGET_MSDOS == 32 || defined(LINUX))
+#define MAX_SYMBOLS                     4096
+#endif
 
+/* symbol name hash buckets, power of 2. the bucket table is grown as the symbol table grows */
 #if TARGET_MSDOS == 32 || defined(LINUX)
-#define MAX_SYMBOLS                     65536
+#define LINK_SYMBOL_HASH_INIT           1024
 #else
-#define MAX_SYMBOLS                     4096
+#define LINK_SYMBOL_HASH_INIT           256
 #endif
 
+#define LINK_SYMBOL_HASH_NONE           ((size_t)(~((size_t)0u)))
+
 struct link_symbol {
     char*                               name;
     char*                               segdef;
@@ -214,6 +302,7 @@ struct link_symbol {
     unsigned short                      in_file;
     unsigned short                      in_module;
     unsigned int                        is_local:1;
+    size_t                              hash_next;          /* next symbol in hash chain (index), or LINK_SYMBOL_HASH_NONE */
 };
 
 static struct link_symbol*              link_symbols = NULL;
@@ -221,8 +310,72 @@ static size_t                           link_symbols_count = 0;
 static size_t                           link_symbols_alloc = 0;
 static size_t                           link_symbols_nextalloc = 0;
 
+static size_t*                          link_symbols_hash = NULL;   /* bucket -> first symbol index */
+static size_t                           link_symbols_hash_size = 0; /* number of buckets, power of 2 */
+
+/* symbol, segment and group names of link_symbols[], pooled. the same few segment and group
+ * names come up for every symbol, and each one only needs to be stored once */
+static struct omf_strpool_t             link_symbol_strings;
+
+char *link_symbol_str(const char *str) {
+    return omf_strpool_add(&link_symbol_strings,str,strlen(str));
+}
+
+unsigned long link_symbol_name_hash(const char *name) {
+    unsigned long h = 5381ul;
+
+    /* djb2 */
+    while (*name != 0)
+        h = ((h << 5ul) + h) ^ (unsigned char)(*name++);
+
+    return h;
+}
+
+void link_symbols_hash_insert(size_t i) {
+    struct link_symbol *sym = link_symbols + i;
+    size_t b;
+
+    assert(sym->name != NULL);
+    assert(link_symbols_hash != NULL);
+    b = (size_t)link_symbol_name_hash(sym->name) & (link_symbols_hash_size - 1u);
+    sym->hash_next = link_symbols_hash[b];
+    link_symbols_hash[b] = i;
+}
+
+/* rebuild the hash index. must be called whenever link_symbols[] is reordered (qsort) */
+int link_symbols_rehash(void) {
+    size_t i,sz;
+
+    sz = link_symbols_hash_size;
+    if (sz < LINK_SYMBOL_HASH_INIT) sz = LINK_SYMBOL_HASH_INIT;
+    while (sz < link_symbols_count) sz *= 2u;
+
+    if (link_symbols_hash == NULL || sz != link_symbols_hash_size) {
+        size_t *n = (size_t*)realloc((void*)link_symbols_hash, sz * sizeof(size_t));
+        if (n == NULL) return -1;
+        link_symbols_hash = n;
+        link_symbols_hash_size = sz;
+    }
+
+    for (i=0;i < link_symbols_hash_size;i++)
+        link_symbols_hash[i] = LINK_SYMBOL_HASH_NONE;
+
+    /* insert in reverse so that each chain lists symbols in table order */
+    for (i=link_symbols_count;i > 0;) {
+        i--;
+        if (link_symbols[i].name != NULL)
+            link_symbols_hash_insert(i);
+        else
+            link_symbols[i].hash_next = LINK_SYMBOL_HASH_NONE;
+    }
+
+    return 0;
+}
+
 int link_symbols_extend(size_t sz) {
+#ifdef MAX_SYMBOLS
     if (sz > MAX_SYMBOLS) return -1;
+#endif
     if (sz <= link_symbols_alloc) return 0;
     if (sz == 0) return -1;
 
@@ -248,13 +401,15 @@ int link_symbols_extend(size_t sz) {
 }
 
 int link_symbols_extend_double(void) {
-    if (link_symbols_alloc < MAX_SYMBOLS) {
-        size_t ns = link_symbols_alloc * 2u;
-        if (ns < 128) ns = 128;
-        if (ns > MAX_SYMBOLS) ns = MAX_SYMBOLS;
-        if (link_symbols_extend(ns)) return -1;
-        assert(link_symbols_alloc >= ns);
-    }
+    size_t ns = link_symbols_alloc * 2u;
+
+    if (ns < 128) ns = 128;
+#ifdef MAX_SYMBOLS
+    if (link_symbols_alloc >= MAX_SYMBOLS) return -1; /* table full */
+    if (ns > MAX_SYMBOLS) ns = MAX_SYMBOLS;
+#endif
+    if (link_symbols_extend(ns)) return -1;
+    assert(link_symbols_alloc >= ns);
 
     return 0;
 }
@@ -290,45 +445,67 @@ struct link_symbol *new_link_symbol(const char *name) {
         assert(sym->segdef == NULL);
         assert(sym->groupdef == NULL);
 
-        sym->name = strdup(name);
+        sym->name = link_symbol_str(name);
+        if (sym->name == NULL) return NULL;
 
         sym->in_file = (unsigned short)(~0u);
+
+        /* grow the bucket table along with the symbol table, else just add to the chain */
+        if (link_symbols_hash == NULL || link_symbols_count > (link_symbols_hash_size * 2u)) {
+            if (link_symbols_rehash()) return NULL;
+        }
+        else {
+            link_symbols_hash_insert((size_t)(sym - link_symbols));
+        }
     }
 
     return sym;
 }
 
 struct link_symbol *find_link_symbol(const char *name,int in_file,int in_module) {
+    struct link_symbol *found = NULL;
     struct link_symbol *sym;
-    size_t i = 0;
+    size_t i;
 
-    if (link_symbols != NULL) {
-        for (;i < link_symbols_count;i++) {
-            sym = link_symbols + i;
-            assert(sym->name != NULL);
+    link_stats_symbol_lookups++;
 
-            if (sym->is_local) {
-                /* ignore local symbols unless file/module scope is given */
-                if (in_file < 0 || in_module < 0)
-                    continue;
-                if (in_file >= 0 && sym->in_file != in_file)
-                    continue;
-                if (in_module >= 0 && sym->in_module != in_module)
-                    continue;
-            }
+    if (link_symbols == NULL || link_symbols_hash == NULL)
+        return NULL;
 
-            if (!strcmp(sym->name, name))
-                return sym;
+    /* the hash chain is newest first, but the symbol table order decides which of a
+     * global and an in-scope local of the same name wins: the first one in the table */
+    i = link_symbols_hash[(size_t)link_symbol_name_hash(name) & (link_symbols_hash_size - 1u)];
+    while (i != LINK_SYMBOL_HASH_NONE) {
+        assert(i < link_symbols_count);
+        sym = link_symbols + i;
+        i = sym->hash_next;
+        assert(sym->name != NULL);
+
+        if (strcmp(sym->name, name))
+            continue;
+
+        if (sym->is_local) {
+            /* ignore local symbols unless file/module scope is given */
+            if (in_file < 0 || in_module < 0)
+                continue;
+            if (sym->in_file != in_file)
+                continue;
+            if (sym->in_module != in_module)
+                continue;
         }
+
+        if (found == NULL || sym < found)
+            found = sym;
     }
 
-    return NULL;
+    return found;
 }
 
+/* the strings belong to link_symbol_strings */
 void link_symbol_free(struct link_symbol *s) {
-    cstr_free(&(s->name));
-    cstr_free(&(s->segdef));
-    cstr_free(&(s->groupdef));
+    s->name = NULL;
+    s->segdef = NULL;
+    s->groupdef = NULL;
 }
 
 void link_symbols_free(void) {
@@ -342,9 +519,15 @@ void link_symbols_free(void) {
         link_symbols_count = 0;
         link_symbols_nextalloc = 0;
     }
-}
 
-#define MAX_SEGMENTS                    256
+    if (link_symbols_hash != NULL) {
+        free(link_symbols_hash);
+        link_symbols_hash = NULL;
+        link_symbols_hash_size = 0;
+    }
+
+    omf_strpool_free(&link_symbol_strings);
+}
 
 struct seg_fragment {
     unsigned short                      in_file;
@@ -378,8 +561,29 @@ struct link_segdef {
     unsigned char                       noemit;
 };
 
-static struct link_segdef               link_segments[MAX_SEGMENTS];
+static struct link_segdef*              link_segments = NULL;
 static unsigned int                     link_segments_count = 0;
+static unsigned int                     link_segments_alloc = 0;
+
+/* segment lookup by name, class and group.
+ *
+ * Each index is a hash table of chains of segment indexes, in link_segments[] order, so that
+ * the first (or last) match in the chain is the first (or last) match in the table. The name
+ * index is kept up to date as segments are added, since names never change and are unique.
+ * The class and group indexes are rebuilt on demand after link_segments[] changes, which it
+ * stops doing once PASS_GATHER is over and the lookups by class and group begin. */
+#define LINK_SEGMENT_HASH_NONE          (~0u)
+
+struct link_segment_index {
+    unsigned int*                       hash;               /* bucket -> first segment index */
+    unsigned int                        hash_size;          /* number of buckets, power of 2 */
+    unsigned int*                       next;               /* segment index -> next segment index in chain */
+    unsigned char                       stale;              /* must be rebuilt before use */
+};
+
+static struct link_segment_index        link_segments_by_name = { NULL, 0, NULL, 1 };
+static struct link_segment_index        link_segments_by_class = { NULL, 0, NULL, 1 };
+static struct link_segment_index        link_segments_by_group = { NULL, 0, NULL, 1 };
 
 static struct link_segdef*              current_link_segment = NULL;
 
@@ -492,6 +696,8 @@ int sort_cmpf_class_stack(const struct link_segdef *a) {
     return 0;
 }
 
+void link_segments_reindex(void);
+
 void link_segments_swap(unsigned int s1,unsigned int s2) {
     if (s1 != s2) {
         struct link_segdef t;
@@ -499,6 +705,8 @@ void link_segments_swap(unsigned int s1,unsigned int s2) {
                         t = link_segments[s1];
         link_segments[s1] = link_segments[s2];
         link_segments[s2] = t;
+
+        link_segments_reindex();
     }
 }
 
@@ -590,6 +798,7 @@ int owlink_segsrt_def_qsort_cmp(const void *a,const void *b) {
 
 void owlink_default_sort_seg(void) {
     qsort(link_segments, link_segments_count, sizeof(struct link_segdef), owlink_segsrt_def_qsort_cmp);
+    link_segments_reindex();
     reconnect_gl_segs();
 }
 
@@ -664,9 +873,21 @@ void free_link_segment(struct link_segdef *sg) {
     }
 }
 
+void link_segment_index_free(struct link_segment_index *ix);
+
 void free_link_segments(void) {
     while (link_segments_count > 0)
         free_link_segment(&link_segments[--link_segments_count]);
+
+    if (link_segments != NULL) {
+        free(link_segments);
+        link_segments = NULL;
+    }
+    link_segments_alloc = 0;
+
+    link_segment_index_free(&link_segments_by_name);
+    link_segment_index_free(&link_segments_by_class);
+    link_segment_index_free(&link_segments_by_group);
 }
 
 unsigned int omf_align_code_to_bytes(const unsigned int x) {
@@ -848,10 +1069,10 @@ void dump_hex_symbols(FILE *hfp,const char *hex_output_name) {
     }
 }
 
-void dump_link_symbols(void) {
+int dump_link_symbols(void) {
     unsigned int i,pass=0,passes=1;
 
-    if (link_symbols == NULL) return;
+    if (link_symbols == NULL) return 0;
 
     if (map_fp != NULL)
         passes = 2;
@@ -865,9 +1086,14 @@ void dump_link_symbols(void) {
             fprintf(map_fp,"---------------------------------------\n");
         }
 
-        if (verbose || map_fp != NULL)
+        if (verbose || map_fp != NULL) {
             qsort(link_symbols, link_symbols_count, sizeof(struct link_symbol),
                 pass == 0 ? link_symbol_qsort_cmp_by_name : link_symbol_qsort_cmp);
+            if (link_symbols_rehash()) {
+                fprintf(stderr,"Unable to rebuild symbol index\n");
+                return -1;
+            }
+        }
 
         while (i < link_symbols_count) {
             struct link_symbol *sym = &link_symbols[i++];
@@ -909,6 +1135,8 @@ void dump_link_symbols(void) {
         if (map_fp != NULL)
             fprintf(map_fp,"\n");
     }
+
+    return 0;
 }
 
 void dump_hex_segments(FILE *hfp,const char *hex_output_name) {
@@ -1116,71 +1344,194 @@ void dump_link_segments(void) {
         fprintf(map_fp,"\n");
 }
 
-struct link_segdef *find_link_segment_by_grpdef(const char *name) {
-    unsigned int i=0;
+const char *link_segment_index_key(const struct link_segment_index *ix,const struct link_segdef *sg) {
+    if (ix == &link_segments_by_class)
+        return sg->classname;
+    if (ix == &link_segments_by_group)
+        return sg->groupname;
 
-    while (i < link_segments_count) {
-        struct link_segdef *sg = &link_segments[i++];
+    return sg->name;
+}
 
-        if (sg->groupname == NULL) continue;
-        if (!strcmp(name,sg->groupname)) return sg;
+void link_segment_index_free(struct link_segment_index *ix) {
+    if (ix->hash != NULL) {
+        free(ix->hash);
+        ix->hash = NULL;
     }
-
-    return NULL;
+    if (ix->next != NULL) {
+        free(ix->next);
+        ix->next = NULL;
+    }
+    ix->hash_size = 0;
+    ix->stale = 1;
 }
 
-struct link_segdef *find_link_segment_by_class(const char *name) {
-    unsigned int i=0;
+int link_segment_index_build(struct link_segment_index *ix) {
+    unsigned int i,sz,b;
+    const char *key;
 
-    while (i < link_segments_count) {
-        struct link_segdef *sg = &link_segments[i++];
+    sz = ix->hash_size;
+    if (sz < 64u) sz = 64u;
+    while (sz < link_segments_count) sz *= 2u;
+
+    if (ix->hash == NULL || sz != ix->hash_size) {
+        unsigned int *n = (unsigned int*)realloc((void*)ix->hash, sz * sizeof(unsigned int));
+        if (n == NULL) return -1;
+        ix->hash = n;
+        ix->hash_size = sz;
+    }
 
-        if (sg->classname == NULL) continue;
-        if (!strcmp(name,sg->classname)) return sg;
+    /* sized to link_segments_alloc, so that new_link_segment() can add to the chains */
+    {
+        unsigned int *n = (unsigned int*)realloc((void*)ix->next, (link_segments_alloc != 0 ? link_segments_alloc : 1u) * sizeof(unsigned int));
+        if (n == NULL) return -1;
+        ix->next = n;
     }
 
-    return NULL;
+    for (i=0;i < ix->hash_size;i++)
+        ix->hash[i] = LINK_SEGMENT_HASH_NONE;
+
+    /* insert in reverse so that each chain lists segments in table order */
+    for (i=link_segments_count;i > 0;) {
+        i--;
+        key = link_segment_index_key(ix,&link_segments[i]);
+        if (key != NULL) {
+            b = (unsigned int)link_symbol_name_hash(key) & (ix->hash_size - 1u);
+            ix->next[i] = ix->hash[b];
+            ix->hash[b] = i;
+        }
+        else {
+            ix->next[i] = LINK_SEGMENT_HASH_NONE;
+        }
+    }
+
+    ix->stale = 0;
+    return 0;
 }
 
-struct link_segdef *find_link_segment_by_class_last(const char *name) {
-    struct link_segdef *ret=NULL;
-    unsigned int i=0;
+/* first (or last) segment in link_segments[] whose name, class or group is 'name' */
+struct link_segdef *link_segment_index_find(struct link_segment_index *ix,const char *name,unsigned char last) {
+    struct link_segdef *ret = NULL;
+    const char *key;
+    unsigned int i;
 
-    while (i < link_segments_count) {
-        struct link_segdef *sg = &link_segments[i++];
+    link_stats_segment_lookups++;
+
+    if (link_segments_count == 0)
+        return NULL;
+
+    if (ix->stale && link_segment_index_build(ix) < 0) {
+        /* no memory for the index, search the table instead */
+        for (i=0;i < link_segments_count;i++) {
+            key = link_segment_index_key(ix,&link_segments[i]);
+            if (key != NULL && !strcmp(name,key)) {
+                ret = &link_segments[i];
+                if (!last) break;
+            }
+        }
+
+        return ret;
+    }
+
+    i = ix->hash[(unsigned int)link_symbol_name_hash(name) & (ix->hash_size - 1u)];
+    while (i != LINK_SEGMENT_HASH_NONE) {
+        assert(i < link_segments_count);
+        key = link_segment_index_key(ix,&link_segments[i]);
+        assert(key != NULL);
 
-        if (sg->classname == NULL) continue;
-        if (!strcmp(name,sg->classname)) ret = sg;
+        if (!strcmp(name,key)) {
+            ret = &link_segments[i];
+            if (!last) break;
+        }
+
+        i = ix->next[i];
     }
 
     return ret;
 }
 
+/* link_segments[] was reordered */
+void link_segments_reindex(void) {
+    link_segments_by_name.stale = 1;
+    link_segments_by_class.stale = 1;
+    link_segments_by_group.stale = 1;
+}
+
+struct link_segdef *find_link_segment_by_grpdef(const char *name) {
+    return link_segment_index_find(&link_segments_by_group,name,0);
+}
+
+struct link_segdef *find_link_segment_by_class(const char *name) {
+    return link_segment_index_find(&link_segments_by_class,name,0);
+}
+
+struct link_segdef *find_link_segment_by_class_last(const char *name) {
+    return link_segment_index_find(&link_segments_by_class,name,1);
+}
+
 struct link_segdef *find_link_segment(const char *name) {
-    unsigned int i=0;
+    return link_segment_index_find(&link_segments_by_name,name,0);
+}
 
-    while (i < link_segments_count) {
-        struct link_segdef *sg = &link_segments[i++];
+int link_segments_extend(void) {
+    unsigned int current = LINK_SEGMENT_HASH_NONE;
+    unsigned int target = LINK_SEGMENT_HASH_NONE;
+    unsigned int frame = LINK_SEGMENT_HASH_NONE;
+    unsigned int na = (link_segments_alloc != 0) ? (link_segments_alloc * 2u) : 64u;
+    struct link_segdef *n;
 
-        assert(sg->name != NULL);
-        if (!strcmp(name,sg->name)) return sg;
-    }
+#ifdef MAX_SEGMENTS
+    if (link_segments_alloc >= MAX_SEGMENTS) return -1; /* table full */
+    if (na > MAX_SEGMENTS) na = MAX_SEGMENTS;
+#endif
 
-    return NULL;
+    /* the table may move. anything that points into it has to follow */
+    if (current_link_segment != NULL) current = (unsigned int)(current_link_segment - link_segments);
+    if (entry_seg_link_target != NULL) target = (unsigned int)(entry_seg_link_target - link_segments);
+    if (entry_seg_link_frame != NULL) frame = (unsigned int)(entry_seg_link_frame - link_segments);
+
+    n = (struct link_segdef*)realloc((void*)link_segments, na * sizeof(struct link_segdef));
+    if (n == NULL) return -1;
+    link_segments = n;
+    link_segments_alloc = na;
+
+    current_link_segment = (current != LINK_SEGMENT_HASH_NONE) ? &link_segments[current] : NULL;
+    entry_seg_link_target = (target != LINK_SEGMENT_HASH_NONE) ? &link_segments[target] : NULL;
+    entry_seg_link_frame = (frame != LINK_SEGMENT_HASH_NONE) ? &link_segments[frame] : NULL;
+
+    /* the chain links are sized to the table */
+    link_segments_reindex();
+    return 0;
 }
 
 struct link_segdef *new_link_segment(const char *name) {
-    if (link_segments_count < MAX_SEGMENTS) {
-        struct link_segdef *sg = &link_segments[link_segments_count++];
+    struct link_segdef *sg;
+    unsigned int i;
+
+    if (link_segments_count >= link_segments_alloc && link_segments_extend() < 0)
+        return NULL;
+
+    i = link_segments_count++;
+    sg = &link_segments[i];
+    memset(sg,0,sizeof(*sg));
+    sg->name = strdup(name);
+    assert(sg->name != NULL);
 
-        memset(sg,0,sizeof(*sg));
-        sg->name = strdup(name);
-        assert(sg->name != NULL);
+    /* names are unique, so the new segment can go anywhere in its chain.
+     * a new segment has no class or group yet, but will have one shortly */
+    if (!link_segments_by_name.stale && link_segments_count <= (link_segments_by_name.hash_size * 2u)) {
+        unsigned int b = (unsigned int)link_symbol_name_hash(name) & (link_segments_by_name.hash_size - 1u);
 
-        return sg;
+        link_segments_by_name.next[i] = link_segments_by_name.hash[b];
+        link_segments_by_name.hash[b] = i;
     }
+    else {
+        link_segments_by_name.stale = 1;
+    }
+    link_segments_by_class.stale = 1;
+    link_segments_by_group.stale = 1;
 
-    return NULL;
+    return sg;
 }
 
 int ledata_add(struct omf_context_t *omf_state, struct omf_ledata_info_t *info,unsigned int pass) {
@@ -1685,6 +2036,7 @@ int grpdef_add(struct omf_context_t *omf_state,unsigned int first) {
                 if (lsg->groupname == NULL) {
                     /* assign to group */
                     lsg->groupname = strdup(grpdef_name);
+                    link_segments_by_group.stale = 1;
                 }
                 else if (!strcmp(lsg->groupname, grpdef_name)) {
                     /* re-asserting group membership, OK */
@@ -1761,8 +2113,8 @@ int pubdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int t
 
         sym->fragment = lsg->fragments_count - 1u;
         sym->offset = pubdef->public_offset;
-        sym->groupdef = strdup(groupname);
-        sym->segdef = strdup(segname);
+        sym->groupdef = link_symbol_str(groupname);
+        sym->segdef = link_symbol_str(segname);
         sym->in_file = in_file;
         sym->in_module = in_module;
         sym->is_local = is_local;
@@ -1869,92 +2221,2411 @@ int segdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int i
     return 0;
 }
 
-static void help(void) {
-    fprintf(stderr,"lnkdos16 [options]\n");
-    fprintf(stderr,"  -i <file>    OMF file to link\n");
-    fprintf(stderr,"  -o <file>    Output file\n");
-    fprintf(stderr,"  -map <file>  Map/report file\n");
-    fprintf(stderr,"  -of <fmt>    Output format (COM, EXE, COMREL)\n");
-    fprintf(stderr,"                COM = flat COM executable\n");
-    fprintf(stderr,"                COMREL = flat COM executable, relocatable\n");
-    fprintf(stderr,"                EXE = segmented EXE executable\n");
-    fprintf(stderr,"                DOSDRV = flat MS-DOS driver (SYS)\n");
-    fprintf(stderr,"                DOSDRVREL = flat MS-DOS driver (SYS), relocateable\n");
-    fprintf(stderr,"                DOSDRVEXE = MS-DOS driver (EXE)\n");
-    fprintf(stderr,"  -v           Verbose mode\n");
-    fprintf(stderr,"  -d           Dump memory state after parsing\n");
-    fprintf(stderr,"  -no-dosseg   No DOSSEG sort order\n");
-    fprintf(stderr,"  -dosseg      DOSSEG sort order\n");
-    fprintf(stderr,"  -comNNN      Link .COM segment starting at 0xNNN\n");
-    fprintf(stderr,"  -com100      Link .COM segment starting at 0x100\n");
-    fprintf(stderr,"  -com0        Link .COM segment starting at 0 (Watcom Linker)\n");
-    fprintf(stderr,"  -stackN      Set minimum stack segment size (0xNNN)\n");
-    fprintf(stderr,"  -pflat       Prefer .COM-like flat layout\n");
-    fprintf(stderr,"  -hsym        Header symbol name (DOSDRV)\n");
-    fprintf(stderr,"  -hex <file>  Also emit file as C header hex dump\n");
-    fprintf(stderr,"  -hexsplit    Emit to -hex as .h and .c files\n");
-    fprintf(stderr,"  -hexcpp      Use CPP extension.\n");
-}
+/* MODEND: note the program entry point, if the module has one */
+void modend_add(struct omf_context_t *omf_state) {
+    unsigned char ModuleType;
+    unsigned char EndData;
+    unsigned int FrameDatum;
+    unsigned int TargetDatum;
+    unsigned long TargetDisplacement;
+    const struct omf_segdef_t *frame_segdef;
+    const struct omf_segdef_t *target_segdef;
+
+    ModuleType = omf_record_get_byte(&omf_state->record);
+    if (ModuleType&0x40/*START*/) {
+        EndData = omf_record_get_byte(&omf_state->record);
+        FrameDatum = omf_record_get_index(&omf_state->record);
+        TargetDatum = omf_record_get_index(&omf_state->record);
+
+        if (omf_state->record.rectype == OMF_RECTYPE_MODEND32)
+            TargetDisplacement = omf_record_get_dword(&omf_state->record);
+        else
+            TargetDisplacement = omf_record_get_word(&omf_state->record);
+
+        frame_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,FrameDatum);
+        target_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,TargetDatum);
 
-void my_dumpstate(const struct omf_context_t * const ctx) {
-    unsigned int i;
-    const char *p;
+        if (verbose) {
+            printf("ModuleType: 0x%02x: MainModule=%u Start=%u Segment=%u StartReloc=%u\n",
+                    ModuleType,
+                    ModuleType&0x80?1:0,
+                    ModuleType&0x40?1:0,
+                    ModuleType&0x20?1:0,
+                    ModuleType&0x01?1:0);
+            printf("    EndData=0x%02x FrameDatum=%u(%s) TargetDatum=%u(%s) TargetDisplacement=0x%lx\n",
+                    EndData,
+                    FrameDatum,
+                    (frame_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index):"",
+                    TargetDatum,
+                    (target_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index):"",
+                    TargetDisplacement);
+        }
 
-    printf("OBJ dump state:\n");
+        if (frame_segdef != NULL && target_segdef != NULL) {
+            const char *framename = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index);
+            const char *targetname = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index);
 
-    if (ctx->THEADR != NULL)
-        printf("* THEADR: \"%s\"\n",ctx->THEADR);
+            if (verbose)
+                fprintf(stderr,"'%s' vs '%s'\n",framename,targetname);
 
-    if (ctx->LNAMEs.omf_LNAMES != NULL) {
-        printf("* LNAMEs:\n");
-        for (i=1;i <= ctx->LNAMEs.omf_LNAMES_count;i++) {
-            p = omf_lnames_context_get_name(&ctx->LNAMEs,i);
+            if (*framename != 0 && *targetname != 0) {
+                struct link_segdef *frameseg,*targseg;
 
-            if (p != NULL)
-                printf("   [%u]: \"%s\"\n",i,p);
-            else
-                printf("   [%u]: (null)\n",i);
+                targseg = find_link_segment(targetname);
+                frameseg = find_link_segment(framename);
+                if (targseg != NULL && frameseg != NULL) {
+                    entry_seg_ofs = TargetDisplacement;
+
+                    assert(frameseg->fragments_count != 0);
+                    entry_seg_link_frame_fragment = frameseg->fragments_count - 1u;
+
+                    assert(targseg->fragments_count != 0);
+                    entry_seg_link_target_fragment = targseg->fragments_count - 1u;
+
+                    entry_seg_link_target_name = strdup(targetname);
+                    entry_seg_link_target = targseg;
+                    entry_seg_link_frame_name = strdup(framename);
+                    entry_seg_link_frame = frameseg;
+                }
+                else {
+                    fprintf(stderr,"Did not find segments\n");
+                }
+            }
+            else {
+                fprintf(stderr,"frame/target name not found\n");
+            }
+        }
+        else {
+            fprintf(stderr,"frame/target segdef not found\n");
         }
     }
+}
 
-    if (ctx->SEGDEFs.omf_SEGDEFS != NULL) {
-        for (i=1;i <= ctx->SEGDEFs.omf_SEGDEFS_count;i++)
-            dump_SEGDEF(stdout,omf_state,i);
+/* In-memory module cache.
+ *
+ * PASS_GATHER keeps, for each module it parses, the name/segment/group/extdef/pubdef tables
+ * and the fixups exactly as the parser left them at the end of the module, plus the records
+ * that act on them (SEGDEF, PUBDEF, GRPDEF, LEDATA, MODEND) in the order they appeared.
+ * PASS_BUILD then replays the modules from memory instead of re-opening and re-parsing every
+ * input file. When the input files are parsed on several threads, each file gets its own list
+ * and PASS_GATHER itself is replayed from the lists, in input file order. If the cache cannot
+ * be allocated, PASS_BUILD falls back to reading the input files again, as it always does in
+ * real mode. */
+struct link_module_op {
+    unsigned char                       rectype;            /* record type, as read */
+    unsigned int                        first;              /* SEGDEF/PUBDEF/GRPDEF: first new index */
+    unsigned int                        count;              /* SEGDEF/PUBDEF/GRPDEF: table count after the record */
+    unsigned int                        segment_index;      /* LEDATA: segment index */
+    unsigned long                       enum_data_offset;   /* LEDATA: enumerated data offset */
+    unsigned long                       data_length;        /* LEDATA/MODEND: length of data */
+    size_t                              data_offset;        /* LEDATA/MODEND: offset of data in module data pool */
+};
+
+struct link_module {
+    unsigned short                      in_file;
+    unsigned short                      in_module;
+    struct omf_lnames_context_t         LNAMEs;
+    struct omf_segdefs_context_t        SEGDEFs;
+    struct omf_grpdefs_context_t        GRPDEFs;
+    struct omf_extdefs_context_t        EXTDEFs;
+    struct omf_pubdefs_context_t        PUBDEFs;
+    struct omf_fixupps_context_t        FIXUPPs;
+    struct link_module_op*              ops;
+    unsigned int                        ops_count;
+    unsigned int                        ops_alloc;
+    unsigned char*                      data;               /* LEDATA/MODEND contents */
+    size_t                              data_length;
+    size_t                              data_alloc;
+};
+
+struct link_module_list {
+    struct link_module*                 modules;
+    size_t                              count;
+    size_t                              alloc;
+    unsigned char                       open;               /* last entry in modules[] is still being filled in */
+};
+
+static struct link_module_list          link_modules = { NULL, 0, 0, 0 };
+#if defined(LINUX) || TARGET_MSDOS == 32
+static unsigned char                    link_modules_ok = 1;    /* cleared if the cache could not be built */
+#else
+/* real mode: memory is too tight to hold every module, and PASS_BUILD needs it for the image */
+static unsigned char                    link_modules_ok = 0;
+#endif
+
+void free_link_module(struct link_module *m) {
+    omf_lnames_context_free(&m->LNAMEs);
+    omf_segdefs_context_free(&m->SEGDEFs);
+    omf_grpdefs_context_free(&m->GRPDEFs);
+    omf_extdefs_context_free(&m->EXTDEFs);
+    omf_pubdefs_context_free(&m->PUBDEFs);
+    omf_fixupps_context_free(&m->FIXUPPs);
+
+    if (m->ops != NULL) {
+        free(m->ops);
+        m->ops = NULL;
     }
+    m->ops_count = 0;
+    m->ops_alloc = 0;
 
-    if (ctx->GRPDEFs.omf_GRPDEFS != NULL) {
-        for (i=1;i <= ctx->GRPDEFs.omf_GRPDEFS_count;i++)
-            dump_GRPDEF(stdout,omf_state,i);
+    if (m->data != NULL) {
+        free(m->data);
+        m->data = NULL;
     }
+    m->data_length = 0;
+    m->data_alloc = 0;
+}
 
-    if (ctx->EXTDEFs.omf_EXTDEFS != NULL)
-        dump_EXTDEF(stdout,omf_state,1);
+void free_link_modules(struct link_module_list *ml) {
+    if (ml->modules != NULL) {
+        while (ml->count > 0)
+            free_link_module(&ml->modules[--ml->count]);
 
-    if (ctx->PUBDEFs.omf_PUBDEFS != NULL)
-        dump_PUBDEF(stdout,omf_state,1);
+        free(ml->modules);
+        ml->modules = NULL;
+    }
 
-    if (ctx->FIXUPPs.omf_FIXUPPS != NULL)
-        dump_FIXUPP(stdout,omf_state,1);
+    ml->alloc = 0;
+    ml->open = 0;
+}
 
-    if (verbose)
-        printf("----END-----\n");
+/* give up on the cache, PASS_BUILD will re-read the input files */
+void link_modules_fail(void) {
+    if (link_modules_ok && verbose)
+        fprintf(stderr,"Module cache disabled (out of memory), input files will be read again\n");
+
+    free_link_modules(&link_modules);
+    link_modules_ok = 0;
 }
 
-int segment_def_arrange(void) {
-    unsigned long m,ofs = 0;
-    unsigned int inf;
+/* move the modules of one list onto the end of another, in order */
+int link_modules_append(struct link_module_list *dst,struct link_module_list *src) {
+    assert(!dst->open && !src->open);
 
-    for (inf=0;inf < link_segments_count;inf++) {
-        struct link_segdef *sd = &link_segments[inf];
+    if ((dst->count + src->count) > dst->alloc) {
+        size_t na = (dst->alloc != 0) ? dst->alloc : 64u;
+        struct link_module *n;
 
-        if (sd->initial_alignment != 0ul) {
-            m = ofs % sd->initial_alignment;
-            if (m != 0ul) ofs += sd->initial_alignment - m;
-        }
+        while (na < (dst->count + src->count)) na *= 2u;
 
-        if (verbose)
-            fprintf(stderr,"segment[%u] ofs=0x%lx len=0x%lx\n",
-                    inf,ofs,sd->segment_length);
+        n = (struct link_module*)realloc((void*)dst->modules, na * sizeof(struct link_module));
+        if (n == NULL)
+            return -1;
+
+        dst->modules = n;
+        dst->alloc = na;
+    }
+
+    if (src->count != 0) memcpy(dst->modules + dst->count, src->modules, src->count * sizeof(struct link_module));
+    dst->count += src->count;
+
+    /* the entries belong to dst now */
+    src->count = 0;
+    free_link_modules(src);
+    return 0;
+}
+
+struct link_module *link_module_current(struct link_module_list *ml,unsigned int in_file,unsigned int in_module) {
+    struct link_module *m;
+
+    if (ml->open) {
+        assert(ml->count != 0);
+        m = &ml->modules[ml->count-1u];
+        assert(m->in_file == in_file && m->in_module == in_module);
+        return m;
+    }
+
+    if (ml->count >= ml->alloc) {
+        size_t na = (ml->alloc != 0) ? (ml->alloc * 2u) : 64u;
+        struct link_module *n = (struct link_module*)realloc((void*)ml->modules, na * sizeof(struct link_module));
+        if (n == NULL)
+            return NULL;
+
+        ml->modules = n;
+        ml->alloc = na;
+    }
+
+    m = &ml->modules[ml->count++];
+    memset(m,0,sizeof(*m));
+    omf_lnames_context_init(&m->LNAMEs);
+    omf_segdefs_context_init(&m->SEGDEFs);
+    omf_grpdefs_context_init(&m->GRPDEFs);
+    omf_extdefs_context_init(&m->EXTDEFs);
+    omf_pubdefs_context_init(&m->PUBDEFs);
+    omf_fixupps_context_init(&m->FIXUPPs);
+    m->in_file = in_file;
+    m->in_module = in_module;
+    ml->open = 1;
+    return m;
+}
+
+struct link_module_op *link_module_new_op(struct link_module_list *ml,unsigned int in_file,unsigned int in_module,unsigned char rectype) {
+    struct link_module *m = link_module_current(ml,in_file,in_module);
+    struct link_module_op *op;
+
+    if (m == NULL)
+        return NULL;
+
+    if (m->ops_count >= m->ops_alloc) {
+        unsigned int na = (m->ops_alloc != 0) ? (m->ops_alloc * 2u) : 64u;
+        struct link_module_op *n = (struct link_module_op*)realloc((void*)m->ops, na * sizeof(struct link_module_op));
+        if (n == NULL)
+            return NULL;
+
+        m->ops = n;
+        m->ops_alloc = na;
+    }
+
+    op = &m->ops[m->ops_count++];
+    memset(op,0,sizeof(*op));
+    op->rectype = rectype;
+    return op;
+}
+
+/* SEGDEF, PUBDEF or GRPDEF record that added table entries first..count-1 */
+int link_module_add_defs(struct link_module_list *ml,unsigned char rectype,unsigned int first,unsigned int count,unsigned int in_file,unsigned int in_module) {
+    struct link_module_op *op = link_module_new_op(ml,in_file,in_module,rectype);
+
+    if (op == NULL)
+        return -1;
+
+    op->first = first;
+    op->count = count;
+    return 0;
+}
+
+/* copy record contents into the data pool of the module the op was just added to */
+int link_module_add_data(struct link_module_list *ml,struct link_module_op *op,const unsigned char *data,unsigned long length) {
+    struct link_module *m = &ml->modules[ml->count-1u];
+
+    if ((m->data_length + length) > m->data_alloc) {
+        size_t na = (m->data_alloc != 0) ? m->data_alloc : 4096u;
+        unsigned char *n;
+
+        while (na < (m->data_length + length)) na *= 2u;
+
+        n = (unsigned char*)realloc((void*)m->data, na);
+        if (n == NULL)
+            return -1;
+
+        m->data = n;
+        m->data_alloc = na;
+    }
+
+    op->data_length = length;
+    op->data_offset = m->data_length;
+    if (length != 0ul) memcpy(m->data + m->data_length, data, length);
+    m->data_length += length;
+    return 0;
+}
+
+int link_module_add_ledata(struct link_module_list *ml,const struct omf_ledata_info_t *info,unsigned int in_file,unsigned int in_module) {
+    struct link_module_op *op = link_module_new_op(ml,in_file,in_module,OMF_RECTYPE_LEDATA);
+
+    if (op == NULL)
+        return -1;
+
+    op->segment_index = info->segment_index;
+    op->enum_data_offset = info->enum_data_offset;
+    return link_module_add_data(ml,op,info->data,info->data_length);
+}
+
+int link_module_add_modend(struct link_module_list *ml,const struct omf_record_t *rec,unsigned int in_file,unsigned int in_module) {
+    struct link_module_op *op = link_module_new_op(ml,in_file,in_module,rec->rectype);
+
+    if (op == NULL)
+        return -1;
+
+    return link_module_add_data(ml,op,rec->data,rec->reclen);
+}
+
+/* shrink a parser table down to what was actually used. the parser allocates
+ * tables for the worst case, which is too much to keep around for every module */
+void *link_module_shrink(void *p,unsigned int count,size_t sz) {
+    void *n;
+
+    if (p == NULL)
+        return NULL;
+
+    if (count == 0) {
+        free(p);
+        return NULL;
+    }
+
+    n = realloc(p,count * sz);
+    return (n != NULL) ? n : p;
+}
+
+/* end of module: move the parser's tables into the cache entry for the module,
+ * and reset the parser state so that the next module starts out with empty tables */
+int link_module_finish(struct link_module_list *ml,struct omf_context_t *omf_state,unsigned int in_file,unsigned int in_module) {
+    struct link_module *m = link_module_current(ml,in_file,in_module);
+
+    if (m == NULL)
+        return -1;
+
+    m->LNAMEs = omf_state->LNAMEs;
+    m->LNAMEs.omf_LNAMES = (char**)link_module_shrink(m->LNAMEs.omf_LNAMES,m->LNAMEs.omf_LNAMES_count,sizeof(char*));
+    m->LNAMEs.omf_LNAMES_alloc = m->LNAMEs.omf_LNAMES_count;
+    omf_strpool_trim(&m->LNAMEs.names);
+    omf_lnames_context_init(&omf_state->LNAMEs);
+
+    m->SEGDEFs = omf_state->SEGDEFs;
+    m->SEGDEFs.omf_SEGDEFS = (struct omf_segdef_t*)link_module_shrink(m->SEGDEFs.omf_SEGDEFS,m->SEGDEFs.omf_SEGDEFS_count,sizeof(struct omf_segdef_t));
+    m->SEGDEFs.omf_SEGDEFS_alloc = m->SEGDEFs.omf_SEGDEFS_count;
+    omf_segdefs_context_init(&omf_state->SEGDEFs);
+
+    m->GRPDEFs = omf_state->GRPDEFs;
+    m->GRPDEFs.omf_GRPDEFS = (struct omf_grpdef_t*)link_module_shrink(m->GRPDEFs.omf_GRPDEFS,m->GRPDEFs.omf_GRPDEFS_count,sizeof(struct omf_grpdef_t));
+    m->GRPDEFs.omf_GRPDEFS_alloc = m->GRPDEFs.omf_GRPDEFS_count;
+    m->GRPDEFs.segdefs = (uint16_t*)link_module_shrink(m->GRPDEFs.segdefs,m->GRPDEFs.segdefs_count,sizeof(uint16_t));
+    m->GRPDEFs.segdefs_alloc = m->GRPDEFs.segdefs_count;
+    omf_grpdefs_context_init(&omf_state->GRPDEFs);
+
+    m->EXTDEFs = omf_state->EXTDEFs;
+    m->EXTDEFs.omf_EXTDEFS = (struct omf_extdef_t*)link_module_shrink(m->EXTDEFs.omf_EXTDEFS,m->EXTDEFs.omf_EXTDEFS_count,sizeof(struct omf_extdef_t));
+    m->EXTDEFs.omf_EXTDEFS_alloc = m->EXTDEFs.omf_EXTDEFS_count;
+    omf_strpool_trim(&m->EXTDEFs.names);
+    omf_extdefs_context_init(&omf_state->EXTDEFs);
+
+    m->PUBDEFs = omf_state->PUBDEFs;
+    m->PUBDEFs.omf_PUBDEFS = (struct omf_pubdef_t*)link_module_shrink(m->PUBDEFs.omf_PUBDEFS,m->PUBDEFs.omf_PUBDEFS_count,sizeof(struct omf_pubdef_t));
+    m->PUBDEFs.omf_PUBDEFS_alloc = m->PUBDEFs.omf_PUBDEFS_count;
+    omf_strpool_trim(&m->PUBDEFs.names);
+    omf_pubdefs_context_init(&omf_state->PUBDEFs);
+
+    m->FIXUPPs = omf_state->FIXUPPs;
+    m->FIXUPPs.omf_FIXUPPS = (struct omf_fixupp_t*)link_module_shrink(m->FIXUPPs.omf_FIXUPPS,m->FIXUPPs.omf_FIXUPPS_count,sizeof(struct omf_fixupp_t));
+    m->FIXUPPs.omf_FIXUPPS_alloc = m->FIXUPPs.omf_FIXUPPS_count;
+    omf_fixupps_context_init(&omf_state->FIXUPPs);
+
+    m->ops = (struct link_module_op*)link_module_shrink(m->ops,m->ops_count,sizeof(struct link_module_op));
+    m->ops_alloc = m->ops_count;
+    m->data = (unsigned char*)link_module_shrink(m->data,(unsigned int)m->data_length,1);
+    m->data_alloc = m->data_length;
+
+    ml->open = 0;
+    return 0;
+}
+
+/* run PASS_GATHER or PASS_BUILD from the module cache.
+ * PASS_GATHER replays SEGDEF/PUBDEF/GRPDEF/MODEND and drops the PUBDEFs when done with them,
+ * PASS_BUILD replays SEGDEF/LEDATA. Both apply the fixups at the end of each module. */
+int link_modules_replay(struct link_module_list *ml,unsigned int pass) {
+    const unsigned int phase = (pass == PASS_GATHER) ? LINK_PHASE_GATHER : LINK_PHASE_BUILD;
+    struct omf_context_t *ctx;
+    struct link_module *m;
+    size_t mi;
+    int ret = 0;
+
+    if ((ctx=omf_context_create()) == NULL) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        return 1;
+    }
+    ctx->flags.verbose = (verbose > 0);
+    omf_state = ctx;
+
+    for (mi=0;mi < ml->count && ret == 0;mi++) {
+        unsigned int oi;
+
+        m = &ml->modules[mi];
+        current_in_file = m->in_file;
+        current_in_mod = m->in_module;
+        link_stats_phase(phase);
+
+        /* lend the cached tables to the context. they go back to the cache entry below.
+         * the handlers work through to the end of the table, which at each record in
+         * the original file was only as long as the count noted for it */
+        ctx->LNAMEs = m->LNAMEs;
+        ctx->SEGDEFs = m->SEGDEFs;
+        ctx->GRPDEFs = m->GRPDEFs;
+        ctx->EXTDEFs = m->EXTDEFs;
+        ctx->PUBDEFs = m->PUBDEFs;
+        ctx->FIXUPPs = m->FIXUPPs;
+        ctx->SEGDEFs.omf_SEGDEFS_count = 0;
+        ctx->GRPDEFs.omf_GRPDEFS_count = 0;
+        ctx->PUBDEFs.omf_PUBDEFS_count = 0;
+
+        for (oi=0;oi < m->ops_count && ret == 0;oi++) {
+            struct link_module_op *op = &m->ops[oi];
+
+            switch (op->rectype) {
+                case OMF_RECTYPE_SEGDEF:/*0x98*/
+                case OMF_RECTYPE_SEGDEF32:/*0x99*/
+                    ctx->SEGDEFs.omf_SEGDEFS_count = op->count;
+                    if (segdef_add(ctx, op->first, m->in_file, m->in_module, pass))
+                        ret = 1;
+                    break;
+                case OMF_RECTYPE_PUBDEF:/*0x90*/
+                case OMF_RECTYPE_PUBDEF32:/*0x91*/
+                case OMF_RECTYPE_LPUBDEF:/*0xB6*/
+                case OMF_RECTYPE_LPUBDEF32:/*0xB7*/
+                    ctx->PUBDEFs.omf_PUBDEFS_count = op->count;
+                    if (pass == PASS_GATHER && pubdef_add(ctx, op->first, op->rectype, m->in_file, m->in_module, pass))
+                        ret = 1;
+                    break;
+                case OMF_RECTYPE_GRPDEF:/*0x9A*/
+                case OMF_RECTYPE_GRPDEF32:/*0x9B*/
+                    ctx->GRPDEFs.omf_GRPDEFS_count = op->count;
+                    if (pass == PASS_GATHER && grpdef_add(ctx, op->first))
+                        ret = 1;
+                    break;
+                case OMF_RECTYPE_LEDATA:/*0xA0*/
+                    if (pass == PASS_BUILD) {
+                        struct omf_ledata_info_t info;
+
+                        info.segment_index = op->segment_index;
+                        info.enum_data_offset = op->enum_data_offset;
+                        info.data_length = op->data_length;
+                        info.data = m->data + op->data_offset;
+
+                        if (ledata_add(ctx, &info, pass))
+                            ret = 1;
+                    }
+                    break;
+                case OMF_RECTYPE_MODEND:/*0x8A*/
+                case OMF_RECTYPE_MODEND32:/*0x8B*/
+                    if (pass == PASS_GATHER) {
+                        ctx->record.rectype = op->rectype;
+                        ctx->record.reclen = (unsigned short)op->data_length;
+                        ctx->record.recpos = 0;
+                        ctx->record.data = m->data + op->data_offset;
+                        ctx->record.data_external = 1;
+                        modend_add(ctx);
+                        omf_record_data_free(&ctx->record);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        ctx->SEGDEFs.omf_SEGDEFS_count = m->SEGDEFs.omf_SEGDEFS_count;
+        ctx->GRPDEFs.omf_GRPDEFS_count = m->GRPDEFs.omf_GRPDEFS_count;
+        ctx->PUBDEFs.omf_PUBDEFS_count = m->PUBDEFs.omf_PUBDEFS_count;
+
+        link_stats_phase(LINK_PHASE_FIXUP);
+        if (ret == 0 && apply_FIXUPP(ctx,0,m->in_file,m->in_module,pass))
+            ret = 1;
+        link_stats_phase(phase);
+
+        m->LNAMEs = ctx->LNAMEs;
+        m->SEGDEFs = ctx->SEGDEFs;
+        m->GRPDEFs = ctx->GRPDEFs;
+        m->EXTDEFs = ctx->EXTDEFs;
+        m->PUBDEFs = ctx->PUBDEFs;
+        m->FIXUPPs = ctx->FIXUPPs;
+        omf_lnames_context_init(&ctx->LNAMEs);
+        omf_segdefs_context_init(&ctx->SEGDEFs);
+        omf_grpdefs_context_init(&ctx->GRPDEFs);
+        omf_extdefs_context_init(&ctx->EXTDEFs);
+        omf_pubdefs_context_init(&ctx->PUBDEFs);
+        omf_fixupps_context_init(&ctx->FIXUPPs);
+
+        /* the symbols are in link_symbols[] now, PASS_BUILD has no use for the PUBDEFs */
+        if (pass == PASS_GATHER)
+            omf_pubdefs_context_free(&m->PUBDEFs);
+    }
+
+    omf_state = omf_context_destroy(ctx);
+    return ret;
+}
+
+/* .LIB module selection.
+ *
+ * A .LIB file with a dictionary (following LIBEND) does not have to be linked whole.
+ * Before PASS_GATHER, the EXTDEFs and PUBDEFs of the object files are scanned, and every
+ * name that is referenced but not defined is looked up in the dictionaries of the libraries
+ * in the order they were given. The module that defines it is selected and scanned in turn,
+ * until no more names can be resolved. PASS_GATHER and PASS_BUILD then read only the selected
+ * modules. Libraries without a dictionary are linked whole, as are all of them with -whole-lib. */
+struct link_library {
+    struct omf_lib_header_t             hdr;
+    unsigned char*                      dict;               /* dictionary blocks */
+    unsigned long*                      modules;            /* file offsets of selected modules, ascending once resolved */
+    unsigned int                        modules_count;
+    unsigned int                        modules_alloc;
+    unsigned int                        modules_scanned;    /* modules[] before this have been scanned */
+    unsigned long*                      selected;           /* open addressing set of modules[], offset+1, 0 = empty */
+    unsigned int                        selected_size;      /* power of 2 */
+};
+
+static struct link_library*             in_lib[MAX_IN_FILES];   /* non-NULL if in_file[] is a .LIB to select modules from */
+static unsigned char                    lib_whole = 0;
+
+/* every PUBDEF/EXTDEF name seen while selecting modules */
+struct link_libname {
+    char*                               name;
+    size_t                              hash_next;
+    unsigned char                       defined;
+    unsigned char                       searched;
+};
+
+static struct link_libname*             link_libnames = NULL;
+static size_t                           link_libnames_count = 0;
+static size_t                           link_libnames_alloc = 0;
+static size_t*                          link_libnames_hash = NULL;
+static size_t                           link_libnames_hash_size = 0;
+
+void link_libnames_free(void) {
+    if (link_libnames != NULL) {
+        while (link_libnames_count > 0)
+            free(link_libnames[--link_libnames_count].name);
+
+        free(link_libnames);
+        link_libnames = NULL;
+    }
+    link_libnames_alloc = 0;
+
+    if (link_libnames_hash != NULL) {
+        free(link_libnames_hash);
+        link_libnames_hash = NULL;
+    }
+    link_libnames_hash_size = 0;
+}
+
+int link_libnames_rehash(size_t buckets) {
+    size_t i,b;
+
+    if (link_libnames_hash != NULL)
+        free(link_libnames_hash);
+
+    link_libnames_hash = (size_t*)malloc(buckets * sizeof(size_t));
+    if (link_libnames_hash == NULL) {
+        link_libnames_hash_size = 0;
+        return -1;
+    }
+    link_libnames_hash_size = buckets;
+
+    for (b=0;b < buckets;b++)
+        link_libnames_hash[b] = LINK_SYMBOL_HASH_NONE;
+
+    for (i=0;i < link_libnames_count;i++) {
+        b = (size_t)link_symbol_name_hash(link_libnames[i].name) & (link_libnames_hash_size - 1u);
+        link_libnames[i].hash_next = link_libnames_hash[b];
+        link_libnames_hash[b] = i;
+    }
+
+    return 0;
+}
+
+/* find name, or add it if not there. returns NULL if out of memory */
+struct link_libname *link_libname_get(const char *name) {
+    struct link_libname *n;
+    size_t i,b;
+
+    if (link_libnames_hash == NULL) {
+        if (link_libnames_rehash(LINK_SYMBOL_HASH_INIT) < 0)
+            return NULL;
+    }
+
+    b = (size_t)link_symbol_name_hash(name) & (link_libnames_hash_size - 1u);
+    for (i=link_libnames_hash[b];i != LINK_SYMBOL_HASH_NONE;i=link_libnames[i].hash_next) {
+        if (!strcmp(link_libnames[i].name,name))
+            return &link_libnames[i];
+    }
+
+    if (link_libnames_count >= link_libnames_alloc) {
+        size_t na = (link_libnames_alloc != 0) ? (link_libnames_alloc * 2u) : 256u;
+        struct link_libname *nl = (struct link_libname*)realloc((void*)link_libnames, na * sizeof(struct link_libname));
+        if (nl == NULL)
+            return NULL;
+
+        link_libnames = nl;
+        link_libnames_alloc = na;
+    }
+
+    n = &link_libnames[link_libnames_count];
+    memset(n,0,sizeof(*n));
+    n->name = strdup(name);
+    if (n->name == NULL)
+        return NULL;
+
+    n->hash_next = link_libnames_hash[b];
+    link_libnames_hash[b] = link_libnames_count++;
+
+    if (link_libnames_count > (link_libnames_hash_size * 2u)) {
+        if (link_libnames_rehash(link_libnames_hash_size * 2u) < 0)
+            return NULL;
+    }
+
+    return &link_libnames[link_libnames_count-1u];
+}
+
+void free_link_library(struct link_library *lib) {
+    if (lib->dict != NULL) {
+        free(lib->dict);
+        lib->dict = NULL;
+    }
+    if (lib->modules != NULL) {
+        free(lib->modules);
+        lib->modules = NULL;
+    }
+    if (lib->selected != NULL) {
+        free(lib->selected);
+        lib->selected = NULL;
+    }
+    lib->selected_size = 0;
+    lib->modules_count = 0;
+    lib->modules_alloc = 0;
+    lib->modules_scanned = 0;
+}
+
+void free_link_libraries(void) {
+    unsigned int i;
+
+    for (i=0;i < MAX_IN_FILES;i++) {
+        if (in_lib[i] != NULL) {
+            free_link_library(in_lib[i]);
+            free(in_lib[i]);
+            in_lib[i] = NULL;
+        }
+    }
+}
+
+/* slot for ofs in lib->selected[], either holding it or empty */
+unsigned int link_library_selected_slot(const struct link_library *lib,unsigned long ofs) {
+    unsigned int i = (unsigned int)((ofs >> 4ul) * 2654435761ul) & (lib->selected_size - 1u);
+
+    while (lib->selected[i] != 0ul && lib->selected[i] != (ofs + 1ul))
+        i = (i + 1u) & (lib->selected_size - 1u);
+
+    return i;
+}
+
+/* select the module at file offset ofs. returns 1 if newly selected */
+int link_library_select(struct link_library *lib,unsigned long ofs) {
+    unsigned int i;
+
+    /* keep the set at most half full */
+    if ((lib->modules_count * 2u) >= lib->selected_size) {
+        unsigned int ns = (lib->selected_size != 0) ? (lib->selected_size * 2u) : 128u;
+        unsigned long *n = (unsigned long*)calloc(ns,sizeof(unsigned long));
+        if (n == NULL)
+            return -1;
+
+        if (lib->selected != NULL)
+            free(lib->selected);
+
+        lib->selected = n;
+        lib->selected_size = ns;
+        for (i=0;i < lib->modules_count;i++)
+            lib->selected[link_library_selected_slot(lib,lib->modules[i])] = lib->modules[i] + 1ul;
+    }
+
+    i = link_library_selected_slot(lib,ofs);
+    if (lib->selected[i] != 0ul)
+        return 0;
+
+    if (lib->modules_count >= lib->modules_alloc) {
+        unsigned int na = (lib->modules_alloc != 0) ? (lib->modules_alloc * 2u) : 64u;
+        unsigned long *n = (unsigned long*)realloc((void*)lib->modules, na * sizeof(unsigned long));
+        if (n == NULL)
+            return -1;
+
+        lib->modules = n;
+        lib->modules_alloc = na;
+    }
+
+    lib->modules[lib->modules_count++] = ofs;
+    lib->selected[i] = ofs + 1ul;
+    return 1;
+}
+
+int link_library_modules_qsort_cmp(const void *a,const void *b) {
+    const unsigned long oa = *((const unsigned long*)a);
+    const unsigned long ob = *((const unsigned long*)b);
+
+    if (oa < ob) return -1;
+    if (oa > ob) return 1;
+    return 0;
+}
+
+/* read one module's PUBDEFs and EXTDEFs into link_libnames[] */
+int link_library_scan_module(struct omf_context_t *ctx,struct omf_reader_t *rdr,const char *path) {
+    unsigned int i;
+    int first,ret;
+
+    while ((ret=omf_context_read_reader(ctx,rdr)) > 0) {
+        switch (ctx->record.rectype) {
+            case OMF_RECTYPE_EXTDEF:/*0x8C*/
+                if ((first=omf_context_parse_EXTDEF(ctx,&ctx->record)) < 0) {
+                    fprintf(stderr,"Error parsing EXTDEF in %s\n",path);
+                    return -1;
+                }
+
+                for (i=(unsigned int)first;i <= ctx->EXTDEFs.omf_EXTDEFS_count;i++) {
+                    const struct omf_extdef_t *ext = omf_extdefs_context_get_extdef(&ctx->EXTDEFs,i);
+
+                    if (ext != NULL && ext->name_string != NULL && ext->type == OMF_EXTDEF_TYPE_GLOBAL) {
+                        if (link_libname_get(ext->name_string) == NULL)
+                            return -1;
+                    }
+                }
+                break;
+            case OMF_RECTYPE_PUBDEF:/*0x90*/
+            case OMF_RECTYPE_PUBDEF32:/*0x91*/
+                if ((first=omf_context_parse_PUBDEF(ctx,&ctx->record)) < 0) {
+                    fprintf(stderr,"Error parsing PUBDEF in %s\n",path);
+                    return -1;
+                }
+
+                for (i=(unsigned int)first;i <= ctx->PUBDEFs.omf_PUBDEFS_count;i++) {
+                    const struct omf_pubdef_t *pub = omf_pubdefs_context_get_pubdef(&ctx->PUBDEFs,i);
+                    struct link_libname *n;
+
+                    if (pub != NULL && pub->name_string != NULL) {
+                        if ((n=link_libname_get(pub->name_string)) == NULL)
+                            return -1;
+
+                        n->defined = 1;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (ret < 0) {
+        fprintf(stderr,"Error reading %s: %s\n",path,strerror(errno));
+        if (ctx->last_error != NULL) fprintf(stderr,"Details: %s\n",ctx->last_error);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* scan an object file, or the modules of library lib not yet scanned */
+int link_library_scan_file(unsigned int inf,struct link_library *lib) {
+    struct omf_context_t *ctx = NULL;
+    struct omf_reader_t *rdr = NULL;
+    int fd,ret = -1;
+
+    fd = open(in_file[inf],O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr,"Failed to open input file %s\n",strerror(errno));
+        return -1;
+    }
+
+    if ((ctx=omf_context_create()) == NULL || (rdr=omf_reader_create()) == NULL ||
+        omf_reader_open_fd(rdr,fd,OMF_READER_ZERO_COPY) < 0) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        goto done;
+    }
+
+    omf_context_begin_file(ctx);
+
+    if (lib != NULL) {
+        while (lib->modules_scanned < lib->modules_count) {
+            omf_context_begin_module(ctx);
+            if (omf_context_seek_lib_module_reader(ctx,rdr,lib->modules[lib->modules_scanned++]) < 0)
+                goto done;
+            if (link_library_scan_module(ctx,rdr,in_file[inf]) < 0)
+                goto done;
+        }
+    }
+    else {
+        do {
+            if (link_library_scan_module(ctx,rdr,in_file[inf]) < 0)
+                goto done;
+            if (!omf_record_is_modend(&ctx->record))
+                break;
+            if (omf_context_next_lib_module_reader(ctx,rdr) <= 0)
+                break;
+
+            omf_context_begin_module(ctx);
+        } while (1);
+    }
+
+    ret = 0;
+done:
+    if (ctx != NULL) {
+        omf_context_clear(ctx);
+        ctx = omf_context_destroy(ctx);
+    }
+    rdr = omf_reader_destroy(rdr);
+    close(fd);
+    return ret;
+}
+
+/* is in_file[inf] a .LIB with a dictionary? if so, load the dictionary */
+int link_library_open(unsigned int inf) {
+    struct omf_context_t *ctx = NULL;
+    struct omf_reader_t *rdr = NULL;
+    struct link_library *lib = NULL;
+    unsigned long dict_size;
+    int fd,ret = -1;
+
+    fd = open(in_file[inf],O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr,"Failed to open input file %s\n",strerror(errno));
+        return -1;
+    }
+
+    if ((ctx=omf_context_create()) == NULL || (rdr=omf_reader_create()) == NULL ||
+        omf_reader_open_fd(rdr,fd,0) < 0) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        goto done;
+    }
+
+    ret = 0;
+    if (omf_context_read_reader(ctx,rdr) <= 0 || ctx->record.rectype != OMF_RECTYPE_LIBHEAD)
+        goto done; /* not a library */
+
+    if ((lib=(struct link_library*)calloc(1,sizeof(struct link_library))) == NULL) {
+        ret = -1;
+        goto done;
+    }
+
+    if (omf_lib_parse_LIBHEAD(&lib->hdr,&ctx->record) < 0 || lib->hdr.dict_offset == 0ul || lib->hdr.dict_blocks == 0)
+        goto done; /* no dictionary, link it whole */
+
+    dict_size = (unsigned long)lib->hdr.dict_blocks * (unsigned long)OMF_LIB_DICT_BLOCK_SIZE;
+#if !(defined(LINUX) || TARGET_MSDOS == 32)
+    if (dict_size > 0xFFF0ul)
+        goto done; /* too big for real mode, link it whole */
+#endif
+
+    if ((lib->dict=(unsigned char*)malloc((size_t)dict_size)) == NULL)
+        goto done; /* not enough memory, link it whole */
+
+    if (omf_reader_seek(rdr,lib->hdr.dict_offset) < 0 ||
+        omf_reader_read(rdr,lib->dict,(unsigned int)dict_size) != (long)dict_size) {
+        fprintf(stderr,"Warning: %s: unable to read library dictionary, linking all modules\n",in_file[inf]);
+        goto done;
+    }
+
+    in_lib[inf] = lib;
+    lib = NULL;
+    ret = 1;
+done:
+    if (lib != NULL) {
+        free_link_library(lib);
+        free(lib);
+    }
+    if (ctx != NULL) {
+        omf_context_clear(ctx);
+        ctx = omf_context_destroy(ctx);
+    }
+    rdr = omf_reader_destroy(rdr);
+    close(fd);
+    return ret;
+}
+
+/* pick the .LIB modules needed to resolve EXTDEFs. returns nonzero on error */
+int link_libraries_resolve(void) {
+    unsigned int inf,libs = 0;
+    unsigned char more;
+    size_t ni = 0;
+    int r;
+
+    if (lib_whole)
+        return 0;
+
+    for (inf=0;inf < in_file_count;inf++) {
+        if ((r=link_library_open(inf)) < 0)
+            return 1;
+        if (r > 0)
+            libs++;
+    }
+
+    if (libs == 0)
+        return 0;
+
+    /* everything the object files (and libraries linked whole) define or need */
+    for (inf=0;inf < in_file_count;inf++) {
+        if (in_lib[inf] == NULL && link_library_scan_file(inf,NULL) < 0)
+            return 1;
+    }
+
+    /* link_libnames[] only grows, so the names from ni on are the worklist: names seen since
+     * the last pass. each is looked up in the dictionaries once, and only the modules selected
+     * for them are scanned, which may add more names to the end. */
+    do {
+        more = 0;
+
+        for (;ni < link_libnames_count;ni++) {
+            struct link_libname *n = &link_libnames[ni];
+            unsigned int page;
+
+            if (n->defined || n->searched)
+                continue;
+
+            n->searched = 1;
+            for (inf=0;inf < in_file_count;inf++) {
+                struct link_library *lib = in_lib[inf];
+
+                if (lib == NULL)
+                    continue;
+
+                if (omf_lib_dict_lookup(lib->dict,lib->hdr.dict_blocks,lib->hdr.flags,n->name,strlen(n->name),&page)) {
+                    const unsigned long ofs = (unsigned long)page * (unsigned long)lib->hdr.block_size;
+
+                    if ((r=link_library_select(lib,ofs)) < 0)
+                        return 1;
+                    if (r > 0) {
+                        if (verbose)
+                            printf("Library %s: module at 0x%lx for '%s'\n",in_file[inf],ofs,n->name);
+
+                        more = 1;
+                    }
+
+                    break;
+                }
+            }
+        }
+
+        /* scan the newly selected modules, which may need more */
+        for (inf=0;inf < in_file_count;inf++) {
+            struct link_library *lib = in_lib[inf];
+
+            if (lib != NULL && lib->modules_scanned < lib->modules_count) {
+                if (link_library_scan_file(inf,lib) < 0)
+                    return 1;
+            }
+        }
+    } while (more);
+
+    /* link them in the order they appear in the library */
+    for (inf=0;inf < in_file_count;inf++) {
+        struct link_library *lib = in_lib[inf];
+
+        if (lib != NULL) {
+            if (lib->modules_count != 0)
+                qsort(lib->modules,lib->modules_count,sizeof(unsigned long),link_library_modules_qsort_cmp);
+
+            free(lib->dict);
+            lib->dict = NULL;
+            free(lib->selected);
+            lib->selected = NULL;
+            lib->selected_size = 0;
+        }
+    }
+
+    link_libnames_free();
+    return 0;
+}
+
+/* move on to the next selected module of a library. returns 1 if there is one, 0 if not, -1 on error */
+int link_library_next_module(struct omf_context_t *ctx,struct omf_reader_t *rdr,struct link_library *lib,unsigned int *lib_module) {
+    if (*lib_module >= lib->modules_count)
+        return 0;
+
+    if (omf_context_seek_lib_module_reader(ctx,rdr,lib->modules[(*lib_module)++]) < 0)
+        return -1;
+
+    return 1;
+}
+
+#if defined(LINUX) || TARGET_MSDOS == 32
+/* Parsing one input file into a module list, without touching anything global.
+ * Used by the parallel PASS_GATHER and by the incremental link. */
+struct link_parse_job {
+    unsigned int                        in_file;
+    struct link_module_list             modules;
+    int                                 result;             /* 0 = parsed, 1 = error, -1 = out of memory */
+    char                                message[256];       /* error if result == 1, read error if result == 0 */
+    unsigned long                       records[256];       /* records read, by type (-stats) */
+};
+
+int link_parse_file(struct link_parse_job *job) {
+    struct link_module_list *ml = &job->modules;
+    const unsigned int inf = job->in_file;
+    struct omf_context_t *ctx;
+    struct omf_reader_t *rdr;
+    unsigned int lib_module = 0;
+    unsigned int in_mod = 0;
+    unsigned char modcached = 0;
+    int fd,ret;
+
+    fd = open(in_file[inf],O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        snprintf(job->message,sizeof(job->message),"Failed to open input file %s\n",strerror(errno));
+        return 1;
+    }
+
+    if ((ctx=omf_context_create()) == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    if ((rdr=omf_reader_create()) == NULL || omf_reader_open_fd(rdr,fd,OMF_READER_ZERO_COPY) < 0) {
+        snprintf(job->message,sizeof(job->message),"Failed to init OMF reader %s\n",strerror(errno));
+        omf_reader_destroy(rdr);
+        omf_context_destroy(ctx);
+        close(fd);
+        return 1;
+    }
+
+    omf_context_begin_file(ctx);
+
+    do {
+        ret = omf_context_read_reader(ctx,rdr);
+        if (ret > 0)
+            job->records[ctx->record.rectype]++;
+        if (ret == 0) {
+            if (link_module_finish(ml,ctx,inf,in_mod) < 0) {
+                ret = -1;
+                break;
+            }
+            modcached = 1;
+
+            if (omf_record_is_modend(&ctx->record)) {
+                if (in_lib[inf] != NULL)
+                    ret = link_library_next_module(ctx,rdr,in_lib[inf],&lib_module);
+                else
+                    ret = omf_context_next_lib_module_reader(ctx,rdr);
+                if (ret < 0) {
+                    snprintf(job->message,sizeof(job->message),"Unable to advance to next .LIB module, %s\n%s%s%s",strerror(errno),
+                        ctx->last_error != NULL ? "Details: " : "",
+                        ctx->last_error != NULL ? ctx->last_error : "",
+                        ctx->last_error != NULL ? "\n" : "");
+                }
+                else if (ret > 0) {
+                    in_mod++;
+                    omf_context_begin_module(ctx);
+                    modcached = 0;
+                    continue;
+                }
+            }
+
+            ret = 0;
+            break;
+        }
+        else if (ret < 0) {
+            snprintf(job->message,sizeof(job->message),"Error: %s\n%s%s%s",strerror(errno),
+                ctx->last_error != NULL ? "Details: " : "",
+                ctx->last_error != NULL ? ctx->last_error : "",
+                ctx->last_error != NULL ? "\n" : "");
+            ret = 0;
+            break;
+        }
+
+        /* .LIB with a dictionary: go straight to the modules selected by link_libraries_resolve() */
+        if (ctx->record.rectype == OMF_RECTYPE_LIBHEAD && in_lib[inf] != NULL) {
+            lib_module = 0;
+            if ((ret=link_library_next_module(ctx,rdr,in_lib[inf],&lib_module)) < 0) {
+                snprintf(job->message,sizeof(job->message),"Unable to seek to .LIB module, %s\n",strerror(errno));
+                ret = 1;
+                break;
+            }
+            else if (ret == 0) {
+                break;
+            }
+
+            continue;
+        }
+
+        ret = 0;
+        switch (ctx->record.rectype) {
+            case OMF_RECTYPE_EXTDEF:/*0x8C*/
+            case OMF_RECTYPE_LEXTDEF:/*0xB4*/
+            case OMF_RECTYPE_LEXTDEF32:/*0xB5*/
+                if (omf_context_parse_EXTDEF(ctx,&ctx->record) < 0) {
+                    snprintf(job->message,sizeof(job->message),"Error parsing EXTDEF\n");
+                    ret = 1;
+                }
+                break;
+            case OMF_RECTYPE_PUBDEF:/*0x90*/
+            case OMF_RECTYPE_PUBDEF32:/*0x91*/
+            case OMF_RECTYPE_LPUBDEF:/*0xB6*/
+            case OMF_RECTYPE_LPUBDEF32:/*0xB7*/
+                {
+                    unsigned int p_count = ctx->PUBDEFs.omf_PUBDEFS_count;
+
+                    if (omf_context_parse_PUBDEF(ctx,&ctx->record) < 0) {
+                        snprintf(job->message,sizeof(job->message),"Error parsing PUBDEF\n");
+                        ret = 1;
+                    }
+                    else if (link_module_add_defs(ml,ctx->record.rectype,p_count,ctx->PUBDEFs.omf_PUBDEFS_count,inf,in_mod) < 0) {
+                        ret = -1;
+                    }
+                } break;
+            case OMF_RECTYPE_LNAMES:/*0x96*/
+                if (omf_context_parse_LNAMES(ctx,&ctx->record) < 0) {
+                    snprintf(job->message,sizeof(job->message),"Error parsing LNAMES\n");
+                    ret = 1;
+                }
+                break;
+            case OMF_RECTYPE_SEGDEF:/*0x98*/
+            case OMF_RECTYPE_SEGDEF32:/*0x99*/
+                {
+                    unsigned int p_count = ctx->SEGDEFs.omf_SEGDEFS_count;
+
+                    if (omf_context_parse_SEGDEF(ctx,&ctx->record) < 0) {
+                        snprintf(job->message,sizeof(job->message),"Error parsing SEGDEF\n");
+                        ret = 1;
+                    }
+                    else if (link_module_add_defs(ml,ctx->record.rectype,p_count,ctx->SEGDEFs.omf_SEGDEFS_count,inf,in_mod) < 0) {
+                        ret = -1;
+                    }
+                } break;
+            case OMF_RECTYPE_GRPDEF:/*0x9A*/
+            case OMF_RECTYPE_GRPDEF32:/*0x9B*/
+                {
+                    unsigned int p_count = ctx->GRPDEFs.omf_GRPDEFS_count;
+
+                    if (omf_context_parse_GRPDEF(ctx,&ctx->record) < 0) {
+                        snprintf(job->message,sizeof(job->message),"Error parsing GRPDEF\n");
+                        ret = 1;
+                    }
+                    else if (link_module_add_defs(ml,ctx->record.rectype,p_count,ctx->GRPDEFs.omf_GRPDEFS_count,inf,in_mod) < 0) {
+                        ret = -1;
+                    }
+                } break;
+            case OMF_RECTYPE_FIXUPP:/*0x9C*/
+            case OMF_RECTYPE_FIXUPP32:/*0x9D*/
+                if (omf_context_parse_FIXUPP(ctx,&ctx->record) < 0) {
+                    snprintf(job->message,sizeof(job->message),"Error parsing FIXUPP\n");
+                    ret = 1;
+                }
+                break;
+            case OMF_RECTYPE_LEDATA:/*0xA0*/
+            case OMF_RECTYPE_LEDATA32:/*0xA1*/
+                {
+                    struct omf_ledata_info_t info;
+
+                    if (omf_context_parse_LEDATA(ctx,&info,&ctx->record) < 0) {
+                        snprintf(job->message,sizeof(job->message),"Error parsing LEDATA\n");
+                        ret = 1;
+                    }
+                    else if (link_module_add_ledata(ml,&info,inf,in_mod) < 0) {
+                        ret = -1;
+                    }
+                } break;
+            case OMF_RECTYPE_MODEND:/*0x8A*/
+            case OMF_RECTYPE_MODEND32:/*0x8B*/
+                if (link_module_add_modend(ml,&ctx->record,inf,in_mod) < 0)
+                    ret = -1;
+                break;
+            default:
+                break;
+        }
+
+        if (ret != 0)
+            break;
+    } while (1);
+
+    if (ret == 0 && !modcached && link_module_finish(ml,ctx,inf,in_mod) < 0)
+        ret = -1;
+
+    omf_context_clear(ctx);
+    omf_context_destroy(ctx);
+    omf_reader_destroy(rdr);
+    close(fd);
+    return ret;
+}
+
+#endif
+
+#if defined(LINUX)
+/* Parallel PASS_GATHER.
+ *
+ * Parsing the input files does not depend on anything but the file itself (and the .LIB module
+ * selection, which is done before), so the files are parsed on worker threads, each into its own
+ * module list. Nothing global is touched while parsing. Once all files are parsed the lists are
+ * replayed in input file order into link_segments[] and link_symbols[], which is exactly what the
+ * single threaded loop in main() would have done, so the output does not depend on the number of
+ * threads or on which thread finished first. */
+static unsigned int                     link_threads = 0;   /* -j, 0 = one per CPU */
+
+static struct link_parse_job*           link_parse_jobs = NULL;
+static unsigned int                     link_parse_next = 0;
+static pthread_mutex_t                  link_parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *link_parse_thread(void *arg) {
+    unsigned int i;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&link_parse_lock);
+        i = link_parse_next++;
+        pthread_mutex_unlock(&link_parse_lock);
+
+        if (i < in_file_count)
+            link_parse_jobs[i].result = link_parse_file(&link_parse_jobs[i]);
+    } while (i < in_file_count);
+
+    return NULL;
+}
+
+void free_link_parse_jobs(void) {
+    unsigned int i;
+
+    if (link_parse_jobs != NULL) {
+        for (i=0;i < in_file_count;i++)
+            free_link_modules(&link_parse_jobs[i].modules);
+
+        free(link_parse_jobs);
+        link_parse_jobs = NULL;
+    }
+}
+
+/* PASS_GATHER on worker threads. returns 0 if done, 1 if the link failed,
+ * or -1 if it could not be done this way and main() should parse the files itself */
+int link_parse_files_parallel(void) {
+    pthread_t threads[64];
+    unsigned int nthreads,i;
+    int ret = 0;
+
+    nthreads = link_threads;
+    if (nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (n > 0) ? (unsigned int)n : 1u;
+    }
+    if (nthreads > (unsigned int)(sizeof(threads)/sizeof(threads[0])))
+        nthreads = (unsigned int)(sizeof(threads)/sizeof(threads[0]));
+    if (nthreads > in_file_count)
+        nthreads = in_file_count;
+    if (nthreads < 2u)
+        return -1;
+
+    link_parse_jobs = (struct link_parse_job*)calloc(in_file_count,sizeof(struct link_parse_job));
+    if (link_parse_jobs == NULL)
+        return -1;
+
+    for (i=0;i < in_file_count;i++)
+        link_parse_jobs[i].in_file = i;
+
+    link_stats_phase(LINK_PHASE_PARSE);
+    link_parse_next = 0;
+    for (i=0;i < nthreads;i++) {
+        if (pthread_create(&threads[i],NULL,link_parse_thread,NULL) != 0)
+            break;
+    }
+    /* whatever threads did start will get through all of the files */
+    if (i == 0) {
+        free_link_parse_jobs();
+        return -1;
+    }
+    while (i > 0)
+        pthread_join(threads[--i],NULL);
+
+    for (i=0;i < in_file_count;i++) {
+        if (link_parse_jobs[i].result < 0) {
+            free_link_parse_jobs();
+            return -1;
+        }
+    }
+
+    /* merge, in input file order */
+    for (i=0;i < in_file_count && ret == 0;i++) {
+        struct link_parse_job *job = &link_parse_jobs[i];
+        unsigned int r;
+
+        for (r=0;r < 256;r++)
+            link_stats_records[r] += job->records[r];
+
+        if (job->result != 0) {
+            fputs(job->message,stderr);
+            ret = 1;
+            break;
+        }
+        if (job->message[0] != 0)
+            fputs(job->message,stderr);
+
+        if (link_modules_replay(&job->modules,PASS_GATHER))
+            ret = 1;
+        else if (link_modules_ok && link_modules_append(&link_modules,&job->modules) < 0)
+            link_modules_fail();
+    }
+
+    free_link_parse_jobs();
+    return ret;
+}
+#endif
+
+void link_stats_json_str(FILE *fp,const char *s) {
+    fputc('"',fp);
+    for (;*s != 0;s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp,"\\%c",*s);
+        else if ((unsigned char)(*s) < 0x20)
+            fprintf(fp,"\\u%04x",(unsigned char)(*s));
+        else
+            fputc(*s,fp);
+    }
+    fputc('"',fp);
+}
+
+/* peak memory use in KB, or 0 if not known */
+unsigned long link_stats_peak_memory(void) {
+#if defined(LINUX)
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF,&ru) == 0)
+        return (unsigned long)ru.ru_maxrss;
+#endif
+
+    return 0;
+}
+
+int link_stats_report(void) {
+    unsigned long fragments = 0,max_fragments = 0,peak;
+    double total = 0;
+    unsigned int i,n;
+    size_t symbols = 0;
+    FILE *fp;
+
+    if (!link_stats)
+        return 0;
+
+    link_stats_phase(LINK_PHASE_EMIT);
+    peak = link_stats_peak_memory();
+
+    for (i=0;i < LINK_PHASE_MAX;i++)
+        total += link_stats_phase_time[i];
+    for (i=0;i < link_segments_count;i++) {
+        fragments += link_segments[i].fragments_count;
+        if (max_fragments < link_segments[i].fragments_count)
+            max_fragments = link_segments[i].fragments_count;
+    }
+    for (i=0;i < link_symbols_count;i++) {
+        if (link_symbols[i].name != NULL) symbols++;
+    }
+
+    if (link_stats_json == NULL) {
+        fprintf(stderr,"Link statistics:\n");
+        for (i=0;i < LINK_PHASE_MAX;i++)
+            fprintf(stderr,"  %-10s %10.3fms\n",link_phase_names[i],link_stats_phase_time[i] * 1000.0);
+        fprintf(stderr,"  %-10s %10.3fms\n","total",total * 1000.0);
+
+        fprintf(stderr,"  Records:\n");
+        for (i=0;i < 256;i++) {
+            if (link_stats_records[i] != 0ul)
+                fprintf(stderr,"    %-10s 0x%02x %10lu\n",omf_rectype_to_str((unsigned char)i),i,link_stats_records[i]);
+        }
+
+        fprintf(stderr,"  Symbols: %lu, lookups: %lu\n",(unsigned long)symbols,link_stats_symbol_lookups);
+        fprintf(stderr,"  Segments: %u, lookups: %lu, fragments: %lu (max %lu per segment)\n",
+            link_segments_count,link_stats_segment_lookups,fragments,max_fragments);
+        for (i=0;i < link_segments_count;i++) {
+            const struct link_segdef *sg = &link_segments[i];
+
+            fprintf(stderr,"    %-24s %-10s %6u fragments, 0x%08lx bytes\n",
+                sg->name,sg->classname != NULL ? sg->classname : "",sg->fragments_count,sg->segment_length);
+        }
+        fprintf(stderr,"  Relocations: %lu\n",(unsigned long)exe_relocation_table_count);
+        if (peak != 0ul)
+            fprintf(stderr,"  Peak memory: %luKB\n",peak);
+
+        return 0;
+    }
+
+    if (!strcmp(link_stats_json,"-")) {
+        fp = stdout;
+    }
+    else if ((fp=fopen(link_stats_json,"w")) == NULL) {
+        fprintf(stderr,"Unable to write statistics to %s, %s\n",link_stats_json,strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp,"{\n  \"phases_ms\": {");
+    for (i=0;i < LINK_PHASE_MAX;i++)
+        fprintf(fp,"%s\n    \"%s\": %.3f",i != 0 ? "," : "",link_phase_names[i],link_stats_phase_time[i] * 1000.0);
+    fprintf(fp,"\n  },\n  \"total_ms\": %.3f,\n",total * 1000.0);
+
+    /* keyed by record type, since every unknown type has the same name */
+    fprintf(fp,"  \"records\": {");
+    for (i=0,n=0;i < 256;i++) {
+        if (link_stats_records[i] != 0ul) {
+            fprintf(fp,"%s\n    \"0x%02x\": { \"name\": ",n++ != 0u ? "," : "",i);
+            link_stats_json_str(fp,omf_rectype_to_str((unsigned char)i));
+            fprintf(fp,", \"count\": %lu }",link_stats_records[i]);
+        }
+    }
+    fprintf(fp,"\n  },\n");
+
+    fprintf(fp,"  \"symbols\": %lu,\n",(unsigned long)symbols);
+    fprintf(fp,"  \"symbol_lookups\": %lu,\n",link_stats_symbol_lookups);
+    fprintf(fp,"  \"segment_lookups\": %lu,\n",link_stats_segment_lookups);
+    fprintf(fp,"  \"relocations\": %lu,\n",(unsigned long)exe_relocation_table_count);
+
+    fprintf(fp,"  \"segments\": [");
+    for (i=0;i < link_segments_count;i++) {
+        const struct link_segdef *sg = &link_segments[i];
+
+        fprintf(fp,"%s\n    { \"name\": ",i != 0 ? "," : "");
+        link_stats_json_str(fp,sg->name);
+        fprintf(fp,", \"class\": ");
+        link_stats_json_str(fp,sg->classname != NULL ? sg->classname : "");
+        fprintf(fp,", \"fragments\": %u, \"length\": %lu }",sg->fragments_count,sg->segment_length);
+    }
+    fprintf(fp,"\n  ],\n");
+
+    if (peak != 0ul)
+        fprintf(fp,"  \"peak_memory_kb\": %lu\n",peak);
+    else
+        fprintf(fp,"  \"peak_memory_kb\": null\n");
+    fprintf(fp,"}\n");
+
+    if (fp != stdout)
+        fclose(fp);
+
+    return 0;
+}
+
+#if defined(LINUX) || TARGET_MSDOS == 32
+/* Incremental link (-incremental).
+ *
+ * After a successful link, the resolved segment layout, fragments, symbols, relocations and entry
+ * point are saved to a state file next to the output, along with the size, time stamp and hash of
+ * each input file. The next link with the same options reloads the state and re-parses only the
+ * input files that changed. If a changed file still defines the same segment fragments (same
+ * sizes), the same public symbols at the same offsets, and produces the same relocations, the
+ * layout cannot have changed, so its fragments are rebuilt and written over the old ones in the
+ * output file. Anything else (options, new or moved symbols, fragment sizes, .LIB files, the entry
+ * point, the MS-DOS driver header, no state file) falls back to a full link, which rewrites the
+ * state file. The map file is left alone, since nothing in it can have changed. */
+#define LINK_STATE_MAGIC                "LKS1"
+#define LINK_STATE_EXT                  ".lks"
+#define LINK_STATE_NONE                 0xFFFFul    /* NULL string */
+
+struct link_state_input {
+    unsigned long                       size;
+    unsigned long                       mtime;
+    unsigned long                       hash;
+    unsigned char                       valid;      /* matches the file on disk */
+};
+
+static unsigned char                    link_incremental_mode = 0;
+static struct link_state_input          link_state_inputs[MAX_IN_FILES];
+
+char *link_state_path(void) {
+    char *p;
+
+    assert(out_file != NULL);
+    p = malloc(strlen(out_file) + sizeof(LINK_STATE_EXT));
+    if (p != NULL) {
+        strcpy(p,out_file);
+        strcat(p,LINK_STATE_EXT);
+    }
+
+    return p;
+}
+
+/* options that do not change the output are not part of the state */
+unsigned int link_state_arg_skip(char **argv,int i) {
+    const char *a = argv[i];
+
+    if (*a != '-') return 0;
+    do { a++; } while (*a == '-');
+
+    if (!strcmp(a,"incremental") || !strcmp(a,"v") || !strcmp(a,"stats")) return 1;
+    if (!strcmp(a,"j") || !strcmp(a,"stats-json")) return (argv[i+1] != NULL) ? 2 : 1;
+    return 0;
+}
+
+int link_state_input_stat(unsigned int inf,struct link_state_input *si) {
+    unsigned char tmp[4096];
+    unsigned long h;
+    struct stat st;
+    int fd,rd,i;
+
+    fd = open(in_file[inf],O_RDONLY|O_BINARY);
+    if (fd < 0) return -1;
+
+    if (fstat(fd,&st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* FNV-1a */
+    h = 0x811C9DC5ul;
+    while ((rd=read(fd,tmp,sizeof(tmp))) > 0) {
+        for (i=0;i < rd;i++) h = ((h ^ tmp[i]) * 0x01000193ul) & 0xFFFFFFFFul;
+    }
+    close(fd);
+    if (rd < 0) return -1;
+
+    si->size = (unsigned long)st.st_size;
+    si->mtime = (unsigned long)st.st_mtime;
+    si->hash = h;
+    si->valid = 1;
+    return 0;
+}
+
+void link_state_put(FILE *fp,unsigned long v,unsigned int bytes) {
+    while (bytes-- > 0) {
+        fputc((int)(v & 0xFFul),fp);
+        v >>= 8ul;
+    }
+}
+
+void link_state_put_str(FILE *fp,const char *s) {
+    if (s != NULL) {
+        size_t l = strlen(s);
+
+        assert(l < LINK_STATE_NONE);
+        link_state_put(fp,(unsigned long)l,2);
+        fwrite(s,l,1,fp);
+    }
+    else {
+        link_state_put(fp,LINK_STATE_NONE,2);
+    }
+}
+
+void link_state_put_attr(FILE *fp,const struct omf_segdef_attr_t *attr) {
+    link_state_put(fp,attr->f.raw,1);
+    link_state_put(fp,attr->frame_number,2);
+    link_state_put(fp,attr->offset,1);
+}
+
+int link_state_get(FILE *fp,unsigned long *v,unsigned int bytes) {
+    unsigned int i;
+    int c;
+
+    *v = 0;
+    for (i=0;i < bytes;i++) {
+        if ((c=fgetc(fp)) == EOF) return -1;
+        *v |= (unsigned long)c << (unsigned long)(i * 8u);
+    }
+
+    return 0;
+}
+
+/* *s is NULL, or a malloc()'d copy */
+int link_state_get_str(FILE *fp,char **s) {
+    unsigned long l;
+
+    *s = NULL;
+    if (link_state_get(fp,&l,2) < 0) return -1;
+    if (l == LINK_STATE_NONE) return 0;
+
+    *s = malloc((size_t)l + 1u);
+    if (*s == NULL) return -1;
+    if (l != 0ul && fread(*s,(size_t)l,1,fp) != 1) {
+        cstr_free(s);
+        return -1;
+    }
+    (*s)[l] = 0;
+    return 0;
+}
+
+int link_state_get_attr(FILE *fp,struct omf_segdef_attr_t *attr) {
+    unsigned long v;
+
+    if (link_state_get(fp,&v,1) < 0) return -1;
+    attr->f.raw = (unsigned char)v;
+    if (link_state_get(fp,&v,2) < 0) return -1;
+    attr->frame_number = (uint16_t)v;
+    if (link_state_get(fp,&v,1) < 0) return -1;
+    attr->offset = (uint8_t)v;
+    return 0;
+}
+
+int link_state_save(int argc,char **argv) {
+    struct stat st;
+    unsigned int i,f;
+    int nargs = 0;
+    char *path;
+    FILE *fp;
+
+    for (i=0;i < in_file_count;i++) {
+        if (!link_state_inputs[i].valid && link_state_input_stat(i,&link_state_inputs[i]) < 0)
+            return -1;
+    }
+
+    if (stat(out_file,&st) < 0)
+        return -1;
+
+    if ((path=link_state_path()) == NULL)
+        return -1;
+
+    fp = fopen(path,"wb");
+    free(path);
+    if (fp == NULL)
+        return -1;
+
+    fwrite(LINK_STATE_MAGIC,4,1,fp);
+    link_state_put(fp,(unsigned long)time(NULL),4);
+
+    for (i=1;i < (unsigned int)argc;i++) {
+        f = link_state_arg_skip(argv,(int)i);
+        if (f != 0) i += f - 1u;
+        else nargs++;
+    }
+    link_state_put(fp,(unsigned long)nargs,2);
+    for (i=1;i < (unsigned int)argc;i++) {
+        f = link_state_arg_skip(argv,(int)i);
+        if (f != 0) i += f - 1u;
+        else link_state_put_str(fp,argv[i]);
+    }
+
+    for (i=0;i < in_file_count;i++) {
+        link_state_put(fp,link_state_inputs[i].size,4);
+        link_state_put(fp,link_state_inputs[i].mtime,4);
+        link_state_put(fp,link_state_inputs[i].hash,4);
+    }
+    link_state_put(fp,(unsigned long)st.st_size,4);
+    link_state_put(fp,(unsigned long)st.st_mtime,4);
+
+    link_state_put(fp,link_segments_count,4);
+    for (i=0;i < link_segments_count;i++) {
+        const struct link_segdef *sg = &link_segments[i];
+
+        link_state_put_str(fp,sg->name);
+        link_state_put_str(fp,sg->classname);
+        link_state_put_str(fp,sg->groupname);
+        link_state_put_attr(fp,&sg->attr);
+        link_state_put(fp,sg->file_offset,4);
+        link_state_put(fp,sg->linear_offset,4);
+        link_state_put(fp,sg->segment_base,4);
+        link_state_put(fp,sg->segment_offset,4);
+        link_state_put(fp,sg->segment_length,4);
+        link_state_put(fp,sg->segment_relative,4);
+        link_state_put(fp,sg->initial_alignment,2);
+        link_state_put(fp,sg->pinned,1);
+        link_state_put(fp,sg->noemit,1);
+
+        link_state_put(fp,sg->fragments_count,4);
+        for (f=0;f < sg->fragments_count;f++) {
+            const struct seg_fragment *frag = &sg->fragments[f];
+
+            link_state_put(fp,frag->in_file,2);
+            link_state_put(fp,frag->in_module,2);
+            link_state_put(fp,frag->segidx,2);
+            link_state_put(fp,frag->offset,4);
+            link_state_put(fp,frag->fragment_length,4);
+            link_state_put_attr(fp,&frag->attr);
+        }
+    }
+
+    for (i=0,f=0;i < link_symbols_count;i++) {
+        if (link_symbols[i].name != NULL) f++;
+    }
+    link_state_put(fp,f,4);
+    for (i=0;i < link_symbols_count;i++) {
+        const struct link_symbol *sym = &link_symbols[i];
+
+        if (sym->name == NULL) continue;
+        link_state_put_str(fp,sym->name);
+        link_state_put_str(fp,sym->segdef);
+        link_state_put_str(fp,sym->groupdef);
+        link_state_put(fp,sym->offset,4);
+        link_state_put(fp,sym->fragment,2);
+        link_state_put(fp,sym->in_file,2);
+        link_state_put(fp,sym->in_module,2);
+        link_state_put(fp,sym->is_local,1);
+    }
+
+    link_state_put(fp,(unsigned long)exe_relocation_table_count,4);
+    for (i=0;i < exe_relocation_table_count;i++) {
+        const struct exe_relocation *rel = &exe_relocation_table[i];
+
+        link_state_put_str(fp,rel->segname);
+        link_state_put(fp,rel->fragment,4);
+        link_state_put(fp,rel->offset,4);
+    }
+
+    link_state_put_str(fp,entry_seg_link_target_name);
+    link_state_put(fp,entry_seg_link_target_fragment,4);
+    link_state_put_str(fp,entry_seg_link_frame_name);
+    link_state_put(fp,entry_seg_link_frame_fragment,4);
+    link_state_put(fp,entry_seg_ofs,4);
+
+    if (ferror(fp)) {
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+void link_state_remove(void) {
+    char *path = link_state_path();
+
+    if (path != NULL) {
+        unlink(path);
+        free(path);
+    }
+}
+
+/* undo link_state_load() */
+void link_state_reset(void) {
+    link_symbols_free();
+    free_link_segments();
+    free_exe_relocations();
+    cstr_free(&entry_seg_link_target_name);
+    cstr_free(&entry_seg_link_frame_name);
+    entry_seg_link_target = NULL;
+    entry_seg_link_frame = NULL;
+    entry_seg_link_target_fragment = 0;
+    entry_seg_link_frame_fragment = 0;
+    entry_seg_ofs = 0;
+    current_link_segment = NULL;
+}
+
+/* load the state file, and note which input files changed since.
+ * returns 0 if loaded, -1 if the state does not apply (or there is none) */
+int link_state_load(int argc,char **argv,unsigned char *changed) {
+    unsigned long v,count,i,f,saved;
+    char magic[4];
+    struct stat st;
+    char *path;
+    char *str;
+    FILE *fp;
+    int ai;
+
+    if ((path=link_state_path()) == NULL)
+        return -1;
+
+    fp = fopen(path,"rb");
+    free(path);
+    if (fp == NULL)
+        return -1;
+
+    if (fread(magic,4,1,fp) != 1 || memcmp(magic,LINK_STATE_MAGIC,4) != 0)
+        goto fail;
+    if (link_state_get(fp,&saved,4) < 0)
+        goto fail;
+
+    /* same options, same input files in the same order */
+    if (link_state_get(fp,&count,2) < 0)
+        goto fail;
+    for (ai=1;ai < argc;ai++) {
+        f = link_state_arg_skip(argv,ai);
+        if (f != 0) {
+            ai += (int)f - 1;
+            continue;
+        }
+
+        if (count == 0 || link_state_get_str(fp,&str) < 0 || str == NULL)
+            goto fail;
+        count--;
+
+        v = (unsigned long)strcmp(str,argv[ai]);
+        free(str);
+        if (v != 0ul)
+            goto fail;
+    }
+    if (count != 0)
+        goto fail;
+
+    for (i=0;i < in_file_count;i++) {
+        struct link_state_input old;
+
+        if (link_state_get(fp,&old.size,4) < 0 || link_state_get(fp,&old.mtime,4) < 0 || link_state_get(fp,&old.hash,4) < 0)
+            goto fail;
+
+        if (stat(in_file[i],&st) < 0)
+            goto fail;
+
+        changed[i] = 0;
+        if (old.size != (unsigned long)st.st_size) {
+            changed[i] = 1;
+        }
+        else if (old.mtime != (unsigned long)st.st_mtime || old.mtime >= saved) {
+            /* touched, but did the contents change? a file changed in the same second
+             * the state was saved could still have the same time stamp */
+            if (link_state_input_stat((unsigned int)i,&link_state_inputs[i]) < 0)
+                goto fail;
+            if (link_state_inputs[i].hash != old.hash)
+                changed[i] = 1;
+        }
+        else {
+            link_state_inputs[i] = old;
+            link_state_inputs[i].valid = 1;
+        }
+    }
+
+    /* the output must still be the one we wrote */
+    if (link_state_get(fp,&v,4) < 0 || stat(out_file,&st) < 0 || v != (unsigned long)st.st_size)
+        goto fail;
+    if (link_state_get(fp,&v,4) < 0 || v != (unsigned long)st.st_mtime)
+        goto fail;
+
+    if (link_state_get(fp,&count,4) < 0)
+        goto fail;
+    for (i=0;i < count;i++) {
+        struct link_segdef *sg;
+        unsigned long fcount;
+
+        if (link_state_get_str(fp,&str) < 0 || str == NULL)
+            goto fail;
+        sg = new_link_segment(str);
+        free(str);
+        if (sg == NULL)
+            goto fail;
+
+        if (link_state_get_str(fp,&sg->classname) < 0) goto fail;
+        if (link_state_get_str(fp,&sg->groupname) < 0) goto fail;
+        if (link_state_get_attr(fp,&sg->attr) < 0) goto fail;
+        if (link_state_get(fp,&sg->file_offset,4) < 0) goto fail;
+        if (link_state_get(fp,&sg->linear_offset,4) < 0) goto fail;
+        if (link_state_get(fp,&sg->segment_base,4) < 0) goto fail;
+        if (link_state_get(fp,&sg->segment_offset,4) < 0) goto fail;
+        if (link_state_get(fp,&sg->segment_length,4) < 0) goto fail;
+        if (link_state_get(fp,&sg->segment_relative,4) < 0) goto fail;
+        if (link_state_get(fp,&v,2) < 0) goto fail;
+        sg->initial_alignment = (unsigned short)v;
+        if (link_state_get(fp,&v,1) < 0) goto fail;
+        sg->pinned = (unsigned char)v;
+        if (link_state_get(fp,&v,1) < 0) goto fail;
+        sg->noemit = (unsigned char)v;
+
+        if (link_state_get(fp,&fcount,4) < 0) goto fail;
+        for (f=0;f < fcount;f++) {
+            struct seg_fragment *frag = alloc_link_segment_fragment(sg);
+
+            if (frag == NULL) goto fail;
+            if (link_state_get(fp,&v,2) < 0) goto fail;
+            frag->in_file = (unsigned short)v;
+            if (link_state_get(fp,&v,2) < 0) goto fail;
+            frag->in_module = (unsigned short)v;
+            if (link_state_get(fp,&v,2) < 0) goto fail;
+            frag->segidx = (unsigned short)v;
+            if (link_state_get(fp,&frag->offset,4) < 0) goto fail;
+            if (link_state_get(fp,&frag->fragment_length,4) < 0) goto fail;
+            if (link_state_get_attr(fp,&frag->attr) < 0) goto fail;
+        }
+    }
+    /* new_link_segment() cannot know the class and group */
+    link_segments_reindex();
+
+    if (link_state_get(fp,&count,4) < 0)
+        goto fail;
+    for (i=0;i < count;i++) {
+        struct link_symbol *sym;
+
+        if (link_state_get_str(fp,&str) < 0 || str == NULL)
+            goto fail;
+        sym = new_link_symbol(str);
+        free(str);
+        if (sym == NULL)
+            goto fail;
+
+        if (link_state_get_str(fp,&str) < 0) goto fail;
+        sym->segdef = (str != NULL) ? link_symbol_str(str) : NULL;
+        v = (str != NULL && sym->segdef == NULL);
+        free(str);
+        if (v) goto fail;
+        if (link_state_get_str(fp,&str) < 0) goto fail;
+        sym->groupdef = (str != NULL) ? link_symbol_str(str) : NULL;
+        v = (str != NULL && sym->groupdef == NULL);
+        free(str);
+        if (v) goto fail;
+        if (link_state_get(fp,&sym->offset,4) < 0) goto fail;
+        if (link_state_get(fp,&v,2) < 0) goto fail;
+        sym->fragment = (unsigned short)v;
+        if (link_state_get(fp,&v,2) < 0) goto fail;
+        sym->in_file = (unsigned short)v;
+        if (link_state_get(fp,&v,2) < 0) goto fail;
+        sym->in_module = (unsigned short)v;
+        if (link_state_get(fp,&v,1) < 0) goto fail;
+        sym->is_local = v ? 1 : 0;
+    }
+
+    if (link_state_get(fp,&count,4) < 0)
+        goto fail;
+    for (i=0;i < count;i++) {
+        struct exe_relocation *rel = new_exe_relocation();
+
+        if (rel == NULL) goto fail;
+        rel->segname = NULL;
+        if (link_state_get_str(fp,&rel->segname) < 0 || rel->segname == NULL) goto fail;
+        if (link_state_get(fp,&v,4) < 0) goto fail;
+        rel->fragment = (unsigned int)v;
+        if (link_state_get(fp,&rel->offset,4) < 0) goto fail;
+    }
+
+    if (link_state_get_str(fp,&entry_seg_link_target_name) < 0) goto fail;
+    if (link_state_get(fp,&v,4) < 0) goto fail;
+    entry_seg_link_target_fragment = (unsigned int)v;
+    if (link_state_get_str(fp,&entry_seg_link_frame_name) < 0) goto fail;
+    if (link_state_get(fp,&v,4) < 0) goto fail;
+    entry_seg_link_frame_fragment = (unsigned int)v;
+    if (link_state_get(fp,&entry_seg_ofs,4) < 0) goto fail;
+
+    if (entry_seg_link_target_name != NULL) {
+        if ((entry_seg_link_target=find_link_segment(entry_seg_link_target_name)) == NULL) goto fail;
+        if (entry_seg_link_target_fragment >= entry_seg_link_target->fragments_count) goto fail;
+    }
+    if (entry_seg_link_frame_name != NULL) {
+        if ((entry_seg_link_frame=find_link_segment(entry_seg_link_frame_name)) == NULL) goto fail;
+        if (entry_seg_link_frame_fragment >= entry_seg_link_frame->fragments_count) goto fail;
+    }
+
+    fclose(fp);
+    return 0;
+fail:
+    fclose(fp);
+    link_state_reset();
+    return -1;
+}
+
+/* index of the first fragment of segment 'sg' that comes from input file 'in_file', module 'in_module' or later.
+ * fragments are added in input file and module order, which leaves them sorted */
+unsigned int link_segment_fragment_lower_bound(const struct link_segdef *sg,unsigned int in_file,unsigned int in_module) {
+    unsigned int lo = 0,hi = sg->fragments_count,mid;
+
+    while (lo < hi) {
+        const struct seg_fragment *frag;
+
+        mid = lo + ((hi - lo) >> 1u);
+        frag = &sg->fragments[mid];
+        if (frag->in_file < in_file || (frag->in_file == in_file && frag->in_module < in_module))
+            lo = mid + 1u;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* fragment of segment 'sg' for SEGDEF 'segidx' of the module, or -1 if none */
+int link_segment_fragment_find(const struct link_segdef *sg,unsigned int in_file,unsigned int in_module,unsigned int segidx) {
+    unsigned int i = link_segment_fragment_lower_bound(sg,in_file,in_module);
+
+    while (i < sg->fragments_count) {
+        const struct seg_fragment *frag = &sg->fragments[i];
+
+        if (frag->in_file != in_file || frag->in_module != in_module) break;
+        if (frag->segidx == segidx) return (int)i;
+        i++;
+    }
+
+    return -1;
+}
+
+/* does the new parse of a changed input file fit the saved layout exactly?
+ * on success, fragments_read of each segment is left pointing just past the file's fragments */
+int link_incremental_check(struct link_parse_job *job) {
+    const unsigned int inf = job->in_file;
+    struct omf_context_t *ctx;
+    unsigned long nfrags = 0,nsyms = 0;
+    size_t reloc_count = exe_relocation_table_count;
+    size_t mi,ri,ni;
+    unsigned int i,j;
+    int ret = 0;
+
+    /* the entry point and the driver header get patched after the build, leave those to a full link */
+    if (entry_seg_link_target != NULL && entry_seg_link_target->fragments[entry_seg_link_target_fragment].in_file == inf)
+        return -1;
+    if (output_format == OFMT_DOSDRV || output_format == OFMT_DOSDRVEXE) {
+        struct link_symbol *sym = find_link_symbol(dosdrv_header_symbol,-1,-1);
+
+        if (sym != NULL && sym->in_file == inf)
+            return -1;
+    }
+
+    if ((ctx=omf_context_create()) == NULL)
+        return -1;
+
+    for (mi=0;mi < job->modules.count && ret == 0;mi++) {
+        struct link_module *m = &job->modules.modules[mi];
+        unsigned int oi;
+
+        /* SEGDEFs: same fragments, same size and attributes */
+        for (i=1;i <= m->SEGDEFs.omf_SEGDEFS_count && ret == 0;i++) {
+            const struct omf_segdef_t *sg = &m->SEGDEFs.omf_SEGDEFS[i-1u];
+            const char *classname = omf_lnames_context_get_name_safe(&m->LNAMEs,sg->class_name_index);
+            const char *name = omf_lnames_context_get_name_safe(&m->LNAMEs,sg->segment_name_index);
+            struct link_segdef *lsg;
+            int fi;
+
+            if (*name == 0) continue;
+
+            if ((lsg=find_link_segment(name)) == NULL || (fi=link_segment_fragment_find(lsg,inf,m->in_module,i)) < 0) {
+                ret = -1;
+                break;
+            }
+            if (lsg->fragments[fi].fragment_length != sg->segment_length ||
+                lsg->fragments[fi].attr.f.raw != sg->attr.f.raw ||
+                lsg->fragments[fi].attr.frame_number != sg->attr.frame_number ||
+                lsg->fragments[fi].attr.offset != sg->attr.offset ||
+                lsg->classname == NULL || strcmp(lsg->classname,classname) != 0) {
+                ret = -1;
+                break;
+            }
+
+            lsg->fragments_read = (unsigned int)fi + 1u;
+            nfrags++;
+        }
+
+        /* GRPDEFs: no new group membership */
+        for (i=0;i < m->GRPDEFs.omf_GRPDEFS_count && ret == 0;i++) {
+            struct omf_grpdef_t *gd = &m->GRPDEFs.omf_GRPDEFS[i];
+            const char *grpdef_name = omf_lnames_context_get_name_safe(&m->LNAMEs,gd->group_name_index);
+            int segdef;
+
+            if (*grpdef_name == 0) continue;
+
+            for (j=0;j < gd->count;j++) {
+                const struct omf_segdef_t *sg;
+                struct link_segdef *lsg;
+
+                if ((segdef=omf_grpdefs_context_get_grpdef_segdef(&m->GRPDEFs,gd,j)) < 0) continue;
+                if ((sg=omf_segdefs_context_get_segdef(&m->SEGDEFs,segdef)) == NULL ||
+                    (lsg=find_link_segment(omf_lnames_context_get_name_safe(&m->LNAMEs,sg->segment_name_index))) == NULL ||
+                    lsg->groupname == NULL || strcmp(lsg->groupname,grpdef_name) != 0) {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+
+        /* PUBDEFs: the same symbols, at the same place. MODEND: no entry point */
+        ctx->LNAMEs = m->LNAMEs;
+        ctx->SEGDEFs = m->SEGDEFs;
+        ctx->GRPDEFs = m->GRPDEFs;
+        for (oi=0;oi < m->ops_count && ret == 0;oi++) {
+            const struct link_module_op *op = &m->ops[oi];
+            unsigned char is_local;
+
+            if ((op->rectype&0xFE) == OMF_RECTYPE_MODEND) {
+                if (op->data_length != 0ul && (m->data[op->data_offset] & 0x40/*START*/))
+                    ret = -1;
+                continue;
+            }
+            if ((op->rectype&0xFE) != OMF_RECTYPE_PUBDEF && (op->rectype&0xFE) != OMF_RECTYPE_LPUBDEF)
+                continue;
+
+            is_local = (op->rectype&0xFE) == OMF_RECTYPE_LPUBDEF;
+            for (i=op->first;i < op->count;i++) {
+                const struct omf_pubdef_t *pubdef = &m->PUBDEFs.omf_PUBDEFS[i];
+                const char *segname,*groupname;
+                struct link_segdef *lsg;
+                struct link_symbol *sym;
+
+                if (pubdef->name_string == NULL) continue;
+                segname = omf_context_get_segdef_name_safe(ctx,pubdef->segment_index);
+                if (*segname == 0) continue;
+                groupname = omf_context_get_grpdef_name_safe(ctx,pubdef->group_index);
+
+                sym = find_link_symbol(pubdef->name_string,inf,m->in_module);
+                if (sym == NULL || sym->in_file != inf || sym->in_module != m->in_module || sym->is_local != is_local ||
+                    sym->offset != pubdef->public_offset || sym->segdef == NULL || strcmp(sym->segdef,segname) != 0 ||
+                    sym->groupdef == NULL || strcmp(sym->groupdef,groupname) != 0 ||
+                    (lsg=find_link_segment(segname)) == NULL || sym->fragment >= lsg->fragments_count ||
+                    lsg->fragments[sym->fragment].in_file != inf || lsg->fragments[sym->fragment].in_module != m->in_module) {
+                    ret = -1;
+                    break;
+                }
+
+                nsyms++;
+            }
+        }
+
+        /* EXTDEFs: everything still resolves */
+        for (i=1;i <= m->EXTDEFs.omf_EXTDEFS_count && ret == 0;i++) {
+            const struct omf_extdef_t *ed = omf_extdefs_context_get_extdef(&m->EXTDEFs,i);
+
+            if (ed != NULL && ed->name_string != NULL && *(ed->name_string) != 0 &&
+                find_link_symbol(ed->name_string,inf,m->in_module) == NULL)
+                ret = -1;
+        }
+
+        /* relocations come out of the fixups in PASS_GATHER. they go into a table in the output,
+         * so they have to come out the same */
+        if (ret == 0) {
+            ctx->EXTDEFs = m->EXTDEFs;
+            ctx->FIXUPPs = m->FIXUPPs;
+            if (apply_FIXUPP(ctx,0,inf,m->in_module,PASS_GATHER))
+                ret = -1;
+        }
+
+        omf_lnames_context_init(&ctx->LNAMEs);
+        omf_segdefs_context_init(&ctx->SEGDEFs);
+        omf_grpdefs_context_init(&ctx->GRPDEFs);
+        omf_extdefs_context_init(&ctx->EXTDEFs);
+        omf_fixupps_context_init(&ctx->FIXUPPs);
+    }
+
+    omf_context_destroy(ctx);
+
+    /* nothing went missing */
+    if (ret == 0) {
+        unsigned long n = 0;
+
+        for (i=0;i < link_segments_count;i++) {
+            const struct link_segdef *sg = &link_segments[i];
+            n += link_segment_fragment_lower_bound(sg,inf+1u,0) - link_segment_fragment_lower_bound(sg,inf,0);
+        }
+        if (n != nfrags)
+            ret = -1;
+
+        for (i=0,n=0;i < link_symbols_count;i++) {
+            if (link_symbols[i].name != NULL && link_symbols[i].in_file == inf) n++;
+        }
+        if (n != nsyms)
+            ret = -1;
+    }
+
+    /* compare the new relocations against the saved ones from this file, in order */
+    for (ri=0,ni=reloc_count;ret == 0 && ri < reloc_count;ri++) {
+        const struct exe_relocation *rel = &exe_relocation_table[ri];
+        const struct exe_relocation *nrel;
+        struct link_segdef *lsg = find_link_segment(rel->segname);
+
+        if (lsg == NULL || rel->fragment >= lsg->fragments_count) {
+            ret = -1;
+            break;
+        }
+        if (lsg->fragments[rel->fragment].in_file != inf)
+            continue;
+
+        if (ni >= exe_relocation_table_count) {
+            ret = -1;
+            break;
+        }
+
+        nrel = &exe_relocation_table[ni++];
+        if (strcmp(nrel->segname,rel->segname) != 0 || nrel->fragment != rel->fragment || nrel->offset != rel->offset)
+            ret = -1;
+    }
+    if (ret == 0 && ni != exe_relocation_table_count)
+        ret = -1;
+
+    while (exe_relocation_table_count > reloc_count)
+        free_exe_relocation_entry(&exe_relocation_table[--exe_relocation_table_count]);
+
+    return ret;
+}
+
+/* rebuild the fragments of a changed input file, and write them over the old ones in the output */
+int link_incremental_patch(struct link_parse_job *job,int fd) {
+    const unsigned int inf = job->in_file;
+    unsigned int i,f,fe;
+
+    for (i=0;i < link_segments_count;i++) {
+        struct link_segdef *sd = &link_segments[i];
+
+        /* PASS_BUILD starts from the file's first fragment in every segment */
+        sd->fragments_read = link_segment_fragment_lower_bound(sd,inf,0);
+
+        if (sd->segment_length != 0 && !sd->noemit && sd->image_ptr == NULL &&
+            sd->fragments_read < link_segment_fragment_lower_bound(sd,inf+1u,0)) {
+            sd->image_ptr = malloc(sd->segment_length);
+            if (sd->image_ptr == NULL) {
+                fprintf(stderr,"Out of memory\n");
+                return 1;
+            }
+        }
+
+        if (sd->image_ptr != NULL)
+            memset(sd->image_ptr,0,sd->segment_length);
+    }
+
+    if (link_modules_replay(&job->modules,PASS_BUILD))
+        return 1;
+
+    for (i=0;i < link_segments_count;i++) {
+        struct link_segdef *sd = &link_segments[i];
+
+        if (sd->image_ptr == NULL) continue;
+
+        fe = link_segment_fragment_lower_bound(sd,inf+1u,0);
+        for (f=link_segment_fragment_lower_bound(sd,inf,0);f < fe;f++) {
+            const struct seg_fragment *frag = &sd->fragments[f];
+            unsigned long len = frag->fragment_length;
+
+            if (frag->offset >= sd->segment_length) continue;
+            if (len > (sd->segment_length - frag->offset)) len = sd->segment_length - frag->offset;
+            if (len == 0ul) continue;
+
+            if ((unsigned long)lseek(fd,sd->file_offset + frag->offset,SEEK_SET) != (sd->file_offset + frag->offset)) {
+                fprintf(stderr,"Seek error\n");
+                return 1;
+            }
+            if ((unsigned long)write(fd,sd->image_ptr + frag->offset,len) != len) {
+                fprintf(stderr,"Write error\n");
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* returns 0 if the output was brought up to date, 1 on error, or -1 if a full link is needed */
+int link_incremental(int argc,char **argv) {
+    unsigned char changed[MAX_IN_FILES];
+    struct link_parse_job *jobs;
+    unsigned int i,nchanged = 0;
+    int ret = 0,fd;
+
+    /* the hex dump is made from the whole output file */
+    if (hex_output != NULL)
+        return -1;
+
+    if (link_state_load(argc,argv,changed) < 0)
+        return -1;
+
+    for (i=0;i < in_file_count;i++) {
+        if (changed[i]) nchanged++;
+    }
+
+    if (verbose)
+        fprintf(stderr,"Incremental link: %u of %u input files changed\n",nchanged,in_file_count);
+
+    if (nchanged == 0) {
+        if (link_state_save(argc,argv) < 0)
+            fprintf(stderr,"Unable to write link state\n");
+        link_stats_report();
+        link_state_reset();
+        return 0;
+    }
+
+    jobs = (struct link_parse_job*)calloc(in_file_count,sizeof(struct link_parse_job));
+    if (jobs == NULL) {
+        link_state_reset();
+        return -1;
+    }
+
+    /* parse and check everything before touching the output */
+    link_stats_phase(LINK_PHASE_PARSE);
+    for (i=0;i < in_file_count && ret == 0;i++) {
+        unsigned char c = 0;
+
+        if (!changed[i]) continue;
+
+        /* a .LIB may now need other modules */
+        fd = open(in_file[i],O_RDONLY|O_BINARY);
+        if (fd < 0 || read(fd,&c,1) != 1 || c == OMF_RECTYPE_LIBHEAD) ret = -1;
+        if (fd >= 0) close(fd);
+        if (ret != 0) break;
+
+        jobs[i].in_file = i;
+        if (link_parse_file(&jobs[i]) != 0 || jobs[i].message[0] != 0)
+            ret = -1;
+        else if (link_incremental_check(&jobs[i]) < 0)
+            ret = -1;
+    }
+
+    if (ret == 0) {
+        link_stats_phase(LINK_PHASE_EMIT);
+        fd = open(out_file,O_RDWR|O_BINARY);
+        if (fd < 0) {
+            ret = -1;
+        }
+        else {
+            for (i=0;i < in_file_count && ret == 0;i++) {
+                if (changed[i] && link_incremental_patch(&jobs[i],fd))
+                    ret = 1;
+            }
+            close(fd);
+
+            if (ret == 0) {
+                for (i=0;i < in_file_count;i++) {
+                    if (changed[i] && !link_state_inputs[i].valid && link_state_input_stat(i,&link_state_inputs[i]) < 0)
+                        ret = 1;
+                }
+            }
+            if (ret == 0 && link_state_save(argc,argv) < 0)
+                fprintf(stderr,"Unable to write link state\n");
+        }
+    }
+
+    for (i=0;i < in_file_count;i++)
+        free_link_modules(&jobs[i].modules);
+    free(jobs);
+
+    if (ret == 0)
+        link_stats_report();
+    link_state_reset();
+    return ret;
+}
+#endif
+
+static void help(void) {
+    fprintf(stderr,"lnkdos16 [options]\n");
+    fprintf(stderr,"  -i <file>    OMF file to link\n");
+    fprintf(stderr,"  -whole-lib   Link every module of .LIB files, not just the ones needed\n");
+#if defined(LINUX)
+    fprintf(stderr,"  -j <n>       Parse input files on <n> threads (default: one per CPU, 1 = off)\n");
+#endif
+    fprintf(stderr,"  -o <file>    Output file\n");
+#if defined(LINUX) || TARGET_MSDOS == 32
+    fprintf(stderr,"  -incremental Keep link state next to the output, relink only changed files\n");
+#endif
+    fprintf(stderr,"  -map <file>  Map/report file\n");
+    fprintf(stderr,"  -of <fmt>    Output format (COM, EXE, COMREL)\n");
+    fprintf(stderr,"                COM = flat COM executable\n");
+    fprintf(stderr,"                COMREL = flat COM executable, relocatable\n");
+    fprintf(stderr,"                EXE = segmented EXE executable\n");
+    fprintf(stderr,"                DOSDRV = flat MS-DOS driver (SYS)\n");
+    fprintf(stderr,"                DOSDRVREL = flat MS-DOS driver (SYS), relocateable\n");
+    fprintf(stderr,"                DOSDRVEXE = MS-DOS driver (EXE)\n");
+    fprintf(stderr,"  -v           Verbose mode\n");
+    fprintf(stderr,"  -stats       Report time per phase, record counts, lookups and memory use\n");
+    fprintf(stderr,"  -stats-json <file>  Write the -stats report as JSON (- for stdout)\n");
+    fprintf(stderr,"  -d           Dump memory state after parsing\n");
+    fprintf(stderr,"  -no-dosseg   No DOSSEG sort order\n");
+    fprintf(stderr,"  -dosseg      DOSSEG sort order\n");
+    fprintf(stderr,"  -comNNN      Link .COM segment starting at 0xNNN\n");
+    fprintf(stderr,"  -com100      Link .COM segment starting at 0x100\n");
+    fprintf(stderr,"  -com0        Link .COM segment starting at 0 (Watcom Linker)\n");
+    fprintf(stderr,"  -stackN      Set minimum stack segment size (0xNNN)\n");
+    fprintf(stderr,"  -pflat       Prefer .COM-like flat layout\n");
+    fprintf(stderr,"  -hsym        Header symbol name (DOSDRV)\n");
+    fprintf(stderr,"  -hex <file>  Also emit file as C header hex dump\n");
+    fprintf(stderr,"  -hexsplit    Emit to -hex as .h and .c files\n");
+    fprintf(stderr,"  -hexcpp      Use CPP extension.\n");
+}
+
+void my_dumpstate(const struct omf_context_t * const ctx) {
+    unsigned int i;
+    const char *p;
+
+    printf("OBJ dump state:\n");
+
+    if (ctx->THEADR != NULL)
+        printf("* THEADR: \"%s\"\n",ctx->THEADR);
+
+    if (ctx->LNAMEs.omf_LNAMES != NULL) {
+        printf("* LNAMEs:\n");
+        for (i=1;i <= ctx->LNAMEs.omf_LNAMES_count;i++) {
+            p = omf_lnames_context_get_name(&ctx->LNAMEs,i);
+
+            if (p != NULL)
+                printf("   [%u]: \"%s\"\n",i,p);
+            else
+                printf("   [%u]: (null)\n",i);
+        }
+    }
+
+    if (ctx->SEGDEFs.omf_SEGDEFS != NULL) {
+        for (i=1;i <= ctx->SEGDEFs.omf_SEGDEFS_count;i++)
+            dump_SEGDEF(stdout,omf_state,i);
+    }
+
+    if (ctx->GRPDEFs.omf_GRPDEFS != NULL) {
+        for (i=1;i <= ctx->GRPDEFs.omf_GRPDEFS_count;i++)
+            dump_GRPDEF(stdout,omf_state,i);
+    }
+
+    if (ctx->EXTDEFs.omf_EXTDEFS != NULL)
+        dump_EXTDEF(stdout,omf_state,1);
+
+    if (ctx->PUBDEFs.omf_PUBDEFS != NULL)
+        dump_PUBDEF(stdout,omf_state,1);
+
+    if (ctx->FIXUPPs.omf_FIXUPPS != NULL)
+        dump_FIXUPP(stdout,omf_state,1);
+
+    if (verbose)
+        printf("----END-----\n");
+}
+
+int segment_def_arrange(void) {
+    unsigned long m,ofs = 0;
+    unsigned int inf;
+
+    for (inf=0;inf < link_segments_count;inf++) {
+        struct link_segdef *sd = &link_segments[inf];
+
+        if (sd->initial_alignment != 0ul) {
+            m = ofs % sd->initial_alignment;
+            if (m != 0ul) ofs += sd->initial_alignment - m;
+        }
+
+        if (verbose)
+            fprintf(stderr,"segment[%u] ofs=0x%lx len=0x%lx\n",
+                    inf,ofs,sd->segment_length);
 
         if (output_format == OFMT_COM || output_format == OFMT_EXE ||
             output_format == OFMT_DOSDRV || output_format == OFMT_DOSDRVEXE) {
@@ -1974,12 +4645,15 @@ int segment_def_arrange(void) {
 
 int main(int argc,char **argv) {
     unsigned char diddump = 0;
+    unsigned char modcached = 0;
+    unsigned int lib_module = 0;
     unsigned char pass;
     unsigned int inf;
     int i,fd,ret;
     char *a;
 
     hex_output_name[0] = 0;
+    link_stats_last_time = link_stats_clock();
 
     for (i=1;i < argc;) {
         a = argv[i++];
@@ -2068,6 +4742,30 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"no-dosseg")) {
                 do_dosseg = 0;
             }
+            else if (!strcmp(a,"whole-lib")) {
+                lib_whole = 1;
+            }
+            else if (!strcmp(a,"stats")) {
+                link_stats = 1;
+            }
+            else if (!strcmp(a,"stats-json")) {
+                link_stats_json = argv[i++];
+                if (link_stats_json == NULL) return 1;
+                link_stats = 1;
+            }
+#if defined(LINUX) || TARGET_MSDOS == 32
+            else if (!strcmp(a,"incremental")) {
+                link_incremental_mode = 1;
+            }
+#endif
+#if defined(LINUX)
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                if (!isdigit(*a)) return 1;
+                link_threads = (unsigned int)strtoul(a,NULL,10);
+            }
+#endif
             else {
                 help();
                 return 1;
@@ -2088,6 +4786,18 @@ int main(int argc,char **argv) {
         }
     }
 
+#if defined(LINUX) || TARGET_MSDOS == 32
+    if (link_incremental_mode && in_file_count != 0 && out_file != NULL) {
+        int r = link_incremental(argc,argv);
+
+        if (r >= 0) return r;
+        if (verbose) fprintf(stderr,"Incremental link not possible, doing a full link\n");
+
+        /* so that a full link that fails cannot leave the old state behind */
+        link_state_remove();
+    }
+#endif
+
     if (map_file != NULL) {
         map_fp = fopen(map_file,"w");
         if (map_fp == NULL) return 1;
@@ -2118,9 +4828,27 @@ int main(int argc,char **argv) {
         sg->pinned = 1;
     }
 
+    link_stats_phase(LINK_PHASE_LIBRARIES);
+    if (link_libraries_resolve())
+        return 1;
+
     for (pass=0;pass < PASS_MAX;pass++) {
-        for (inf=0;inf < in_file_count;inf++) {
+        if (pass == PASS_BUILD && link_modules_ok) {
+            ret = link_modules_replay(&link_modules,PASS_BUILD);
+            free_link_modules(&link_modules);
+            if (ret)
+                return 1;
+        }
+#if defined(LINUX)
+        else if (pass == PASS_GATHER && link_modules_ok && !verbose &&
+            (ret=link_parse_files_parallel()) >= 0) {
+            if (ret)
+                return 1;
+        }
+#endif
+        else for (inf=0;inf < in_file_count;inf++) {
             assert(in_file[inf] != NULL);
+            link_stats_phase(LINK_PHASE_PARSE);
 
             fd = open(in_file[inf],O_RDONLY|O_BINARY);
             if (fd < 0) {
@@ -2136,27 +4864,49 @@ int main(int argc,char **argv) {
             }
             omf_state->flags.verbose = (verbose > 0);
 
+            // records are only parsed, never modified, so let them point into the reader buffer
+            if ((omf_reader=omf_reader_create()) == NULL || omf_reader_open_fd(omf_reader,fd,OMF_READER_ZERO_COPY) < 0) {
+                fprintf(stderr,"Failed to init OMF reader %s\n",strerror(errno));
+                return 1;
+            }
+
             diddump = 0;
+            modcached = 0;
             current_in_mod = 0;
             omf_context_begin_file(omf_state);
 
             do {
-                ret = omf_context_read_fd(omf_state,fd);
+                link_stats_phase(LINK_PHASE_PARSE);
+                ret = omf_context_read_reader(omf_state,omf_reader);
+                if (ret > 0 && pass == PASS_GATHER)
+                    link_stats_records[omf_state->record.rectype]++;
                 if (ret == 0) {
+                    link_stats_phase(LINK_PHASE_FIXUP);
                     if (apply_FIXUPP(omf_state,0,inf,current_in_mod,pass))
                         return 1;
+                    link_stats_phase(LINK_PHASE_PARSE);
+
+                    if (!diddump && verbose) {
+                        my_dumpstate(omf_state);
+                        diddump = 1;
+                    }
+
+                    if (pass == PASS_GATHER && link_modules_ok) {
+                        if (link_module_finish(&link_modules,omf_state,inf,current_in_mod) < 0)
+                            link_modules_fail();
+                        modcached = 1;
+                    }
                     omf_fixupps_context_free_entries(&omf_state->FIXUPPs);
 
                     if (omf_record_is_modend(&omf_state->record)) {
-                        if (!diddump && verbose) {
-                            my_dumpstate(omf_state);
-                            diddump = 1;
-                        }
 
                         if (verbose)
                             printf("----- next module -----\n");
 
-                        ret = omf_context_next_lib_module_fd(omf_state,fd);
+                        if (in_lib[inf] != NULL)
+                            ret = link_library_next_module(omf_state,omf_reader,in_lib[inf],&lib_module);
+                        else
+                            ret = omf_context_next_lib_module_reader(omf_state,omf_reader);
                         if (ret < 0) {
                             printf("Unable to advance to next .LIB module, %s\n",strerror(errno));
                             if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
@@ -2164,6 +4914,7 @@ int main(int argc,char **argv) {
                         else if (ret > 0) {
                             current_in_mod++;
                             omf_context_begin_module(omf_state);
+                            modcached = 0;
                             diddump = 0;
                             continue;
                         }
@@ -2177,6 +4928,20 @@ int main(int argc,char **argv) {
                     break;
                 }
 
+                /* .LIB with a dictionary: go straight to the modules selected by link_libraries_resolve() */
+                if (omf_state->record.rectype == OMF_RECTYPE_LIBHEAD && in_lib[inf] != NULL) {
+                    lib_module = 0;
+                    if ((ret=link_library_next_module(omf_state,omf_reader,in_lib[inf],&lib_module)) < 0) {
+                        fprintf(stderr,"Unable to seek to .LIB module, %s\n",strerror(errno));
+                        return 1;
+                    }
+                    else if (ret == 0) {
+                        break;
+                    }
+
+                    continue;
+                }
+
                 switch (omf_state->record.rectype) {
                     case OMF_RECTYPE_EXTDEF:/*0x8C*/
                     case OMF_RECTYPE_LEXTDEF:/*0xB4*/
@@ -2213,6 +4978,7 @@ int main(int argc,char **argv) {
                             /* TODO: LPUBDEF symbols need to "disappear" at the end of the module.
                              *       LPUBDEF means the symbols are not visible outside the module. */
 
+                            link_stats_phase(LINK_PHASE_GATHER);
                             if (pass == PASS_GATHER && pubdef_add(omf_state, p_count, omf_state->record.rectype, inf, current_in_mod, pass))
                                 return 1;
                         } break;
@@ -2243,8 +5009,12 @@ int main(int argc,char **argv) {
                             if (omf_state->flags.verbose)
                                 dump_SEGDEF(stdout,omf_state,(unsigned int)first_new_segdef);
 
+                            link_stats_phase(pass == PASS_GATHER ? LINK_PHASE_GATHER : LINK_PHASE_BUILD);
                             if (segdef_add(omf_state, p_count, inf, current_in_mod, pass))
                                 return 1;
+                            if (pass == PASS_GATHER && link_modules_ok &&
+                                link_module_add_defs(&link_modules, omf_state->record.rectype, p_count, omf_state->SEGDEFs.omf_SEGDEFS_count, inf, current_in_mod) < 0)
+                                link_modules_fail();
                         } break;
                     case OMF_RECTYPE_GRPDEF:/*0x9A*/
                     case OMF_RECTYPE_GRPDEF32:/*0x9B*/
@@ -2260,6 +5030,7 @@ int main(int argc,char **argv) {
                             if (omf_state->flags.verbose)
                                 dump_GRPDEF(stdout,omf_state,(unsigned int)first_new_grpdef);
 
+                            link_stats_phase(LINK_PHASE_GATHER);
                             if (pass == PASS_GATHER && grpdef_add(omf_state, p_count))
                                 return 1;
                         } break;
@@ -2289,89 +5060,19 @@ int main(int argc,char **argv) {
                             if (omf_state->flags.verbose && pass == PASS_GATHER)
                                 dump_LEDATA(stdout,omf_state,&info);
 
+                            link_stats_phase(pass == PASS_GATHER ? LINK_PHASE_GATHER : LINK_PHASE_BUILD);
                             if (pass == PASS_BUILD && ledata_add(omf_state, &info, pass))
                                 return 1;
+                            if (pass == PASS_GATHER && link_modules_ok &&
+                                link_module_add_ledata(&link_modules, &info, inf, current_in_mod) < 0)
+                                link_modules_fail();
                         } break;
                     case OMF_RECTYPE_MODEND:/*0x8A*/
                     case OMF_RECTYPE_MODEND32:/*0x8B*/
-                        if (pass == PASS_GATHER) {
-                            unsigned char ModuleType;
-                            unsigned char EndData;
-                            unsigned int FrameDatum;
-                            unsigned int TargetDatum;
-                            unsigned long TargetDisplacement;
-                            const struct omf_segdef_t *frame_segdef;
-                            const struct omf_segdef_t *target_segdef;
-
-                            ModuleType = omf_record_get_byte(&omf_state->record);
-                            if (ModuleType&0x40/*START*/) {
-                                EndData = omf_record_get_byte(&omf_state->record);
-                                FrameDatum = omf_record_get_index(&omf_state->record);
-                                TargetDatum = omf_record_get_index(&omf_state->record);
-
-                                if (omf_state->record.rectype == OMF_RECTYPE_MODEND32)
-                                    TargetDisplacement = omf_record_get_dword(&omf_state->record);
-                                else
-                                    TargetDisplacement = omf_record_get_word(&omf_state->record);
-
-                                frame_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,FrameDatum);
-                                target_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,TargetDatum);
-
-                                if (verbose) {
-                                    printf("ModuleType: 0x%02x: MainModule=%u Start=%u Segment=%u StartReloc=%u\n",
-                                            ModuleType,
-                                            ModuleType&0x80?1:0,
-                                            ModuleType&0x40?1:0,
-                                            ModuleType&0x20?1:0,
-                                            ModuleType&0x01?1:0);
-                                    printf("    EndData=0x%02x FrameDatum=%u(%s) TargetDatum=%u(%s) TargetDisplacement=0x%lx\n",
-                                            EndData,
-                                            FrameDatum,
-                                            (frame_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index):"",
-                                            TargetDatum,
-                                            (target_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index):"",
-                                            TargetDisplacement);
-                                }
-
-                                if (frame_segdef != NULL && target_segdef != NULL) {
-                                    const char *framename = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index);
-                                    const char *targetname = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index);
-
-                                    if (verbose)
-                                        fprintf(stderr,"'%s' vs '%s'\n",framename,targetname);
-
-                                    if (*framename != 0 && *targetname != 0) {
-                                        struct link_segdef *frameseg,*targseg;
-
-                                        targseg = find_link_segment(targetname);
-                                        frameseg = find_link_segment(framename);
-                                        if (targseg != NULL && frameseg != NULL) {
-                                            entry_seg_ofs = TargetDisplacement;
-
-                                            assert(frameseg->fragments_count != 0);
-                                            entry_seg_link_frame_fragment = frameseg->fragments_count - 1u;
-
-                                            assert(targseg->fragments_count != 0);
-                                            entry_seg_link_target_fragment = targseg->fragments_count - 1u;
-
-                                            entry_seg_link_target_name = strdup(targetname);
-                                            entry_seg_link_target = targseg;
-                                            entry_seg_link_frame_name = strdup(framename);
-                                            entry_seg_link_frame = frameseg;
-                                        }
-                                        else {
-                                            fprintf(stderr,"Did not find segments\n");
-                                        }
-                                    }
-                                    else {
-                                        fprintf(stderr,"frame/target name not found\n");
-                                    }
-                                }
-                                else {
-                                    fprintf(stderr,"frame/target segdef not found\n");
-                                }
-                            }
-                        } break;
+                        link_stats_phase(LINK_PHASE_GATHER);
+                        if (pass == PASS_GATHER)
+                            modend_add(omf_state);
+                        break;
  
                     default:
                         break;
@@ -2383,12 +5084,19 @@ int main(int argc,char **argv) {
                 diddump = 1;
             }
 
+            link_stats_phase(LINK_PHASE_FIXUP);
             if (apply_FIXUPP(omf_state,0,inf,current_in_mod,pass))
                 return 1;
+            link_stats_phase(pass == PASS_GATHER ? LINK_PHASE_GATHER : LINK_PHASE_BUILD);
+            if (pass == PASS_GATHER && link_modules_ok && !modcached) {
+                if (link_module_finish(&link_modules,omf_state,inf,current_in_mod) < 0)
+                    link_modules_fail();
+            }
             omf_fixupps_context_free_entries(&omf_state->FIXUPPs);
 
             omf_context_clear(omf_state);
             omf_state = omf_context_destroy(omf_state);
+            omf_reader = omf_reader_destroy(omf_reader);
 
             close(fd);
         }
@@ -2396,6 +5104,8 @@ int main(int argc,char **argv) {
         if (pass == PASS_GATHER) {
             unsigned long file_baseofs = 0;
 
+            link_stats_phase(LINK_PHASE_ARRANGE);
+
             if (output_format == OFMT_EXE || output_format == OFMT_DOSDRVEXE) {
                 struct link_segdef *stacksg = find_link_segment_by_class_last("STACK");
 
@@ -2608,7 +5318,7 @@ int main(int argc,char **argv) {
                             if (sym == NULL) return 1;
                             sym->offset = 0;
                             sym->fragment = (int)(frag - &sg->fragments[0]);
-                            sym->segdef = strdup("__COM_ENTRY_JMP");
+                            sym->segdef = link_symbol_str("__COM_ENTRY_JMP");
                         }
                     }
 
@@ -2808,14 +5518,14 @@ int main(int argc,char **argv) {
                     sym = find_link_symbol("__COMREL_RELOC_TABLE",-1,-1);
                     if (sym != NULL) return 1;
                     sym = new_link_symbol("__COMREL_RELOC_TABLE");
-                    sym->groupdef = strdup("DGROUP");
+                    sym->groupdef = link_symbol_str("DGROUP");
                     if (tsg != NULL) {
-                        sym->segdef = strdup("__COMREL_RELOCTBL");
+                        sym->segdef = link_symbol_str("__COMREL_RELOCTBL");
                         sym->fragment = tsg->fragments_count-1;
                         sym->offset = ro - tfrag->offset;
                     }
                     else {
-                        sym->segdef = strdup("__COMREL_RELOC");
+                        sym->segdef = link_symbol_str("__COMREL_RELOC");
                         sym->fragment = sg->fragments_count-1;
                         sym->offset = ro - frag->offset;
                     }
@@ -2823,8 +5533,8 @@ int main(int argc,char **argv) {
                     sym = find_link_symbol("__COMREL_RELOC_ENTRY",-1,-1);
                     if (sym != NULL) return 1;
                     sym = new_link_symbol("__COMREL_RELOC_ENTRY");
-                    sym->groupdef = strdup("DGROUP");
-                    sym->segdef = strdup("__COMREL_RELOC");
+                    sym->groupdef = link_symbol_str("DGROUP");
+                    sym->segdef = link_symbol_str("__COMREL_RELOC");
                     sym->fragment = sg->fragments_count-1;
                     sym->offset = po - frag->offset;
 
@@ -2888,8 +5598,8 @@ int main(int argc,char **argv) {
                             sym = find_link_symbol("__COMREL_RELOC_ENTRY_STRAT",-1,-1);
                             if (sym != NULL) return 1;
                             sym = new_link_symbol("__COMREL_RELOC_ENTRY_STRAT");
-                            sym->groupdef = strdup("DGROUP");
-                            sym->segdef = strdup("__COMREL_RELOC");
+                            sym->groupdef = link_symbol_str("DGROUP");
+                            sym->segdef = link_symbol_str("__COMREL_RELOC");
                             sym->fragment = sg->fragments_count-1;
                             sym->offset = po - frag->offset;
                         }
@@ -2898,8 +5608,8 @@ int main(int argc,char **argv) {
                             sym = find_link_symbol("__COMREL_RELOC_ENTRY_INTR",-1,-1);
                             if (sym != NULL) return 1;
                             sym = new_link_symbol("__COMREL_RELOC_ENTRY_INTR");
-                            sym->groupdef = strdup("DGROUP");
-                            sym->segdef = strdup("__COMREL_RELOC");
+                            sym->groupdef = link_symbol_str("DGROUP");
+                            sym->segdef = link_symbol_str("__COMREL_RELOC");
                             sym->fragment = sg->fragments_count-1;
                             sym->offset = po + dosdrvrel_entry_point_code_intr - frag->offset;
                         }
@@ -3035,12 +5745,18 @@ int main(int argc,char **argv) {
     }
 
     dump_link_relocations();
-    dump_link_symbols();
+    if (dump_link_symbols())
+        return 1;
     dump_link_segments();
 
     qsort(link_symbols, link_symbols_count, sizeof(struct link_symbol), link_symbol_qsort_cmp);
+    if (link_symbols_rehash()) {
+        fprintf(stderr,"Unable to rebuild symbol index\n");
+        return 1;
+    }
 
     /* write output */
+    link_stats_phase(LINK_PHASE_EMIT);
     assert(out_file != NULL);
     {
         int fd;
@@ -3587,6 +6303,13 @@ int main(int argc,char **argv) {
         fprintf(map_fp,"\n");
     }
 
+#if defined(LINUX) || TARGET_MSDOS == 32
+    if (link_incremental_mode && link_state_save(argc,argv) < 0)
+        fprintf(stderr,"Unable to write link state\n");
+#endif
+
+    link_stats_report();
+
     cstr_free(&entry_seg_link_target_name);
     cstr_free(&entry_seg_link_frame_name);
 
@@ -3597,6 +6320,8 @@ int main(int argc,char **argv) {
 
     link_symbols_free();
     free_link_segments();
+    free_link_libraries();
+    free_link_modules(&link_modules);
     free_exe_relocations();
     return 0;
 }
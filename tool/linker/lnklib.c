@@ -0,0 +1,792 @@
+/* OMF librarian. Reads .OBJ and .LIB files and writes a paged OMF library:
+ * LIBHEAD, modules aligned to the page size, LIBEND, and the hashed dictionary
+ * that lnkdos16 (and other linkers) use to pick modules by public name.
+ *
+ * Modules are kept in the order given. Adding a module with the same name
+ * (THEADR) as one already in the library replaces it in place, so a library
+ * can be updated one .OBJ at a time with -u. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#include <fmt/omf/omf.h>
+#include <fmt/omf/omfcstr.h>
+
+#if defined(_MSC_VER)
+# define strcasecmp strcmpi
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
+//================================== PROGRAM ================================
+
+#define DEFAULT_PAGE_SIZE               16u
+#define MAX_PAGE_SIZE                   32768u
+
+struct lib_module {
+    char*                               name;           /* THEADR name (interned) */
+    unsigned char*                      data;           /* THEADR through MODEND, as records */
+    unsigned long                       size;
+    unsigned long                       alloc;
+    char**                              publics;        /* global PUBDEF names (interned) */
+    unsigned int                        publics_count;
+    unsigned int                        publics_alloc;
+    unsigned long                       page;           /* where it was written, in pages */
+};
+
+static struct lib_module**              lib_modules = NULL;
+static unsigned int                     lib_modules_count = 0;
+static unsigned int                     lib_modules_alloc = 0;
+
+static struct omf_strpool_t             lib_strings;
+
+static char*                            out_file = NULL;
+static char                             out_tmpfile[1024];
+
+static unsigned int                     page_size = DEFAULT_PAGE_SIZE;
+static unsigned char                    lib_flags = 0;
+static unsigned char                    page_size_set = 0;  /* -p given */
+static unsigned char                    lib_flags_set = 0;  /* -cs given */
+static char*                            update_file = NULL; /* -u, keeps its settings unless -p or -cs say otherwise */
+static unsigned char                    list_modules = 0;
+static unsigned char                    verbose = 0;
+
+static void free_lib_module(struct lib_module *mod) {
+    if (mod->data != NULL) {
+        free(mod->data);
+        mod->data = NULL;
+    }
+    if (mod->publics != NULL) {
+        free(mod->publics);
+        mod->publics = NULL;
+    }
+    mod->publics_count = 0;
+    mod->publics_alloc = 0;
+    mod->size = 0;
+    mod->alloc = 0;
+    mod->name = NULL; /* lib_strings owns it */
+}
+
+static void free_lib_modules(void) {
+    unsigned int i;
+
+    if (lib_modules != NULL) {
+        for (i=0;i < lib_modules_count;i++) {
+            if (lib_modules[i] != NULL) {
+                free_lib_module(lib_modules[i]);
+                free(lib_modules[i]);
+            }
+        }
+
+        free(lib_modules);
+        lib_modules = NULL;
+    }
+
+    lib_modules_count = 0;
+    lib_modules_alloc = 0;
+}
+
+static int lib_module_name_cmp(const char *a,const char *b) {
+    if (lib_flags & OMF_LIB_FLAG_CASE_SENSITIVE)
+        return strcmp(a,b);
+
+    return strcasecmp(a,b);
+}
+
+static int lib_module_find(const char *name) {
+    unsigned int i;
+
+    for (i=0;i < lib_modules_count;i++) {
+        if (!lib_module_name_cmp(lib_modules[i]->name,name))
+            return (int)i;
+    }
+
+    return -1;
+}
+
+/* take ownership of mod. a module of the same name is replaced where it is */
+static int lib_module_add(struct lib_module *mod,const char *path) {
+    int i;
+
+    if ((i=lib_module_find(mod->name)) >= 0) {
+        if (verbose)
+            fprintf(stderr,"Replacing module %s with the one from %s\n",mod->name,path);
+
+        free_lib_module(lib_modules[i]);
+        free(lib_modules[i]);
+        lib_modules[i] = mod;
+        return 0;
+    }
+
+    if (lib_modules_count >= lib_modules_alloc) {
+        unsigned int nalloc = (lib_modules_alloc == 0) ? 64u : (lib_modules_alloc * 2u);
+        struct lib_module **n = (struct lib_module**)realloc(lib_modules,sizeof(struct lib_module*) * nalloc);
+
+        if (n == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return -1;
+        }
+
+        lib_modules = n;
+        lib_modules_alloc = nalloc;
+    }
+
+    if (verbose)
+        fprintf(stderr,"Adding module %s from %s\n",mod->name,path);
+
+    lib_modules[lib_modules_count++] = mod;
+    return 0;
+}
+
+static int lib_module_remove(const char *name) {
+    int i;
+
+    if ((i=lib_module_find(name)) < 0) {
+        fprintf(stderr,"Module %s is not in the library\n",name);
+        return -1;
+    }
+
+    if (verbose)
+        fprintf(stderr,"Removing module %s\n",lib_modules[i]->name);
+
+    free_lib_module(lib_modules[i]);
+    free(lib_modules[i]);
+    lib_modules_count--;
+    if ((unsigned int)i < lib_modules_count)
+        memmove(lib_modules+i,lib_modules+i+1,sizeof(struct lib_module*) * (lib_modules_count - (unsigned int)i));
+
+    return 0;
+}
+
+/* append the record just read, as it was in the file (header, contents, checksum) */
+static int lib_module_append_record(struct lib_module *mod,const struct omf_record_t *rec) {
+    const unsigned long len = 3ul + (unsigned long)rec->reclen + 1ul;
+    unsigned char *d;
+
+    if ((mod->size + len) > mod->alloc) {
+        unsigned long nalloc = (mod->alloc == 0) ? 4096ul : mod->alloc;
+
+        while ((mod->size + len) > nalloc) nalloc *= 2ul;
+        if ((d=(unsigned char*)realloc(mod->data,(size_t)nalloc)) == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return -1;
+        }
+
+        mod->data = d;
+        mod->alloc = nalloc;
+    }
+
+    d = mod->data + mod->size;
+    d[0] = rec->rectype;
+    d[1] = (unsigned char)((rec->reclen + 1u) & 0xFFu);
+    d[2] = (unsigned char)(((rec->reclen + 1u) >> 8u) & 0xFFu);
+    memcpy(d+3,rec->data,(size_t)rec->reclen + 1u/*checksum*/);
+    mod->size += len;
+    return 0;
+}
+
+static int lib_module_add_public(struct lib_module *mod,const char *name) {
+    if (mod->publics_count >= mod->publics_alloc) {
+        unsigned int nalloc = (mod->publics_alloc == 0) ? 32u : (mod->publics_alloc * 2u);
+        char **n = (char**)realloc(mod->publics,sizeof(char*) * nalloc);
+
+        if (n == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return -1;
+        }
+
+        mod->publics = n;
+        mod->publics_alloc = nalloc;
+    }
+
+    if ((mod->publics[mod->publics_count]=omf_strpool_add(&lib_strings,name,strlen(name))) == NULL) {
+        fprintf(stderr,"Out of memory\n");
+        return -1;
+    }
+
+    mod->publics_count++;
+    return 0;
+}
+
+/* read one module, THEADR through MODEND. returns 1 if a module was read, 0 if there are no more */
+static int lib_read_module(struct omf_context_t *ctx,struct omf_reader_t *rdr,const char *path) {
+    struct lib_module *mod = NULL;
+    unsigned int i;
+    int first,ret;
+
+    while ((ret=omf_context_read_reader(ctx,rdr)) > 0) {
+        if (ctx->record.rectype == OMF_RECTYPE_LIBHEAD)
+            continue; /* the dictionary is rebuilt from the modules, not copied */
+        if (ctx->record.rectype == OMF_RECTYPE_LIBEND)
+            break;
+
+        if (mod == NULL) {
+            if (ctx->record.rectype != OMF_RECTYPE_THEADR) {
+                fprintf(stderr,"%s: module does not start with THEADR\n",path);
+                return -1;
+            }
+            if ((mod=(struct lib_module*)calloc(1,sizeof(struct lib_module))) == NULL) {
+                fprintf(stderr,"Out of memory\n");
+                return -1;
+            }
+        }
+
+        if (lib_module_append_record(mod,&ctx->record) < 0)
+            goto fail;
+
+        switch (ctx->record.rectype) {
+            case OMF_RECTYPE_THEADR:/*0x80*/
+                if (omf_context_parse_THEADR(ctx,&ctx->record) < 0) {
+                    fprintf(stderr,"Error parsing THEADR in %s\n",path);
+                    goto fail;
+                }
+                if (mod->name == NULL) {
+                    if ((mod->name=omf_strpool_add(&lib_strings,ctx->THEADR ? ctx->THEADR : "",ctx->THEADR ? strlen(ctx->THEADR) : 0)) == NULL) {
+                        fprintf(stderr,"Out of memory\n");
+                        goto fail;
+                    }
+                }
+                break;
+            case OMF_RECTYPE_PUBDEF:/*0x90*/
+            case OMF_RECTYPE_PUBDEF32:/*0x91*/
+                if ((first=omf_context_parse_PUBDEF(ctx,&ctx->record)) < 0) {
+                    fprintf(stderr,"Error parsing PUBDEF in %s\n",path);
+                    goto fail;
+                }
+
+                for (i=(unsigned int)first;i <= ctx->PUBDEFs.omf_PUBDEFS_count;i++) {
+                    const struct omf_pubdef_t *pub = omf_pubdefs_context_get_pubdef(&ctx->PUBDEFs,i);
+
+                    if (pub != NULL && pub->name_string != NULL && pub->type == OMF_PUBDEF_TYPE_GLOBAL) {
+                        if (lib_module_add_public(mod,pub->name_string) < 0)
+                            goto fail;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (ret < 0) {
+        fprintf(stderr,"Error reading %s: %s\n",path,strerror(errno));
+        if (ctx->last_error != NULL) fprintf(stderr,"Details: %s\n",ctx->last_error);
+        goto fail;
+    }
+
+    if (mod == NULL)
+        return 0;
+
+    if (!omf_record_is_modend(&ctx->record)) {
+        fprintf(stderr,"%s: module %s does not end with MODEND\n",path,mod->name);
+        goto fail;
+    }
+
+    if (lib_module_add(mod,path) < 0)
+        goto fail;
+
+    return 1;
+fail:
+    if (mod != NULL) {
+        free_lib_module(mod);
+        free(mod);
+    }
+    return -1;
+}
+
+/* read the LIBHEAD of a .LIB file. returns 1 if read, 0 if the file is not a library */
+static int lib_read_header(const char *path,struct omf_lib_header_t *hdr) {
+    struct omf_context_t *ctx = NULL;
+    struct omf_reader_t *rdr = NULL;
+    int fd,ret = -1;
+
+    fd = open(path,O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr,"Failed to open input file %s: %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    if ((ctx=omf_context_create()) == NULL || (rdr=omf_reader_create()) == NULL ||
+        omf_reader_open_fd(rdr,fd,OMF_READER_ZERO_COPY) < 0) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        goto done;
+    }
+
+    omf_context_begin_file(ctx);
+    memset(hdr,0,sizeof(*hdr));
+
+    ret = 0;
+    if (omf_context_read_reader(ctx,rdr) > 0 && ctx->record.rectype == OMF_RECTYPE_LIBHEAD) {
+        if (omf_lib_parse_LIBHEAD(hdr,&ctx->record) < 0) {
+            fprintf(stderr,"%s: bad LIBHEAD\n",path);
+            ret = -1;
+        }
+        else {
+            ret = 1;
+        }
+    }
+done:
+    if (ctx != NULL) {
+        omf_context_clear(ctx);
+        ctx = omf_context_destroy(ctx);
+    }
+    rdr = omf_reader_destroy(rdr);
+    close(fd);
+    return ret;
+}
+
+/* add every module in an .OBJ or .LIB file */
+static int lib_read_file(const char *path) {
+    struct omf_context_t *ctx = NULL;
+    struct omf_reader_t *rdr = NULL;
+    unsigned int count = 0;
+    int fd,ret = -1,rr;
+
+    fd = open(path,O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr,"Failed to open input file %s: %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    if ((ctx=omf_context_create()) == NULL || (rdr=omf_reader_create()) == NULL ||
+        omf_reader_open_fd(rdr,fd,OMF_READER_ZERO_COPY) < 0) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        goto done;
+    }
+
+    omf_context_begin_file(ctx);
+
+    do {
+        omf_context_begin_module(ctx);
+        if ((rr=lib_read_module(ctx,rdr,path)) < 0)
+            goto done;
+        if (rr == 0)
+            break;
+
+        count++;
+        if (ctx->library_block_size != 0ul) {
+            if (omf_context_next_lib_module_reader(ctx,rdr) <= 0)
+                break;
+        }
+        else {
+            /* .OBJ files may hold more than one module, back to back */
+            if (omf_context_seek_lib_module_reader(ctx,rdr,omf_reader_tell(rdr)) < 0)
+                break;
+        }
+    } while (1);
+
+    if (count == 0)
+        fprintf(stderr,"Warning: no modules in %s\n",path);
+
+    ret = 0;
+done:
+    if (ctx != NULL) {
+        omf_context_clear(ctx);
+        ctx = omf_context_destroy(ctx);
+    }
+    rdr = omf_reader_destroy(rdr);
+    close(fd);
+    return ret;
+}
+
+/* assign pages to modules. returns the file offset of LIBEND, or 0 if a page number
+ * does not fit in 16 bits at this page size */
+static unsigned long lib_layout(void) {
+    unsigned long ofs = (unsigned long)page_size; /* LIBHEAD */
+    unsigned int i;
+
+    for (i=0;i < lib_modules_count;i++) {
+        struct lib_module *mod = lib_modules[i];
+
+        mod->page = ofs / (unsigned long)page_size;
+        if (mod->page > 0xFFFFul)
+            return 0;
+
+        ofs += mod->size;
+        ofs = (ofs + (unsigned long)page_size - 1ul) & (~((unsigned long)page_size - 1ul));
+    }
+
+    return ofs;
+}
+
+/* build the dictionary: every global public, and "module!" for every module.
+ * returns the number of blocks, 0 on error */
+static unsigned int lib_build_dict(unsigned char **pdict) {
+    unsigned long names = 0,name_bytes = 0;
+    unsigned char *dict = NULL;
+    unsigned int dict_blocks = 0;
+    char tmp[258];
+    unsigned int i,j;
+    int warn;
+
+    for (i=0;i < lib_modules_count;i++) {
+        names += 1ul + (unsigned long)lib_modules[i]->publics_count;
+        name_bytes += (unsigned long)strlen(lib_modules[i]->name) + 1ul;
+        for (j=0;j < lib_modules[i]->publics_count;j++)
+            name_bytes += (unsigned long)strlen(lib_modules[i]->publics[j]);
+    }
+
+    do {
+        /* warn about duplicates only once, on the first attempt */
+        warn = (dict_blocks == 0);
+
+        if ((dict_blocks=omf_lib_dict_blocks(names,name_bytes,dict_blocks)) == 0) {
+            fprintf(stderr,"Too many public names for the library dictionary\n");
+            goto fail;
+        }
+#if !(defined(LINUX) || TARGET_MSDOS == 32)
+        if (((unsigned long)dict_blocks * (unsigned long)OMF_LIB_DICT_BLOCK_SIZE) > 0xFFF0ul) {
+            fprintf(stderr,"Library dictionary too large\n");
+            goto fail;
+        }
+#endif
+
+        if (dict != NULL) free(dict);
+        if ((dict=(unsigned char*)malloc((size_t)dict_blocks * (size_t)OMF_LIB_DICT_BLOCK_SIZE)) == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            goto fail;
+        }
+        omf_lib_dict_init(dict,dict_blocks);
+
+        for (i=0;i < lib_modules_count;i++) {
+            const struct lib_module *mod = lib_modules[i];
+            unsigned int page;
+            size_t len;
+
+            for (j=0;j <= mod->publics_count;j++) {
+                if (j < mod->publics_count) {
+                    const char *name = mod->publics[j];
+
+                    len = strlen(name);
+                    if (len == 0 || len > 255) continue;
+                    memcpy(tmp,name,len);
+                }
+                else {
+                    len = strlen(mod->name);
+                    if (len == 0 || len > 254) continue;
+                    memcpy(tmp,mod->name,len);
+                    tmp[len++] = '!';
+                }
+
+                if (omf_lib_dict_lookup(dict,dict_blocks,lib_flags,tmp,len,&page)) {
+                    if (warn) {
+                        tmp[len] = 0;
+                        fprintf(stderr,"Warning: %s in module %s is already defined by a module at page 0x%x, not added to the dictionary\n",tmp,mod->name,page);
+                    }
+                    continue;
+                }
+
+                if (omf_lib_dict_add(dict,dict_blocks,tmp,len,(unsigned int)mod->page) <= 0)
+                    break;
+            }
+
+            if (j <= mod->publics_count)
+                break; /* dictionary full */
+        }
+    } while (i < lib_modules_count);
+
+    *pdict = dict;
+    return dict_blocks;
+fail:
+    if (dict != NULL) free(dict);
+    return 0;
+}
+
+static int lib_write_zeros(int fd,unsigned long count) {
+    static const unsigned char zero[512] = {0};
+
+    while (count > 0ul) {
+        const unsigned int todo = (count > (unsigned long)sizeof(zero)) ? (unsigned int)sizeof(zero) : (unsigned int)count;
+
+        if (write(fd,zero,todo) != (int)todo)
+            return -1;
+
+        count -= (unsigned long)todo;
+    }
+
+    return 0;
+}
+
+static int lib_write_record_header(int fd,unsigned char rectype,unsigned long pad,unsigned char *sum) {
+    unsigned char tmp[3];
+
+    tmp[0] = rectype;
+    tmp[1] = (unsigned char)(pad & 0xFFul);
+    tmp[2] = (unsigned char)((pad >> 8ul) & 0xFFul);
+    if (sum != NULL) *sum = (unsigned char)(tmp[0] + tmp[1] + tmp[2]);
+
+    return (write(fd,tmp,3) == 3) ? 0 : -1;
+}
+
+static int lib_write(const char *path) {
+    unsigned char *dict = NULL;
+    unsigned int dict_blocks;
+    unsigned long libend_ofs,dict_ofs,ofs,pad;
+    unsigned char hdr[8],sum;
+    unsigned int i;
+    int fd = -1,ret = -1;
+
+    /* raise the page size until every module has a 16-bit page number */
+    while ((libend_ofs=lib_layout()) == 0ul) {
+        if (page_size >= MAX_PAGE_SIZE) {
+            fprintf(stderr,"Library too large\n");
+            return -1;
+        }
+
+        page_size *= 2u;
+        if (verbose)
+            fprintf(stderr,"Page size raised to %u\n",page_size);
+    }
+
+    if ((dict_blocks=lib_build_dict(&dict)) == 0)
+        return -1;
+
+    /* LIBEND pads the file out to a 512-byte boundary, where the dictionary starts */
+    dict_ofs = (libend_ofs + 4ul + 511ul) & (~511ul);
+
+    /* write to a temporary file and rename, so that updating a library in place
+     * does not leave it half written on error */
+    {
+        char *x;
+
+        if (strlen(path) >= (sizeof(out_tmpfile) - 5))
+            goto done;
+
+        strcpy(out_tmpfile,path);
+        x = strrchr(out_tmpfile,'.');
+        if (x == NULL || strchr(x,'/') != NULL || strchr(x,'\\') != NULL)
+            x = out_tmpfile + strlen(out_tmpfile);
+        strcpy(x,".$$$");
+    }
+
+    fd = open(out_tmpfile,O_RDWR|O_BINARY|O_CREAT|O_TRUNC,0644);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to open output file %s: %s\n",out_tmpfile,strerror(errno));
+        goto done;
+    }
+
+    /* LIBHEAD: dictionary offset, dictionary blocks, flags, padded to one page */
+    hdr[0] = (unsigned char)(dict_ofs & 0xFFul);
+    hdr[1] = (unsigned char)((dict_ofs >> 8ul) & 0xFFul);
+    hdr[2] = (unsigned char)((dict_ofs >> 16ul) & 0xFFul);
+    hdr[3] = (unsigned char)((dict_ofs >> 24ul) & 0xFFul);
+    hdr[4] = (unsigned char)(dict_blocks & 0xFFu);
+    hdr[5] = (unsigned char)((dict_blocks >> 8u) & 0xFFu);
+    hdr[6] = lib_flags;
+    hdr[7] = 0;
+    if (lib_write_record_header(fd,OMF_RECTYPE_LIBHEAD,(unsigned long)page_size - 3ul,&sum) < 0)
+        goto werr;
+    for (i=0;i < 7;i++) sum += hdr[i];
+    if (write(fd,hdr,7) != 7 || lib_write_zeros(fd,(unsigned long)page_size - 3ul - 7ul - 1ul) < 0)
+        goto werr;
+    hdr[7] = (unsigned char)(0x100u - sum);
+    if (write(fd,hdr+7,1) != 1)
+        goto werr;
+
+    ofs = (unsigned long)page_size;
+    for (i=0;i < lib_modules_count;i++) {
+        const struct lib_module *mod = lib_modules[i];
+        const unsigned long mofs = mod->page * (unsigned long)page_size;
+
+        if (lib_write_zeros(fd,mofs - ofs) < 0)
+            goto werr;
+        if (write(fd,mod->data,(unsigned int)mod->size) != (int)mod->size)
+            goto werr;
+
+        ofs = mofs + mod->size;
+    }
+
+    if (lib_write_zeros(fd,libend_ofs - ofs) < 0)
+        goto werr;
+
+    /* LIBEND, all padding, optional (zero) checksum */
+    pad = dict_ofs - libend_ofs - 3ul;
+    if (lib_write_record_header(fd,OMF_RECTYPE_LIBEND,pad,NULL) < 0 || lib_write_zeros(fd,pad) < 0)
+        goto werr;
+
+    if (write(fd,dict,(unsigned int)dict_blocks * OMF_LIB_DICT_BLOCK_SIZE) != (int)(dict_blocks * OMF_LIB_DICT_BLOCK_SIZE))
+        goto werr;
+
+    close(fd);
+    fd = -1;
+
+    /* MS-DOS rename() will not replace an existing file */
+    unlink(path);
+    if (rename(out_tmpfile,path) < 0) {
+        fprintf(stderr,"Unable to rename %s to %s: %s\n",out_tmpfile,path,strerror(errno));
+        goto done;
+    }
+
+    if (verbose)
+        fprintf(stderr,"Wrote %s: %u modules, page size %u, %u dictionary blocks\n",path,lib_modules_count,page_size,dict_blocks);
+
+    ret = 0;
+    goto done;
+werr:
+    fprintf(stderr,"Error writing %s: %s\n",out_tmpfile,strerror(errno));
+    close(fd);
+    fd = -1;
+    unlink(out_tmpfile);
+done:
+    if (dict != NULL) free(dict);
+    return ret;
+}
+
+static void lib_list(FILE *fp) {
+    unsigned int i,j;
+
+    for (i=0;i < lib_modules_count;i++) {
+        const struct lib_module *mod = lib_modules[i];
+
+        fprintf(fp,"%-24s page 0x%04lx size %lu\n",mod->name,mod->page,mod->size);
+        for (j=0;j < mod->publics_count;j++)
+            fprintf(fp,"    %s\n",mod->publics[j]);
+    }
+}
+
+static void help(void) {
+    fprintf(stderr,"lnklib [options]\n");
+    fprintf(stderr,"  -i <file>    Add the modules of an OMF .OBJ or .LIB file, replacing\n");
+    fprintf(stderr,"               modules of the same name\n");
+    fprintf(stderr,"  -r <module>  Remove a module by name\n");
+    fprintf(stderr,"  -o <file>    Output library\n");
+    fprintf(stderr,"  -u <file>    Update a library: read it first (like -i), write it back (like -o)\n");
+    fprintf(stderr,"  -p <size>    Page size (module alignment), power of 2 (default 16)\n");
+    fprintf(stderr,"  -cs          Case sensitive dictionary\n");
+    fprintf(stderr,"  -l           List modules and public names\n");
+    fprintf(stderr,"  -v           Verbose mode\n");
+}
+
+int main(int argc,char **argv) {
+    struct omf_lib_header_t hdr;
+    unsigned char did_work = 0;
+    int i,ret = 1;
+    char *a;
+
+    omf_strpool_init(&lib_strings);
+
+    /* settings first, so that they apply to every input no matter where they are given */
+    for (i=1;i < argc;) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"i") || !strcmp(a,"r")) {
+                if (argv[i++] == NULL) goto done;
+                did_work = 1;
+            }
+            else if (!strcmp(a,"u")) {
+                update_file = out_file = argv[i++];
+                if (out_file == NULL) goto done;
+                did_work = 1;
+            }
+            else if (!strcmp(a,"o")) {
+                out_file = argv[i++];
+                if (out_file == NULL) goto done;
+            }
+            else if (!strcmp(a,"p")) {
+                a = argv[i++];
+                if (a == NULL) goto done;
+                page_size = (unsigned int)strtoul(a,NULL,0);
+                if (page_size < 16u || page_size > MAX_PAGE_SIZE || (page_size & (page_size - 1u)) != 0u) {
+                    fprintf(stderr,"Page size must be a power of 2 from 16 to %u\n",MAX_PAGE_SIZE);
+                    goto done;
+                }
+                page_size_set = 1;
+            }
+            else if (!strcmp(a,"cs")) {
+                lib_flags |= OMF_LIB_FLAG_CASE_SENSITIVE;
+                lib_flags_set = 1;
+            }
+            else if (!strcmp(a,"l")) {
+                list_modules = 1;
+            }
+            else if (!strcmp(a,"v")) {
+                verbose = 1;
+            }
+            else if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                goto done;
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                help();
+                goto done;
+            }
+        }
+        else {
+            fprintf(stderr,"Unexpected arg %s\n",a);
+            goto done;
+        }
+    }
+
+    if (!did_work) {
+        help();
+        goto done;
+    }
+
+    /* an updated library keeps its own settings unless told otherwise */
+    if (update_file != NULL && (!page_size_set || !lib_flags_set)) {
+        if ((i=lib_read_header(update_file,&hdr)) < 0)
+            goto done;
+
+        if (i > 0 && !page_size_set) {
+            if (hdr.block_size >= 16u && hdr.block_size <= MAX_PAGE_SIZE && (hdr.block_size & (hdr.block_size - 1u)) == 0u)
+                page_size = hdr.block_size;
+            else
+                fprintf(stderr,"Warning: library page size %u is not usable, using %u\n",hdr.block_size,page_size);
+        }
+        if (i > 0 && !lib_flags_set)
+            lib_flags = hdr.flags & OMF_LIB_FLAG_CASE_SENSITIVE;
+    }
+
+    /* then the inputs and removals, in order */
+    for (i=1;i < argc;) {
+        a = argv[i++];
+        do { a++; } while (*a == '-');
+
+        if (!strcmp(a,"i") || !strcmp(a,"u")) {
+            if (lib_read_file(argv[i++]) < 0) goto done;
+        }
+        else if (!strcmp(a,"r")) {
+            if (lib_module_remove(argv[i++]) < 0) goto done;
+        }
+        else if (!strcmp(a,"o") || !strcmp(a,"p")) {
+            i++;
+        }
+    }
+
+    if (out_file != NULL) {
+        if (lib_write(out_file) < 0)
+            goto done;
+    }
+    else if (!list_modules) {
+        fprintf(stderr,"No output file specified\n");
+        goto done;
+    }
+    else {
+        /* list only: page numbers as they would be written */
+        while (lib_layout() == 0ul && page_size < MAX_PAGE_SIZE) page_size *= 2u;
+    }
+
+    if (list_modules)
+        lib_list(stdout);
+
+    ret = 0;
+done:
+    free_lib_modules();
+    omf_strpool_free(&lib_strings);
+    return ret;
+}
@@ -23,6 +23,7 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "zlib.h"
 #include "iconv.h"
@@ -115,6 +116,13 @@ static void help(void) {
     fprintf(stderr,"  -oc <charset>            File names for target use this charset\n");
     fprintf(stderr,"  -t+                      Add trailing data descriptor\n");
     fprintf(stderr,"  -t-                      Don't write trailing descriptor\n");
+    fprintf(stderr,"  -j <n>                   Deflate files on n threads (default one per CPU)\n");
+    fprintf(stderr,"  -B <size>                Deflate files of at least size in parallel blocks\n");
+    fprintf(stderr,"  -d+                      Deflate identical files once, copy the rest (default)\n");
+    fprintf(stderr,"  -d-                      Deflate every file, even if identical to another\n");
+    fprintf(stderr,"  -n+                      Store files that look already compressed\n");
+    fprintf(stderr,"  -n-                      Deflate every file (default)\n");
+    fprintf(stderr,"  -u                       Update: copy unchanged files from the existing archive\n");
     fprintf(stderr,"\n");
     fprintf(stderr,"Spanning size can be specified in bytes, or with K, M, G, suffix.\n");
     fprintf(stderr,"With spanning, the zip file must have .zip suffix, which will be changed\n");
@@ -131,6 +139,10 @@ static void help(void) {
     fprintf(stderr,"If targeting Japanese PC-98, use -oc CP932 or -oc SHIFT-JIS.\n");
     fprintf(stderr,"You will need to specify -ic and/or -oc before listing files to archive.\n");
     fprintf(stderr,"\n");
+    fprintf(stderr,"With -u, files whose name, size, date/time and CRC match an entry in the\n");
+    fprintf(stderr,"existing --zip archive are copied from it as-is. The rest are compressed,\n");
+    fprintf(stderr,"and entries for files not listed are dropped, as if rebuilt. Not for spanning.\n");
+    fprintf(stderr,"\n");
     fprintf(stderr,"For simplistic reasons, this code only supports Deflate compression\n");
     fprintf(stderr,"with no password protection.\n");
 }
@@ -210,6 +222,28 @@ struct disk_info *disk_new(void) {
 
 #define ATTR_DOS_DIR    0x10            /* MS-DOS directory */
 
+/* compressed output held for the writer, spilled to a temp file past ZIP_CBUF_MEM_MAX */
+#define ZIP_CBUF_MEM_MAX    (4UL << 20UL)
+
+struct zip_cbuf {
+    unsigned char*      p;
+    size_t              len,alloc;
+    FILE*               spill;
+    _Bool               err;
+};
+
+/* an entry in the archive being updated (-u), from its central directory */
+struct zip_old_entry {
+    char*               name;
+    uint16_t            method;
+    uint16_t            flags;
+    uint16_t            msdos_time,msdos_date;
+    uint32_t            crc32;
+    uint32_t            compressed_size;
+    uint32_t            uncompressed_size;
+    uint32_t            local_offset;
+};
+
 struct in_file {
     char*               in_path;
     char*               zip_name;
@@ -224,6 +258,15 @@ struct in_file {
     struct in_file*     next;
 
     _Bool               data_descriptor;/* write data descriptor after file */
+    unsigned char       method;         /* compression method, 0 (stored) or 8 (deflate) */
+
+    struct in_file*     dup_of;         /* earlier file with identical contents, if any */
+    unsigned int        dup_refs;       /* later files that will copy this one's cdata */
+    struct zip_old_entry* reuse;        /* unchanged, copy from the archive being updated */
+
+    struct zip_cbuf     cdata;          /* deflated by a worker thread, for the writer */
+    int                 cresult;        /* zip_deflate_stream() result from the worker */
+    volatile _Bool      cdone;          /* worker is finished with this file */
 } in_file;
 
 struct in_file *in_file_alloc(void) {
@@ -238,7 +281,21 @@ char *in_file_set_zip_name(struct in_file *f,char *s) {
     return set_string(&f->zip_name,s);
 }
 
+void zip_cbuf_free(struct zip_cbuf *b) {
+    if (b->p != NULL) {
+        free(b->p);
+        b->p = NULL;
+    }
+    if (b->spill != NULL) {
+        fclose(b->spill);
+        b->spill = NULL;
+    }
+
+    b->len = b->alloc = 0;
+}
+
 void in_file_free(struct in_file *f) {
+    zip_cbuf_free(&f->cdata);
     clear_string(&f->in_path);
     clear_string(&f->zip_name);
     memset(f,0,sizeof(*f));
@@ -283,6 +340,11 @@ _Bool recurse = 0;
 char *codepage_in = NULL;
 char *codepage_out = NULL;
 int trailing_data_descriptor = -1;
+unsigned int deflate_threads = 0; /* -j, 0 = one per CPU */
+unsigned long block_deflate_min = 0; /* -B, 0 = never deflate in blocks */
+_Bool dedup_files = 1; /* -d */
+_Bool store_compressed = 0; /* -n */
+_Bool update_mode = 0; /* -u */
 
 unsigned int fat_start = 0;
 unsigned int data_start = 0;
@@ -316,9 +378,12 @@ unsigned long zip_out_pos(void) {
     return 0UL;
 }
 
+/* -u writes the new archive here, then renames it over zip_path when done */
+char *zip_update_tmp = NULL;
+
 int zip_out_open(void) {
     if (zip_fd < 0)
-        zip_fd = open(zip_path,O_RDWR|O_CREAT|O_TRUNC|O_BINARY,0644);
+        zip_fd = open(zip_update_tmp != NULL ? zip_update_tmp : zip_path,O_RDWR|O_CREAT|O_TRUNC|O_BINARY,0644);
 
     return (zip_fd >= 0);
 }
@@ -726,7 +791,101 @@ int zip_store(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     return 0;
 }
 
-int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+/* where zip_deflate_stream() sends the compressed data. returns 0 on success */
+typedef int (*zip_sink_t)(void *ctx,const void *buf,size_t count);
+
+int zip_sink_archive(void *ctx,const void *buf,size_t count) {
+    (void)ctx;
+    return ((size_t)zip_write_and_span(zip_fd,buf,count) == count) ? 0 : -1;
+}
+
+int zip_sink_cbuf(void *ctx,const void *buf,size_t count) {
+    struct zip_cbuf *b = (struct zip_cbuf*)ctx;
+
+    if (b->err)
+        return -1;
+
+    if (b->spill == NULL && (b->len + count) > ZIP_CBUF_MEM_MAX) {
+        if ((b->spill=tmpfile()) == NULL ||
+            (b->len != 0 && fwrite(b->p,b->len,1,b->spill) != 1)) {
+            b->err = 1;
+            return -1;
+        }
+
+        free(b->p);
+        b->p = NULL;
+        b->alloc = 0;
+    }
+
+    if (b->spill != NULL) {
+        if (fwrite(buf,count,1,b->spill) != 1) {
+            b->err = 1;
+            return -1;
+        }
+    }
+    else {
+        if ((b->len + count) > b->alloc) {
+            size_t na = (b->alloc != 0) ? (b->alloc * 2) : 65536;
+            unsigned char *np;
+
+            while (na < (b->len + count)) na *= 2;
+            if ((np=realloc(b->p,na)) == NULL) {
+                b->err = 1;
+                return -1;
+            }
+
+            b->p = np;
+            b->alloc = na;
+        }
+
+        memcpy(b->p + b->len,buf,count);
+    }
+
+    b->len += count;
+    return 0;
+}
+
+/* to the archive, and kept in the file's cdata for later identical files to copy */
+int zip_sink_archive_keep(void *ctx,const void *buf,size_t count) {
+    struct in_file *f = (struct in_file*)ctx;
+
+    if (zip_sink_archive(NULL,buf,count))
+        return -1;
+
+    /* if this fails, the copies deflate for themselves */
+    zip_sink_cbuf(&f->cdata,buf,count);
+    return 0;
+}
+
+/* write the contents of a zip_cbuf to the archive */
+int zip_cbuf_write_out(struct zip_cbuf *b) {
+    if (b->err)
+        return -1;
+
+    if (b->spill != NULL) {
+        unsigned char tmp[32768];
+        size_t rd;
+
+        rewind(b->spill);
+        while ((rd=fread(tmp,1,sizeof(tmp),b->spill)) > 0) {
+            if ((size_t)zip_write_and_span(zip_fd,tmp,rd) != rd) {
+                fprintf(stderr,"write error\n");
+                break;
+            }
+        }
+        fseek(b->spill,0,SEEK_END);
+    }
+    else if (b->len != 0) {
+        if ((size_t)zip_write_and_span(zip_fd,b->p,b->len) != b->len)
+            fprintf(stderr,"write error\n");
+    }
+
+    return 0;
+}
+
+/* deflate list->in_path into sink, setting list->crc32 and list->compressed_size.
+ * safe to call from a worker thread when sink is not zip_sink_archive. */
+int zip_deflate_stream(struct in_file *list,zip_sink_t sink,void *ctx) {
     size_t inbuffer_sz = 32768,outbuffer_sz = 32768;
     char *inbuffer,*outbuffer;
     unsigned long total = 0;
@@ -741,8 +900,6 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     memset(&z,0,sizeof(z));
     assert(list->in_path != NULL);
 
-    lfh->uncompressed_size = list->file_size;
-
     src_fd = open(list->in_path,O_RDONLY|O_BINARY);
     if (src_fd < 0) {
         fprintf(stderr,"Cannot open %s, %s\n",list->in_path,strerror(errno));
@@ -783,7 +940,7 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
             assert((char*)z.next_out <= (outbuffer+outbuffer_sz));
             wd = (size_t)((char*)z.next_out - (char*)outbuffer);
             if (wd > 0) {
-                if ((size_t)zip_write_and_span(zip_fd,outbuffer,wd) != wd) {
+                if (sink(ctx,outbuffer,wd)) {
                     fprintf(stderr,"write error\n");
                     break;
                 }
@@ -811,7 +968,7 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
         assert((char*)z.next_out <= (outbuffer+outbuffer_sz));
         wd = (size_t)((char*)z.next_out - (char*)outbuffer);
         if (wd > 0) {
-            if ((size_t)zip_write_and_span(zip_fd,outbuffer,wd) != wd) {
+            if (sink(ctx,outbuffer,wd)) {
                 fprintf(stderr,"write error\n");
                 break;
             }
@@ -830,14 +987,864 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     if (deflateEnd(&z) != Z_OK)
         fprintf(stderr,"deflateEnd() error\n");
 
-    lfh->crc32 = list->crc32 = zipcrc_finalize(crc32);
-    list->compressed_size = lfh->compressed_size = total;
+    list->crc32 = zipcrc_finalize(crc32);
+    list->compressed_size = total;
     close(src_fd);
     free(inbuffer);
     free(outbuffer);
     return 0;
 }
 
+int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    lfh->uncompressed_size = list->file_size;
+
+    if (list->dup_refs != 0) {
+        if (zip_deflate_stream(list,zip_sink_archive_keep,list))
+            return -1;
+    }
+    else {
+        if (zip_deflate_stream(list,zip_sink_archive,NULL))
+            return -1;
+    }
+
+    lfh->crc32 = list->crc32;
+    lfh->compressed_size = list->compressed_size;
+    return 0;
+}
+
+/* does the file look like it is already compressed? known archive and compressed
+ * format signatures first, then whether the start of it shrinks at all at level 1. */
+_Bool zip_probe_compressed(const struct in_file *f) {
+    static const struct { unsigned char ofs,len; const char *sig; } sigs[] = {
+        { 0, 4, "PK\x03\x04" },                   /* ZIP */
+        { 0, 2, "\x1F\x8B" },                      /* gzip */
+        { 0, 3, "BZh" },                            /* bzip2 */
+        { 0, 6, "\xFD" "7zXZ\x00" },                /* xz */
+        { 0, 6, "7z\xBC\xAF\x27\x1C" },             /* 7-Zip */
+        { 0, 4, "\x28\xB5\x2F\xFD" },               /* zstd */
+        { 0, 6, "Rar!\x1A\x07" },                  /* RAR */
+        { 0, 2, "\x60\xEA" },                      /* ARJ */
+        { 2, 3, "-lh" },                            /* LHA/LZH */
+        { 0, 3, "\xFF\xD8\xFF" },                   /* JPEG */
+        { 0, 4, "\x89PNG" },                        /* PNG */
+        { 0, 4, "GIF8" },                           /* GIF */
+        { 0, 4, "OggS" },                           /* Ogg */
+        { 0, 4, "fLaC" }                            /* FLAC */
+    };
+    size_t sample_sz = 65536,rd = 0,i;
+    unsigned char *in,*out;
+    _Bool res = 0;
+    z_stream z;
+    ssize_t r;
+    int src_fd;
+
+    /* not worth it for small files */
+    if (f->file_size < 4096)
+        return 0;
+
+    src_fd = open(f->in_path,O_RDONLY|O_BINARY);
+    if (src_fd < 0)
+        return 0;
+
+    in = malloc(sample_sz);
+    out = malloc(sample_sz + 1024);
+    if (in == NULL || out == NULL)
+        goto done;
+
+    while (rd < sample_sz && (r=read(src_fd,in + rd,sample_sz - rd)) > 0)
+        rd += (size_t)r;
+
+    for (i=0;i < (sizeof(sigs)/sizeof(sigs[0]));i++) {
+        if (rd >= (size_t)(sigs[i].ofs + sigs[i].len) && !memcmp(in + sigs[i].ofs,sigs[i].sig,sigs[i].len)) {
+            res = 1;
+            goto done;
+        }
+    }
+
+    memset(&z,0,sizeof(z));
+    if (deflateInit2(&z,1,Z_DEFLATED,-15/*window, raw*/,8/*memlevel*/,Z_DEFAULT_STRATEGY) == Z_OK) {
+        z.next_in = in;
+        z.avail_in = (uInt)rd;
+        z.next_out = out;
+        z.avail_out = (uInt)(sample_sz + 1024);
+        if (deflate(&z,Z_FINISH) == Z_STREAM_END) {
+            /* less than 2% saved, not worth deflating */
+            if ((z.total_out * 100UL) >= (rd * 98UL))
+                res = 1;
+        }
+
+        deflateEnd(&z);
+    }
+
+done:
+    if (in != NULL) free(in);
+    if (out != NULL) free(out);
+    close(src_fd);
+    return res;
+}
+
+/* nonzero if the two files have identical contents */
+int zip_files_equal(const char *a,const char *b) {
+    unsigned char *ba = NULL,*bb = NULL;
+    size_t buffer_sz = 65536;
+    int fa,fb,ret = 0;
+    ssize_t ra,rb;
+
+    fa = open(a,O_RDONLY|O_BINARY);
+    fb = open(b,O_RDONLY|O_BINARY);
+    ba = malloc(buffer_sz);
+    bb = malloc(buffer_sz);
+    if (fa >= 0 && fb >= 0 && ba != NULL && bb != NULL) {
+        do {
+            ra = read(fa,ba,buffer_sz);
+            rb = read(fb,bb,buffer_sz);
+            if (ra != rb || ra < 0) break;
+            if (ra == 0) { ret = 1; break; }
+        } while (!memcmp(ba,bb,(size_t)ra));
+    }
+
+    if (ba != NULL) free(ba);
+    if (bb != NULL) free(bb);
+    if (fa >= 0) close(fa);
+    if (fb >= 0) close(fb);
+    return ret;
+}
+
+/* CRC of the whole file, for matching up identical files. returns 0 on success */
+int zip_file_crc(const char *path,uint32_t *crc) {
+    size_t buffer_sz = 65536;
+    zipcrc_t c = zipcrc_init();
+    char *buffer;
+    int src_fd;
+    ssize_t rd;
+
+    src_fd = open(path,O_RDONLY|O_BINARY);
+    if (src_fd < 0)
+        return -1;
+
+    buffer = malloc(buffer_sz);
+    if (buffer == NULL) {
+        close(src_fd);
+        return -1;
+    }
+
+    while ((rd=read(src_fd,buffer,buffer_sz)) > 0)
+        c = zipcrc_update(c,buffer,(size_t)rd);
+
+    *crc = zipcrc_finalize(c);
+    free(buffer);
+    close(src_fd);
+    return (rd < 0) ? -1 : 0;
+}
+
+struct zip_dedup_ent {
+    struct in_file*     f;
+    unsigned long       index;          /* position in the file list */
+    uint32_t            crc32;
+    _Bool               crc_ok;
+};
+
+static int zip_dedup_ent_cmp(const void *a,const void *b) {
+    const struct zip_dedup_ent *ea = (const struct zip_dedup_ent*)a;
+    const struct zip_dedup_ent *eb = (const struct zip_dedup_ent*)b;
+
+    if (ea->f->file_size != eb->f->file_size)
+        return (ea->f->file_size < eb->f->file_size) ? -1 : 1;
+    if (ea->crc32 != eb->crc32)
+        return (ea->crc32 < eb->crc32) ? -1 : 1;
+    if (ea->index != eb->index)
+        return (ea->index < eb->index) ? -1 : 1;
+
+    return 0;
+}
+
+/* choose the compression method for each file, and find files with identical contents so that
+ * only the first of them is deflated. only files that share a size are read to compare. */
+int zip_file_list_dedup(void) {
+    struct zip_dedup_ent *ents;
+    unsigned long count = 0,i,j,k;
+    struct in_file *f;
+
+    for (f=file_list_head;f;f=f->next) {
+        f->method = (deflate_mode > 0 && !(f->attr & ATTR_DOS_DIR)) ? 8 : 0;
+        if (f->method == 8 && f->file_size != 0)
+            count++;
+    }
+
+    if (!dedup_files || count < 2)
+        return 0;
+
+    ents = calloc(count,sizeof(*ents));
+    if (ents == NULL)
+        return -1;
+
+    for (f=file_list_head,i=0,k=0;f;f=f->next,k++) {
+        if (f->method == 8 && f->file_size != 0) {
+            ents[i].f = f;
+            ents[i].index = k;
+            i++;
+        }
+    }
+
+    /* by size, then CRC where two or more files are the same size */
+    qsort(ents,count,sizeof(*ents),zip_dedup_ent_cmp);
+    for (i=0;i < count;i = j) {
+        for (j=i+1;j < count && ents[j].f->file_size == ents[i].f->file_size;j++);
+        if ((j - i) < 2)
+            continue;
+
+        for (k=i;k < j;k++)
+            ents[k].crc_ok = (zip_file_crc(ents[k].f->in_path,&ents[k].crc32) == 0);
+
+        qsort(ents + i,j - i,sizeof(*ents),zip_dedup_ent_cmp);
+    }
+
+    /* same size and CRC, in list order. confirm byte for byte against the first of the run */
+    for (i=0;i < count;i++) {
+        struct zip_dedup_ent *o = &ents[i];
+
+        if (!o->crc_ok || o->f->dup_of != NULL)
+            continue;
+
+        for (j=i+1;j < count && ents[j].f->file_size == o->f->file_size && ents[j].crc32 == o->crc32;j++) {
+            if (!ents[j].crc_ok || ents[j].f->dup_of != NULL)
+                continue;
+
+            if (zip_files_equal(o->f->in_path,ents[j].f->in_path)) {
+                ents[j].f->dup_of = o->f;
+                o->f->dup_refs++;
+            }
+        }
+    }
+
+    free(ents);
+    return 0;
+}
+
+/* Update mode (-u): the old archive's central directory is read before anything is written.
+ * Files whose name, size, MS-DOS date/time, compression method and CRC match an old entry have
+ * that entry's compressed data copied as-is, without decompressing or compressing anything. */
+static struct zip_old_entry*    zip_old = NULL;
+static unsigned long            zip_old_count = 0;
+static int                      zip_old_fd = -1;
+
+static int zip_old_entry_cmp(const void *a,const void *b) {
+    return strcmp(((const struct zip_old_entry*)a)->name,((const struct zip_old_entry*)b)->name);
+}
+
+void zip_update_close(void) {
+    unsigned long i;
+
+    if (zip_old != NULL) {
+        for (i=0;i < zip_old_count;i++)
+            clear_string(&zip_old[i].name);
+
+        free(zip_old);
+        zip_old = NULL;
+    }
+    zip_old_count = 0;
+
+    if (zip_old_fd >= 0) {
+        close(zip_old_fd);
+        zip_old_fd = -1;
+    }
+
+    clear_string(&zip_update_tmp);
+}
+
+/* read the central directory of the archive to update. returns 0 if it was read, or if
+ * there is nothing to update from (not there, or not an archive), -1 on error */
+int zip_update_open(void) {
+    struct pkzip_central_directory_header_end ehdr;
+    unsigned char *tail = NULL,*cdir = NULL;
+    unsigned long fsz,tail_sz,i,ofs;
+    off_t sz;
+    long e;
+
+    zip_update_tmp = malloc(strlen(zip_path) + 5);
+    if (zip_update_tmp == NULL)
+        return -1;
+    sprintf(zip_update_tmp,"%s.tmp",zip_path);
+
+    zip_old_fd = open(zip_path,O_RDONLY|O_BINARY);
+    if (zip_old_fd < 0)
+        return 0;
+
+    if ((sz=lseek(zip_old_fd,0,SEEK_END)) < (off_t)sizeof(ehdr))
+        goto not_zip;
+    fsz = (unsigned long)sz;
+
+    /* the end record is in the last 64KB + 22 bytes, depending on the comment length */
+    tail_sz = fsz;
+    if (tail_sz > (0xFFFFUL + sizeof(ehdr)))
+        tail_sz = 0xFFFFUL + sizeof(ehdr);
+    if ((tail=malloc(tail_sz)) == NULL)
+        goto fail;
+    if (pread(zip_old_fd,tail,tail_sz,(off_t)(fsz - tail_sz)) != (ssize_t)tail_sz)
+        goto not_zip;
+
+    for (e=(long)(tail_sz - sizeof(ehdr));e >= 0;e--) {
+        memcpy(&ehdr,tail + e,sizeof(ehdr));
+        if (ehdr.sig == PKZIP_CENTRAL_DIRECTORY_END_SIG && ((unsigned long)e + sizeof(ehdr) + ehdr.zipfile_comment_length) <= tail_sz)
+            break;
+    }
+    if (e < 0 || ehdr.number_of_this_disk != 0 || ehdr.number_of_disk_with_start_of_central_directory != 0)
+        goto not_zip;
+    if (((unsigned long)ehdr.offset_of_central_directory_from_start_disk + ehdr.size_of_central_directory) > fsz)
+        goto not_zip;
+
+    if ((cdir=malloc(ehdr.size_of_central_directory + 1)) == NULL)
+        goto fail;
+    if (pread(zip_old_fd,cdir,ehdr.size_of_central_directory,(off_t)ehdr.offset_of_central_directory_from_start_disk) != (ssize_t)ehdr.size_of_central_directory)
+        goto not_zip;
+
+    if ((zip_old=calloc(ehdr.total_number_of_entries_of_central_dir + 1,sizeof(*zip_old))) == NULL)
+        goto fail;
+
+    for (i=0,ofs=0;i < ehdr.total_number_of_entries_of_central_dir;i++) {
+        struct pkzip_central_directory_header_main chdr;
+        struct zip_old_entry *o = &zip_old[zip_old_count];
+
+        if ((ofs + sizeof(chdr)) > ehdr.size_of_central_directory)
+            goto not_zip;
+        memcpy(&chdr,cdir + ofs,sizeof(chdr));
+        if (chdr.sig != PKZIP_CENTRAL_DIRECTORY_HEADER_SIG)
+            goto not_zip;
+        if ((ofs + sizeof(chdr) + chdr.filename_length) > ehdr.size_of_central_directory)
+            goto not_zip;
+
+        if ((o->name=malloc(chdr.filename_length + 1)) == NULL)
+            goto fail;
+        memcpy(o->name,cdir + ofs + sizeof(chdr),chdr.filename_length);
+        o->name[chdr.filename_length] = 0;
+        o->method = chdr.compression_method;
+        o->flags = chdr.general_purpose_bit_flag;
+        o->msdos_time = chdr.last_mod_file_time;
+        o->msdos_date = chdr.last_mod_file_date;
+        o->crc32 = chdr.crc32;
+        o->compressed_size = chdr.compressed_size;
+        o->uncompressed_size = chdr.uncompressed_size;
+        o->local_offset = chdr.relative_offset_of_local_header;
+        zip_old_count++;
+
+        ofs += sizeof(chdr) + chdr.filename_length + chdr.extra_field_length + chdr.file_comment_length;
+    }
+
+    qsort(zip_old,zip_old_count,sizeof(*zip_old),zip_old_entry_cmp);
+    free(cdir);
+    free(tail);
+    return 0;
+
+not_zip:
+    fprintf(stderr,"%s is not a ZIP archive that can be updated, rebuilding it\n",zip_path);
+    if (zip_old != NULL) {
+        while (zip_old_count > 0) clear_string(&zip_old[--zip_old_count].name);
+        free(zip_old);
+        zip_old = NULL;
+    }
+    if (cdir != NULL) free(cdir);
+    if (tail != NULL) free(tail);
+    return 0;
+fail:
+    fprintf(stderr,"out of memory\n");
+    if (cdir != NULL) free(cdir);
+    if (tail != NULL) free(tail);
+    return -1;
+}
+
+/* find the files that have not changed since the old archive was written */
+void zip_update_match(void) {
+    struct zip_old_entry key,*o;
+    struct in_file *f;
+    uint32_t crc;
+
+    if (zip_old == NULL)
+        return;
+
+    for (f=file_list_head;f;f=f->next) {
+        if (f->attr & ATTR_DOS_DIR)
+            continue;
+
+        key.name = f->zip_name;
+        o = (struct zip_old_entry*)bsearch(&key,zip_old,zip_old_count,sizeof(*zip_old),zip_old_entry_cmp);
+        if (o == NULL)
+            continue;
+
+        if (o->uncompressed_size != f->file_size || o->msdos_time != f->msdos_time || o->msdos_date != f->msdos_date)
+            continue;
+        if (o->flags & 1) /* encrypted */
+            continue;
+        /* stored may have been -n+ deciding it was already compressed */
+        if (!(o->method == f->method || (o->method == 0 && f->method == 8 && store_compressed)))
+            continue;
+        if (zip_file_crc(f->in_path,&crc) || crc != o->crc32)
+            continue;
+
+        f->reuse = o;
+        f->method = (unsigned char)o->method;
+    }
+}
+
+/* copy an unchanged file's compressed data from the old archive */
+int zip_update_copy(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    struct pkzip_local_file_header_main olh;
+    const struct zip_old_entry *o = list->reuse;
+    unsigned char tmp[32768];
+    unsigned long left,ofs;
+    ssize_t rd;
+
+    assert(o != NULL);
+
+    if (pread(zip_old_fd,&olh,sizeof(olh),(off_t)o->local_offset) != (ssize_t)sizeof(olh) || olh.sig != PKZIP_LOCAL_FILE_HEADER_SIG) {
+        fprintf(stderr,"Bad local header for %s in the archive being updated\n",o->name);
+        return -1;
+    }
+
+    ofs = o->local_offset + sizeof(olh) + olh.filename_length + olh.extra_field_length;
+    left = o->compressed_size;
+    while (left > 0) {
+        rd = pread(zip_old_fd,tmp,(left < sizeof(tmp)) ? (size_t)left : sizeof(tmp),(off_t)ofs);
+        if (rd <= 0) {
+            fprintf(stderr,"Read error copying %s from the archive being updated\n",o->name);
+            return -1;
+        }
+
+        if ((size_t)zip_write_and_span(zip_fd,tmp,(size_t)rd) != (size_t)rd) {
+            fprintf(stderr,"write error\n");
+            break;
+        }
+
+        /* identical files later on copy it from here */
+        if (list->dup_refs != 0)
+            zip_sink_cbuf(&list->cdata,tmp,(size_t)rd);
+
+        ofs += (unsigned long)rd;
+        left -= (unsigned long)rd;
+    }
+
+    lfh->uncompressed_size = list->file_size;
+    lfh->crc32 = list->crc32 = o->crc32;
+    lfh->compressed_size = list->compressed_size = o->compressed_size;
+    return 0;
+}
+
+unsigned int zip_thread_count(void) {
+    unsigned int nthreads = deflate_threads;
+
+    if (nthreads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (n > 0) ? (unsigned int)n : 1u;
+    }
+    if (nthreads > 64u)
+        nthreads = 64u;
+
+    return nthreads;
+}
+
+/* files deflated as independent blocks by zip_deflate_blocks() instead of one zlib stream */
+_Bool zip_deflate_in_blocks(const struct in_file *f) {
+    return block_deflate_min != 0 && f->file_size >= block_deflate_min;
+}
+
+/* Parallel deflate: worker threads deflate files ahead of the writer into memory (or a spill
+ * file), and the writer emits them in list order through zip_write_and_span(). zlib is given
+ * exactly the same input in the same chunks either way, so the archive is byte-identical to
+ * the serial path. Workers stay at most jobs_window files ahead of the writer to bound memory. */
+static struct in_file*          jobs_next = NULL;
+static unsigned long            jobs_taken = 0;
+static unsigned long            jobs_written = 0;
+static unsigned long            jobs_window = 0;
+static pthread_mutex_t          jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           jobs_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t                jobs_threads[64];
+static unsigned int             jobs_thread_count = 0;
+static unsigned int             jobs_busy = 0;          /* workers deflating a file right now */
+
+/* number of file workers busy deflating, which the block deflate threads leave room for.
+ * at most limit, so a group always gets at least one thread */
+unsigned int zip_deflate_threads_busy(unsigned int limit) {
+    unsigned int n;
+
+    if (jobs_thread_count == 0)
+        return 0;
+
+    pthread_mutex_lock(&jobs_lock);
+    n = jobs_busy;
+    pthread_mutex_unlock(&jobs_lock);
+
+    return (n > limit) ? limit : n;
+}
+
+/* Block deflate (pigz style): the file is cut into ZIP_BLOCK_SIZE blocks which are deflated on
+ * worker threads as separate raw streams, each primed with the 32KB of input before it. Every
+ * block but the last ends with a sync flush, which leaves the stream byte aligned with no final
+ * block, so the blocks concatenate into one valid deflate stream. Block CRCs are joined with
+ * crc32_combine(). The output differs from a single stream, which is why it is opt-in (-B). */
+#define ZIP_BLOCK_SIZE      (128UL << 10UL)
+#define ZIP_BLOCK_DICT      (32UL << 10UL)
+
+struct zip_block {
+    const unsigned char*    in;         /* block input, with dict_len bytes of dictionary before it */
+    size_t                  in_len,dict_len;
+    unsigned char*          out;
+    size_t                  out_len,out_alloc;
+    uint32_t                crc32;
+    _Bool                   last;
+    int                     result;
+};
+
+static struct zip_block*        blocks = NULL;
+static unsigned int             blocks_count = 0;
+static unsigned int             blocks_next = 0;
+static pthread_mutex_t          blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int zip_deflate_block(struct zip_block *b) {
+    z_stream z;
+    int x;
+
+    memset(&z,0,sizeof(z));
+    if (deflateInit2(&z,deflate_mode,Z_DEFLATED,-15/*window, raw*/,8/*memlevel*/,Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    if (b->dict_len != 0 && deflateSetDictionary(&z,b->in - b->dict_len,(uInt)b->dict_len) != Z_OK) {
+        deflateEnd(&z);
+        return -1;
+    }
+
+    b->out_len = 0;
+    z.next_in = (unsigned char*)b->in;
+    z.avail_in = (uInt)b->in_len;
+    do {
+        if (b->out_len == b->out_alloc) {
+            size_t na = (b->out_alloc != 0) ? (b->out_alloc * 2) : ((size_t)deflateBound(&z,(uLong)b->in_len) + 64);
+            unsigned char *np = realloc(b->out,na);
+
+            if (np == NULL) {
+                deflateEnd(&z);
+                return -1;
+            }
+
+            b->out = np;
+            b->out_alloc = na;
+        }
+
+        z.next_out = b->out + b->out_len;
+        z.avail_out = (uInt)(b->out_alloc - b->out_len);
+        x = deflate(&z,b->last ? Z_FINISH : Z_SYNC_FLUSH);
+        b->out_len = (size_t)(z.next_out - b->out);
+
+        if (x != Z_OK && x != Z_STREAM_END && x != Z_BUF_ERROR) {
+            deflateEnd(&z);
+            return -1;
+        }
+        /* a flush is complete once deflate() leaves output space unused */
+    } while (b->last ? (x != Z_STREAM_END) : (z.avail_out == 0));
+
+    deflateEnd(&z);
+    b->crc32 = zipcrc_finalize(zipcrc_update(zipcrc_init(),b->in,b->in_len));
+    return 0;
+}
+
+static void *zip_deflate_block_thread(void *arg) {
+    unsigned int i;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&blocks_lock);
+        i = blocks_next++;
+        pthread_mutex_unlock(&blocks_lock);
+
+        if (i < blocks_count)
+            blocks[i].result = zip_deflate_block(&blocks[i]);
+    } while (i < blocks_count);
+
+    return NULL;
+}
+
+int zip_deflate_blocks(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    unsigned int nthreads,group_blocks,started,i;
+    pthread_t threads[64];
+    unsigned long total = 0,total_in = 0;
+    unsigned char *buf = NULL;
+    size_t dict = 0,group_sz;
+    uLong crc = 0;
+    int src_fd,ret = 0;
+    _Bool eof = 0;
+
+    assert(list->in_path != NULL);
+
+    lfh->uncompressed_size = list->file_size;
+
+    src_fd = open(list->in_path,O_RDONLY|O_BINARY);
+    if (src_fd < 0) {
+        fprintf(stderr,"Cannot open %s, %s\n",list->in_path,strerror(errno));
+        return -1;
+    }
+
+    /* read a few blocks per thread at a time, with room for the dictionary in front */
+    nthreads = zip_thread_count();
+    group_blocks = nthreads * 4u;
+    group_sz = (size_t)group_blocks * ZIP_BLOCK_SIZE;
+    buf = malloc(ZIP_BLOCK_DICT + group_sz);
+    blocks = calloc(group_blocks,sizeof(*blocks));
+    if (buf == NULL || blocks == NULL) {
+        fprintf(stderr,"out of memory\n");
+        ret = -1;
+        goto done;
+    }
+
+    while (!eof) {
+        size_t fill = 0;
+        ssize_t rd;
+
+        while (fill < group_sz && (rd=read(src_fd,buf + ZIP_BLOCK_DICT + fill,group_sz - fill)) > 0)
+            fill += (size_t)rd;
+        if (fill < group_sz)
+            eof = 1;
+
+        /* an empty final block if the file ended exactly on the last group */
+        blocks_count = (unsigned int)((fill + ZIP_BLOCK_SIZE - 1) / ZIP_BLOCK_SIZE);
+        if (blocks_count == 0)
+            blocks_count = 1;
+
+        for (i=0;i < blocks_count;i++) {
+            struct zip_block *b = &blocks[i];
+            size_t ofs = (size_t)i * ZIP_BLOCK_SIZE;
+
+            b->in = buf + ZIP_BLOCK_DICT + ofs;
+            b->in_len = fill - ofs;
+            if (b->in_len > ZIP_BLOCK_SIZE) b->in_len = ZIP_BLOCK_SIZE;
+            b->dict_len = (i != 0) ? ZIP_BLOCK_DICT : dict;
+            b->last = eof && (i + 1u) == blocks_count;
+            b->result = 0;
+        }
+
+        /* share the -j budget with the file workers still deflating ahead of us */
+        blocks_next = 0;
+        started = nthreads - zip_deflate_threads_busy(nthreads - 1u);
+        if (started > blocks_count) started = blocks_count;
+        for (i=0;i < started;i++) {
+            if (pthread_create(&threads[i],NULL,zip_deflate_block_thread,NULL) != 0)
+                break;
+        }
+        started = i;
+        /* if no thread would start, do it here */
+        if (started == 0)
+            zip_deflate_block_thread(NULL);
+        while (started > 0)
+            pthread_join(threads[--started],NULL);
+
+        for (i=0;i < blocks_count;i++) {
+            struct zip_block *b = &blocks[i];
+
+            if (b->result) {
+                fprintf(stderr,"deflate() error\n");
+                ret = -1;
+                goto done;
+            }
+            if ((size_t)zip_write_and_span(zip_fd,b->out,b->out_len) != b->out_len) {
+                fprintf(stderr,"write error\n");
+                ret = -1;
+                goto done;
+            }
+            if (list->dup_refs != 0)
+                zip_sink_cbuf(&list->cdata,b->out,b->out_len);
+
+            crc = crc32_combine(crc,b->crc32,(z_off_t)b->in_len);
+            total += b->out_len;
+            total_in += b->in_len;
+        }
+
+        /* the end of this group is the dictionary for the next */
+        if (!eof) {
+            memmove(buf,buf + group_sz,ZIP_BLOCK_DICT);
+            dict = ZIP_BLOCK_DICT;
+        }
+    }
+
+    if (total_in != list->file_size)
+        fprintf(stderr,"WARNING: %s changed size while reading\n",list->in_path);
+
+    lfh->crc32 = list->crc32 = (uint32_t)crc;
+    list->compressed_size = lfh->compressed_size = total;
+
+done:
+    if (blocks != NULL) {
+        for (i=0;i < group_blocks;i++) {
+            if (blocks[i].out != NULL)
+                free(blocks[i].out);
+        }
+        free(blocks);
+        blocks = NULL;
+    }
+    blocks_count = 0;
+    if (buf != NULL)
+        free(buf);
+    close(src_fd);
+    return ret;
+}
+
+static void *zip_deflate_thread(void *arg) {
+    struct in_file *f;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&jobs_lock);
+        while (jobs_next != NULL && jobs_taken >= (jobs_written + jobs_window))
+            pthread_cond_wait(&jobs_cond,&jobs_lock);
+        if ((f=jobs_next) != NULL) {
+            jobs_next = f->next;
+            jobs_taken++;
+            jobs_busy++;
+        }
+        pthread_mutex_unlock(&jobs_lock);
+
+        if (f != NULL) {
+            if (f->method == 8 && f->dup_of == NULL && f->reuse == NULL) {
+                if (store_compressed && zip_probe_compressed(f))
+                    f->method = 0;
+                else if (!zip_deflate_in_blocks(f))
+                    f->cresult = zip_deflate_stream(f,zip_sink_cbuf,&f->cdata);
+            }
+
+            pthread_mutex_lock(&jobs_lock);
+            f->cdone = 1;
+            jobs_busy--;
+            pthread_cond_broadcast(&jobs_cond);
+            pthread_mutex_unlock(&jobs_lock);
+        }
+    } while (f != NULL);
+
+    return NULL;
+}
+
+/* start the worker threads, if there is enough to deflate to make it worthwhile */
+void zip_deflate_threads_start(void) {
+    unsigned int nthreads,i;
+    unsigned long count = 0;
+    struct in_file *f;
+
+    if (deflate_mode == 0)
+        return;
+
+    for (f=file_list_head;f;f=f->next) {
+        if (f->method == 8 && f->dup_of == NULL && f->reuse == NULL && !zip_deflate_in_blocks(f))
+            count++;
+    }
+
+    nthreads = zip_thread_count();
+    if (nthreads > count)
+        nthreads = (unsigned int)count;
+    if (nthreads < 2u)
+        return;
+
+    jobs_next = file_list_head;
+    jobs_taken = jobs_written = 0;
+    jobs_window = (unsigned long)nthreads * 2UL;
+    for (i=0;i < nthreads;i++) {
+        if (pthread_create(&jobs_threads[i],NULL,zip_deflate_thread,NULL) != 0)
+            break;
+    }
+    /* whatever threads did start will get through all of the files */
+    jobs_thread_count = i;
+}
+
+/* the writer is done with this file, let the workers move ahead */
+void zip_deflate_threads_advance(void) {
+    if (jobs_thread_count == 0)
+        return;
+
+    pthread_mutex_lock(&jobs_lock);
+    jobs_written++;
+    pthread_cond_broadcast(&jobs_cond);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+void zip_deflate_threads_finish(void) {
+    while (jobs_thread_count > 0)
+        pthread_join(jobs_threads[--jobs_thread_count],NULL);
+}
+
+/* wait for the worker threads to finish with this file */
+void zip_deflate_wait(struct in_file *list) {
+    pthread_mutex_lock(&jobs_lock);
+    while (!list->cdone) pthread_cond_wait(&jobs_cond,&jobs_lock);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+/* write out what a worker thread deflated for this file */
+int zip_deflate_emit(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    struct zip_cbuf *b = &list->cdata;
+    int ret = 0;
+
+    zip_deflate_wait(list);
+
+    lfh->uncompressed_size = list->file_size;
+    if (list->cresult) {
+        zip_cbuf_free(b);
+        return -1;
+    }
+
+    if (zip_cbuf_write_out(b)) {
+        fprintf(stderr,"out of memory\n");
+        ret = -1;
+    }
+
+    lfh->crc32 = list->crc32;
+    lfh->compressed_size = list->compressed_size;
+
+    /* identical files later on copy it from here */
+    if (list->dup_refs == 0)
+        zip_cbuf_free(b);
+
+    return ret;
+}
+
+/* write a file identical to an earlier one by copying the earlier one's deflated data */
+int zip_deflate_copy(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    struct in_file *o = list->dup_of;
+    int ret = 0;
+
+    assert(o != NULL && o->dup_refs != 0);
+
+    /* could not keep it, deflate this one too */
+    if (o->cdata.err) {
+        ret = zip_deflate(lfh,list);
+    }
+    else {
+        lfh->uncompressed_size = list->file_size;
+        zip_cbuf_write_out(&o->cdata);
+        lfh->crc32 = list->crc32 = o->crc32;
+        lfh->compressed_size = list->compressed_size = o->compressed_size;
+    }
+
+    if (--o->dup_refs == 0)
+        zip_cbuf_free(&o->cdata);
+
+    return ret;
+}
+
+/* decide how the next file is stored, once any worker thread is done with it */
+void zip_file_prepare(struct in_file *list) {
+    if (jobs_thread_count > 0)
+        zip_deflate_wait(list);
+    else if (list->method == 8 && list->dup_of == NULL && list->reuse == NULL && store_compressed && zip_probe_compressed(list))
+        list->method = 0;
+
+    if (list->dup_of != NULL)
+        list->method = list->dup_of->method;
+
+    /* nothing to copy from if the earlier file ended up stored */
+    if (list->method != 8 && list->dup_of != NULL) {
+        if (--list->dup_of->dup_refs == 0)
+            zip_cbuf_free(&list->dup_of->cdata);
+
+        list->dup_of = NULL;
+    }
+}
+
 uint16_t stat2msdostime(struct stat *st) {
     struct tm *tm = localtime(&st->st_mtime);
     assert(tm != NULL);
@@ -930,6 +1937,31 @@ static int parse(int argc,char **argv) {
             else if (!strcmp(a,"t-")) {
                 trailing_data_descriptor = 0;
             }
+            else if (!strcmp(a,"d+")) {
+                dedup_files = 1;
+            }
+            else if (!strcmp(a,"d-")) {
+                dedup_files = 0;
+            }
+            else if (!strcmp(a,"n+")) {
+                store_compressed = 1;
+            }
+            else if (!strcmp(a,"n-")) {
+                store_compressed = 0;
+            }
+            else if (!strcmp(a,"u")) {
+                update_mode = 1;
+            }
+            else if (!strcmp(a,"B")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                if (!parse_unit_amount(&block_deflate_min,a)) return 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL || !isdigit(*a)) return 1;
+                deflate_threads = (unsigned int)strtoul(a,NULL,10);
+            }
             else if (isdigit(*a)) {
                 deflate_mode = (int)strtol(a,(char**)(&a),10);
                 if (deflate_mode < 0 || deflate_mode > 9) return 1;
@@ -1110,6 +2142,10 @@ static int parse(int argc,char **argv) {
         fprintf(stderr,"Nothing to add\n");
         return 1;
     }
+    if (update_mode && spanning_size > 0) {
+        fprintf(stderr,"Spanning archives cannot be updated (-u)\n");
+        return 1;
+    }
 
     /* default, off, UNLESS spanning ZIP archives.
      * The reason we default ON for spanning ZIP archives is that
@@ -1291,6 +2327,11 @@ static int parse(int argc,char **argv) {
         ic = (iconv_t)-1;
     }
 
+    if (update_mode) {
+        if (zip_update_open())
+            return 1;
+    }
+
     {
         struct disk_info *d = disk_new();
         if (d == NULL) return 1;
@@ -1319,21 +2360,28 @@ static int parse(int argc,char **argv) {
         struct pkzip_local_file_header_main lhdr;
         struct in_file *list;
 
+        if (zip_file_list_dedup()) {
+            fprintf(stderr,"out of memory\n");
+            return 1;
+        }
+
+        zip_update_match();
+
+        zip_deflate_threads_start();
+
         for (list=file_list_head;list;list=list->next) {
             assert(list->in_path != NULL);
             assert(list->zip_name != NULL);
+            zip_file_prepare(list);
             printf("%s: %s\n",
-                deflate_mode==0?"Storing":"Deflating",list->in_path);
+                list->dup_of!=NULL?"Copying":(list->reuse!=NULL?"Keeping":(list->method==8?"Deflating":"Storing")),list->in_path);
 
             memset(&lhdr,0,sizeof(lhdr));
             lhdr.sig = PKZIP_LOCAL_FILE_HEADER_SIG;
             lhdr.version_needed_to_extract = 20;        /* PKZIP 2.0 or higher */
             lhdr.general_purpose_bit_flag = (0 << 1);   /* just lie and say that "normal" deflate was used */
 
-            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
-                lhdr.compression_method = 8; /* deflate */
-            else
-                lhdr.compression_method = 0; /* stored (no compression) */
+            lhdr.compression_method = list->method; /* 8 = deflate, 0 = stored (no compression) */
 
             lhdr.last_mod_file_time = list->msdos_time;
             lhdr.last_mod_file_date = list->msdos_date;
@@ -1379,10 +2427,28 @@ static int parse(int argc,char **argv) {
 
             /* store, if a file */
             if (!(list->attr & ATTR_DOS_DIR)) {
-                if (lhdr.compression_method == 8) {
-                    if (zip_deflate(&lhdr,list))
+                if (list->reuse != NULL && list->dup_of == NULL) {
+                    if (zip_update_copy(&lhdr,list))
                         return 1;
                 }
+                else if (lhdr.compression_method == 8) {
+                    if (list->dup_of != NULL) {
+                        if (zip_deflate_copy(&lhdr,list))
+                            return 1;
+                    }
+                    else if (zip_deflate_in_blocks(list)) {
+                        if (zip_deflate_blocks(&lhdr,list))
+                            return 1;
+                    }
+                    else if (jobs_thread_count > 0) {
+                        if (zip_deflate_emit(&lhdr,list))
+                            return 1;
+                    }
+                    else {
+                        if (zip_deflate(&lhdr,list))
+                            return 1;
+                    }
+                }
                 else if (lhdr.compression_method == 0) {
                     if (zip_store(&lhdr,list))
                         return 1;
@@ -1436,7 +2502,11 @@ static int parse(int argc,char **argv) {
                     lseek(zip_fd,0,SEEK_END);
                 }
             }
+
+            zip_deflate_threads_advance();
         }
+
+        zip_deflate_threads_finish();
     }
 
     /* write central directory */
@@ -1482,10 +2552,7 @@ static int parse(int argc,char **argv) {
             if (list->data_descriptor)
                 chdr.general_purpose_bit_flag |= (1 << 3);
 
-            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
-                chdr.compression_method = 8; /* deflate */
-            else
-                chdr.compression_method = 0; /* stored (no compression) */
+            chdr.compression_method = list->method; /* 8 = deflate, 0 = stored (no compression) */
 
             chdr.last_mod_file_time = list->msdos_time;
             chdr.last_mod_file_date = list->msdos_date;
@@ -1561,6 +2628,14 @@ static int parse(int argc,char **argv) {
     }
 
     zip_out_close();
+    if (zip_update_tmp != NULL) {
+        if (rename(zip_update_tmp,zip_path)) {
+            fprintf(stderr,"Failed to rename '%s' to '%s', %s\n",zip_update_tmp,zip_path,strerror(errno));
+            return 1;
+        }
+    }
+
+    zip_update_close();
     clear_string(&codepage_out);
     clear_string(&codepage_in);
     clear_string(&zip_path);
@@ -63,6 +63,18 @@ static inline zipcrc_t zipcrc_init(void)
 zipcrc_t zipcrc_update(zipcrc_t crc, const void *data, size_t data_len);
 
 
+/**
+ * zlib crc32() compatible entry point: crc is the finalized crc of the data
+ * so far (0 to start) and the finalized crc is returned.
+ *
+ * \param crc      The crc of the data so far, 0 initially.
+ * \param data     Pointer to a buffer of \a data_len bytes.
+ * \param data_len Number of bytes in the \a data buffer.
+ * \return         The crc of the data so far.
+ *****************************************************************************/
+unsigned long zipcrc_crc32(unsigned long crc, const void *data, size_t data_len);
+
+
 /**
  * Calculate the final crc value.
  *